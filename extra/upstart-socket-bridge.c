@@ -60,11 +60,13 @@ typedef struct job {
 	NihList entry;
 	char *path;
 	NihList sockets;
+	int pending;
 } Job;
 
 /* Structure we use for tracking listening sockets */
 typedef struct socket {
 	NihList entry;
+	Job *job;
 
 	union {
 		struct sockaddr        addr;
@@ -88,8 +90,10 @@ static void job_add_socket       (Job *job, char **socket_info);
 static void cleanup              (void);
 static void socket_destroy       (Socket *socket);
 static void upstart_disconnected (DBusConnection *connection);
-static void emit_event_reply     (Socket *sock, NihDBusMessage *message);
-static void emit_event_error     (Socket *sock, NihDBusMessage *message);
+static char *socket_name         (const void *parent, Socket *sock);
+static void job_emit_socket_event (Job *job, Socket *sock);
+static void emit_event_reply     (Job *job, NihDBusMessage *message);
+static void emit_event_error     (Job *job, NihDBusMessage *message);
 
 
 /**
@@ -310,10 +314,6 @@ epoll_watcher (void *      data,
 
 	for (int i = 0; i < num_events; i++) {
 		Socket *sock = (Socket *)event[i].data.ptr;
-		nih_local char **env = NULL;
-		size_t env_len = 0;
-		char *var;
-		DBusPendingCall *pending_call;
 
 		if (event[i].events & EPOLLIN)
 			nih_debug ("%p EPOLLIN", sock);
@@ -322,56 +322,18 @@ epoll_watcher (void *      data,
 		if (event[i].events & EPOLLHUP)
 			nih_debug ("%p EPOLLHUP", sock);
 
-		env = NIH_MUST (nih_str_array_new (NULL));
-
-		switch (sock->addr.sa_family) {
-		case AF_INET:
-			NIH_MUST (nih_str_array_add (&env, NULL, &env_len,
-						     "PROTO=inet"));
-
-			var = NIH_MUST (nih_sprintf (NULL, "PORT=%d",
-						     ntohs (sock->sin_addr.sin_port)));
-			NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
-						      var));
-			nih_discard (var);
-
-			var = NIH_MUST (nih_sprintf (NULL, "ADDR=%s",
-						     inet_ntoa (sock->sin_addr.sin_addr)));
-			NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
-						      var));
-			nih_discard (var);
-			break;
-		case AF_UNIX:
-			NIH_MUST (nih_str_array_add (&env, NULL, &env_len,
-						     "PROTO=unix"));
-
-			var = NIH_MUST (nih_sprintf (NULL, "SOCKET_PATH=%s",
-						     sock->sun_addr.sun_path));
-			NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
-						      var));
-			nih_discard (var);
-			break;
-		default:
-			nih_assert_not_reached ();
-		}
-
-		pending_call = NIH_SHOULD (upstart_emit_event_with_file (
-						   upstart, "socket", env, TRUE,
-						   sock->sock,
-						   (UpstartEmitEventWithFileReply)emit_event_reply,
-						   (NihDBusErrorHandler)emit_event_error,
-						   sock,
-						   NIH_DBUS_TIMEOUT_NEVER));
-		if (! pending_call) {
-			NihError *err;
-
-			err = nih_error_get ();
-			nih_warn ("%s: %s", _("Could not send socket event"),
-				  err->message);
-			nih_free (err);
+		/* All of a job's sockets go out with a single event, so
+		 * don't emit another while that one is still being handled;
+		 * this also covers several of its sockets becoming ready
+		 * in this same batch.
+		 */
+		if (sock->job->pending) {
+			nih_debug ("Activation of %s already pending",
+				   sock->job->path);
+			continue;
 		}
 
-		dbus_pending_call_unref (pending_call);
+		job_emit_socket_event (sock->job, sock);
 
 		// might be EPOLLIN
 		// might be EPOLLERR
@@ -379,6 +341,159 @@ epoll_watcher (void *      data,
 	}
 }
 
+/**
+ * socket_name:
+ * @parent: parent object for new string,
+ * @sock: socket to name.
+ *
+ * Names @sock for the benefit of the job, this is the protocol followed
+ * by the address and port or the path of the socket; whitespace is
+ * replaced since the names are passed as a space-separated list.
+ *
+ * Returns: newly allocated string or NULL if insufficient memory.
+ **/
+static char *
+socket_name (const void *parent,
+	     Socket *    sock)
+{
+	char *name;
+
+	nih_assert (sock != NULL);
+
+	switch (sock->addr.sa_family) {
+	case AF_INET:
+		name = nih_sprintf (parent, "inet:%s:%d",
+				    inet_ntoa (sock->sin_addr.sin_addr),
+				    ntohs (sock->sin_addr.sin_port));
+		break;
+	case AF_UNIX:
+		name = nih_sprintf (parent, "unix:%s%s",
+				    sock->sun_addr.sun_path[0] ? "" : "@",
+				    sock->sun_addr.sun_path
+				    + (sock->sun_addr.sun_path[0] ? 0 : 1));
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	if (name)
+		for (char *c = name; *c; c++)
+			if (strchr (" \t\r\n", *c))
+				*c = '_';
+
+	return name;
+}
+
+/**
+ * job_emit_socket_event:
+ * @job: job to activate,
+ * @sock: socket that became ready.
+ *
+ * Emits the socket event for @job with the environment describing @sock,
+ * so that it matches the job's start condition, passing all of the job's
+ * listening sockets along with it so that it is activated just once with
+ * everything it needs.
+ **/
+static void
+job_emit_socket_event (Job *   job,
+		       Socket *sock)
+{
+	nih_local char **env = NULL;
+	nih_local char **names = NULL;
+	nih_local int   *fds = NULL;
+	size_t           env_len = 0;
+	size_t           names_len = 0;
+	size_t           num_fds = 0;
+	char            *var;
+	DBusPendingCall *pending_call;
+
+	nih_assert (job != NULL);
+	nih_assert (sock != NULL);
+
+	env = NIH_MUST (nih_str_array_new (NULL));
+
+	switch (sock->addr.sa_family) {
+	case AF_INET:
+		NIH_MUST (nih_str_array_add (&env, NULL, &env_len,
+					     "PROTO=inet"));
+
+		var = NIH_MUST (nih_sprintf (NULL, "PORT=%d",
+					     ntohs (sock->sin_addr.sin_port)));
+		NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
+					      var));
+		nih_discard (var);
+
+		var = NIH_MUST (nih_sprintf (NULL, "ADDR=%s",
+					     inet_ntoa (sock->sin_addr.sin_addr)));
+		NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
+					      var));
+		nih_discard (var);
+		break;
+	case AF_UNIX:
+		NIH_MUST (nih_str_array_add (&env, NULL, &env_len,
+					     "PROTO=unix"));
+
+		var = NIH_MUST (nih_sprintf (NULL, "SOCKET_PATH=%s",
+					     sock->sun_addr.sun_path));
+		NIH_MUST (nih_str_array_addp (&env, NULL, &env_len,
+					      var));
+		nih_discard (var);
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	/* Pass every socket the job listens on, the one that became ready
+	 * first so that single-socket jobs see no difference.
+	 */
+	names = NIH_MUST (nih_str_array_new (NULL));
+
+	NIH_LIST_FOREACH (&job->sockets, iter) {
+		num_fds++;
+	}
+
+	fds = NIH_MUST (nih_alloc (NULL, sizeof (int) * num_fds));
+	num_fds = 0;
+
+	fds[num_fds++] = sock->sock;
+	var = NIH_MUST (socket_name (NULL, sock));
+	NIH_MUST (nih_str_array_addp (&names, NULL, &names_len, var));
+	nih_discard (var);
+
+	NIH_LIST_FOREACH (&job->sockets, iter) {
+		Socket *other = (Socket *)iter;
+
+		if (other == sock)
+			continue;
+
+		fds[num_fds++] = other->sock;
+		var = NIH_MUST (socket_name (NULL, other));
+		NIH_MUST (nih_str_array_addp (&names, NULL, &names_len, var));
+		nih_discard (var);
+	}
+
+	pending_call = NIH_SHOULD (upstart_emit_event_with_files (
+					   upstart, "socket", env, TRUE,
+					   fds, num_fds, names,
+					   (UpstartEmitEventWithFilesReply)emit_event_reply,
+					   (NihDBusErrorHandler)emit_event_error,
+					   job,
+					   NIH_DBUS_TIMEOUT_NEVER));
+	if (! pending_call) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn ("%s: %s", _("Could not send socket event"),
+			  err->message);
+		nih_free (err);
+		return;
+	}
+
+	job->pending = TRUE;
+
+	dbus_pending_call_unref (pending_call);
+}
+
 
 static void
 upstart_job_added (void *          data,
@@ -442,6 +557,7 @@ upstart_job_added (void *          data,
 	/* Create new record for the job */
 	job = NIH_MUST (nih_new (NULL, Job));
 	job->path = NIH_MUST (nih_strdup (job, job_class_path));
+	job->pending = FALSE;
 
 	nih_list_init (&job->entry);
 	nih_list_init (&job->sockets);
@@ -498,6 +614,7 @@ job_add_socket (Job *  job,
 
 	sock = NIH_MUST (nih_new (job, Socket));
 	memset (sock, 0, sizeof (Socket));
+	sock->job = job;
 	sock->sock = -1;
 
 	nih_list_init (&sock->entry);
@@ -673,18 +790,22 @@ upstart_disconnected (DBusConnection *connection)
 
 
 static void
-emit_event_reply (Socket *        sock,
+emit_event_reply (Job *           job,
 		  NihDBusMessage *message)
 {
 	nih_debug ("Event completed");
+
+	job->pending = FALSE;
 }
 
 static void
-emit_event_error (Socket *        sock,
+emit_event_error (Job *           job,
 		  NihDBusMessage *message)
 {
 	NihError *err;
 
+	job->pending = FALSE;
+
 	err = nih_error_get ();
 	nih_warn ("%s: %s", _("Error emitting socket event"), err->message);
 	nih_free (err);
@@ -0,0 +1,682 @@
+/* upstart
+ *
+ * cgroup.c - control group process tracking
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include <nih-dbus/dbus_util.h>
+
+#include "cgroup.h"
+
+
+/* Prototypes for static functions */
+static int cgroup_write        (const char *path, const char *file,
+				const char *value);
+static int cgroup_process_stat (pid_t pid, pid_t *ppid, pid_t *session);
+
+
+/**
+ * cgroup_setting_files:
+ *
+ * Names of the files within a control group written for each setting,
+ * indexed by CgroupSetting; the controller each requires is the part
+ * of the name before the dot.
+ **/
+static const char * const cgroup_setting_files[] = {
+	"cpu.weight",
+	"cpu.max",
+	"memory.max",
+	"memory.high",
+	"io.weight",
+	"pids.max",
+};
+
+
+/**
+ * cgroup_root:
+ *
+ * Directory within a mounted control group (version 2) hierarchy under
+ * which a group is created for each job instance; when NULL, processes
+ * are not placed into groups and forking jobs are followed with ptrace
+ * instead.
+ **/
+char *cgroup_root = NULL;
+
+
+/**
+ * cgroup_path:
+ * @parent: parent object for new string,
+ * @class_name: name of job class,
+ * @name: name of job instance.
+ *
+ * Constructs the path of the control group for the instance @name of the
+ * job class @class_name, beneath cgroup_root.  Both names are escaped in
+ * the same manner as D-Bus object paths so that neither may contain a
+ * path separator, with an empty instance name becoming "_".
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: newly allocated string or NULL if insufficient memory.
+ **/
+char *
+cgroup_path (const void *parent,
+	     const char *class_name,
+	     const char *name)
+{
+	nih_assert (cgroup_root != NULL);
+	nih_assert (class_name != NULL);
+	nih_assert (name != NULL);
+
+	return nih_dbus_path (parent, cgroup_root, class_name, name, NULL);
+}
+
+
+/**
+ * cgroup_create:
+ * @path: path of control group.
+ *
+ * Creates the control group @path, along with any parent groups that do
+ * not yet exist.  It is not an error for the group to exist already.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_create (const char *path)
+{
+	char dir[PATH_MAX];
+	int  len;
+
+	nih_assert (path != NULL);
+
+	len = snprintf (dir, sizeof (dir), "%s", path);
+	if ((len < 0) || ((size_t)len >= sizeof (dir))) {
+		errno = ENAMETOOLONG;
+		nih_return_system_error (-1);
+	}
+
+	for (char *p = strchr (dir + 1, '/'); ; p = strchr (p + 1, '/')) {
+		if (p)
+			*p = '\0';
+
+		if ((mkdir (dir, 0755) < 0) && (errno != EEXIST))
+			nih_return_system_error (-1);
+
+		if (! p)
+			break;
+
+		*p = '/';
+	}
+
+	return 0;
+}
+
+/**
+ * cgroup_remove:
+ * @path: path of control group.
+ *
+ * Removes the control group @path, which must be empty of processes and
+ * child groups.  It is not an error for the group not to exist.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_remove (const char *path)
+{
+	nih_assert (path != NULL);
+
+	if ((rmdir (path) < 0) && (errno != ENOENT))
+		nih_return_system_error (-1);
+
+	return 0;
+}
+
+
+/**
+ * cgroup_enter:
+ * @path: path of control group,
+ * @pid: process to move.
+ *
+ * Moves the process @pid into the control group @path; any processes it
+ * later creates will be members of the same group until moved elsewhere.
+ *
+ * This may be called in a child process between fork() and exec() since
+ * it allocates no memory unless an error is raised.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_enter (const char *path,
+	      pid_t       pid)
+{
+	char buf[32];
+
+	nih_assert (path != NULL);
+	nih_assert (pid > 0);
+
+	snprintf (buf, sizeof (buf), "%d\n", pid);
+
+	return cgroup_write (path, "cgroup.procs", buf);
+}
+
+
+/**
+ * cgroup_setting_file:
+ * @setting: setting to look up.
+ *
+ * Returns: name of the file written for @setting within a control group.
+ **/
+const char *
+cgroup_setting_file (CgroupSetting setting)
+{
+	nih_assert (setting < CGROUP_SETTING_LAST);
+
+	return cgroup_setting_files[setting];
+}
+
+/**
+ * cgroup_set:
+ * @path: path of control group,
+ * @setting: setting to change,
+ * @value: value to write.
+ *
+ * Writes @value, which must already be in the form the kernel expects,
+ * to the file for @setting within the control group @path.
+ *
+ * The controller for @setting must be enabled for the group by each of
+ * its parents; this is done for those beneath cgroup_root, while enabling
+ * it for cgroup_root itself is left to the system.
+ *
+ * Like cgroup_enter(), this may be called in a child process between
+ * fork() and exec().
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_set (const char    *path,
+	    CgroupSetting  setting,
+	    const char    *value)
+{
+	const char *file;
+	char        controller[32];
+	char        dir[PATH_MAX];
+	size_t      root_len;
+	int         len;
+
+	nih_assert (path != NULL);
+	nih_assert (setting < CGROUP_SETTING_LAST);
+	nih_assert (value != NULL);
+
+	file = cgroup_setting_files[setting];
+
+	len = snprintf (controller, sizeof (controller), "+%.*s",
+			(int)strcspn (file, "."), file);
+	nih_assert ((len > 0) && ((size_t)len < sizeof (controller)));
+
+	len = snprintf (dir, sizeof (dir), "%s", path);
+	if ((len < 0) || ((size_t)len >= sizeof (dir))) {
+		errno = ENAMETOOLONG;
+		nih_return_system_error (-1);
+	}
+
+	root_len = cgroup_root ? strlen (cgroup_root) : 0;
+	if (cgroup_root && strncmp (dir, cgroup_root, root_len))
+		root_len = 0;
+
+	if (root_len) {
+		for (char *p = dir + root_len; p && (*p == '/');
+		     p = strchr (p + 1, '/')) {
+			*p = '\0';
+
+			if (cgroup_write (dir, "cgroup.subtree_control",
+					  controller) < 0)
+				return -1;
+
+			*p = '/';
+		}
+	}
+
+	return cgroup_write (path, file, value);
+}
+
+/**
+ * cgroup_write:
+ * @path: path of control group,
+ * @file: name of file within group,
+ * @value: value to write.
+ *
+ * Writes @value to @file within the control group @path in a single
+ * write() call, as the kernel expects; no memory is allocated unless an
+ * error is raised.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+cgroup_write (const char *path,
+	      const char *file,
+	      const char *value)
+{
+	char    filename[PATH_MAX];
+	size_t  value_len;
+	int     fd, len;
+
+	nih_assert (path != NULL);
+	nih_assert (file != NULL);
+	nih_assert (value != NULL);
+
+	len = snprintf (filename, sizeof (filename), "%s/%s", path, file);
+	if ((len < 0) || ((size_t)len >= sizeof (filename))) {
+		errno = ENAMETOOLONG;
+		nih_return_system_error (-1);
+	}
+
+	fd = open (filename, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	value_len = strlen (value);
+	if (write (fd, value, value_len) != (ssize_t)value_len) {
+		nih_error_raise_system ();
+		close (fd);
+		return -1;
+	}
+
+	if (close (fd) < 0)
+		nih_return_system_error (-1);
+
+	return 0;
+}
+
+
+/**
+ * cgroup_procs:
+ * @parent: parent object for new array,
+ * @path: path of control group,
+ * @len: pointer to store length of array.
+ *
+ * Reads the list of processes that are members of the control group
+ * @path, not including those of any child groups.  The number of entries
+ * is stored in @len, which may be zero if the group is empty.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated array or NULL on raised error.
+ **/
+pid_t *
+cgroup_procs (const void *parent,
+	      const char *path,
+	      size_t     *len)
+{
+	nih_local char *filename = NULL;
+	pid_t          *pids;
+	size_t          size;
+	FILE           *procs;
+	int             pid;
+
+	nih_assert (path != NULL);
+	nih_assert (len != NULL);
+
+	filename = nih_sprintf (NULL, "%s/cgroup.procs", path);
+	if (! filename)
+		nih_return_no_memory_error (NULL);
+
+	procs = fopen (filename, "r");
+	if (! procs)
+		nih_return_system_error (NULL);
+
+	size = 8;
+	pids = nih_alloc (parent, sizeof (pid_t) * size);
+	if (! pids) {
+		fclose (procs);
+		nih_return_no_memory_error (NULL);
+	}
+
+	*len = 0;
+	while (fscanf (procs, "%d", &pid) == 1) {
+		if (*len == size) {
+			pid_t *new_pids;
+
+			new_pids = nih_realloc (pids, parent,
+						sizeof (pid_t) * size * 2);
+			if (! new_pids) {
+				nih_free (pids);
+				fclose (procs);
+				nih_return_no_memory_error (NULL);
+			}
+
+			pids = new_pids;
+			size *= 2;
+		}
+
+		pids[(*len)++] = pid;
+	}
+
+	fclose (procs);
+
+	return pids;
+}
+
+/**
+ * cgroup_populated:
+ * @path: path of control group.
+ *
+ * Checks the "populated" key of the cgroup.events file of the control
+ * group @path, which the kernel clears once the group and all of its
+ * children are empty of processes; the file is modified when it changes,
+ * so may be watched for that.
+ *
+ * Returns: TRUE if the group contains processes, FALSE if it is empty,
+ * or negative value on raised error.
+ **/
+int
+cgroup_populated (const char *path)
+{
+	nih_local char *filename = NULL;
+	FILE           *events;
+	char            key[32];
+	int             value, populated = -1;
+
+	nih_assert (path != NULL);
+
+	filename = nih_sprintf (NULL, "%s/cgroup.events", path);
+	if (! filename)
+		nih_return_no_memory_error (-1);
+
+	events = fopen (filename, "r");
+	if (! events)
+		nih_return_system_error (-1);
+
+	while (fscanf (events, "%31s %d", key, &value) == 2) {
+		if (! strcmp (key, "populated")) {
+			populated = value ? TRUE : FALSE;
+			break;
+		}
+	}
+
+	fclose (events);
+
+	if (populated < 0) {
+		errno = EILSEQ;
+		nih_return_system_error (-1);
+	}
+
+	return populated;
+}
+
+
+/**
+ * cgroup_main_pid:
+ * @path: path of control group,
+ * @daemon: whether a daemon is expected.
+ *
+ * Identifies the main process of the control group @path as the first
+ * member whose parent is not itself a member, which is the top of the
+ * process tree within the group once the process we spawned into it has
+ * exited.
+ *
+ * If @daemon is TRUE, the group is expected to hold a daemon which forks
+ * twice, becoming a session leader in between; should the top of the tree
+ * be such a session leader that has already forked again, its child is
+ * returned instead.  A session leader is only returned when it has not
+ * yet done so.
+ *
+ * Returns: process id of main process, zero if the group is empty,
+ * or negative value on raised error.
+ **/
+pid_t
+cgroup_main_pid (const char *path,
+		 int         daemon)
+{
+	nih_local pid_t *pids = NULL;
+	nih_local pid_t *ppids = NULL;
+	nih_local pid_t *sessions = NULL;
+	size_t           len;
+	pid_t            main_pid = 0;
+	pid_t            main_session = 0;
+
+	nih_assert (path != NULL);
+
+	pids = cgroup_procs (NULL, path, &len);
+	if (! pids)
+		return -1;
+
+	if (! len)
+		return 0;
+
+	ppids = NIH_MUST (nih_alloc (NULL, sizeof (pid_t) * len));
+	sessions = NIH_MUST (nih_alloc (NULL, sizeof (pid_t) * len));
+
+	/* Processes may exit while we're looking, so those we can't stat
+	 * are simply left out of the tree.
+	 */
+	for (size_t i = 0; i < len; i++) {
+		if (cgroup_process_stat (pids[i], &ppids[i], &sessions[i]) < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_free (err);
+
+			pids[i] = 0;
+		}
+	}
+
+	for (size_t i = 0; (i < len) && (! main_pid); i++) {
+		int orphan = TRUE;
+
+		if (! pids[i])
+			continue;
+
+		for (size_t j = 0; j < len; j++) {
+			if (pids[j] && (pids[j] == ppids[i])) {
+				orphan = FALSE;
+				break;
+			}
+		}
+
+		if (orphan) {
+			main_pid = pids[i];
+			main_session = sessions[i];
+		}
+	}
+
+	if (daemon && main_pid && (main_session == main_pid)) {
+		for (size_t i = 0; i < len; i++) {
+			if (pids[i] && (ppids[i] == main_pid)
+			    && (sessions[i] != pids[i]))
+				return pids[i];
+		}
+	}
+
+	return main_pid;
+}
+
+/**
+ * cgroup_cpu_usage:
+ * @path: path of control group,
+ * @usec: pointer to store usage.
+ *
+ * Reads the total CPU time consumed by the processes of the control group
+ * @path, including those that have since exited, from the "usage_usec"
+ * key of its cpu.stat file; this is available whether or not the cpu
+ * controller is enabled for the group.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_cpu_usage (const char *path,
+		  uint64_t   *usec)
+{
+	nih_local char     *filename = NULL;
+	FILE               *cpu_stat;
+	char                key[32];
+	unsigned long long  value;
+	int                 found = FALSE;
+
+	nih_assert (path != NULL);
+	nih_assert (usec != NULL);
+
+	filename = nih_sprintf (NULL, "%s/cpu.stat", path);
+	if (! filename)
+		nih_return_no_memory_error (-1);
+
+	cpu_stat = fopen (filename, "r");
+	if (! cpu_stat)
+		nih_return_system_error (-1);
+
+	while (fscanf (cpu_stat, "%31s %llu", key, &value) == 2) {
+		if (! strcmp (key, "usage_usec")) {
+			*usec = value;
+			found = TRUE;
+			break;
+		}
+	}
+
+	fclose (cpu_stat);
+
+	if (! found) {
+		errno = EILSEQ;
+		nih_return_system_error (-1);
+	}
+
+	return 0;
+}
+
+/**
+ * cgroup_memory_usage:
+ * @path: path of control group,
+ * @bytes: pointer to store usage.
+ *
+ * Reads the memory currently in use by the processes of the control group
+ * @path from its memory.current file, which only exists while the memory
+ * controller is enabled for the group.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+cgroup_memory_usage (const char *path,
+		     uint64_t   *bytes)
+{
+	nih_local char     *filename = NULL;
+	FILE               *current;
+	unsigned long long  value;
+	int                 ret;
+
+	nih_assert (path != NULL);
+	nih_assert (bytes != NULL);
+
+	filename = nih_sprintf (NULL, "%s/memory.current", path);
+	if (! filename)
+		nih_return_no_memory_error (-1);
+
+	current = fopen (filename, "r");
+	if (! current)
+		nih_return_system_error (-1);
+
+	ret = fscanf (current, "%llu", &value);
+	fclose (current);
+
+	if (ret != 1) {
+		errno = EILSEQ;
+		nih_return_system_error (-1);
+	}
+
+	*bytes = value;
+
+	return 0;
+}
+
+
+/**
+ * cgroup_process_stat:
+ * @pid: process to look up,
+ * @ppid: pointer to store parent process,
+ * @session: pointer to store session.
+ *
+ * Reads the parent process id and session id of @pid from its stat file
+ * in /proc.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+cgroup_process_stat (pid_t  pid,
+		     pid_t *ppid,
+		     pid_t *session)
+{
+	char    filename[PATH_MAX];
+	char    buf[1024];
+	char   *ptr;
+	ssize_t len;
+	int     fd, pgrp;
+
+	nih_assert (pid > 0);
+	nih_assert (ppid != NULL);
+	nih_assert (session != NULL);
+
+	snprintf (filename, sizeof (filename), "/proc/%d/stat", pid);
+
+	fd = open (filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	len = read (fd, buf, sizeof (buf) - 1);
+	if (len < 0) {
+		nih_error_raise_system ();
+		close (fd);
+		return -1;
+	}
+
+	close (fd);
+	buf[len] = '\0';
+
+	/* The command name may itself contain spaces and parentheses, so
+	 * the fields we want are found after the last closing one.
+	 */
+	ptr = strrchr (buf, ')');
+	if ((! ptr)
+	    || (sscanf (ptr + 1, " %*c %d %d %d", ppid, &pgrp, session) != 3)) {
+		errno = EILSEQ;
+		nih_return_system_error (-1);
+	}
+
+	return 0;
+}
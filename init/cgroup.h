@@ -0,0 +1,84 @@
+/* upstart
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_CGROUP_H
+#define INIT_CGROUP_H
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+#include <nih/macros.h>
+
+
+/**
+ * CgroupSetting:
+ *
+ * Resource settings that may be given to the control group of a job, each
+ * of which is written to its own file within the group.
+ **/
+typedef enum cgroup_setting {
+	CGROUP_CPU_WEIGHT,
+	CGROUP_CPU_MAX,
+	CGROUP_MEMORY_MAX,
+	CGROUP_MEMORY_HIGH,
+	CGROUP_IO_WEIGHT,
+	CGROUP_PIDS_MAX,
+	CGROUP_SETTING_LAST
+} CgroupSetting;
+
+
+NIH_BEGIN_EXTERN
+
+extern char *cgroup_root;
+
+
+char *      cgroup_path         (const void *parent,
+				 const char *class_name, const char *name)
+	__attribute__ ((warn_unused_result, malloc));
+
+int         cgroup_create       (const char *path)
+	__attribute__ ((warn_unused_result));
+int         cgroup_remove       (const char *path)
+	__attribute__ ((warn_unused_result));
+
+int         cgroup_enter        (const char *path, pid_t pid)
+	__attribute__ ((warn_unused_result));
+
+const char *cgroup_setting_file (CgroupSetting setting);
+int         cgroup_set          (const char *path, CgroupSetting setting,
+				 const char *value)
+	__attribute__ ((warn_unused_result));
+
+pid_t *     cgroup_procs        (const void *parent, const char *path,
+				 size_t *len)
+	__attribute__ ((warn_unused_result, malloc));
+int         cgroup_populated    (const char *path)
+	__attribute__ ((warn_unused_result));
+
+pid_t       cgroup_main_pid     (const char *path, int daemon)
+	__attribute__ ((warn_unused_result));
+
+int         cgroup_cpu_usage    (const char *path, uint64_t *usec)
+	__attribute__ ((warn_unused_result));
+int         cgroup_memory_usage (const char *path, uint64_t *bytes)
+	__attribute__ ((warn_unused_result));
+
+NIH_END_EXTERN
+
+#endif /* INIT_CGROUP_H */
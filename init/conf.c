@@ -29,7 +29,9 @@
 
 #include <errno.h>
 #include <libgen.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nih/macros.h>
@@ -83,6 +85,15 @@ static inline int is_conf_file_std     (const char *path)
 static inline int is_conf_file_override(const char *path)
 	__attribute__ ((warn_unused_result));
 
+static uint64_t  conf_file_hash        (const char *buf, size_t len)
+	__attribute__ ((warn_unused_result));
+static void      conf_file_stamp       (ConfFileStamp *stamp,
+					const struct stat *statbuf,
+					uint64_t hash);
+static int       conf_file_unchanged   (ConfFileStamp *stamp,
+					const char *path)
+	__attribute__ ((warn_unused_result));
+
 /**
  * conf_sources:
  *
@@ -92,6 +103,23 @@ static inline int is_conf_file_override(const char *path)
  **/
 NihList *conf_sources = NULL;
 
+/**
+ * conf_lazy:
+ *
+ * If TRUE, only those parts of job definitions needed to decide when the
+ * jobs are started and stopped are parsed when configuration is loaded,
+ * the rest is parsed once each job is first needed.
+ **/
+int conf_lazy = FALSE;
+
+/**
+ * conf_packed:
+ *
+ * If TRUE, the start on and stop on expressions of each job are packed
+ * into single blocks once parsed, see job_class_pack().
+ **/
+int conf_packed = FALSE;
+
 
 /**
  * is_conf_file_std:
@@ -315,6 +343,8 @@ conf_file_new (ConfSource *source,
 
 	file->source = source;
 	file->flag = source->flag;
+	memset (&file->stamp, 0, sizeof (ConfFileStamp));
+	memset (&file->override, 0, sizeof (ConfFileStamp));
 	file->data = NULL;
 
 	nih_alloc_set_destructor (file, conf_file_destroy);
@@ -927,6 +957,128 @@ conf_file_visitor (ConfSource  *source,
 }
 
 
+/**
+ * conf_file_hash:
+ * @buf: contents of configuration file,
+ * @len: length of @buf.
+ *
+ * Computes a 64-bit FNV-1a hash of the contents of a configuration file,
+ * kept in its ConfFile so that an unchanged file need not be parsed again
+ * when reloaded.
+ *
+ * Returns: hash of @buf.
+ **/
+static uint64_t
+conf_file_hash (const char *buf,
+		size_t      len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t   i;
+
+	nih_assert (buf != NULL);
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)buf[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * conf_file_stamp:
+ * @stamp: stamp to set,
+ * @statbuf: stat of file,
+ * @hash: hash of file contents.
+ *
+ * Records the file described by @statbuf and with contents hashing to
+ * @hash in @stamp, noting whether it was modified too recently for its
+ * stat details to be trusted.
+ **/
+static void
+conf_file_stamp (ConfFileStamp     *stamp,
+		 const struct stat *statbuf,
+		 uint64_t           hash)
+{
+	time_t now;
+
+	nih_assert (stamp != NULL);
+	nih_assert (statbuf != NULL);
+
+	now = time (NULL);
+
+	stamp->dev = statbuf->st_dev;
+	stamp->ino = statbuf->st_ino;
+	stamp->size = statbuf->st_size;
+	stamp->mtime = statbuf->st_mtim;
+	stamp->ctime = statbuf->st_ctim;
+	stamp->racy = ((now <= statbuf->st_mtime + 1)
+		       || (now <= statbuf->st_ctime + 1));
+	stamp->hash = hash;
+}
+
+/**
+ * conf_file_unchanged:
+ * @stamp: stamp of file when parsed,
+ * @path: path to file.
+ *
+ * Determines whether the file at @path is the same as that recorded in
+ * @stamp, or is still missing if @stamp records no file.
+ *
+ * Only a stat of the file is needed when nothing about it has changed;
+ * otherwise it is read and the hash of its contents compared, so that a
+ * file that has merely been touched or rewritten with the same contents
+ * is still recognised, in which case @stamp is updated to match.
+ *
+ * Returns: TRUE if the file is unchanged, FALSE otherwise.
+ **/
+static int
+conf_file_unchanged (ConfFileStamp *stamp,
+		     const char    *path)
+{
+	nih_local char *buf = NULL;
+	size_t          len;
+	struct stat     statbuf;
+	uint64_t        hash;
+
+	nih_assert (stamp != NULL);
+	nih_assert (path != NULL);
+
+	if (stat (path, &statbuf) < 0)
+		return (stamp->hash ? FALSE : TRUE);
+
+	if (! stamp->hash)
+		return FALSE;
+
+	if ((! stamp->racy)
+	    && (stamp->dev == statbuf.st_dev)
+	    && (stamp->ino == statbuf.st_ino)
+	    && (stamp->size == statbuf.st_size)
+	    && (stamp->mtime.tv_sec == statbuf.st_mtim.tv_sec)
+	    && (stamp->mtime.tv_nsec == statbuf.st_mtim.tv_nsec)
+	    && (stamp->ctime.tv_sec == statbuf.st_ctim.tv_sec)
+	    && (stamp->ctime.tv_nsec == statbuf.st_ctim.tv_nsec))
+		return TRUE;
+
+	buf = nih_file_read (NULL, path, &len);
+	if (! buf) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_free (err);
+
+		return FALSE;
+	}
+
+	hash = conf_file_hash (buf, len);
+	if (hash != stamp->hash)
+		return FALSE;
+
+	conf_file_stamp (stamp, &statbuf, hash);
+
+	return TRUE;
+}
+
 /**
  * conf_reload_path:
  * @source: configuration source,
@@ -943,7 +1095,8 @@ conf_file_visitor (ConfSource  *source,
  * If the file has been parsed before, then the existing item is deleted and
  * freed if the file fails to load, or after the new item has been parsed.
  * Items are only reused between reloads if @override_path is
- * non-NULL.
+ * non-NULL, or if neither the file nor its override file have changed,
+ * in which case it is not parsed again.
  *
  * Physical errors are returned, parse errors are not.
  *
@@ -958,7 +1111,9 @@ conf_reload_path (ConfSource *source,
 	nih_local char *buf = NULL;
 	const char     *start, *end;
 	nih_local char *name = NULL;
+	nih_local char *other_path = NULL;
 	size_t          len, pos, lineno;
+	struct stat     statbuf;
 	NihError       *err = NULL;
 	const char     *path_to_load;
 
@@ -967,23 +1122,48 @@ conf_reload_path (ConfSource *source,
 
 	path_to_load = (override_path ? override_path : path);
 
-	/* If there is no corresponding override file, look up the old
-	 * conf file in memory, and then free it.  In cases of failure,
-	 * we discard it anyway, so there's no particular reason
-	 * to keep it around anymore.
+	/* Look up the old conf file in memory.  When neither it nor its
+	 * override file have changed since they were parsed there's
+	 * nothing to do but mark it as seen, which is usually decided by a
+	 * stat of each; since the override file is only overlaid on a
+	 * freshly parsed conf file, it's skipped too when unchanged.
+	 */
+	file = (ConfFile *)nih_hash_lookup (source->files, path);
+	if (file && override_path) {
+		if (conf_file_unchanged (&file->override, override_path))
+			return 0;
+	} else if (file) {
+		if (is_conf_file_std (path))
+			other_path = toggle_conf_name (NULL, path);
+
+		if (conf_file_unchanged (&file->stamp, path)
+		    && ((! other_path)
+			|| conf_file_unchanged (&file->override, other_path))) {
+			nih_debug ("Skipping unchanged %s", path);
+			file->flag = source->flag;
+			return 0;
+		}
+	}
+
+	/* If there is no corresponding override file, free the old conf
+	 * file.  In cases of failure, we discard it anyway, so there's no
+	 * particular reason to keep it around anymore.
 	 *
 	 * Note: if @override_path has been specified, do not
 	 * free the file if found, since we want to _update_ the
 	 * existing entry.
 	 */
-	file = (ConfFile *)nih_hash_lookup (source->files, path);
 	if (! override_path && file)
 		nih_unref (file, source);
 
 	/* Read the file into memory for parsing, if this fails we don't
 	 * bother creating a new ConfFile structure for it and bail out
-	 * now.
+	 * now.  The file is stamped with its details from before it was
+	 * read, so that a change while reading is seen on the next reload.
 	 */
+	if (stat (path_to_load, &statbuf) < 0)
+		nih_return_system_error (-1);
+
 	buf = nih_file_read (NULL, path_to_load, &len);
 	if (! buf)
 		return -1;
@@ -993,6 +1173,9 @@ conf_reload_path (ConfSource *source,
 	if (! file)
 		file = NIH_MUST (conf_file_new (source, path));
 
+	conf_file_stamp ((override_path ? &file->override : &file->stamp),
+			 &statbuf, conf_file_hash (buf, len));
+
 	pos = 0;
 	lineno = 1;
 
@@ -1040,8 +1223,17 @@ conf_reload_path (ConfSource *source,
 		} else {
 			nih_debug ("Loading %s from %s", name, path);
 		}
-		file->job = parse_job (NULL, file->job, name, buf, len, &pos, &lineno);
+		if (conf_lazy) {
+			file->job = parse_job_header (NULL, file->job, name,
+						      buf, len, &pos, &lineno);
+		} else {
+			file->job = parse_job (NULL, file->job, name,
+					       buf, len, &pos, &lineno);
+		}
 		if (file->job) {
+			if (conf_packed)
+				NIH_ZERO (job_class_pack (file->job));
+
 			job_class_consider (file->job);
 		} else {
 			err = nih_error_get ();
@@ -1070,10 +1262,13 @@ conf_reload_path (ConfSource *source,
 		case PARSE_ILLEGAL_NICE:
 		case PARSE_ILLEGAL_OOM:
 		case PARSE_ILLEGAL_LIMIT:
+		case PARSE_ILLEGAL_CGROUP:
+		case PARSE_ILLEGAL_MULTIPLIER:
 		case PARSE_EXPECTED_EVENT:
 		case PARSE_EXPECTED_OPERATOR:
 		case PARSE_EXPECTED_VARIABLE:
 		case PARSE_MISMATCHED_PARENS:
+		case PARSE_ILLEGAL_PRIORITY:
 			nih_error ("%s:%zi: %s", path_to_load, lineno, err->message);
 			nih_free (err);
 			err = NULL;
@@ -1265,9 +1460,11 @@ debug_show_event (const Event *event)
 {
 	nih_assert (event);
 
-	nih_debug ("Event %p: name='%s', progress=%x, failed=%d, "
-			"blockers=%d, blocking=%p",
-			event, event->name, event->progress, event->failed,
+	nih_debug ("Event %p: name='%s', priority=%s, source=%p, "
+			"progress=%x, failed=%d, blockers=%d, blocking=%p",
+			event, event->name,
+			event_priority_name (event->priority), event->source,
+			event->progress, event->failed,
 			event->blockers, (void *)&event->blocking);
 }
 
@@ -20,6 +20,11 @@
 #ifndef INIT_CONF_H
 #define INIT_CONF_H
 
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <time.h>
+
 #include <nih/macros.h>
 
 #include <nih/hash.h>
@@ -73,32 +78,69 @@ typedef struct conf_source {
 	NihHash            *files;
 } ConfSource;
 
+/**
+ * ConfFileStamp:
+ * @dev: device of file,
+ * @ino: inode of file,
+ * @size: size of file,
+ * @mtime: time file was last modified,
+ * @ctime: time file status was last changed,
+ * @racy: whether the stat details alone cannot be trusted,
+ * @hash: hash of file contents, zero if there is no file.
+ *
+ * This structure records a file as it was when parsed, so that it can be
+ * recognised as unchanged when reloaded; if it has the same stat details
+ * it need not be read again, otherwise if it has the same contents it
+ * need not be parsed again.
+ *
+ * A file stamped within the resolution of its timestamps of being
+ * modified could be modified again without them changing, @racy is set
+ * for such files so that their contents are always compared.
+ **/
+typedef struct conf_file_stamp {
+	dev_t           dev;
+	ino_t           ino;
+	off_t           size;
+	struct timespec mtime;
+	struct timespec ctime;
+	int             racy;
+	uint64_t        hash;
+} ConfFileStamp;
+
 /**
  * ConfFile:
  * @entry: list header,
  * @path: path to file,
  * @source: configuration source,
  * @flag: reload flag,
+ * @stamp: stamp of the file when parsed,
+ * @override: stamp of the override file when parsed,
  * @data: pointer to actual item.
  *
  * This structure represents a file within @source and links to the item
  * parsed from it.
  *
+ * The @stamp and @override members allow a file that has not changed,
+ * along with its override file, to be skipped when the source is
+ * reloaded, keeping the item already parsed.
+ *
  * The @flag member is used to support mandatory reloading; when the file is
  * created and parsed, it is set to the same value as the source's.  Then
  * the source can trivially see which files have been lost, since they have
  * the wrong flag value.
  **/
 typedef struct conf_file {
-	NihList     entry;
-	char       *path;
+	NihList        entry;
+	char          *path;
 
-	ConfSource *source;
-	int         flag;
+	ConfSource    *source;
+	int            flag;
+	ConfFileStamp  stamp;
+	ConfFileStamp  override;
 
 	union {
-		void     *data;
-		JobClass *job;
+		void      *data;
+		JobClass  *job;
 	};
 } ConfFile;
 
@@ -106,6 +148,8 @@ typedef struct conf_file {
 NIH_BEGIN_EXTERN
 
 extern NihList *conf_sources;
+extern int      conf_lazy;
+extern int      conf_packed;
 
 
 void        conf_init          (void);
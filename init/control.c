@@ -51,6 +51,7 @@
 #include "job_class.h"
 #include "blocked.h"
 #include "conf.h"
+#include "runlevel.h"
 #include "control.h"
 #include "errors.h"
 
@@ -294,6 +295,11 @@ control_disconnected (DBusConnection *conn)
 		control_bus = NULL;
 	}
 
+	/* The connection is about to be freed, and its address may be
+	 * given to a new client that shouldn't inherit its events.
+	 */
+	event_forget_source (conn);
+
 	/* Remove from the connections list */
 	NIH_LIST_FOREACH_SAFE (control_conns, iter) {
 		NihListEntry *entry = (NihListEntry *)iter;
@@ -483,8 +489,58 @@ control_emit_event (void            *data,
  * @wait: whether to wait for event completion before returning,
  * @file: file descriptor.
  *
- * Implements the top half of the EmitEvent method of the com.ubuntu.Upstart
- * interface, the bottom half may be found in event_finished().
+ * Implements the top half of the EmitEventWithFile method of the
+ * com.ubuntu.Upstart interface; this is simply a wrapper around
+ * control_emit_event_with_files() with a single file descriptor named
+ * after the event, or none at all if @file is -1.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_emit_event_with_file (void            *data,
+			      NihDBusMessage  *message,
+			      const char      *name,
+			      char * const    *env,
+			      int              wait,
+			      int              file)
+{
+	nih_local char **file_names = NULL;
+	size_t           len = 0;
+
+	nih_assert (message != NULL);
+	nih_assert (name != NULL);
+
+	if (file < 0)
+		return control_emit_event_with_files (data, message, name,
+						      env, wait, NULL, 0,
+						      NULL);
+
+	file_names = nih_str_array_new (NULL);
+	if ((! file_names)
+	    || (! nih_str_array_add (&file_names, NULL, &len, name))) {
+		nih_error_raise_system ();
+		close (file);
+		return -1;
+	}
+
+	return control_emit_event_with_files (data, message, name, env, wait,
+					      &file, 1, file_names);
+}
+
+/**
+ * control_emit_event_with_files:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @name: name of event to emit,
+ * @env: environment of environment,
+ * @wait: whether to wait for event completion before returning,
+ * @files: file descriptors,
+ * @files_len: number of entries in @files,
+ * @file_names: NULL-terminated list of names for @files.
+ *
+ * Implements the top half of the EmitEvent, EmitEventWithFile and
+ * EmitEventWithFiles methods of the com.ubuntu.Upstart interface, the
+ * bottom half may be found in event_finished().
  *
  * Called to emit an event with a given @name and @env, which will be
  * added to the event queue and processed asynchronously.  If @name or
@@ -493,6 +549,21 @@ control_emit_event (void            *data,
  * com.ubuntu.Upstart.Error.EventFailed D-Bus error will be returned when
  * the event finishes.
  *
+ * If events named @name are coalesced and an identical event without
+ * files is still pending, no new event is queued; the method call is
+ * instead answered when that event finishes.
+ *
+ * If too many events from this connection, or from D-Bus connections as a
+ * whole, are already pending, the com.ubuntu.Upstart.Error.QueueFull D-Bus
+ * error will be returned immediately; the method may be called again
+ * later.
+ *
+ * Each of @files is passed along with the event under the name at the
+ * same index of @file_names, so there must be exactly one non-empty
+ * name without whitespace for each file descriptor; they are handed to
+ * the processes of any job started by the event.  The descriptors are
+ * closed if an error is returned.
+ *
  * When @wait is TRUE the method call will not return until the event
  * has completed, which means that all jobs affected by the event have
  * finished starting (running for tasks) or stopping; when @wait is FALSE,
@@ -501,45 +572,72 @@ control_emit_event (void            *data,
  * Returns: zero on success, negative value on raised error.
  **/
 int
-control_emit_event_with_file (void            *data,
-			      NihDBusMessage  *message,
-			      const char      *name,
-			      char * const    *env,
-			      int              wait,
-			      int              file)
+control_emit_event_with_files (void            *data,
+			       NihDBusMessage  *message,
+			       const char      *name,
+			       char * const    *env,
+			       int              wait,
+			       const int       *files,
+			       size_t           files_len,
+			       char * const    *file_names)
 {
 	Event   *event;
 	Blocked *blocked;
 	char   **sanitized_env;
 	size_t   len = 0;
+	size_t   i;
+	int      coalesced = FALSE;
 	char * const *e;
 
 	nih_assert (message != NULL);
 	nih_assert (name != NULL);
 	nih_assert (env != NULL);
+	nih_assert ((files != NULL) || (files_len == 0));
 
 	/* Verify that the name is valid */
 	if (! strlen (name)) {
 		nih_dbus_error_raise_printf (DBUS_ERROR_INVALID_ARGS,
 					     _("Name may not be empty string"));
-		close (file);
-		return -1;
+		goto error;
 	}
 
 	/* Verify that the environment is valid */
 	if (! environ_all_valid (env)) {
 		nih_dbus_error_raise_printf (DBUS_ERROR_INVALID_ARGS,
 					     _("Env must be KEY=VALUE pairs"));
-		close (file);
-		return -1;
+		goto error;
+	}
+
+	/* Verify that there's one usable name for each file */
+	for (i = 0; i < files_len; i++) {
+		if ((! file_names) || (! file_names[i])) {
+			nih_dbus_error_raise_printf (
+				DBUS_ERROR_INVALID_ARGS,
+				_("Each file must have a name"));
+			goto error;
+		}
+
+		if ((! *file_names[i])
+		    || strpbrk (file_names[i], " \t\r\n")) {
+			nih_dbus_error_raise_printf (
+				DBUS_ERROR_INVALID_ARGS,
+				_("File names may not be empty or "
+				  "contain whitespace"));
+			goto error;
+		}
+	}
+
+	if (file_names && file_names[files_len]) {
+		nih_dbus_error_raise_printf (DBUS_ERROR_INVALID_ARGS,
+					     _("Each name must have a file"));
+		goto error;
 	}
 
 	/* Filter out variables generated by upstart internally */
 	sanitized_env = nih_str_array_new (message);
 	if (! sanitized_env) {
 		nih_error_raise_system ();
-		close (file);
-		return -1;
+		goto error;
 	}
 
 	for (e = env; e && *e; e++) {
@@ -548,35 +646,63 @@ control_emit_event_with_file (void            *data,
 
 		if (! environ_add (&sanitized_env, message, &len, TRUE, *e)) {
 			nih_error_raise_system ();
-			close (file);
-			return -1;
+			goto error;
 		}
 	}
 
+	/* Fold the emission into an identical event that's still pending
+	 * if events of this name are coalesced; events with files are always
+	 * distinct.
+	 */
+	event = (files_len ? NULL : event_coalesce (name, sanitized_env));
+	if (event) {
+		coalesced = TRUE;
+		goto block;
+	}
+
+	/* Refuse the event if this client, or clients as a whole, already
+	 * have as many events waiting as we're willing to hold; the client
+	 * may try again once they've been handled.
+	 */
+	if (event_queue_full (message->connection)) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.QueueFull",
+			_("Too many events are pending, try again later"));
+		goto error;
+	}
+
 	/* Make the event and block the message on it */
 	event = event_new (NULL, name, sanitized_env);
 	if (! event) {
 		nih_error_raise_system ();
-		close (file);
-		return -1;
+		goto error;
 	}
 
-	event->fd = file;
-	if (event->fd >= 0) {
-		long flags;
+	/* Identify the client so that it only gets its share of the queue */
+	if (event_set_source (event, message->connection) < 0) {
+		nih_error_raise_system ();
+		goto error_event;
+	}
+
+	/* Hand the files over to the event; they stay close-on-exec in
+	 * our process since the spawned job processes dup() them to their
+	 * final location anyway.
+	 */
+	for (i = 0; i < files_len; i++) {
+		nih_io_set_cloexec (files[i]);
 
-		flags = fcntl (event->fd, F_GETFD);
-		flags &= ~FD_CLOEXEC;
-		fcntl (event->fd, F_SETFD, flags);
+		if (event_add_fd (event, files[i], file_names[i]) < 0) {
+			nih_error_raise_system ();
+			goto error_event;
+		}
 	}
 
+block:
 	if (wait) {
 		blocked = blocked_new (event, BLOCKED_EMIT_METHOD, message);
 		if (! blocked) {
 			nih_error_raise_system ();
-			nih_free (event);
-			close (file);
-			return -1;
+			goto error_event;
 		}
 
 		nih_list_add (&event->blocking, &blocked->entry);
@@ -585,6 +711,15 @@ control_emit_event_with_file (void            *data,
 	}
 
 	return 0;
+
+error_event:
+	if (! coalesced)
+		nih_free (event);
+error:
+	for (i = 0; i < files_len; i++)
+		close (files[i]);
+
+	return -1;
 }
 
 
@@ -720,3 +855,63 @@ control_set_log_priority (void *          data,
 
 	return 0;
 }
+
+/**
+ * control_get_runlevel:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @runlevel: pointer for reply string.
+ *
+ * Implements the get method for the runlevel property of the
+ * com.ubuntu.Upstart interface.
+ *
+ * Called to obtain the runlevel of the most recent runlevel event, which
+ * will be stored as a single character string in @runlevel, "N" if there
+ * hasn't been one.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_runlevel (void *          data,
+		      NihDBusMessage *message,
+		      char **         runlevel)
+{
+	nih_assert (message != NULL);
+	nih_assert (runlevel != NULL);
+
+	*runlevel = nih_sprintf (message, "%c", runlevel_current);
+	if (! *runlevel)
+		nih_return_no_memory_error (-1);
+
+	return 0;
+}
+
+/**
+ * control_get_prevlevel:
+ * @data: not used,
+ * @message: D-Bus connection and message received,
+ * @prevlevel: pointer for reply string.
+ *
+ * Implements the get method for the prevlevel property of the
+ * com.ubuntu.Upstart interface.
+ *
+ * Called to obtain the runlevel before the most recent runlevel event,
+ * which will be stored as a single character string in @prevlevel, "N"
+ * if there was none.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+control_get_prevlevel (void *          data,
+		       NihDBusMessage *message,
+		       char **         prevlevel)
+{
+	nih_assert (message != NULL);
+	nih_assert (prevlevel != NULL);
+
+	*prevlevel = nih_sprintf (message, "%c", runlevel_previous);
+	if (! *prevlevel)
+		nih_return_no_memory_error (-1);
+
+	return 0;
+}
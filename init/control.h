@@ -64,6 +64,12 @@ int  control_emit_event_with_file (void *data, NihDBusMessage *message,
 				   const char *name, char * const *env,
 				   int wait, int file)
 	__attribute__ ((warn_unused_result));
+int  control_emit_event_with_files (void *data, NihDBusMessage *message,
+				    const char *name, char * const *env,
+				    int wait, const int *files,
+				    size_t files_len,
+				    char * const *file_names)
+	__attribute__ ((warn_unused_result));
 
 int  control_get_version          (void *data, NihDBusMessage *message,
 				   char **version)
@@ -76,6 +82,13 @@ int  control_set_log_priority     (void *data, NihDBusMessage *message,
 				   const char *log_priority)
 	__attribute__ ((warn_unused_result));
 
+int  control_get_runlevel         (void *data, NihDBusMessage *message,
+				   char **runlevel)
+	__attribute__ ((warn_unused_result));
+int  control_get_prevlevel        (void *data, NihDBusMessage *message,
+				   char **prevlevel)
+	__attribute__ ((warn_unused_result));
+
 NIH_END_EXTERN
 
 #endif /* INIT_CONTROL_H */
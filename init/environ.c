@@ -24,13 +24,17 @@
 #endif /* HAVE_CONFIG_H */
 
 
+#include <alloca.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
 #include <nih/logging.h>
 #include <nih/error.h>
 
@@ -38,11 +42,79 @@
 #include "errors.h"
 
 
+/**
+ * EnvironEntry:
+ * @entry: list header,
+ * @str: KEY=VALUE string in the table,
+ * @pos: position of @str in the table.
+ *
+ * This structure is used for the hashes of environment tables kept by
+ * EnvironTable and built temporarily by environ_append(); the key of each
+ * entry is the part of @str before the equals.
+ **/
+typedef struct environ_entry {
+	NihList  entry;
+	char    *str;
+	size_t   pos;
+} EnvironEntry;
+
+/**
+ * EnvironTemplateValue:
+ * @str: value to substitute, or NULL to expand the argument instead,
+ * @len: length of @str.
+ *
+ * This structure holds the value looked up for a reference in an
+ * EnvironTemplate between calculating the length of its expansion and
+ * writing it.
+ **/
+typedef struct environ_template_value {
+	const char *str;
+	size_t      len;
+} EnvironTemplateValue;
+
+
 /* Prototypes for static functions */
+static char **       environ_add_indexed  (char ***env, const void *parent,
+					   size_t *len, int replace,
+					   const char *str, NihHash *index)
+	__attribute__ ((warn_unused_result));
+
+static NihHash *     environ_index_new    (const void *parent,
+					   char * const *env, size_t len)
+	__attribute__ ((malloc, warn_unused_result));
+static EnvironEntry *environ_index_lookup (NihHash *index, const char *key,
+					   size_t len);
+static const void *  environ_index_key    (NihList *entry);
+static uint32_t      environ_index_hash   (const void *key);
+static int           environ_index_cmp    (const void *key1,
+					   const void *key2);
+
 static char *environ_expand_until (char **str, const void *parent,
 				   size_t *len, size_t *pos, char * const *env,
 				   const char *until);
 
+static int   environ_template_add    (EnvironTemplate *template,
+				      EnvironTemplateOp op, const char *str,
+				      size_t len)
+	__attribute__ ((warn_unused_result));
+static int   environ_template_parse  (EnvironTemplate *template,
+				      const char *str, size_t *pos,
+				      const char *until)
+	__attribute__ ((warn_unused_result));
+static int   environ_template_value  (const EnvironTemplatePart *part,
+				      char * const *env,
+				      EnvironTemplateValue *value)
+	__attribute__ ((warn_unused_result));
+static int   environ_template_length (const EnvironTemplate *template,
+				      char * const *env,
+				      EnvironTemplateValue *values,
+				      size_t *len)
+	__attribute__ ((warn_unused_result));
+static char *environ_template_write  (const EnvironTemplate *template,
+				      char * const *env,
+				      const EnvironTemplateValue *values,
+				      char *buf);
+
 
 /**
  * environ_add:
@@ -83,9 +155,43 @@ environ_add (char       ***env,
 	     size_t       *len,
 	     int           replace,
 	     const char   *str)
+{
+	nih_assert (env != NULL);
+	nih_assert (str != NULL);
+
+	if (! environ_add_indexed (env, parent, len, replace, str, NULL))
+		return NULL;
+
+	return *env;
+}
+
+/**
+ * environ_add_indexed:
+ * @env: pointer to environment table,
+ * @parent: parent object for new array,
+ * @len: length of @env,
+ * @replace: TRUE if existing entry should be replaced,
+ * @str: string to add,
+ * @index: hash of @env or NULL.
+ *
+ * Implements environ_add(), taking the additional @index argument which
+ * when not NULL must be a hash of the entries of @env built with
+ * environ_index_new(); it's used instead of scanning @env for an existing
+ * entry, and kept up to date with the changes made.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+static char **
+environ_add_indexed (char       ***env,
+		     const void   *parent,
+		     size_t       *len,
+		     int           replace,
+		     const char   *str,
+		     NihHash      *index)
 {
 	size_t           key, _len;
 	char           **old_str;
+	EnvironEntry    *entry = NULL;
 	nih_local char  *new_str = NULL;
 
 	nih_assert (env != NULL);
@@ -126,17 +232,42 @@ environ_add (char       ***env,
 	 * if we find one we either finish or overwrite it instead of
 	 * extending the table.
 	 */
-	old_str = (char **)environ_lookup (*env, str, key);
+	if (index) {
+		entry = environ_index_lookup (index, str, key);
+		old_str = entry ? *env + entry->pos : NULL;
+	} else {
+		old_str = (char **)environ_lookup (*env, str, key);
+	}
+
 	if (old_str && replace) {
+		if (entry && (! new_str))
+			nih_free (entry);
+
 		nih_unref (*old_str, *env);
 
 		if (new_str) {
 			*old_str = new_str;
 			nih_ref (new_str, *env);
+
+			if (entry)
+				entry->str = new_str;
 		} else {
 			memmove (old_str, old_str + 1,
 				 (char *)(*env + *len) - (char *)old_str);
 			(*len)--;
+
+			/* Entries after the one removed have moved down */
+			if (index) {
+				for (char **e = old_str; *e; e++) {
+					EnvironEntry *moved;
+
+					moved = environ_index_lookup (
+						index, *e, strcspn (*e, "="));
+					nih_assert (moved != NULL);
+
+					moved->pos = e - *env;
+				}
+			}
 		}
 
 		return *env;
@@ -144,11 +275,30 @@ environ_add (char       ***env,
 		return *env;
 	}
 
-	/* No existing entry exists so extend the table instead.
+	/* No existing entry exists so extend the table instead, creating
+	 * the hash entry first so that failure leaves both unchanged.
 	 */
 	if (new_str) {
-		if (! nih_str_array_addp (env, parent, len, new_str))
+		if (index) {
+			entry = nih_new (index, EnvironEntry);
+			if (! entry)
+				return NULL;
+
+			nih_list_init (&entry->entry);
+			nih_alloc_set_destructor (entry, nih_list_destroy);
+
+			entry->str = new_str;
+			entry->pos = *len;
+		}
+
+		if (! nih_str_array_addp (env, parent, len, new_str)) {
+			if (entry)
+				nih_free (entry);
 			return NULL;
+		}
+
+		if (entry)
+			nih_hash_add (index, &entry->entry);
 	}
 
 	return *env;
@@ -196,17 +346,93 @@ environ_append (char       ***env,
 		int           replace,
 		char * const *new_env)
 {
-	char * const *e;
+	nih_local NihHash *index = NULL;
+	char * const      *e;
+	size_t             _len, new_len = 0;
 
 	nih_assert (env != NULL);
 
+	if (! len) {
+		len = &_len;
+
+		_len = 0;
+		for (e = *env; e && *e; e++)
+			_len++;
+	}
+
+	/* Appending to a large table would mean scanning it for each new
+	 * entry, so hash the existing entries first instead.
+	 */
 	for (e = new_env; e && *e; e++)
-		if (! environ_add (env, parent, len, replace, *e))
+		new_len++;
+
+	if ((new_len > 1) && (*len + new_len > ENVIRON_INDEX_THRESHOLD)) {
+		index = environ_index_new (NULL, *env, *len);
+		if (! index)
+			return NULL;
+	}
+
+	for (e = new_env; e && *e; e++)
+		if (! environ_add_indexed (env, parent, len, replace, *e,
+					   index))
 			return NULL;
 
 	return *env;
 }
 
+/**
+ * environ_copy:
+ * @parent: parent object for new array,
+ * @len: pointer to variable to store length of new array in,
+ * @env: environment table to copy.
+ *
+ * Returns a copy of the NULL-terminated environment table @env which
+ * shares its strings with @env rather than duplicating them; each string
+ * is referenced by the new array, so it remains valid after @env itself
+ * is freed.
+ *
+ * This is safe because environ_add() and friends never modify an entry
+ * in place, but only ever unreference it from the array when it is
+ * replaced or removed; the strings of @env must therefore have been
+ * allocated with nih_alloc() and must not be modified or freed directly.
+ *
+ * If @len is not NULL it will be set to the number of entries in the
+ * returned array.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: new array or NULL if insufficient memory.
+ **/
+char **
+environ_copy (const void    *parent,
+	      size_t        *len,
+	      char * const  *env)
+{
+	char   **new_env;
+	size_t   new_len = 0;
+
+	for (char * const *e = env; e && *e; e++)
+		new_len++;
+
+	new_env = nih_alloc (parent, sizeof (char *) * (new_len + 1));
+	if (! new_env)
+		return NULL;
+
+	for (size_t i = 0; i < new_len; i++) {
+		new_env[i] = env[i];
+		nih_ref (new_env[i], new_env);
+	}
+	new_env[new_len] = NULL;
+
+	if (len)
+		*len = new_len;
+
+	return new_env;
+}
+
 
 /**
  * environ_set:
@@ -735,3 +961,931 @@ error:
 	*str = NULL;
 	return NULL;
 }
+
+
+/**
+ * environ_template_new:
+ * @parent: parent object for new template,
+ * @string: string to compile.
+ *
+ * Compiles the variable references in @string, which may be any of those
+ * understood by environ_expand(), into a template that can be expanded
+ * by environ_template_expand() without the string being parsed again;
+ * syntax errors in @string are raised here rather than on expansion.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned template.  When all parents
+ * of the returned template are freed, the returned template will also be
+ * freed.
+ *
+ * Returns: newly allocated template or NULL on raised error.
+ **/
+EnvironTemplate *
+environ_template_new (const void *parent,
+		      const char *string)
+{
+	EnvironTemplate *template;
+	size_t           pos = 0;
+
+	nih_assert (string != NULL);
+
+	template = nih_new (parent, EnvironTemplate);
+	if (! template) {
+		nih_error_raise_no_memory ();
+		return NULL;
+	}
+
+	template->parts = NULL;
+	template->num_parts = 0;
+
+	template->string = nih_strdup (template, string);
+	if (! template->string) {
+		nih_error_raise_no_memory ();
+		goto error;
+	}
+
+	if (environ_template_parse (template, template->string,
+				    &pos, "") < 0)
+		goto error;
+
+	return template;
+
+error:
+	nih_free (template);
+	return NULL;
+}
+
+/**
+ * environ_template_add:
+ * @template: template to add to,
+ * @op: type of part,
+ * @str: literal text or variable name,
+ * @len: length of @str.
+ *
+ * Appends a new part to @template, with the @name and @arg members
+ * set to NULL; literal parts with zero @len are not added.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+environ_template_add (EnvironTemplate   *template,
+		      EnvironTemplateOp  op,
+		      const char        *str,
+		      size_t             len)
+{
+	EnvironTemplatePart *parts;
+	EnvironTemplatePart *part;
+
+	nih_assert (template != NULL);
+	nih_assert (str != NULL);
+
+	if ((op == ENVIRON_TEMPLATE_LITERAL) && (! len))
+		return 0;
+
+	parts = nih_realloc (template->parts, template,
+			     sizeof (EnvironTemplatePart)
+			     * (template->num_parts + 1));
+	if (! parts) {
+		nih_error_raise_no_memory ();
+		return -1;
+	}
+
+	template->parts = parts;
+	part = &template->parts[template->num_parts++];
+
+	part->op = op;
+	part->ignore_empty = FALSE;
+	part->str = str;
+	part->len = len;
+	part->name = NULL;
+	part->arg = NULL;
+
+	return 0;
+}
+
+/**
+ * environ_template_parse:
+ * @template: template to add to,
+ * @str: string being compiled,
+ * @pos: current position within @str,
+ * @until: characters to stop compilation on.
+ *
+ * Compiles the variable references in @str from @pos into parts of
+ * @template, stopping when any of the characters in @until or the end of
+ * @str is reached; this follows exactly the same rules as
+ * environ_expand_until(), @pos being updated to point to the character
+ * listed in @until.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+environ_template_parse (EnvironTemplate *template,
+			const char      *str,
+			size_t          *pos,
+			const char      *until)
+{
+	size_t literal;
+
+	nih_assert (template != NULL);
+	nih_assert (str != NULL);
+	nih_assert (pos != NULL);
+	nih_assert (until != NULL);
+
+	literal = *pos;
+
+	for (;;) {
+		EnvironTemplatePart *part;
+		EnvironTemplate     *name, *arg;
+		EnvironTemplateOp    op = ENVIRON_TEMPLATE_VALUE;
+		int                  ignore_empty = FALSE;
+		size_t               start, name_start;
+
+		/* Locate the start of the next reference, everything
+		 * before it is literal text.
+		 */
+		while ((str[*pos] != '$') && (! strchr (until, str[*pos])))
+			(*pos)++;
+		if (str[*pos] != '$')
+			break;
+
+		start = (*pos)++;
+		if ((str[*pos] == '_')
+		    || ((str[*pos] >= 'A') && (str[*pos] <= 'Z'))
+		    || ((str[*pos] >= 'a') && (str[*pos] <= 'z')))
+		{
+			/* Simple reference. */
+			name_start = (*pos)++;
+			while ((str[*pos] == '_')
+			       || ((str[*pos] >= 'A') && (str[*pos] <= 'Z'))
+			       || ((str[*pos] >= 'a') && (str[*pos] <= 'z'))
+			       || ((str[*pos] >= '0') && (str[*pos] <= '9')))
+				(*pos)++;
+
+			if (environ_template_add (template,
+						  ENVIRON_TEMPLATE_LITERAL,
+						  str + literal,
+						  start - literal) < 0)
+				return -1;
+			if (environ_template_add (template,
+						  ENVIRON_TEMPLATE_VALUE,
+						  str + name_start,
+						  *pos - name_start) < 0)
+				return -1;
+
+			literal = *pos;
+			continue;
+
+		} else if ((str[*pos] == '{') && (str[*pos + 1] == '}')) {
+			/* Empty bracketed expression; the dollar sign is
+			 * kept as literal text and the brackets dropped.
+			 */
+			if (environ_template_add (template,
+						  ENVIRON_TEMPLATE_LITERAL,
+						  str + literal,
+						  start + 1 - literal) < 0)
+				return -1;
+
+			*pos += 2;
+			literal = *pos;
+			continue;
+
+		} else if (str[*pos] != '{') {
+			/* Lone dollar sign, part of the literal text. */
+			continue;
+		}
+
+		/* Bracketed reference; the name and argument are compiled
+		 * into templates of their own.
+		 */
+		if (environ_template_add (template, ENVIRON_TEMPLATE_LITERAL,
+					  str + literal, start - literal) < 0)
+			return -1;
+
+		name = nih_new (template, EnvironTemplate);
+		if (! name) {
+			nih_error_raise_no_memory ();
+			return -1;
+		}
+
+		name->string = NULL;
+		name->parts = NULL;
+		name->num_parts = 0;
+
+		name_start = ++(*pos);
+		if (environ_template_parse (name, str, pos, "}:-+") < 0)
+			return -1;
+
+		if ((str[*pos] == ':') && (str[*pos + 1] == '-')) {
+			(*pos) += 2;
+			op = ENVIRON_TEMPLATE_DEFAULT;
+			ignore_empty = TRUE;
+		} else if ((str[*pos] == ':') && (str[*pos + 1] == '+')) {
+			(*pos) += 2;
+			op = ENVIRON_TEMPLATE_ALTERNATE;
+			ignore_empty = TRUE;
+		} else if (str[*pos] == '-') {
+			(*pos)++;
+			op = ENVIRON_TEMPLATE_DEFAULT;
+		} else if (str[*pos] == '+') {
+			(*pos)++;
+			op = ENVIRON_TEMPLATE_ALTERNATE;
+		} else if ((str[*pos] != '}') && (str[*pos] != '\0')) {
+			nih_error_raise (ENVIRON_EXPECTED_OPERATOR,
+					 _(ENVIRON_EXPECTED_OPERATOR_STR));
+			return -1;
+		}
+
+		arg = nih_new (template, EnvironTemplate);
+		if (! arg) {
+			nih_error_raise_no_memory ();
+			return -1;
+		}
+
+		arg->string = NULL;
+		arg->parts = NULL;
+		arg->num_parts = 0;
+
+		if (environ_template_parse (arg, str, pos, "}") < 0)
+			return -1;
+
+		if (str[*pos] != '}') {
+			nih_error_raise (ENVIRON_MISMATCHED_BRACES,
+					 _(ENVIRON_MISMATCHED_BRACES_STR));
+			return -1;
+		}
+
+		(*pos)++;
+
+		/* A name without references is kept as the text of the
+		 * part itself, and an empty argument dropped, since that's
+		 * by far the most common case.
+		 */
+		if ((name->num_parts == 1)
+		    && (name->parts[0].op == ENVIRON_TEMPLATE_LITERAL)) {
+			if (environ_template_add (template, op,
+						  name->parts[0].str,
+						  name->parts[0].len) < 0)
+				return -1;
+
+			nih_free (name);
+			name = NULL;
+		} else {
+			if (environ_template_add (template, op,
+						  str + name_start, 0) < 0)
+				return -1;
+
+			if (! name->num_parts) {
+				nih_free (name);
+				name = NULL;
+			}
+		}
+
+		if (! arg->num_parts) {
+			nih_free (arg);
+			arg = NULL;
+		}
+
+		part = &template->parts[template->num_parts - 1];
+		part->ignore_empty = ignore_empty;
+		part->name = name;
+		part->arg = arg;
+
+		literal = *pos;
+	}
+
+	if (environ_template_add (template, ENVIRON_TEMPLATE_LITERAL,
+				  str + literal, *pos - literal) < 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * environ_template_expand:
+ * @parent: parent object for new string,
+ * @template: template to expand,
+ * @env: NULL-terminated list of environment variables to use.
+ *
+ * Expands @template, compiled by environ_template_new(), using the
+ * NULL-terminated list of KEY=VALUE strings in the given @env table,
+ * returning a newly allocated string with the references replaced by
+ * the values exactly as environ_expand() would for the original string.
+ *
+ * Unlike environ_expand() the values are looked up and the length of the
+ * result calculated first, so that it can be written into a single
+ * allocation without any intermediate copies.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: newly allocated string or NULL on raised error.
+ **/
+char *
+environ_template_expand (const void            *parent,
+			 const EnvironTemplate *template,
+			 char * const          *env)
+{
+	EnvironTemplateValue *values;
+	char                 *str;
+	size_t                len;
+
+	nih_assert (template != NULL);
+
+	values = alloca (sizeof (EnvironTemplateValue) * template->num_parts);
+
+	if (environ_template_length (template, env, values, &len) < 0)
+		return NULL;
+
+	str = nih_alloc (parent, len + 1);
+	if (! str) {
+		nih_error_raise_no_memory ();
+		return NULL;
+	}
+
+	*environ_template_write (template, env, values, str) = '\0';
+
+	return str;
+}
+
+/**
+ * environ_template_value:
+ * @part: template part to look up,
+ * @env: NULL-terminated list of environment variables to use,
+ * @value: value to fill in.
+ *
+ * Looks up the variable referenced by @part in @env, expanding its name
+ * first if necessary, and applies the operator of @part to work out what
+ * it should be replaced by.  When that is the argument of @part, the str
+ * member of @value is set to NULL and the argument should be expanded
+ * instead.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+environ_template_value (const EnvironTemplatePart *part,
+			char * const              *env,
+			EnvironTemplateValue      *value)
+{
+	const char *name;
+	size_t      name_len;
+	const char *str;
+
+	nih_assert (part != NULL);
+	nih_assert (part->op != ENVIRON_TEMPLATE_LITERAL);
+	nih_assert (value != NULL);
+
+	if (part->name) {
+		EnvironTemplateValue *name_values;
+		char                 *buf;
+
+		name_values = alloca (sizeof (EnvironTemplateValue)
+				      * part->name->num_parts);
+
+		if (environ_template_length (part->name, env, name_values,
+					     &name_len) < 0)
+			return -1;
+
+		buf = alloca (name_len + 1);
+		*environ_template_write (part->name, env, name_values,
+					 buf) = '\0';
+		name = buf;
+	} else {
+		name = part->str;
+		name_len = part->len;
+	}
+
+	str = environ_getn (env, name, name_len);
+
+	switch (part->op) {
+	case ENVIRON_TEMPLATE_VALUE:
+		if (str == NULL) {
+			nih_error_raise_printf (
+				ENVIRON_UNKNOWN_PARAM,
+				"%s: %.*s", _(ENVIRON_UNKNOWN_PARAM_STR),
+				(int)name_len, name);
+			return -1;
+		}
+		break;
+	case ENVIRON_TEMPLATE_DEFAULT:
+		if ((str == NULL)
+		    || (part->ignore_empty && (str[0] == '\0')))
+			str = NULL;
+		break;
+	case ENVIRON_TEMPLATE_ALTERNATE:
+		if ((str == NULL)
+		    || (part->ignore_empty && (str[0] == '\0'))) {
+			str = "";
+		} else {
+			str = NULL;
+		}
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	value->str = str;
+	value->len = str ? strlen (str) : 0;
+
+	return 0;
+}
+
+/**
+ * environ_template_length:
+ * @template: template to expand,
+ * @env: NULL-terminated list of environment variables to use,
+ * @values: array to store values in,
+ * @len: pointer to store length in.
+ *
+ * Looks up the value of each reference in @template using @env, storing
+ * them in @values which must have as many elements as @template has
+ * parts, and calculates the length of the expansion excluding the
+ * terminating NUL.  Any unknown references are raised as errors here,
+ * including those in arguments that are not used, as environ_expand()
+ * would.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+environ_template_length (const EnvironTemplate *template,
+			 char * const          *env,
+			 EnvironTemplateValue  *values,
+			 size_t                *len)
+{
+	nih_assert (template != NULL);
+	nih_assert (len != NULL);
+
+	*len = 0;
+
+	for (size_t i = 0; i < template->num_parts; i++) {
+		const EnvironTemplatePart *part = &template->parts[i];
+		size_t                     arg_len = 0;
+
+		if (part->op == ENVIRON_TEMPLATE_LITERAL) {
+			*len += part->len;
+			continue;
+		}
+
+		if (environ_template_value (part, env, &values[i]) < 0)
+			return -1;
+
+		if (part->arg) {
+			EnvironTemplateValue *arg_values;
+
+			arg_values = alloca (sizeof (EnvironTemplateValue)
+					     * part->arg->num_parts);
+
+			if (environ_template_length (part->arg, env,
+						     arg_values, &arg_len) < 0)
+				return -1;
+		}
+
+		*len += values[i].str ? values[i].len : arg_len;
+	}
+
+	return 0;
+}
+
+/**
+ * environ_template_write:
+ * @template: template to expand,
+ * @env: NULL-terminated list of environment variables to use,
+ * @values: values of references,
+ * @buf: buffer to write to.
+ *
+ * Writes the expansion of @template using @env into @buf, which must be
+ * at least the length returned by environ_template_length() which must
+ * have been successfully called with the same arguments to fill in
+ * @values.  The result is not NUL-terminated.
+ *
+ * Returns: pointer to the end of the expansion in @buf.
+ **/
+static char *
+environ_template_write (const EnvironTemplate      *template,
+			char * const               *env,
+			const EnvironTemplateValue *values,
+			char                       *buf)
+{
+	nih_assert (template != NULL);
+	nih_assert (buf != NULL);
+
+	for (size_t i = 0; i < template->num_parts; i++) {
+		const EnvironTemplatePart *part = &template->parts[i];
+
+		if (part->op == ENVIRON_TEMPLATE_LITERAL) {
+			memcpy (buf, part->str, part->len);
+			buf += part->len;
+		} else if (values[i].str) {
+			memcpy (buf, values[i].str, values[i].len);
+			buf += values[i].len;
+		} else if (part->arg) {
+			EnvironTemplateValue *arg_values;
+			size_t                arg_len;
+			int                   ret;
+
+			arg_values = alloca (sizeof (EnvironTemplateValue)
+					     * part->arg->num_parts);
+
+			ret = environ_template_length (part->arg, env,
+						       arg_values, &arg_len);
+			nih_assert (ret == 0);
+
+			buf = environ_template_write (part->arg, env,
+						      arg_values, buf);
+		}
+	}
+
+	return buf;
+}
+
+/**
+ * environ_index_new:
+ * @parent: parent object for new hash,
+ * @env: environment table to index,
+ * @len: length of @env.
+ *
+ * Builds a hash of the entries in @env, which has @len elements excluding
+ * the final NULL element, by key; each entry being an EnvironEntry
+ * structure.  Where @env contains the same key more than once, lookups
+ * return the first as environ_lookup() would.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned hash.  When all parents
+ * of the returned hash are freed, the returned hash will also be
+ * freed.
+ *
+ * Returns: new hash or NULL if insufficient memory.
+ **/
+static NihHash *
+environ_index_new (const void   *parent,
+		   char * const *env,
+		   size_t        len)
+{
+	NihHash *index;
+
+	index = nih_hash_new (parent, len, environ_index_key,
+			      environ_index_hash, environ_index_cmp);
+	if (! index)
+		return NULL;
+
+	for (size_t i = 0; i < len; i++) {
+		EnvironEntry *entry;
+
+		nih_assert (env[i] != NULL);
+
+		entry = nih_new (index, EnvironEntry);
+		if (! entry) {
+			nih_free (index);
+			return NULL;
+		}
+
+		nih_list_init (&entry->entry);
+		nih_alloc_set_destructor (entry, nih_list_destroy);
+
+		entry->str = env[i];
+		entry->pos = i;
+
+		nih_hash_add (index, &entry->entry);
+	}
+
+	return index;
+}
+
+/**
+ * environ_index_lookup:
+ * @index: hash to search,
+ * @key: key to lookup,
+ * @len: length of @key.
+ *
+ * Lookup the environment variable named @key, which is @len characters
+ * long, in the hash @index.
+ *
+ * Returns: entry found or NULL if not found.
+ **/
+static EnvironEntry *
+environ_index_lookup (NihHash    *index,
+		      const char *key,
+		      size_t      len)
+{
+	nih_assert (index != NULL);
+	nih_assert (key != NULL);
+
+	/* The hash and comparison functions stop at an equals, so we only
+	 * need a copy of the key when it's followed by something else.
+	 */
+	if ((key[len] != '=') && (key[len] != '\0')) {
+		char *copy;
+
+		copy = alloca (len + 1);
+		memcpy (copy, key, len);
+		copy[len] = '\0';
+
+		key = copy;
+	}
+
+	return (EnvironEntry *)nih_hash_lookup (index, key);
+}
+
+/**
+ * environ_index_key:
+ * @entry: hash entry.
+ *
+ * Returns: the KEY=VALUE string of @entry, the key of which is compared
+ * by environ_index_hash() and environ_index_cmp().
+ **/
+static const void *
+environ_index_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return ((EnvironEntry *)entry)->str;
+}
+
+/**
+ * environ_index_hash:
+ * @key: KEY or KEY=VALUE string.
+ *
+ * Generates a hash of the part of @key before any equals.
+ *
+ * Returns: hash value.
+ **/
+static uint32_t
+environ_index_hash (const void *key)
+{
+	const unsigned char *c;
+	uint32_t             hash = 2166136261U;
+
+	nih_assert (key != NULL);
+
+	for (c = key; *c && (*c != '='); c++) {
+		hash ^= *c;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/**
+ * environ_index_cmp:
+ * @key1: KEY or KEY=VALUE string,
+ * @key2: KEY or KEY=VALUE string.
+ *
+ * Compares the part of @key1 and @key2 before any equals.
+ *
+ * Returns: zero if the keys are the same, non-zero otherwise.
+ **/
+static int
+environ_index_cmp (const void *key1,
+		   const void *key2)
+{
+	const char *c1 = key1, *c2 = key2;
+
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	while (*c1 && (*c1 != '=') && (*c1 == *c2)) {
+		c1++;
+		c2++;
+	}
+
+	return ! (((*c1 == '\0') || (*c1 == '='))
+		  && ((*c2 == '\0') || (*c2 == '=')));
+}
+
+
+/**
+ * environ_table_new:
+ * @parent: parent object for new table,
+ * @env: initial entries.
+ *
+ * Allocates and returns a new EnvironTable, copying any entries from the
+ * NULL-terminated array @env (which may be NULL) as environ_append()
+ * would.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned table.  When all parents
+ * of the returned table are freed, the returned table will also be
+ * freed.
+ *
+ * Returns: newly allocated table or NULL if insufficient memory.
+ **/
+EnvironTable *
+environ_table_new (const void   *parent,
+		   char * const *env)
+{
+	EnvironTable *table;
+	size_t        len = 0;
+
+	for (char * const *e = env; e && *e; e++)
+		len++;
+
+	table = nih_new (parent, EnvironTable);
+	if (! table)
+		return NULL;
+
+	table->len = 0;
+
+	table->env = nih_str_array_new (table);
+	if (! table->env)
+		goto error;
+
+	table->index = nih_hash_new (table, len, environ_index_key,
+				     environ_index_hash, environ_index_cmp);
+	if (! table->index)
+		goto error;
+
+	if (! environ_table_append (table, TRUE, env))
+		goto error;
+
+	return table;
+
+error:
+	nih_free (table);
+	return NULL;
+}
+
+/**
+ * environ_table_copy:
+ * @parent: parent object for new table,
+ * @env: initial entries.
+ *
+ * Allocates and returns a new EnvironTable with the entries of the
+ * NULL-terminated array @env (which may be NULL), sharing the strings
+ * with @env as environ_copy() does rather than copying each with
+ * environ_append().
+ *
+ * @env must be a valid environment table, with no key appearing more
+ * than once, whose strings were allocated with nih_alloc(); this is
+ * true of any table built with environ_add() and friends.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned table.  When all parents
+ * of the returned table are freed, the returned table will also be
+ * freed.
+ *
+ * Returns: newly allocated table or NULL if insufficient memory.
+ **/
+EnvironTable *
+environ_table_copy (const void   *parent,
+		    char * const *env)
+{
+	EnvironTable *table;
+
+	table = nih_new (parent, EnvironTable);
+	if (! table)
+		return NULL;
+
+	table->env = environ_copy (table, &table->len, env);
+	if (! table->env)
+		goto error;
+
+	table->index = environ_index_new (table, table->env, table->len);
+	if (! table->index)
+		goto error;
+
+	return table;
+
+error:
+	nih_free (table);
+	return NULL;
+}
+
+/**
+ * environ_table_add:
+ * @table: environment table,
+ * @replace: TRUE if existing entry should be replaced,
+ * @str: string to add.
+ *
+ * Add the new environment variable @str to @table, either replacing an
+ * existing entry or appended to the end, following the same rules as
+ * environ_add().
+ *
+ * Returns: the new @env member of @table or NULL if insufficient memory.
+ **/
+char **
+environ_table_add (EnvironTable *table,
+		   int           replace,
+		   const char   *str)
+{
+	nih_assert (table != NULL);
+	nih_assert (str != NULL);
+
+	return environ_add_indexed (&table->env, table, &table->len,
+				    replace, str, table->index);
+}
+
+/**
+ * environ_table_append:
+ * @table: environment table,
+ * @replace: TRUE if existing entries should be replaced,
+ * @new_env: environment table to append to @table.
+ *
+ * Appends the entries in the environment table @new_env to @table, either
+ * replacing an existing entry or appended to the end, following the same
+ * rules as environ_append().
+ *
+ * Returns: the new @env member of @table or NULL if insufficient memory.
+ **/
+char **
+environ_table_append (EnvironTable *table,
+		      int           replace,
+		      char * const *new_env)
+{
+	nih_assert (table != NULL);
+
+	for (char * const *e = new_env; e && *e; e++)
+		if (! environ_table_add (table, replace, *e))
+			return NULL;
+
+	return table->env;
+}
+
+/**
+ * environ_table_set:
+ * @table: environment table,
+ * @replace: TRUE if existing entry should be replaced,
+ * @format: format string.
+ *
+ * Add the new environment variable specified by the format string
+ * @format to @table, either replacing an existing entry or appended to
+ * the end, following the same rules as environ_set().
+ *
+ * Returns: the new @env member of @table or NULL if insufficient memory.
+ **/
+char **
+environ_table_set (EnvironTable *table,
+		   int           replace,
+		   const char   *format,
+		   ...)
+{
+	nih_local char *str = NULL;
+	va_list         args;
+
+	nih_assert (table != NULL);
+	nih_assert (format != NULL);
+
+	va_start (args, format);
+	str = nih_vsprintf (NULL, format, args);
+	va_end (args);
+
+	if (! str)
+		return NULL;
+
+	return environ_table_add (table, replace, str);
+}
+
+/**
+ * environ_table_lookup:
+ * @table: environment table,
+ * @key: key to lookup,
+ * @len: length of @key.
+ *
+ * Lookup the environment variable named @key, which is @len characters
+ * long, in @table.
+ *
+ * Returns: pointer to entry in the @env member of @table or NULL if not
+ * found.
+ **/
+char * const *
+environ_table_lookup (EnvironTable *table,
+		      const char   *key,
+		      size_t        len)
+{
+	EnvironEntry *entry;
+
+	nih_assert (table != NULL);
+	nih_assert (key != NULL);
+
+	entry = environ_index_lookup (table->index, key, len);
+	if (! entry)
+		return NULL;
+
+	return table->env + entry->pos;
+}
+
+/**
+ * environ_table_get:
+ * @table: environment table,
+ * @key: key to lookup.
+ *
+ * Lookup the environment variable named @key in @table and return a
+ * pointer to the value.
+ *
+ * Returns: string from @table or NULL if not found.
+ **/
+const char *
+environ_table_get (EnvironTable *table,
+		   const char   *key)
+{
+	char * const *e;
+
+	nih_assert (table != NULL);
+	nih_assert (key != NULL);
+
+	e = environ_table_lookup (table, key, strlen (key));
+	if (! e)
+		return NULL;
+
+	return strchr (*e, '=') + 1;
+}
@@ -21,6 +21,98 @@
 #define INIT_ENVIRON_H
 
 #include <nih/macros.h>
+#include <nih/hash.h>
+
+
+/**
+ * ENVIRON_INDEX_THRESHOLD:
+ *
+ * Number of entries above which environ_append() builds a temporary hash
+ * of the table rather than scanning it for each new entry.
+ **/
+#define ENVIRON_INDEX_THRESHOLD 16
+
+
+/**
+ * EnvironTable:
+ * @env: NULL-terminated array of KEY=VALUE strings,
+ * @len: number of entries in @env,
+ * @index: hash of entries in @env by key.
+ *
+ * This structure is an environment table that keeps its entries in the
+ * order they were added, in the same NULL-terminated form as the ordinary
+ * tables handled by environ_add() and friends, while maintaining a hash
+ * of the keys so that adding, replacing and looking up entries doesn't
+ * require a scan of the whole table.
+ *
+ * @env may be passed directly to exec() or referenced by another object
+ * and used as an ordinary table after the EnvironTable is freed; it
+ * must not be modified except through the environ_table_*() functions
+ * while the EnvironTable is still in use.
+ **/
+typedef struct environ_table {
+	char    **env;
+	size_t    len;
+	NihHash  *index;
+} EnvironTable;
+
+
+/**
+ * EnvironTemplateOp:
+ *
+ * Type of each part of an EnvironTemplate; either literal text or one of
+ * the forms of variable reference understood by environ_expand().
+ **/
+typedef enum environ_template_op {
+	ENVIRON_TEMPLATE_LITERAL,
+	ENVIRON_TEMPLATE_VALUE,
+	ENVIRON_TEMPLATE_DEFAULT,
+	ENVIRON_TEMPLATE_ALTERNATE,
+} EnvironTemplateOp;
+
+typedef struct environ_template EnvironTemplate;
+
+/**
+ * EnvironTemplatePart:
+ * @op: type of part,
+ * @ignore_empty: TRUE if an empty value is treated as unset,
+ * @str: literal text or variable name,
+ * @len: length of @str,
+ * @name: template for a variable name containing references,
+ * @arg: template for the argument to a default or alternate expression.
+ *
+ * A part of an EnvironTemplate.  For ENVIRON_TEMPLATE_LITERAL parts, @str
+ * is the text to be copied; for the others it is the name of the variable
+ * referenced unless the name itself contains references, in which case
+ * @name is set instead.  @arg is NULL when there is no argument, or it
+ * is empty.
+ **/
+typedef struct environ_template_part {
+	EnvironTemplateOp  op;
+	int                ignore_empty;
+	const char        *str;
+	size_t             len;
+	EnvironTemplate   *name;
+	EnvironTemplate   *arg;
+} EnvironTemplatePart;
+
+/**
+ * EnvironTemplate:
+ * @string: string compiled,
+ * @parts: parts of the template,
+ * @num_parts: number of entries in @parts.
+ *
+ * A string containing variable references compiled by
+ * environ_template_new() into a sequence of literal text and references,
+ * which can be expanded with environ_template_expand() repeatedly without
+ * being parsed again.  The parts refer to the text of @string, which is
+ * only set for the outermost template.
+ **/
+struct environ_template {
+	char                *string;
+	EnvironTemplatePart *parts;
+	size_t               num_parts;
+};
 
 
 NIH_BEGIN_EXTERN
@@ -31,6 +123,9 @@ char **       environ_add       (char ***env, const void *parent, size_t *len,
 char **       environ_append    (char ***env, const void *parent, size_t *len,
 				 int replace, char * const *new_env)
 	__attribute__ ((warn_unused_result));
+char **       environ_copy      (const void *parent, size_t *len,
+				 char * const *env)
+	__attribute__ ((malloc, warn_unused_result));
 
 char **       environ_set       (char ***env, const void *parent, size_t *len,
 				 int replace, const char *format, ...)
@@ -50,6 +145,33 @@ char *        environ_expand    (const void *parent, const char *string,
 				 char * const *env)
 	__attribute__ ((malloc, warn_unused_result));
 
+EnvironTable *environ_table_new    (const void *parent, char * const *env)
+	__attribute__ ((malloc, warn_unused_result));
+EnvironTable *environ_table_copy   (const void *parent, char * const *env)
+	__attribute__ ((malloc, warn_unused_result));
+
+char **       environ_table_add    (EnvironTable *table, int replace,
+				    const char *str)
+	__attribute__ ((warn_unused_result));
+char **       environ_table_append (EnvironTable *table, int replace,
+				    char * const *new_env)
+	__attribute__ ((warn_unused_result));
+char **       environ_table_set    (EnvironTable *table, int replace,
+				    const char *format, ...)
+	__attribute__ ((warn_unused_result));
+
+char * const *environ_table_lookup (EnvironTable *table, const char *key,
+				    size_t len);
+const char *  environ_table_get    (EnvironTable *table, const char *key);
+
+EnvironTemplate *environ_template_new    (const void *parent,
+					  const char *string)
+	__attribute__ ((malloc, warn_unused_result));
+char *           environ_template_expand (const void *parent,
+					  const EnvironTemplate *template,
+					  char * const *env)
+	__attribute__ ((malloc, warn_unused_result));
+
 NIH_END_EXTERN
 
 #endif /* INIT_ENVIRON_H */
@@ -45,14 +45,20 @@ enum {
 	PARSE_ILLEGAL_NICE,
 	PARSE_ILLEGAL_OOM,
 	PARSE_ILLEGAL_LIMIT,
+	PARSE_ILLEGAL_CGROUP,
+	PARSE_ILLEGAL_MULTIPLIER,
 	PARSE_EXPECTED_EVENT,
 	PARSE_EXPECTED_OPERATOR,
 	PARSE_EXPECTED_VARIABLE,
 	PARSE_MISMATCHED_PARENS,
+	PARSE_ILLEGAL_PRIORITY,
 
 	/* Errors while handling control requests */
 	CONTROL_NAME_TAKEN,
 
+	/* Errors while restoring state */
+	STATE_INVALID,
+
 	/* SELinux handling errors */
 	SELINUX_POLICY_LOAD_FAIL,
 };
@@ -70,11 +76,15 @@ enum {
 #define PARSE_ILLEGAL_OOM_STR		N_("Illegal oom adjustment, expected -16 to 15 or 'never'")
 #define PARSE_ILLEGAL_OOM_SCORE_STR	N_("Illegal oom score adjustment, expected -999 to 1000 or 'never'")
 #define PARSE_ILLEGAL_LIMIT_STR		N_("Illegal limit, expected 'unlimited' or integer")
+#define PARSE_ILLEGAL_CGROUP_STR	N_("Illegal control group setting")
+#define PARSE_ILLEGAL_MULTIPLIER_STR	N_("Illegal multiplier, expected positive integer")
 #define PARSE_EXPECTED_EVENT_STR	N_("Expected event")
 #define PARSE_EXPECTED_OPERATOR_STR	N_("Expected operator")
 #define PARSE_EXPECTED_VARIABLE_STR	N_("Expected variable name before value")
 #define PARSE_MISMATCHED_PARENS_STR	N_("Mismatched parentheses")
+#define PARSE_ILLEGAL_PRIORITY_STR	N_("Illegal priority, expected 'high', 'normal' or 'low'")
 #define CONTROL_NAME_TAKEN_STR		N_("Name already taken")
+#define STATE_INVALID_STR		N_("Invalid or incompatible state")
 #define SELINUX_POLICY_LOAD_FAIL_STR	N_("Failed to load SELinux policy while in enforcing mode")
 
 #endif /* INIT_ERRORS_H */
@@ -24,7 +24,10 @@
 #endif /* HAVE_CONFIG_H */
 
 
+#include <errno.h>
+#include <stdint.h>
 #include <string.h>
+#include <fnmatch.h>
 #include <unistd.h>
 
 #include <nih/macros.h>
@@ -39,17 +42,46 @@
 #include "dbus/upstart.h"
 
 #include "environ.h"
+#include "hash.h"
+#include "intern.h"
 #include "event.h"
 #include "job.h"
 #include "blocked.h"
+#include "shutdown.h"
+#include "runlevel.h"
+#include "events.h"
 #include "errors.h"
 
 #include "com.ubuntu.Upstart.h"
 
 
+/**
+ * EventSource:
+ * @entry: list header,
+ * @source: D-Bus connection,
+ * @queued: number of pending events from @source.
+ *
+ * Entries in the event_sources hash, which exist only while @queued is
+ * non-zero.
+ **/
+typedef struct event_source {
+	NihList     entry;
+	const void *source;
+	size_t      queued;
+} EventSource;
+
+
 /* Prototypes for static functions */
+static int  event_destroy              (Event *event);
+static void event_unqueue              (Event *event);
+static const void *event_source_key    (NihList *entry);
+static uint32_t event_source_hash      (const void *key);
+static int  event_source_cmp           (const void *key1, const void *key2);
+static int  event_poll_admit           (Event *event, const void ***sources,
+					size_t **counts, size_t *num_sources);
 static void event_pending              (Event *event);
 static void event_pending_handle_jobs  (Event *event);
+static void event_pending_stop_jobs    (Event *event, JobClass *class);
 static void event_finished             (Event *event);
 
 
@@ -61,17 +93,120 @@ static void event_finished             (Event *event);
  **/
 NihList *events = NULL;
 
+/**
+ * event_priority_rules:
+ *
+ * This list holds the rules read from the init.conf file that assign
+ * priorities to events by name; each item is an EventPriorityRule
+ * structure.  Later rules take precedence over earlier ones.
+ **/
+NihList *event_priority_rules = NULL;
+
+/**
+ * event_coalesce_rules:
+ *
+ * This list holds the rules read from the init.conf file naming events
+ * that are coalesced when emitted again while still pending; each item is
+ * an EventCoalesceRule structure.
+ **/
+NihList *event_coalesce_rules = NULL;
+
+/**
+ * event_source_limit:
+ *
+ * Number of pending events from a single D-Bus connection that are handled
+ * each time the queue is polled, so that a client emitting a burst of events
+ * cannot hold up the events of others or those queued by jobs.  Zero
+ * disables the limit.
+ **/
+int event_source_limit = EVENT_SOURCE_LIMIT;
+
+/**
+ * event_max_queued:
+ *
+ * Maximum number of events from D-Bus connections that may be pending at
+ * once, beyond which further events are refused; zero removes the limit.
+ **/
+int event_max_queued = EVENT_MAX_QUEUED;
+
+/**
+ * event_max_queued_source:
+ *
+ * Maximum number of events from a single D-Bus connection that may be
+ * pending at once, beyond which further events from it are refused; zero
+ * removes the limit.
+ **/
+int event_max_queued_source = EVENT_MAX_QUEUED_SOURCE;
+
+/**
+ * event_priority_defaults:
+ *
+ * Events that are given a high priority unless a rule in init.conf says
+ * otherwise; these are the events that jobs and the system administrator
+ * are waiting on.
+ **/
+static const char * const event_priority_defaults[] = {
+	JOB_STARTING_EVENT,
+	JOB_STARTED_EVENT,
+	JOB_STOPPING_EVENT,
+	JOB_STOPPED_EVENT,
+	STARTUP_EVENT,
+	CTRLALTDEL_EVENT,
+	KBDREQUEST_EVENT,
+	PWRSTATUS_EVENT,
+	RUNLEVEL_EVENT,
+	NULL,
+};
+
+/**
+ * event_sources:
+ *
+ * Number of events pending from each D-Bus connection with any, so that
+ * event_queue_full() needn't count them; each entry is an EventSource.
+ **/
+static NihHash *event_sources = NULL;
+
+/**
+ * events_queued:
+ *
+ * Number of events pending from D-Bus connections as a whole.
+ **/
+static size_t events_queued = 0;
+
+/**
+ * events_repoll:
+ *
+ * Set when an event that event_poll() has already passed over needs to be
+ * looked at again; either because event_unblock() released its last
+ * blocker, or because event_new() queued it with a higher priority than
+ * the pending events currently being handled.
+ **/
+static int events_repoll = FALSE;
+
+/**
+ * events_sweep:
+ *
+ * Priority of the pending events currently being handled by event_poll().
+ **/
+static EventPriority events_sweep = EVENT_PRIORITY_HIGH;
+
 
 /**
  * event_init:
  *
- * Initialise the event list.
+ * Initialise the event, priority rule and coalesce rule lists.
  **/
 void
 event_init (void)
 {
 	if (! events)
 		events = NIH_MUST (nih_list_new (NULL));
+
+	if (! event_priority_rules)
+		event_priority_rules = NIH_MUST (nih_list_new (NULL));
+
+	if (! event_coalesce_rules)
+		event_coalesce_rules = NIH_MUST (nih_list_new (NULL));
 }
 
 
@@ -124,7 +259,12 @@ event_new (const void  *parent,
 
 	nih_list_init (&event->entry);
 
-	event->fd = -1;
+	event->fds = NULL;
+	event->fd_names = NULL;
+	event->num_fds = 0;
+
+	event->source = NULL;
+	event->queued = FALSE;
 
 	event->progress = EVENT_PENDING;
 	event->failed = FALSE;
@@ -132,11 +272,11 @@ event_new (const void  *parent,
 	event->blockers = 0;
 	nih_list_init (&event->blocking);
 
-	nih_alloc_set_destructor (event, nih_list_destroy);
+	nih_alloc_set_destructor (event, event_destroy);
 
 
 	/* Fill in the event details */
-	event->name = nih_strdup (event, name);
+	event->name = intern_string (event, name);
 	if (! event->name) {
 		nih_free (event);
 		return NULL;
@@ -146,16 +286,267 @@ event_new (const void  *parent,
 	if (event->env)
 		nih_ref (event->env, event);
 
+	event->priority = event_priority (event->name);
+
 
-	/* Place it in the pending list */
+	/* Place it in the pending list; if we're in the middle of handling
+	 * lower priority events, make sure we come back for it.
+	 */
 	nih_debug ("Pending %s event", name);
 	nih_list_add (events, &event->entry);
 
+	if (event->priority < events_sweep)
+		events_repoll = TRUE;
+
 	nih_main_loop_interrupt ();
 
 	return event;
 }
 
+/**
+ * event_destroy:
+ * @event: event to be destroyed.
+ *
+ * Removes @event from the events list and, should it still be pending,
+ * from the count of events pending from its source.
+ *
+ * Normally used or called from an nih_alloc() destructor so that the list
+ * item is automatically removed from its containing list when freed.
+ *
+ * Returns: zero.
+ **/
+static int
+event_destroy (Event *event)
+{
+	nih_assert (event != NULL);
+
+	event_unqueue (event);
+
+	nih_list_destroy (&event->entry);
+
+	return 0;
+}
+
+/**
+ * event_set_source:
+ * @event: pending event,
+ * @source: D-Bus connection that emitted it.
+ *
+ * Records that the pending @event was emitted by @source, counting it
+ * against the events that @source, and D-Bus connections as a whole, may
+ * have pending until it is handled.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+event_set_source (Event      *event,
+		  const void *source)
+{
+	EventSource *entry;
+
+	nih_assert (event != NULL);
+	nih_assert (source != NULL);
+	nih_assert (event->source == NULL);
+	nih_assert (event->progress == EVENT_PENDING);
+
+	entry = (event_sources
+		 ? (EventSource *)nih_hash_search (event_sources, source, NULL)
+		 : NULL);
+	if (! entry) {
+		if (! event_sources) {
+			event_sources = nih_hash_new (NULL, 0,
+						      event_source_key,
+						      event_source_hash,
+						      event_source_cmp);
+			if (! event_sources)
+				return -1;
+		}
+
+		entry = nih_new (NULL, EventSource);
+		if (! entry)
+			return -1;
+
+		nih_list_init (&entry->entry);
+		nih_alloc_set_destructor (entry, nih_list_destroy);
+
+		entry->source = source;
+		entry->queued = 0;
+
+		hash_add (NULL, &event_sources, &entry->entry);
+	}
+
+	entry->queued++;
+	events_queued++;
+
+	event->source = source;
+	event->queued = TRUE;
+
+	return 0;
+}
+
+/**
+ * event_forget_source:
+ * @source: D-Bus connection that has gone away.
+ *
+ * Called when the D-Bus connection @source is disconnected, before it is
+ * freed and its address could be reused by a new connection.  Events it
+ * emitted are kept, but treated as though queued internally from now on,
+ * so that the new connection isn't charged for them.
+ **/
+void
+event_forget_source (const void *source)
+{
+	nih_assert (source != NULL);
+
+	event_init ();
+
+	NIH_LIST_FOREACH (events, iter) {
+		Event *event = (Event *)iter;
+
+		if (event->source != source)
+			continue;
+
+		event_unqueue (event);
+		event->source = NULL;
+	}
+}
+
+/**
+ * event_unqueue:
+ * @event: event leaving the pending state.
+ *
+ * Removes @event from the count of events pending from its source, if it
+ * was counted.
+ **/
+static void
+event_unqueue (Event *event)
+{
+	EventSource *entry;
+
+	nih_assert (event != NULL);
+
+	if (! event->queued)
+		return;
+
+	event->queued = FALSE;
+
+	nih_assert (events_queued > 0);
+	events_queued--;
+
+	entry = (EventSource *)nih_hash_search (event_sources,
+						event->source, NULL);
+	nih_assert (entry != NULL);
+	nih_assert (entry->queued > 0);
+
+	if (! --entry->queued)
+		nih_free (entry);
+}
+
+/**
+ * event_source_key:
+ * @entry: hash entry.
+ *
+ * Returns: D-Bus connection of @entry, which is compared by
+ * event_source_hash() and event_source_cmp().
+ **/
+static const void *
+event_source_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return ((EventSource *)entry)->source;
+}
+
+/**
+ * event_source_hash:
+ * @key: D-Bus connection.
+ *
+ * The connection is never dereferenced, so its address is hashed; the
+ * low bits are discarded since they are the same for every allocation.
+ *
+ * Returns: hash value.
+ **/
+static uint32_t
+event_source_hash (const void *key)
+{
+	nih_assert (key != NULL);
+
+	return (uint32_t)((uintptr_t)key >> 4);
+}
+
+/**
+ * event_source_cmp:
+ * @key1: D-Bus connection,
+ * @key2: D-Bus connection.
+ *
+ * Returns: zero if the connections are the same, non-zero otherwise.
+ **/
+static int
+event_source_cmp (const void *key1,
+		  const void *key2)
+{
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	return (key1 != key2);
+}
+
+
+/**
+ * event_add_fd:
+ * @event: event to add to,
+ * @fd: file descriptor to pass,
+ * @name: name of @fd.
+ *
+ * Attaches the open file descriptor @fd to @event under @name, which must
+ * be a non-empty string without whitespace so that it can be listed in
+ * the environment of the job processes; if @name is NULL, the name of
+ * the event is used instead.
+ *
+ * Ownership of @fd passes to @event, it will be closed once the event
+ * has finished; on error the caller retains ownership.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+event_add_fd (Event      *event,
+	      int         fd,
+	      const char *name)
+{
+	int    *fds;
+	size_t  len;
+
+	nih_assert (event != NULL);
+	nih_assert (fd >= 0);
+
+	if (! name)
+		name = event->name;
+
+	nih_assert (*name);
+	nih_assert (! strpbrk (name, " \t\r\n"));
+
+	fds = nih_realloc (event->fds, event,
+			   sizeof (int) * (event->num_fds + 1));
+	if (! fds)
+		return -1;
+
+	event->fds = fds;
+
+	if (! event->fd_names) {
+		event->fd_names = nih_str_array_new (event);
+		if (! event->fd_names)
+			return -1;
+	}
+
+	len = event->num_fds;
+	if (! nih_str_array_add (&event->fd_names, event, &len, name))
+		return -1;
+
+	event->fds[event->num_fds++] = fd;
+
+	return 0;
+}
+
 
 /**
  * event_block:
@@ -191,6 +582,297 @@ event_unblock (Event *event)
 	nih_assert (event->blockers > 0);
 
 	event->blockers--;
+
+	if (! event->blockers)
+		events_repoll = TRUE;
+}
+
+/**
+ * event_queue_full:
+ * @source: D-Bus connection wishing to emit an event.
+ *
+ * Checks whether another event may be queued for @source, which should be
+ * refused if either @source or D-Bus connections as a whole already have
+ * the maximum number of events pending.  Events queued internally are not
+ * counted, and are never refused.
+ *
+ * The events pending are counted as event_set_source() records them and
+ * as they are handled, so this need not walk the queue.
+ *
+ * Returns: TRUE if the queue is full for @source, FALSE otherwise.
+ **/
+int
+event_queue_full (const void *source)
+{
+	EventSource *entry;
+
+	nih_assert (source != NULL);
+
+	if ((event_max_queued > 0)
+	    && (events_queued >= (size_t)event_max_queued))
+		return TRUE;
+
+	if (event_max_queued_source <= 0)
+		return FALSE;
+
+	entry = (event_sources
+		 ? (EventSource *)nih_hash_search (event_sources, source, NULL)
+		 : NULL);
+	if (entry && (entry->queued >= (size_t)event_max_queued_source))
+		return TRUE;
+
+	return FALSE;
+}
+
+
+/**
+ * event_priority_rule_new:
+ * @parent: parent object for new rule,
+ * @pattern: pattern to match event names against,
+ * @priority: priority of matching events.
+ *
+ * Allocates and returns a new EventPriorityRule structure giving events
+ * whose name matches @pattern the @priority given, appending it to the
+ * event_priority_rules list.
+ *
+ * The rule is removed from the list when freed, so should normally be
+ * parented to the configuration file it was read from.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned rule.  When all parents
+ * of the returned rule are freed, the returned rule will also be
+ * freed.
+ *
+ * Returns: newly allocated rule or NULL if insufficient memory.
+ **/
+EventPriorityRule *
+event_priority_rule_new (const void    *parent,
+			 const char    *pattern,
+			 EventPriority  priority)
+{
+	EventPriorityRule *rule;
+
+	nih_assert (pattern != NULL);
+	nih_assert (priority < EVENT_NUM_PRIORITIES);
+
+	event_init ();
+
+	rule = nih_new (parent, EventPriorityRule);
+	if (! rule)
+		return NULL;
+
+	nih_list_init (&rule->entry);
+
+	nih_alloc_set_destructor (rule, nih_list_destroy);
+
+	rule->pattern = nih_strdup (rule, pattern);
+	if (! rule->pattern) {
+		nih_free (rule);
+		return NULL;
+	}
+
+	rule->priority = priority;
+
+	nih_list_add (event_priority_rules, &rule->entry);
+
+	return rule;
+}
+
+/**
+ * event_priority:
+ * @name: name of event.
+ *
+ * Determines the priority of events named @name; the last rule in
+ * event_priority_rules whose pattern matches @name is used, otherwise
+ * events that jobs and the system are waiting on are given a high
+ * priority and any others a normal priority.
+ *
+ * Returns: priority of @name.
+ **/
+EventPriority
+event_priority (const char *name)
+{
+	EventPriorityRule *match = NULL;
+
+	nih_assert (name != NULL);
+
+	if (event_priority_rules) {
+		NIH_LIST_FOREACH (event_priority_rules, iter) {
+			EventPriorityRule *rule = (EventPriorityRule *)iter;
+
+			if (! fnmatch (rule->pattern, name, 0))
+				match = rule;
+		}
+	}
+
+	if (match)
+		return match->priority;
+
+	for (const char * const *def = event_priority_defaults; *def; def++)
+		if (! strcmp (*def, name))
+			return EVENT_PRIORITY_HIGH;
+
+	return EVENT_PRIORITY_NORMAL;
+}
+
+/**
+ * event_priority_name:
+ * @priority: priority to convert.
+ *
+ * Converts an enumerated event priority into the string used in the
+ * configuration and for logging purposes.
+ *
+ * Returns: static string or NULL if priority not known.
+ **/
+const char *
+event_priority_name (EventPriority priority)
+{
+	switch (priority) {
+	case EVENT_PRIORITY_HIGH:
+		return N_("high");
+	case EVENT_PRIORITY_NORMAL:
+		return N_("normal");
+	case EVENT_PRIORITY_LOW:
+		return N_("low");
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * event_priority_from_name:
+ * @priority: priority to convert.
+ *
+ * Converts an event priority string into the enumeration.
+ *
+ * Returns: enumerated priority or -1 if not known.
+ **/
+EventPriority
+event_priority_from_name (const char *priority)
+{
+	nih_assert (priority != NULL);
+
+	if (! strcmp (priority, "high")) {
+		return EVENT_PRIORITY_HIGH;
+	} else if (! strcmp (priority, "normal")) {
+		return EVENT_PRIORITY_NORMAL;
+	} else if (! strcmp (priority, "low")) {
+		return EVENT_PRIORITY_LOW;
+	} else {
+		return -1;
+	}
+}
+
+/**
+ * event_coalesce_rule_new:
+ * @parent: parent object for new rule,
+ * @pattern: pattern to match event names against.
+ *
+ * Allocates and returns a new EventCoalesceRule structure for events whose
+ * name matches @pattern, appending it to the event_coalesce_rules list.
+ *
+ * The rule is removed from the list when freed, so should normally be
+ * parented to the configuration file it was read from.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned rule.  When all parents
+ * of the returned rule are freed, the returned rule will also be
+ * freed.
+ *
+ * Returns: newly allocated rule or NULL if insufficient memory.
+ **/
+EventCoalesceRule *
+event_coalesce_rule_new (const void *parent,
+			 const char *pattern)
+{
+	EventCoalesceRule *rule;
+
+	nih_assert (pattern != NULL);
+
+	event_init ();
+
+	rule = nih_new (parent, EventCoalesceRule);
+	if (! rule)
+		return NULL;
+
+	nih_list_init (&rule->entry);
+
+	nih_alloc_set_destructor (rule, nih_list_destroy);
+
+	rule->pattern = nih_strdup (rule, pattern);
+	if (! rule->pattern) {
+		nih_free (rule);
+		return NULL;
+	}
+
+	nih_list_add (event_coalesce_rules, &rule->entry);
+
+	return rule;
+}
+
+/**
+ * event_coalesce:
+ * @name: name of event to emit,
+ * @env: NULL-terminated array of environment variables for event.
+ *
+ * Looks for a pending event that an emission of @name with @env can be
+ * folded into, rather than queuing another identical event; this is only
+ * done when a rule in event_coalesce_rules matches @name.
+ *
+ * The event found must have been emitted by a client rather than queued
+ * internally, have exactly the same environment, in the same order, and
+ * carry no file descriptors.  Anything waiting on the new emission should
+ * block on the returned event instead.
+ *
+ * Returns: existing pending event, or NULL if a new one should be queued.
+ **/
+Event *
+event_coalesce (const char   *name,
+		char * const *env)
+{
+	int coalesce = FALSE;
+
+	nih_assert (name != NULL);
+
+	event_init ();
+
+	NIH_LIST_FOREACH (event_coalesce_rules, iter) {
+		EventCoalesceRule *rule = (EventCoalesceRule *)iter;
+
+		if (! fnmatch (rule->pattern, name, 0)) {
+			coalesce = TRUE;
+			break;
+		}
+	}
+
+	if (! coalesce)
+		return NULL;
+
+	NIH_LIST_FOREACH (events, iter) {
+		Event        *event = (Event *)iter;
+		char * const *e1;
+		char * const *e2;
+
+		if ((event->progress != EVENT_PENDING)
+		    || (! event->source)
+		    || event->num_fds
+		    || strcmp (event->name, name))
+			continue;
+
+		e1 = event->env;
+		e2 = env;
+		while (e1 && *e1 && e2 && *e2 && (! strcmp (*e1, *e2))) {
+			e1++;
+			e2++;
+		}
+
+		if (((! e1) || (! *e1)) && ((! e2) || (! *e2))) {
+			nih_debug ("Coalesced %s event", name);
+			return event;
+		}
+	}
+
+	return NULL;
 }
 
 
@@ -206,53 +888,157 @@ event_unblock (Event *event)
  *
  * This function will only return once the events list is empty, or all
  * events are in the handling state; so any time an event queues another,
- * it will be processed immediately.
+ * it will be processed immediately.  Since new events are always added
+ * to the end of the list, they are handled in the same sweep as the event
+ * that queued them; the list is only swept again when an event we've
+ * already passed over has been unblocked, or a higher priority one queued.
+ *
+ * Pending events are handled in order of priority, and no more than
+ * event_source_limit from any one D-Bus connection are handled each time;
+ * the remainder are left pending for the next time through the main loop.
  *
  * Normally this function is used as a main loop callback.
  **/
 void
 event_poll (void)
 {
-	int poll_again;
+	nih_local const void **sources = NULL;
+	nih_local size_t      *counts = NULL;
+	size_t                 num_sources = 0;
+	size_t                 handled[EVENT_NUM_PRIORITIES] = { 0 };
+	size_t                 deferred[EVENT_NUM_PRIORITIES] = { 0 };
 
 	event_init ();
 
 	do {
-		poll_again = FALSE;
-
-		NIH_LIST_FOREACH_SAFE (events, iter) {
-			Event *event = (Event *)iter;
-
-			/* Ignore events that we're handling and are
-			 * blocked, there's nothing we can do to hurry them.
-			 *
-			 * Decide whether to poll again based on the state
-			 * before handling the event; that way we always loop
-			 * at least once more after finding a pending or
-			 * finished event, in case they added new events as
-			 * a side effect that we missed.
-			 */
-			switch (event->progress) {
-			case EVENT_PENDING:
-				event_pending (event);
-				poll_again = TRUE;
-
-				/* fall through */
-			case EVENT_HANDLING:
-				if (event->blockers)
+		events_repoll = FALSE;
+
+		for (events_sweep = EVENT_PRIORITY_HIGH;
+		     events_sweep < EVENT_NUM_PRIORITIES; events_sweep++) {
+			NIH_LIST_FOREACH_SAFE (events, iter) {
+				Event *event = (Event *)iter;
+
+				/* Ignore events that we're handling and are
+				 * blocked, there's nothing we can do to hurry
+				 * them; and pending events of other priorities
+				 * or whose source has had its share.
+				 */
+				switch (event->progress) {
+				case EVENT_PENDING:
+					if (event->priority != events_sweep)
+						break;
+
+					if (! event_poll_admit (event, &sources,
+								&counts,
+								&num_sources)) {
+						deferred[event->priority]++;
+						break;
+					}
+
+					handled[event->priority]++;
+					event_pending (event);
+
+					/* fall through */
+				case EVENT_HANDLING:
+					if (event->blockers)
+						break;
+
+					event->progress = EVENT_FINISHED;
+					/* fall through */
+				case EVENT_FINISHED:
+					event_finished (event);
 					break;
-
-				event->progress = EVENT_FINISHED;
-				/* fall through */
-			case EVENT_FINISHED:
-				event_finished (event);
-				poll_again = TRUE;
-				break;
-			default:
-				nih_assert_not_reached ();
+				default:
+					nih_assert_not_reached ();
+				}
 			}
 		}
-	} while (poll_again);
+	} while (events_repoll);
+
+	events_sweep = EVENT_PRIORITY_HIGH;
+
+	if (handled[EVENT_PRIORITY_HIGH] || handled[EVENT_PRIORITY_NORMAL]
+	    || handled[EVENT_PRIORITY_LOW])
+		nih_debug ("Handled %zu high, %zu normal and %zu low "
+			   "priority events",
+			   handled[EVENT_PRIORITY_HIGH],
+			   handled[EVENT_PRIORITY_NORMAL],
+			   handled[EVENT_PRIORITY_LOW]);
+
+	/* Deferred events are counted again each time they're passed over,
+	 * so report what's actually left rather than the totals.
+	 */
+	if (deferred[EVENT_PRIORITY_HIGH] || deferred[EVENT_PRIORITY_NORMAL]
+	    || deferred[EVENT_PRIORITY_LOW]) {
+		size_t depth[EVENT_NUM_PRIORITIES] = { 0 };
+
+		NIH_LIST_FOREACH (events, iter) {
+			Event *event = (Event *)iter;
+
+			if (event->progress == EVENT_PENDING)
+				depth[event->priority]++;
+		}
+
+		nih_debug ("Deferred %zu high, %zu normal and %zu low "
+			   "priority events",
+			   depth[EVENT_PRIORITY_HIGH],
+			   depth[EVENT_PRIORITY_NORMAL],
+			   depth[EVENT_PRIORITY_LOW]);
+
+		nih_main_loop_interrupt ();
+	}
+}
+
+/**
+ * event_poll_admit:
+ * @event: pending event,
+ * @sources: pointer to array of sources seen,
+ * @counts: pointer to array of events handled from each of @sources,
+ * @num_sources: number of entries in @sources and @counts.
+ *
+ * Decides whether the pending @event may be handled in this call to
+ * event_poll(), counting it against the share of its source.  Events
+ * queued internally are always handled.
+ *
+ * Returns: TRUE if @event may be handled, FALSE if it should be deferred.
+ **/
+static int
+event_poll_admit (Event         *event,
+		  const void  ***sources,
+		  size_t       **counts,
+		  size_t        *num_sources)
+{
+	size_t i;
+
+	nih_assert (event != NULL);
+	nih_assert (sources != NULL);
+	nih_assert (counts != NULL);
+	nih_assert (num_sources != NULL);
+
+	if ((! event->source) || (event_source_limit <= 0))
+		return TRUE;
+
+	for (i = 0; i < *num_sources; i++)
+		if ((*sources)[i] == event->source)
+			break;
+
+	if (i == *num_sources) {
+		*sources = NIH_MUST (nih_realloc (*sources, NULL,
+						  sizeof (const void *) * (i + 1)));
+		*counts = NIH_MUST (nih_realloc (*counts, NULL,
+						 sizeof (size_t) * (i + 1)));
+
+		(*sources)[i] = event->source;
+		(*counts)[i] = 0;
+		(*num_sources)++;
+	}
+
+	if ((*counts)[i] >= (size_t)event_source_limit)
+		return FALSE;
+
+	(*counts)[i]++;
+
+	return TRUE;
 }
 
 
@@ -275,13 +1061,26 @@ event_pending (Event *event)
 
 	nih_info (_("Handling %s event"), event->name);
 	event->progress = EVENT_HANDLING;
+	event_unqueue (event);
 
 	event_pending_handle_jobs (event);
+
+	/* Keep track of the runlevel so it can be queried without going
+	 * to utmp.
+	 */
+	runlevel_event (event);
+
+	/* Once the jobs waiting for a shutdown have reacted to it, stop
+	 * the remaining independent jobs together.
+	 */
+	if (shutdown_event (event))
+		shutdown_begin ();
 }
 
 /**
  * event_environment_init
  * @root: event context
+ * @state: state of @root, or NULL
  * @class: job class
  * @env: environment to construct
  * @parent: Parent for @env allocations
@@ -295,18 +1094,19 @@ event_pending (Event *event)
  * environment.
  **/
 static void
-event_environment_init (EventOperator *root,
-			JobClass      *class,
-			char        ***env,
-			void          *parent,
-			size_t        *len,
-			const char    *event_list_key) {
+event_environment_init (EventOperator      *root,
+			EventOperatorState *state,
+			JobClass           *class,
+			char             ***env,
+			void               *parent,
+			size_t             *len,
+			const char         *event_list_key) {
 	nih_local char **event_op_env = NULL;
 	size_t event_op_env_len = 0;
 	char *const *event_list = NULL;
 	char **e = NULL;
 
-	NIH_MUST (event_operator_environment (root, &event_op_env, NULL,
+	NIH_MUST (event_operator_environment (root, state, &event_op_env, NULL,
 					      &event_op_env_len,
 					      event_list_key));
 
@@ -347,70 +1147,41 @@ event_pending_handle_jobs (Event *event)
 		 * a process's start and stop scripts to be run without the
 		 * actual process).
 		 */
-		NIH_HASH_FOREACH_SAFE (class->instances, job_iter) {
-			Job *job = (Job *)job_iter;
-
-			if (job->stop_on
-			    && event_operator_handle (job->stop_on, event,
-						      job->env)
-			    && job->stop_on->value) {
-				if (job->goal != JOB_STOP) {
-					size_t len = 0;
-
-					if (job->stop_env)
-						nih_unref (job->stop_env, job);
-					job->stop_env = NULL;
-
-					/* Collect environment that stopped
-					 * the job for the pre-stop script;
-					 * it can make a more informed
-					 * decision whether the stop is valid.
-					 * We don't add class environment
-					 * since this is appended to the
-					 * existing job environment.
-					 */
-					event_environment_init (
-						job->stop_on, class,
-						&job->stop_env, job, &len,
-						"UPSTART_STOP_EVENTS");
-
-					job_finished (job, FALSE);
-
-					event_operator_events (
-						job->stop_on,
-						job, &job->blocking);
-
-					job_change_goal (job, JOB_STOP);
-				}
-
-				event_operator_reset (job->stop_on);
-			}
-
-		}
+		event_pending_stop_jobs (event, class);
 
 		/* Now we match the start events for the class to see
 		 * whether we need a new instance.
 		 */
 		if (class->start_on
-		    && event_operator_handle (class->start_on, event, NULL)
+		    && event_operator_handle (class->start_on, NULL,
+					      event, NULL)
 		    && class->start_on->value) {
 			nih_local char **env = NULL;
 			nih_local char  *name = NULL;
 			size_t           len;
 			Job             *job;
 
+			/* Complete the definition of the class if it was
+			 * deferred, the error has already been logged when
+			 * that fails.
+			 */
+			if (job_class_materialise (class) < 0) {
+				event_operator_reset (class->start_on, NULL);
+				continue;
+			}
+
 			/* Construct the environment for the new instance
 			 * from the class and the start events.
 			 */
 			env = NIH_MUST (job_class_environment (
 					  NULL, class, &len));
-			event_environment_init (class->start_on, class, &env,
-						NULL, &len, "UPSTART_EVENTS");
+			event_environment_init (class->start_on, NULL, class,
+						&env, NULL, &len,
+						"UPSTART_EVENTS");
 
 			/* Expand the instance name against the environment */
-			name = NIH_SHOULD (environ_expand (NULL,
-							   class->instance,
-							   env));
+			name = NIH_SHOULD (job_class_expand_instance (
+						   NULL, class, env));
 			if (! name) {
 				NihError *err;
 
@@ -419,7 +1190,7 @@ event_pending_handle_jobs (Event *event)
 					  class->name, err->message);
 				nih_free (err);
 
-				event_operator_reset (class->start_on);
+				event_operator_reset (class->start_on, NULL);
 				continue;
 			}
 
@@ -443,19 +1214,100 @@ event_pending_handle_jobs (Event *event)
 
 				job_finished (job, FALSE);
 
-				NIH_MUST (event_operator_fds (class->start_on, job,
-							      &job->fds, &job->num_fds,
-							      &job->start_env, &len,
-							      "UPSTART_FDS"));
+				/* Take our own copies of any file descriptors
+				 * passed with the events, replacing those we
+				 * had from the last time the job was started.
+				 */
+				job_close_fds (job);
+				while (event_operator_fds (class->start_on, NULL,
+							   job, &job->fds,
+							   &job->fd_names,
+							   &job->num_fds) < 0) {
+					NihError *err;
+
+					err = nih_error_get ();
+					if (err->number != ENOMEM) {
+						nih_warn (_("Failed to pass file descriptors to %s: %s"),
+							  job_name (job), err->message);
+						nih_free (err);
+						break;
+					}
+					nih_free (err);
+				}
 
 				event_operator_events (job->class->start_on,
-						       job, &job->blocking);
+						       NULL, job,
+						       &job->blocking);
 
 				job_change_goal (job, JOB_START);
 			}
 
-			event_operator_reset (class->start_on);
+			event_operator_reset (class->start_on, NULL);
+		}
+	}
+}
+
+/**
+ * event_pending_stop_jobs:
+ * @event: event to be handled,
+ * @class: class of jobs to check.
+ *
+ * Matches @event against the stop on expression of each instance of
+ * @class, stopping those for which it becomes true.
+ *
+ * The instances share the class's expression, so when no part of it
+ * names @event none of them can be affected and the instances are not
+ * visited at all; thus classes with many instances only cost time for
+ * the events they might stop on.
+ **/
+static void
+event_pending_stop_jobs (Event    *event,
+			 JobClass *class)
+{
+	nih_assert (event != NULL);
+	nih_assert (class != NULL);
+
+	if (! class->stop_on)
+		return;
+
+	if (! event_operator_can_match (class->stop_on, event))
+		return;
+
+	NIH_HASH_FOREACH_SAFE (class->instances, iter) {
+		Job *job = (Job *)iter;
+
+		if (! (job->stop_on
+		       && event_operator_handle (class->stop_on, job->stop_on,
+						 event, job->env)
+		       && EVENT_OPERATOR_VALUE (class->stop_on, job->stop_on)))
+			continue;
+
+		if (job->goal != JOB_STOP) {
+			size_t len = 0;
+
+			if (job->stop_env)
+				nih_unref (job->stop_env, job);
+			job->stop_env = NULL;
+
+			/* Collect environment that stopped the job for the
+			 * pre-stop script; it can make a more informed
+			 * decision whether the stop is valid.  We don't add
+			 * class environment since this is appended to the
+			 * existing job environment.
+			 */
+			event_environment_init (class->stop_on, job->stop_on,
+						class, &job->stop_env, job,
+						&len, "UPSTART_STOP_EVENTS");
+
+			job_finished (job, FALSE);
+
+			event_operator_events (class->stop_on, job->stop_on,
+					       job, &job->blocking);
+
+			job_change_goal (job, JOB_STOP);
 		}
+
+		event_operator_reset (class->stop_on, job->stop_on);
 	}
 }
 
@@ -512,7 +1364,8 @@ event_finished (Event *event)
 		nih_free  (blocked);
 	}
 
-	close (event->fd);
+	for (size_t i = 0; i < event->num_fds; i++)
+		close (event->fds[i]);
 
 	if (event->failed) {
 		char *name;
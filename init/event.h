@@ -37,11 +37,61 @@ typedef enum event_progress {
 	EVENT_FINISHED
 } EventProgress;
 
+/**
+ * EventPriority:
+ *
+ * Pending events are handled in order of their priority, highest first,
+ * and then in the order they were queued.
+ **/
+typedef enum event_priority {
+	EVENT_PRIORITY_HIGH,
+	EVENT_PRIORITY_NORMAL,
+	EVENT_PRIORITY_LOW
+} EventPriority;
+
+/**
+ * EVENT_NUM_PRIORITIES:
+ *
+ * Number of entries in EventPriority.
+ **/
+#define EVENT_NUM_PRIORITIES 3
+
+/**
+ * EVENT_SOURCE_LIMIT:
+ *
+ * Default number of pending events from a single source that are handled
+ * each time the queue is polled.
+ **/
+#define EVENT_SOURCE_LIMIT 64
+
+/**
+ * EVENT_MAX_QUEUED:
+ *
+ * Default maximum number of events emitted by D-Bus clients that may be
+ * pending at once.
+ **/
+#define EVENT_MAX_QUEUED 4096
+
+/**
+ * EVENT_MAX_QUEUED_SOURCE:
+ *
+ * Default maximum number of events emitted by a single D-Bus connection
+ * that may be pending at once.
+ **/
+#define EVENT_MAX_QUEUED_SOURCE 1024
+
+
 /**
  * Event:
  * @entry: list header,
- * @name: string name of the event,
+ * @name: interned string name of the event,
  * @env: NULL-terminated array of environment variables,
+ * @fds: file descriptors passed with the event,
+ * @fd_names: NULL-terminated array of names for @fds,
+ * @num_fds: number of entries in @fds and @fd_names,
+ * @priority: priority of event while pending,
+ * @source: D-Bus connection that emitted the event, or NULL,
+ * @queued: whether counted as pending from @source,
  * @progress: progress of event,
  * @failed: whether this event has failed,
  * @blockers: number of blockers for finishing,
@@ -52,18 +102,35 @@ typedef enum event_progress {
  * @name string, and can carry further information in the form of @env
  * which are passed to any jobs whose goal is changed by this event.
  *
+ * Events may also carry open file descriptors in @fds, each identified by
+ * the string at the same index of @fd_names; these are handed to the
+ * processes of any job started by the event and are closed once the
+ * event has finished.
+ *
  * This structure holds all the information on an active event, including
  * the information contained within the event and the current progress of
  * that event through the queue.
  *
  * Events remain in the handling state while @blockers is non-zero.
+ *
+ * @priority is assigned from the event's name when it is queued; @source
+ * is only used to identify events from the same emitter so that it can't
+ * starve the others, and is never dereferenced.  It is set with
+ * event_set_source(), which counts the event until it is handled, and
+ * cleared by event_forget_source() once the connection is lost.
  **/
 typedef struct event {
 	NihList          entry;
 
  	char            *name;
 	char           **env;
-	int              fd;
+	int             *fds;
+	char           **fd_names;
+	size_t           num_fds;
+
+	EventPriority    priority;
+	const void      *source;
+	int              queued;
 
 	EventProgress    progress;
 	int              failed;
@@ -72,11 +139,45 @@ typedef struct event {
 	NihList          blocking;
 } Event;
 
+/**
+ * EventPriorityRule:
+ * @entry: list header,
+ * @pattern: pattern to match event names against,
+ * @priority: priority of matching events.
+ *
+ * Rules are read from the init.conf file and assign @priority to any event
+ * whose name matches @pattern.
+ **/
+typedef struct event_priority_rule {
+	NihList        entry;
+	char          *pattern;
+	EventPriority  priority;
+} EventPriorityRule;
+
+/**
+ * EventCoalesceRule:
+ * @entry: list header,
+ * @pattern: pattern to match event names against.
+ *
+ * Rules are read from the init.conf file; an event emitted by a D-Bus
+ * client whose name matches @pattern is folded into an identical event
+ * that is still pending, rather than being queued again.
+ **/
+typedef struct event_coalesce_rule {
+	NihList  entry;
+	char    *pattern;
+} EventCoalesceRule;
+
 
 NIH_BEGIN_EXTERN
 
 extern int      paused;
 extern NihList *events;
+extern NihList *event_priority_rules;
+extern NihList *event_coalesce_rules;
+extern int      event_source_limit;
+extern int      event_max_queued;
+extern int      event_max_queued_source;
 
 
 void   event_init    (void);
@@ -84,11 +185,38 @@ void   event_init    (void);
 Event *event_new     (const void *parent, const char *name, char **env)
 	__attribute__ ((malloc));
 
+int    event_add_fd  (Event *event, int fd, const char *name)
+	__attribute__ ((warn_unused_result));
+
+int    event_set_source (Event *event, const void *source)
+	__attribute__ ((warn_unused_result));
+void   event_forget_source (const void *source);
+
 void   event_block   (Event *event);
 void   event_unblock (Event *event);
 
 void   event_poll    (void);
 
+int    event_queue_full (const void *source);
+
+EventPriorityRule *event_priority_rule_new   (const void *parent,
+					      const char *pattern,
+					      EventPriority priority)
+	__attribute__ ((warn_unused_result, malloc));
+
+EventPriority      event_priority            (const char *name);
+
+const char *       event_priority_name       (EventPriority priority)
+	__attribute__ ((const));
+EventPriority      event_priority_from_name  (const char *priority);
+
+EventCoalesceRule *event_coalesce_rule_new   (const void *parent,
+					      const char *pattern)
+	__attribute__ ((warn_unused_result, malloc));
+
+Event *            event_coalesce            (const char *name,
+					      char * const *env);
+
 NIH_END_EXTERN
 
 #endif /* INIT_EVENT_H */
@@ -25,9 +25,11 @@
 
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <fnmatch.h>
 
 #include <nih/macros.h>
@@ -38,12 +40,29 @@
 #include <nih/error.h>
 
 #include "environ.h"
+#include "intern.h"
 #include "event.h"
 #include "event_operator.h"
 #include "blocked.h"
 #include "errors.h"
 
 
+/* Prototypes for static functions */
+static void           event_operator_pack_size    (const EventOperator *oper,
+						   size_t *nodes,
+						   size_t *slots,
+						   size_t *bytes);
+static EventOperator *event_operator_pack_node    (const void *block,
+						   const EventOperator *old_oper,
+						   EventOperator **node,
+						   char ***slot, char **str);
+static int            event_operator_pack_destroy (EventOperator *oper);
+
+static void           event_operator_index_node   (EventOperator *oper,
+						   size_t *count);
+static int            event_operator_state_destroy (EventOperatorState *state);
+
+
 /**
  * event_operator_new:
  * @parent: parent object for new operator,
@@ -88,10 +107,11 @@ event_operator_new (const void         *parent,
 	nih_tree_init (&oper->node);
 
 	oper->type = type;
+	oper->index = 0;
 	oper->value = FALSE;
 
 	if (oper->type == EVENT_MATCH) {
-		oper->name = nih_strdup (oper, name);
+		oper->name = intern_string (oper, name);
 		if (! oper->name) {
 			nih_free (oper);
 			return NULL;
@@ -148,6 +168,7 @@ event_operator_copy (const void          *parent,
 	if (! oper)
 		return NULL;
 
+	oper->index = old_oper->index;
 	oper->value = old_oper->value;
 
 	if (old_oper->env) {
@@ -189,6 +210,213 @@ event_operator_copy (const void          *parent,
 	return oper;
 }
 
+/**
+ * event_operator_pack:
+ * @parent: parent object for new operator,
+ * @old_oper: operator to copy.
+ *
+ * Allocates and returns a copy of the expression tree rooted at @old_oper,
+ * like event_operator_copy(), except that the whole tree including its
+ * environment arrays is placed in a single block with the nodes laid out
+ * in pre-order; this means that the tree is allocated at once rather than
+ * node by node, and is kept together in memory while being matched.
+ *
+ * Only the returned root is an nih_alloc() block; no node or environment
+ * array within may be freed, referenced or modified on its own, but the
+ * whole tree may be freed or copied as normal and any matched state
+ * updated.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned operator.  When all parents
+ * of the returned operator are freed, the returned operator will also be
+ * freed.
+ *
+ * Returns: newly allocated EventOperator structure, or NULL if
+ * insufficient memory.
+ **/
+EventOperator *
+event_operator_pack (const void          *parent,
+		     const EventOperator *old_oper)
+{
+	EventOperator  *oper, *node;
+	char          **slot;
+	char           *str;
+	size_t          nodes = 0, slots = 0, bytes = 0;
+
+	nih_assert (old_oper != NULL);
+
+	event_operator_pack_size (old_oper, &nodes, &slots, &bytes);
+
+	oper = nih_alloc (parent, (sizeof (EventOperator) * nodes
+				   + sizeof (char *) * slots + bytes));
+	if (! oper)
+		return NULL;
+
+	node = oper;
+	slot = (char **)(oper + nodes);
+	str = (char *)(slot + slots);
+
+	if (! event_operator_pack_node (oper, old_oper, &node, &slot, &str)) {
+		nih_free (oper);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < nodes; i++)
+		if (oper[i].event)
+			event_block (oper[i].event);
+
+	nih_alloc_set_destructor (oper, event_operator_pack_destroy);
+
+	return oper;
+}
+
+/**
+ * event_operator_pack_size:
+ * @oper: operator to measure,
+ * @nodes: number of nodes,
+ * @slots: number of environment array slots,
+ * @bytes: size of environment strings.
+ *
+ * Adds the space needed by the expression tree rooted at @oper to @nodes,
+ * @slots and @bytes, for event_operator_pack().
+ **/
+static void
+event_operator_pack_size (const EventOperator *oper,
+			  size_t              *nodes,
+			  size_t              *slots,
+			  size_t              *bytes)
+{
+	nih_assert (oper != NULL);
+
+	(*nodes)++;
+
+	if (oper->env) {
+		for (char **e = oper->env; *e; e++) {
+			(*slots)++;
+			*bytes += strlen (*e) + 1;
+		}
+
+		(*slots)++;
+	}
+
+	if (oper->node.left)
+		event_operator_pack_size ((EventOperator *)oper->node.left,
+					  nodes, slots, bytes);
+	if (oper->node.right)
+		event_operator_pack_size ((EventOperator *)oper->node.right,
+					  nodes, slots, bytes);
+}
+
+/**
+ * event_operator_pack_node:
+ * @block: block being filled,
+ * @old_oper: operator to copy,
+ * @node: next free node,
+ * @slot: next free environment array slot,
+ * @str: next free environment string space.
+ *
+ * Copies the expression tree rooted at @old_oper into the space within
+ * @block given by @node, @slot and @str, which are advanced past the
+ * space used, for event_operator_pack().  Matched events are copied but
+ * not blocked.
+ *
+ * Returns: copied node, or NULL if insufficient memory.
+ **/
+static EventOperator *
+event_operator_pack_node (const void           *block,
+			  const EventOperator  *old_oper,
+			  EventOperator       **node,
+			  char               ***slot,
+			  char                **str)
+{
+	EventOperator *oper, *child;
+
+	nih_assert (block != NULL);
+	nih_assert (old_oper != NULL);
+
+	oper = (*node)++;
+
+	nih_tree_init (&oper->node);
+
+	oper->type = old_oper->type;
+	oper->index = old_oper->index;
+	oper->value = old_oper->value;
+	oper->name = NULL;
+	oper->env = NULL;
+	oper->event = old_oper->event;
+
+	if (old_oper->name) {
+		oper->name = intern_string (block, old_oper->name);
+		if (! oper->name)
+			return NULL;
+	}
+
+	if (old_oper->env) {
+		oper->env = *slot;
+
+		for (char **e = old_oper->env; *e; e++) {
+			size_t len = strlen (*e) + 1;
+
+			memcpy (*str, *e, len);
+			*(*slot)++ = *str;
+			*str += len;
+		}
+
+		*(*slot)++ = NULL;
+	}
+
+	if (old_oper->node.left) {
+		child = event_operator_pack_node (
+			block, (EventOperator *)old_oper->node.left,
+			node, slot, str);
+		if (! child)
+			return NULL;
+
+		nih_tree_add (&oper->node, &child->node, NIH_TREE_LEFT);
+	}
+
+	if (old_oper->node.right) {
+		child = event_operator_pack_node (
+			block, (EventOperator *)old_oper->node.right,
+			node, slot, str);
+		if (! child)
+			return NULL;
+
+		nih_tree_add (&oper->node, &child->node, NIH_TREE_RIGHT);
+	}
+
+	return oper;
+}
+
+/**
+ * event_operator_pack_destroy:
+ * @oper: packed tree to be destroyed.
+ *
+ * Unblocks the events referenced by every node of the tree packed by
+ * event_operator_pack() into the block @oper, and unlinks it from any
+ * event tree.
+ *
+ * Used as an nih_alloc() destructor.
+ *
+ * Returns: zero.
+ **/
+static int
+event_operator_pack_destroy (EventOperator *oper)
+{
+	nih_assert (oper != NULL);
+
+	NIH_TREE_FOREACH (&oper->node, iter) {
+		EventOperator *node = (EventOperator *)iter;
+
+		if (node->event)
+			event_unblock (node->event);
+	}
+
+	nih_tree_destroy (&oper->node);
+
+	return 0;
+}
+
 /**
  * event_operator_destroy:
  * @oper: operator to be destroyed.
@@ -214,18 +442,194 @@ event_operator_destroy (EventOperator *oper)
 	return 0;
 }
 
+/**
+ * event_operator_equal:
+ * @oper: first operator,
+ * @other: second operator.
+ *
+ * Compares the expression tree rooted at @oper with that rooted at
+ * @other, either of which may be NULL.  Only the expression itself is
+ * compared, any matched state or events are ignored.
+ *
+ * Returns: TRUE if the trees are the same expression, FALSE otherwise.
+ **/
+int
+event_operator_equal (const EventOperator *oper,
+		      const EventOperator *other)
+{
+	size_t i;
+
+	if ((! oper) || (! other))
+		return (oper == other ? TRUE : FALSE);
+
+	if (oper->type != other->type)
+		return FALSE;
+
+	if (oper->type == EVENT_MATCH) {
+		if (strcmp (oper->name, other->name))
+			return FALSE;
+
+		if ((! oper->env) || (! other->env)) {
+			if (oper->env != other->env)
+				return FALSE;
+		} else {
+			for (i = 0; oper->env[i] && other->env[i]; i++)
+				if (strcmp (oper->env[i], other->env[i]))
+					return FALSE;
+
+			if (oper->env[i] || other->env[i])
+				return FALSE;
+		}
+	}
+
+	if (! event_operator_equal ((EventOperator *)oper->node.left,
+				    (EventOperator *)other->node.left))
+		return FALSE;
+
+	return event_operator_equal ((EventOperator *)oper->node.right,
+				     (EventOperator *)other->node.right);
+}
+
+
+/**
+ * event_operator_index:
+ * @root: operator tree to number.
+ *
+ * Numbers the operators in the tree rooted at @root in pre-order, setting
+ * the index of each to its entry in arrays of EventOperatorState; the
+ * root is always given the first entry.  Trees of the same shape are
+ * always numbered the same way, so an array for one may be used with
+ * the other.
+ *
+ * Returns: number of operators in the tree.
+ **/
+size_t
+event_operator_index (EventOperator *root)
+{
+	size_t count = 0;
+
+	nih_assert (root != NULL);
+
+	event_operator_index_node (root, &count);
+
+	return count;
+}
+
+/**
+ * event_operator_index_node:
+ * @oper: operator to number,
+ * @count: next index.
+ *
+ * Numbers @oper and its children from @count, which is advanced past the
+ * indexes used, for event_operator_index().
+ **/
+static void
+event_operator_index_node (EventOperator *oper,
+			   size_t        *count)
+{
+	nih_assert (oper != NULL);
+	nih_assert (count != NULL);
+
+	oper->index = (*count)++;
+
+	if (oper->node.left)
+		event_operator_index_node ((EventOperator *)oper->node.left,
+					   count);
+	if (oper->node.right)
+		event_operator_index_node ((EventOperator *)oper->node.right,
+					   count);
+}
+
+/**
+ * event_operator_state_new:
+ * @parent: parent object for new array,
+ * @root: operator tree to be matched.
+ *
+ * Allocates and returns a new array of EventOperatorState structures, one
+ * for each operator in the tree rooted at @root, so that the tree may be
+ * matched with it in place of the state held within the tree itself; all
+ * operators start FALSE.  The tree is numbered by event_operator_index().
+ *
+ * The array may be passed along with @root, or any tree of the same shape,
+ * to event_operator_handle() and the other functions that match or use the
+ * state of a tree.  Any events matched are unblocked when the array is
+ * freed.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated array, or NULL if insufficient memory.
+ **/
+EventOperatorState *
+event_operator_state_new (const void    *parent,
+			  EventOperator *root)
+{
+	EventOperatorState *state;
+	size_t              count;
+
+	nih_assert (root != NULL);
+
+	count = event_operator_index (root);
+
+	state = nih_alloc (parent, sizeof (EventOperatorState) * count);
+	if (! state)
+		return NULL;
+
+	for (size_t i = 0; i < count; i++) {
+		state[i].value = FALSE;
+		state[i].event = NULL;
+	}
+
+	nih_alloc_set_destructor (state, event_operator_state_destroy);
+
+	return state;
+}
+
+/**
+ * event_operator_state_destroy:
+ * @state: array to be destroyed.
+ *
+ * Unblocks the events referenced by each entry of @state.
+ *
+ * Used as an nih_alloc() destructor.
+ *
+ * Returns: zero.
+ **/
+static int
+event_operator_state_destroy (EventOperatorState *state)
+{
+	size_t count;
+
+	nih_assert (state != NULL);
+
+	count = nih_alloc_size (state) / sizeof (EventOperatorState);
+
+	for (size_t i = 0; i < count; i++)
+		if (state[i].event)
+			event_unblock (state[i].event);
+
+	return 0;
+}
+
 
 /**
  * event_operator_update:
- * @oper: operator to update.
+ * @oper: operator to update,
+ * @state: array of operator states.
  *
  * Updates the value of @oper to reflect the value of its child nodes
  * when combined with the particular operation this represents.
  *
+ * @state is optional, and may be NULL; if given, values are read from and
+ * stored in it rather than the tree.
+ *
  * This may only be called if the type of @oper is EVENT_OR or EVENT_AND.
  **/
 void
-event_operator_update (EventOperator *oper)
+event_operator_update (EventOperator      *oper,
+		       EventOperatorState *state)
 {
 	EventOperator *left, *right;
 
@@ -238,10 +642,14 @@ event_operator_update (EventOperator *oper)
 
 	switch (oper->type) {
 	case EVENT_OR:
-		oper->value = (left->value || right->value);
+		EVENT_OPERATOR_VALUE (oper, state)
+			= (EVENT_OPERATOR_VALUE (left, state)
+			   || EVENT_OPERATOR_VALUE (right, state));
 		break;
 	case EVENT_AND:
-		oper->value = (left->value && right->value);
+		EVENT_OPERATOR_VALUE (oper, state)
+			= (EVENT_OPERATOR_VALUE (left, state)
+			   && EVENT_OPERATOR_VALUE (right, state));
 		break;
 	default:
 		nih_assert_not_reached ();
@@ -284,8 +692,10 @@ event_operator_match (EventOperator *oper,
 	nih_assert (oper->node.right == NULL);
 	nih_assert (event != NULL);
 
-	/* Names must match */
-	if (strcmp (oper->name, event->name))
+	/* Names must match; both are interned so this need only compare
+	 * the pointers.
+	 */
+	if (oper->name != event->name)
 		return FALSE;
 
 	/* Match operator environment variables against those from the event,
@@ -338,20 +748,25 @@ event_operator_match (EventOperator *oper,
 
 		/* Expand operator value against given environment before
 		 * matching; silently discard errors, since otherwise we'd
-		 * be excessively noisy on every event.
+		 * be excessively noisy on every event.  Most values contain
+		 * no references at all, so don't copy those.
 		 */
-		while (! (expoval = environ_expand (NULL, oval, env))) {
-			NihError *err;
-
-			err = nih_error_get ();
-			if (err->number != ENOMEM) {
+		if (strchr (oval, '$')) {
+			while (! (expoval = environ_expand (NULL, oval, env))) {
+				NihError *err;
+
+				err = nih_error_get ();
+				if (err->number != ENOMEM) {
+					nih_free (err);
+					return FALSE;
+				}
 				nih_free (err);
-				return FALSE;
 			}
-			nih_free (err);
+
+			oval = expoval;
 		}
 
-		ret = fnmatch (expoval, eval, 0);
+		ret = fnmatch (oval, eval, 0);
 
 		if (negate ? (! ret) : ret)
 			return FALSE;
@@ -364,6 +779,7 @@ event_operator_match (EventOperator *oper,
 /**
  * event_operator_handle:
  * @root: operator tree to update,
+ * @state: array of operator states,
  * @event: event to match against,
  * @env: NULL-terminated array of environment variables for expansion.
  *
@@ -375,6 +791,10 @@ event_operator_match (EventOperator *oper,
  * array of environment variables in KEY=VALUE form and will be used to expand
  * EVENT_MATCH nodes before matching them,
  *
+ * @state is optional, and may be NULL; if given, the tree is left alone and
+ * the values of its nodes and the events they match are held in @state,
+ * which must have been allocated for the tree by event_operator_state_new().
+ *
  * If @event is matched within this tree, it will be referenced and blocked
  * by the nodes that match it.  The blockage and references can be cleared
  * using event_operator_reset().
@@ -387,9 +807,10 @@ event_operator_match (EventOperator *oper,
  * otherwise.
  **/
 int
-event_operator_handle (EventOperator *root,
-		       Event         *event,
-		       char * const  *env)
+event_operator_handle (EventOperator      *root,
+		       EventOperatorState *state,
+		       Event              *event,
+		       char * const       *env)
 {
 	int ret = FALSE;
 
@@ -407,15 +828,15 @@ event_operator_handle (EventOperator *root,
 		switch (oper->type) {
 		case EVENT_OR:
 		case EVENT_AND:
-			event_operator_update (oper);
+			event_operator_update (oper, state);
 			break;
 		case EVENT_MATCH:
-			if ((! oper->value)
+			if ((! EVENT_OPERATOR_VALUE (oper, state))
 			    && event_operator_match (oper, event, env)) {
-				oper->value = TRUE;
+				EVENT_OPERATOR_VALUE (oper, state) = TRUE;
 
-				oper->event = event;
-				event_block (oper->event);
+				EVENT_OPERATOR_EVENT (oper, state) = event;
+				event_block (event);
 
 				ret = TRUE;
 			}
@@ -430,9 +851,42 @@ event_operator_handle (EventOperator *root,
 }
 
 
+/**
+ * event_operator_can_match:
+ * @root: operator tree to check,
+ * @event: event to check.
+ *
+ * Checks whether any EVENT_MATCH node in the EventOperator tree rooted at
+ * @root names @event; when none does, event_operator_handle() cannot match
+ * @event whatever the state or environment passed to it, so callers
+ * matching many states against one tree can skip them all at once.
+ *
+ * Returns: TRUE if @event may match an entry in the tree under @root,
+ * FALSE if it cannot.
+ **/
+int
+event_operator_can_match (EventOperator *root,
+			  Event         *event)
+{
+	nih_assert (root != NULL);
+	nih_assert (event != NULL);
+
+	NIH_TREE_FOREACH (&root->node, iter) {
+		EventOperator *oper = (EventOperator *)iter;
+
+		/* Both names are interned */
+		if ((oper->type == EVENT_MATCH)
+		    && (oper->name == event->name))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
 /**
  * event_operator_filter:
- * @data: not used,
+ * @state: array of operator states or NULL,
  * @oper: EventOperator to check.
  *
  * Used when iterating the operator tree to filter out those operators and
@@ -441,24 +895,26 @@ event_operator_handle (EventOperator *root,
  * Returns: TRUE if operator should be ignored, FALSE otherwise.
  **/
 static int
-event_operator_filter (void          *data,
-		       EventOperator *oper)
+event_operator_filter (EventOperatorState *state,
+		       EventOperator      *oper)
 {
 	nih_assert (oper != NULL);
 
-	return oper->value != TRUE;
+	return EVENT_OPERATOR_VALUE (oper, state) != TRUE;
 }
 
 /**
  * event_operator_environment:
  * @root: operator tree to collect from,
+ * @state: array of operator states,
  * @env: NULL-terminated array of environment variables to add to,
  * @parent: parent object for new array,
  * @len: length of @env,
  * @key: key of variable to contain event names.
  *
  * Collects environment from the portion of the EventOperator tree rooted at
- * @oper that are TRUE, ignoring the rest.
+ * @oper that are TRUE, ignoring the rest.  @state is optional, and may be
+ * NULL; if given, the values and events are taken from it.
  *
  * Environment variables from each event (in tree order) will be added to
  * the NULL-terminated array at @env so that it contains the complete
@@ -485,11 +941,12 @@ event_operator_filter (void          *data,
  * Returns: pointer to new array on success, NULL on insufficient memory.
  **/
 char **
-event_operator_environment (EventOperator   *root,
-			    char          ***env,
-			    const void      *parent,
-			    size_t          *len,
-			    const char      *key)
+event_operator_environment (EventOperator       *root,
+			    EventOperatorState  *state,
+			    char              ***env,
+			    const void          *parent,
+			    size_t              *len,
+			    const char          *key)
 {
 	nih_local char *evlist = NULL;
 
@@ -518,27 +975,28 @@ event_operator_environment (EventOperator   *root,
 	 * of their logic wasn't present.
 	 */
 	NIH_TREE_FOREACH_FULL (&root->node, iter,
-			       (NihTreeFilter)event_operator_filter, NULL) {
+			       (NihTreeFilter)event_operator_filter, state) {
 		EventOperator *oper = (EventOperator *)iter;
+		Event         *event;
 
 		if (oper->type != EVENT_MATCH)
 			continue;
 
-		nih_assert (oper->event != NULL);
+		event = EVENT_OPERATOR_EVENT (oper, state);
+		nih_assert (event != NULL);
 
 		/* Add environment from the event */
-		if (! environ_append (env, parent, len, TRUE, oper->event->env))
+		if (! environ_append (env, parent, len, TRUE, event->env))
 			return NULL;
 
 		/* Append the name of the event to the string we're building */
 		if (evlist) {
 			if (evlist[strlen (evlist) - 1] != '=') {
 				if (! nih_strcat_sprintf (&evlist, NULL, " %s",
-							  oper->event->name))
+							  event->name))
 					return NULL;
 			} else {
-				if (! nih_strcat (&evlist, NULL,
-						  oper->event->name))
+				if (! nih_strcat (&evlist, NULL, event->name))
 					return NULL;
 			}
 		}
@@ -552,73 +1010,124 @@ event_operator_environment (EventOperator   *root,
 	return *env;
 }
 
-int *
-event_operator_fds (EventOperator *root,
-		    const void *parent,
-		    int **fds,
-		    size_t *num_fds,
-		    char          ***env,
-		    size_t          *len,
-		    const char      *key)
+/**
+ * event_operator_fds:
+ * @root: operator tree to collect from,
+ * @state: array of operator states,
+ * @parent: parent object for new arrays,
+ * @fds: pointer to store array of file descriptors in,
+ * @fd_names: pointer to store NULL-terminated array of names in,
+ * @num_fds: pointer to store number of file descriptors in.
+ *
+ * Collects the file descriptors passed with the events from the portion
+ * of the EventOperator tree rooted at @oper that are TRUE, ignoring the
+ * rest, in the same order as event_operator_environment().  @state is
+ * optional, and may be NULL; if given, the values and events are taken
+ * from it.
+ *
+ * Each file descriptor is duplicated (with the close-on-exec flag set) so
+ * that the copies remain valid after the events have finished; the new
+ * descriptors are stored in a newly allocated array at @fds and the name
+ * of each in a newly allocated array at @fd_names, any previous arrays
+ * are not freed.  When no events carried file descriptors both are set
+ * to NULL.  It is up to the caller to close the descriptors when they
+ * are no longer needed.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned arrays.  When all parents of
+ * the returned arrays are freed, the returned arrays will also be freed.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+event_operator_fds (EventOperator       *root,
+		    EventOperatorState  *state,
+		    const void          *parent,
+		    int                **fds,
+		    char              ***fd_names,
+		    size_t              *num_fds)
 {
-	nih_local char *evlist = NULL;
+	int    *new_fds = NULL;
+	char  **new_names = NULL;
+	size_t  len = 0;
 
 	nih_assert (root != NULL);
 	nih_assert (fds != NULL);
+	nih_assert (fd_names != NULL);
 	nih_assert (num_fds != NULL);
-	nih_assert (env != NULL);
-	nih_assert (len != NULL);
-	nih_assert (key != NULL);
 
-	/* Initialise the event list variable with the name given. */
-	evlist = nih_sprintf (NULL, "%s=", key);
-	if (! evlist)
-		return NULL;
-
-	*num_fds = 0;
 	NIH_TREE_FOREACH_FULL (&root->node, iter,
-			       (NihTreeFilter)event_operator_filter, NULL) {
+			       (NihTreeFilter)event_operator_filter, state) {
 		EventOperator *oper = (EventOperator *)iter;
+		Event         *event;
 
 		if (oper->type != EVENT_MATCH)
 			continue;
 
-		nih_assert (oper->event != NULL);
+		event = EVENT_OPERATOR_EVENT (oper, state);
+		nih_assert (event != NULL);
 
-		if (oper->event->fd >= 0) {
-			*fds = nih_realloc (*fds, parent, sizeof (int) * (*num_fds + 1));
-			if (! *fds)
-				return NULL;
+		for (size_t i = 0; i < event->num_fds; i++) {
+			int *tmp;
+			int  fd;
 
-			(*fds)[(*num_fds)++] = oper->event->fd;
+			if (! new_names) {
+				new_names = nih_str_array_new (parent);
+				if (! new_names)
+					goto error_nomem;
+			}
 
-			if (evlist[strlen (evlist) - 1] != '=') {
-				if (! nih_strcat_sprintf (&evlist, NULL, " %d",
-							  oper->event->fd))
-					return NULL;
-			} else {
-				if (! nih_strcat_sprintf (&evlist, NULL, "%d",
-							  oper->event->fd))
-					return NULL;
+			tmp = nih_realloc (new_fds, parent,
+					   sizeof (int) * (len + 1));
+			if (! tmp)
+				goto error_nomem;
+
+			new_fds = tmp;
+
+			if (! nih_str_array_add (&new_names, parent, NULL,
+						 event->fd_names[i]))
+				goto error_nomem;
+
+			fd = fcntl (event->fds[i], F_DUPFD_CLOEXEC, 0);
+			if (fd < 0) {
+				nih_error_raise_system ();
+				goto error;
 			}
+
+			new_fds[len++] = fd;
 		}
 	}
 
-	if (*num_fds)
-		if (! environ_add (env, parent, len, TRUE, evlist))
-			return NULL;
+	*fds = new_fds;
+	*fd_names = new_names;
+	*num_fds = len;
+
+	return 0;
+
+error_nomem:
+	nih_error_raise_no_memory ();
+error:
+	while (len)
+		close (new_fds[--len]);
 
-	return (void *)1;
+	if (new_fds)
+		nih_free (new_fds);
+	if (new_names)
+		nih_free (new_names);
+
+	return -1;
 }
 
 /**
  * event_operator_events:
  * @root: operator tree to collect from,
+ * @state: array of operator states,
  * @parent: parent object for blocked structures,
  * @list: list to add events to.
  *
  * Collects events from the portion of the EventOperator tree rooted at @oper
- * that are TRUE, ignoring the rest.
+ * that are TRUE, ignoring the rest.  @state is optional, and may be NULL;
+ * if given, the values and events are taken from it.
  *
  * Each event is blocked and a Blocked structure will be appended to @list
  * for it.
@@ -629,9 +1138,10 @@ event_operator_fds (EventOperator *root,
  * freed.
  **/
 void
-event_operator_events (EventOperator *root,
-		       const void    *parent,
-		       NihList       *list)
+event_operator_events (EventOperator      *root,
+		       EventOperatorState *state,
+		       const void         *parent,
+		       NihList            *list)
 {
 	nih_assert (root != NULL);
 	nih_assert (list != NULL);
@@ -643,17 +1153,18 @@ event_operator_events (EventOperator *root,
 	 * of their logic wasn't present.
 	 */
 	NIH_TREE_FOREACH_FULL (&root->node, iter,
-			       (NihTreeFilter)event_operator_filter, NULL) {
+			       (NihTreeFilter)event_operator_filter, state) {
 		EventOperator *oper = (EventOperator *)iter;
 		Blocked       *blocked;
 
 		if (oper->type != EVENT_MATCH)
 			continue;
 
-		nih_assert (oper->event != NULL);
+		nih_assert (EVENT_OPERATOR_EVENT (oper, state) != NULL);
 
-		blocked = NIH_MUST (blocked_new (parent, BLOCKED_EVENT,
-						 oper->event));
+		blocked = NIH_MUST (blocked_new (
+				  parent, BLOCKED_EVENT,
+				  EVENT_OPERATOR_EVENT (oper, state)));
 		nih_list_add (list, &blocked->entry);
 
 		event_block (blocked->event);
@@ -663,14 +1174,19 @@ event_operator_events (EventOperator *root,
 
 /**
  * event_operator_reset:
- * @root: operator tree to update.
+ * @root: operator tree to update,
+ * @state: array of operator states.
  *
  * Resets the EventOperator tree rooted at @oper, unblocking and
  * unreferencing any events that were matched by the tree and changing
  * the values of other operators to match.
+ *
+ * @state is optional, and may be NULL; if given, it is reset in place of
+ * the tree.
  **/
 void
-event_operator_reset (EventOperator *root)
+event_operator_reset (EventOperator      *root,
+		      EventOperatorState *state)
 {
 	nih_assert (root != NULL);
 
@@ -681,14 +1197,15 @@ event_operator_reset (EventOperator *root)
 		switch (oper->type) {
 		case EVENT_OR:
 		case EVENT_AND:
-			event_operator_update (oper);
+			event_operator_update (oper, state);
 			break;
 		case EVENT_MATCH:
-			oper->value = FALSE;
+			EVENT_OPERATOR_VALUE (oper, state) = FALSE;
 
-			if (oper->event) {
-				event_unblock (oper->event);
-				oper->event = NULL;
+			if (EVENT_OPERATOR_EVENT (oper, state)) {
+				event_unblock (EVENT_OPERATOR_EVENT (oper,
+								     state));
+				EVENT_OPERATOR_EVENT (oper, state) = NULL;
 			}
 			break;
 		default:
@@ -42,8 +42,9 @@ typedef enum event_operator_type {
  * EventOperator:
  * @node: tree node,
  * @type: operator type,
+ * @index: position of the operator's entry in state arrays,
  * @value: operator value,
- * @name: name of event to match (EVENT_MATCH only),
+ * @name: interned name of event to match (EVENT_MATCH only),
  * @env: environment variables of event to match (EVENT_MATCH only),
  * @event: event matched (EVENT_MATCH only).
  *
@@ -59,10 +60,15 @@ typedef enum event_operator_type {
  *
  * Once an event has been matched, the @event member is set and a reference
  * held until the structure is cleared.
+ *
+ * A tree may instead be shared by several users each matching it
+ * separately, in which case @value and @event are unused and each user
+ * keeps its own array of EventOperatorState; see event_operator_state_new().
  **/
 typedef struct event_operator {
 	NihTree             node;
 	EventOperatorType   type;
+	size_t              index;
 
 	int                 value;
 
@@ -72,6 +78,46 @@ typedef struct event_operator {
 	Event              *event;
 } EventOperator;
 
+/**
+ * EventOperatorState:
+ * @value: operator value,
+ * @event: event matched (EVENT_MATCH only).
+ *
+ * This structure holds the matched state of an operator in a tree that is
+ * shared by several users, such as the stop on expression of a job class
+ * shared by its instances; each user keeps an array with an entry for
+ * each operator in the tree, indexed by the operator's @index.
+ *
+ * The members have the same meaning as those of EventOperator.
+ **/
+typedef struct event_operator_state {
+	int                 value;
+	Event              *event;
+} EventOperatorState;
+
+
+/**
+ * EVENT_OPERATOR_VALUE:
+ * @oper: operator,
+ * @state: array of operator states or NULL.
+ *
+ * Expands to the value of @oper, held in @state if not NULL, or within
+ * @oper itself otherwise; this may be assigned to.
+ **/
+#define EVENT_OPERATOR_VALUE(oper, state) \
+	(*((state) ? &(state)[(oper)->index].value : &(oper)->value))
+
+/**
+ * EVENT_OPERATOR_EVENT:
+ * @oper: operator,
+ * @state: array of operator states or NULL.
+ *
+ * Expands to the event matched by @oper, held in @state if not NULL, or
+ * within @oper itself otherwise; this may be assigned to.
+ **/
+#define EVENT_OPERATOR_EVENT(oper, state) \
+	(*((state) ? &(state)[(oper)->index].event : &(oper)->event))
+
 
 NIH_BEGIN_EXTERN
 
@@ -82,31 +128,46 @@ EventOperator *event_operator_new         (const void *parent,
 EventOperator *event_operator_copy        (const void *parent,
 					   const EventOperator *old_oper)
 	__attribute__ ((warn_unused_result, malloc));
+EventOperator *event_operator_pack        (const void *parent,
+					   const EventOperator *old_oper)
+	__attribute__ ((warn_unused_result, malloc));
 
 int            event_operator_destroy     (EventOperator *oper);
+int            event_operator_equal       (const EventOperator *oper,
+					   const EventOperator *other);
 
-void           event_operator_update      (EventOperator *oper);
-int            event_operator_match       (EventOperator *oper, Event *event,
-					   char * const *env);
+size_t         event_operator_index       (EventOperator *root);
+EventOperatorState *event_operator_state_new (const void *parent,
+					      EventOperator *root)
+	__attribute__ ((warn_unused_result, malloc));
 
-int            event_operator_handle      (EventOperator *root, Event *event,
+void           event_operator_update      (EventOperator *oper,
+					   EventOperatorState *state);
+int            event_operator_match       (EventOperator *oper, Event *event,
 					   char * const *env);
 
-char **        event_operator_environment (EventOperator *root, char ***env,
-					   const void *parent, size_t *len,
-					   const char *key);
-int *
-event_operator_fds (EventOperator *root,
-		    const void *parent,
-		    int **fds,
-		    size_t *num_fds,
-		    char          ***env,
-		    size_t          *len,
-		    const char      *key);
+int            event_operator_handle      (EventOperator *root,
+					   EventOperatorState *state,
+					   Event *event, char * const *env);
+int            event_operator_can_match   (EventOperator *root,
+					   Event *event);
+
+char **        event_operator_environment (EventOperator *root,
+					   EventOperatorState *state,
+					   char ***env, const void *parent,
+					   size_t *len, const char *key);
+int            event_operator_fds         (EventOperator *root,
+					   EventOperatorState *state,
+					   const void *parent,
+					   int **fds, char ***fd_names,
+					   size_t *num_fds)
+	__attribute__ ((warn_unused_result));
 void           event_operator_events      (EventOperator *root,
+					   EventOperatorState *state,
 					   const void *parent, NihList *list);
 
-void           event_operator_reset       (EventOperator *root);
+void           event_operator_reset       (EventOperator *root,
+					   EventOperatorState *state);
 
 NIH_END_EXTERN
 
@@ -56,6 +56,14 @@
  **/
 #define PWRSTATUS_EVENT "power-status-changed"
 
+/**
+ * RUNLEVEL_EVENT:
+ *
+ * Name of the event emitted by shutdown and telinit when the runlevel is
+ * changed; we watch for it to begin a shutdown.
+ **/
+#define RUNLEVEL_EVENT "runlevel"
+
 
 /**
  * JOB_STARTING_EVENT:
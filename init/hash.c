@@ -0,0 +1,132 @@
+/* upstart
+ *
+ * hash.c - hash tables that grow with their contents
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "hash.h"
+
+
+/* Prototypes for static functions */
+static void hash_grow (const void *parent, NihHash **hash);
+
+
+/**
+ * hash_add:
+ * @parent: parent of @hash,
+ * @hash: pointer to hash table,
+ * @entry: entry to be added.
+ *
+ * Adds @entry to the hash table pointed to by @hash as nih_hash_add()
+ * does.
+ *
+ * An NihHash has a fixed number of bins chosen when it is created, so
+ * that a table created for a handful of entries searches long chains
+ * once it holds thousands.  When the bin @entry was added to holds more
+ * than HASH_CHAIN_MAX entries, the table is replaced with a larger one
+ * holding the same entries, allocated as a child of @parent; @hash is
+ * updated to point to it, and the old table freed.  Entries with the
+ * same key are kept in the same order.
+ * Should there be insufficient memory to do so, the old table is kept.
+ *
+ * Since the table may be replaced, callers must not add entries to a
+ * table while iterating it, and must not hold pointers to it other than
+ * the one given as @hash.
+ *
+ * Returns: @entry.
+ **/
+NihList *
+hash_add (const void  *parent,
+	  NihHash    **hash,
+	  NihList     *entry)
+{
+	size_t len = 0;
+
+	nih_assert (hash != NULL);
+	nih_assert (*hash != NULL);
+	nih_assert (entry != NULL);
+
+	nih_hash_add (*hash, entry);
+
+	/* The bin is a circular list, so walking it from the entry counts
+	 * the other entries and the bin's own list head.
+	 */
+	for (NihList *iter = entry->next; iter != entry; iter = iter->next)
+		len++;
+
+	if (len > HASH_CHAIN_MAX)
+		hash_grow (parent, hash);
+
+	return entry;
+}
+
+/**
+ * hash_grow:
+ * @parent: parent of @hash,
+ * @hash: pointer to hash table.
+ *
+ * Replaces the hash table pointed to by @hash with one of about four
+ * times as many bins holding the same entries, for hash_add().
+ *
+ * Every entry is moved each time the table grows, so it grows by four
+ * rather than doubling to halve the number of times that happens as a
+ * table goes from a handful of entries to tens of thousands.
+ **/
+static void
+hash_grow (const void  *parent,
+	   NihHash    **hash)
+{
+	NihHash *old_hash;
+	NihHash *new_hash;
+
+	nih_assert (hash != NULL);
+	nih_assert (*hash != NULL);
+
+	old_hash = *hash;
+
+	new_hash = nih_hash_new (parent, old_hash->size * 4,
+				 old_hash->key_function,
+				 old_hash->hash_function,
+				 old_hash->cmp_function);
+	if (! new_hash)
+		return;
+
+	/* Already as large as a table can be */
+	if (new_hash->size <= old_hash->size) {
+		nih_free (new_hash);
+		return;
+	}
+
+	NIH_HASH_FOREACH_SAFE (old_hash, iter) {
+		nih_list_remove (iter);
+		nih_hash_add (new_hash, iter);
+	}
+
+	*hash = new_hash;
+	nih_free (old_hash);
+}
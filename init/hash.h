@@ -0,0 +1,42 @@
+/* upstart
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_HASH_H
+#define INIT_HASH_H
+
+#include <nih/macros.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+
+
+/**
+ * HASH_CHAIN_MAX:
+ *
+ * Number of entries that may share a bin of a hash table before
+ * hash_add() replaces the table with a larger one.
+ **/
+#define HASH_CHAIN_MAX 8
+
+
+NIH_BEGIN_EXTERN
+
+NihList *hash_add (const void *parent, NihHash **hash, NihList *entry);
+
+NIH_END_EXTERN
+
+#endif /* INIT_HASH_H */
@@ -0,0 +1,128 @@
+/* upstart
+ *
+ * intern.c - shared storage of commonly repeated strings
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "hash.h"
+#include "intern.h"
+
+
+/**
+ * InternString:
+ * @entry: list header,
+ * @str: interned string.
+ *
+ * Entries in the intern_strings hash; each is allocated as a child of
+ * @str so that it is removed from the hash once the string is freed.
+ **/
+typedef struct intern_string {
+	NihList  entry;
+	char    *str;
+} InternString;
+
+
+/**
+ * intern_strings:
+ *
+ * This hash table holds the strings currently shared by their users,
+ * indexed by the string itself; each entry is an InternString.
+ **/
+NihHash *intern_strings = NULL;
+
+
+/**
+ * intern_init:
+ *
+ * Initialise the intern_strings hash table.
+ **/
+void
+intern_init (void)
+{
+	if (! intern_strings)
+		intern_strings = NIH_MUST (nih_hash_string_new (NULL, 0));
+}
+
+
+/**
+ * intern_string:
+ * @parent: object referencing the string,
+ * @str: string to intern.
+ *
+ * Returns a string with the same contents as @str that is shared with
+ * every other user of the same contents, rather than allocating a new
+ * copy for each; this means that two interned strings are equal if and
+ * only if they are the same pointer.
+ *
+ * The returned string is referenced by @parent, which must not be NULL,
+ * and is freed once all of its parents have been freed or have dropped
+ * their reference with nih_unref(); since it is shared, it must never
+ * be modified or freed with nih_free().
+ *
+ * Returns: interned string or NULL if insufficient memory.
+ **/
+char *
+intern_string (const void *parent,
+	       const char *str)
+{
+	InternString *interned;
+	char         *new_str;
+
+	nih_assert (parent != NULL);
+	nih_assert (str != NULL);
+
+	intern_init ();
+
+	interned = (InternString *)nih_hash_lookup (intern_strings, str);
+	if (interned) {
+		nih_ref (interned->str, parent);
+		return interned->str;
+	}
+
+	new_str = nih_strdup (parent, str);
+	if (! new_str)
+		return NULL;
+
+	interned = nih_new (new_str, InternString);
+	if (! interned) {
+		nih_unref (new_str, parent);
+		return NULL;
+	}
+
+	nih_list_init (&interned->entry);
+	nih_alloc_set_destructor (interned, nih_list_destroy);
+
+	interned->str = new_str;
+
+	hash_add (NULL, &intern_strings, &interned->entry);
+
+	return new_str;
+}
@@ -28,6 +28,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
@@ -36,6 +37,7 @@
 #include <nih/hash.h>
 #include <nih/signal.h>
 #include <nih/logging.h>
+#include <nih/error.h>
 
 #include <nih-dbus/dbus_error.h>
 #include <nih-dbus/dbus_message.h>
@@ -46,6 +48,8 @@
 
 #include "events.h"
 #include "environ.h"
+#include "hash.h"
+#include "intern.h"
 #include "process.h"
 #include "job_class.h"
 #include "job.h"
@@ -54,11 +58,35 @@
 #include "event_operator.h"
 #include "blocked.h"
 #include "control.h"
+#include "cgroup.h"
 
 #include "com.ubuntu.Upstart.Job.h"
 #include "com.ubuntu.Upstart.Instance.h"
 
 
+/**
+ * job_transitions:
+ *
+ * Table of the next state for a job, indexed by its current state and
+ * its goal.  Combinations that should never occur are marked with -1;
+ * job_next_state() handles the few transitions that depend on more
+ * than the state and goal.
+ **/
+static const int job_transitions[][3] = {
+	/*                   JOB_STOP        JOB_START       JOB_RESPAWN */
+	[JOB_WAITING]    = { -1,             JOB_STARTING,   -1           },
+	[JOB_STARTING]   = { JOB_STOPPING,   JOB_PRE_START,  -1           },
+	[JOB_PRE_START]  = { JOB_STOPPING,   JOB_SPAWNED,    -1           },
+	[JOB_SPAWNED]    = { JOB_STOPPING,   JOB_POST_START, -1           },
+	[JOB_POST_START] = { JOB_STOPPING,   JOB_RUNNING,    JOB_STOPPING },
+	[JOB_RUNNING]    = { JOB_PRE_STOP,   JOB_STOPPING,   -1           },
+	[JOB_PRE_STOP]   = { JOB_STOPPING,   JOB_RUNNING,    JOB_STOPPING },
+	[JOB_STOPPING]   = { JOB_KILLED,     JOB_KILLED,     -1           },
+	[JOB_KILLED]     = { JOB_POST_STOP,  JOB_POST_STOP,  -1           },
+	[JOB_POST_STOP]  = { JOB_WAITING,    JOB_STARTING,   -1           },
+};
+
+
 /**
  * job_new:
  * @class: class of job,
@@ -91,9 +119,16 @@ job_new (JobClass   *class,
 
 	nih_list_init (&job->entry);
 
-	nih_alloc_set_destructor (job, nih_list_destroy);
+	job->fds = NULL;
+	job->fd_names = NULL;
+	job->num_fds = 0;
+
+	job->cgroup = NULL;
+	job->cgroup_watch = NULL;
+
+	nih_alloc_set_destructor (job, job_destroy);
 
-	job->name = nih_strdup (job, name);
+	job->name = intern_string (job, name);
 	if (! job->name)
 		goto error;
 
@@ -111,16 +146,16 @@ job_new (JobClass   *class,
 	job->start_env = NULL;
 	job->stop_env = NULL;
 
+	/* The stop on expression is shared with the class, only whether
+	 * each of its operators has matched is kept for the instance.
+	 */
 	job->stop_on = NULL;
 	if (class->stop_on) {
-		job->stop_on = event_operator_copy (job, class->stop_on);
+		job->stop_on = event_operator_state_new (job, class->stop_on);
 		if (! job->stop_on)
 			goto error;
 	}
 
-	job->fds = NULL;
-	job->num_fds = 0;
-
 	job->pid = nih_alloc (job, sizeof (pid_t) * PROCESS_LAST);
 	if (! job->pid)
 		goto error;
@@ -133,6 +168,7 @@ job_new (JobClass   *class,
 
 	job->kill_timer = NULL;
 	job->kill_process = -1;
+	job->kill_step = 0;
 
 	job->failed = FALSE;
 	job->failed_process = -1;
@@ -140,11 +176,21 @@ job_new (JobClass   *class,
 
 	job->respawn_time = 0;
 	job->respawn_count = 0;
+	job->respawn_delay = 0;
+	job->respawn_pending = FALSE;
+	job->respawn_timer = NULL;
+	job->spawn_time = 0;
 
 	job->trace_forks = 0;
 	job->trace_state = TRACE_NONE;
 
-	nih_hash_add (class->instances, &job->entry);
+	if (cgroup_root) {
+		job->cgroup = cgroup_path (job, class->name, job->name);
+		if (! job->cgroup)
+			goto error;
+	}
+
+	hash_add (class, &class->instances, &job->entry);
 
 	NIH_LIST_FOREACH (control_conns, iter) {
 		NihListEntry   *entry = (NihListEntry *)iter;
@@ -160,6 +206,68 @@ error:
 	return NULL;
 }
 
+/**
+ * job_destroy:
+ * @job: job to be destroyed.
+ *
+ * Closes any file descriptors passed to @job, removes its control group
+ * if it has one and removes it from the list of instances of its class.
+ *
+ * Normally used or called from an nih_alloc() destructor so that the
+ * descriptors aren't leaked when the job is freed.
+ *
+ * Returns: zero.
+ **/
+int
+job_destroy (Job *job)
+{
+	nih_assert (job != NULL);
+
+	job_close_fds (job);
+
+	/* The group can only be removed once empty, anything left running
+	 * in it keeps it around to be found again by a new instance.
+	 */
+	if (job->cgroup && (cgroup_remove (job->cgroup) < 0)) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_debug ("Failed to remove %s: %s", job->cgroup,
+			   err->message);
+		nih_free (err);
+	}
+
+	nih_list_destroy (&job->entry);
+
+	return 0;
+}
+
+/**
+ * job_close_fds:
+ * @job: job to close descriptors of.
+ *
+ * Closes the file descriptors that were passed to @job by the events
+ * that started it and frees the arrays holding them.
+ **/
+void
+job_close_fds (Job *job)
+{
+	nih_assert (job != NULL);
+
+	for (size_t i = 0; i < job->num_fds; i++)
+		close (job->fds[i]);
+
+	if (job->fds)
+		nih_free (job->fds);
+	if (job->fd_names)
+		nih_free (job->fd_names);
+
+	job->fds = NULL;
+	job->fd_names = NULL;
+	job->num_fds = 0;
+}
+
+
 /**
  * job_register:
  * @job: job to register,
@@ -252,8 +360,15 @@ job_change_goal (Job     *job,
 
 		break;
 	case JOB_STOP:
-		if (job->state == JOB_RUNNING)
+		if (job->state == JOB_RUNNING) {
 			job_change_state (job, job_next_state (job));
+		} else if (job->respawn_timer) {
+			/* No need to wait out a respawn that won't happen */
+			nih_unref (job->respawn_timer, job);
+			job->respawn_timer = NULL;
+
+			job_change_state (job, job_next_state (job));
+		}
 
 		break;
 	case JOB_RESPAWN:
@@ -523,118 +638,73 @@ job_change_state (Job      *job,
  * failed.  It is also up to the caller to actually set the new state as
  * this simply returns the suggested one.
  *
+ * A job in the post-stop state with a backed off respawn pending is kept
+ * there, with a timer set to start it again once the delay has passed.
+ *
  * Returns: suggested state to change to.
  **/
 JobState
 job_next_state (Job *job)
 {
+	int state;
+
 	nih_assert (job != NULL);
+	nih_assert (job->state <= JOB_POST_STOP);
+	nih_assert (job->goal <= JOB_RESPAWN);
 
-	switch (job->state) {
-	case JOB_WAITING:
-		switch (job->goal) {
-		case JOB_STOP:
-			nih_assert_not_reached ();
-		case JOB_START:
-			return JOB_STARTING;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_STARTING:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_STOPPING;
-		case JOB_START:
-			return JOB_PRE_START;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_PRE_START:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_STOPPING;
-		case JOB_START:
-			return JOB_SPAWNED;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_SPAWNED:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_STOPPING;
-		case JOB_START:
-			return JOB_POST_START;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_POST_START:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_STOPPING;
-		case JOB_START:
-			return JOB_RUNNING;
-		case JOB_RESPAWN:
-			job_change_goal (job, JOB_START);
-			return JOB_STOPPING;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_RUNNING:
-		switch (job->goal) {
-		case JOB_STOP:
-			if (job->class->process[PROCESS_MAIN]
-			    && (job->pid[PROCESS_MAIN] > 0)) {
-				return JOB_PRE_STOP;
-			} else {
-				return JOB_STOPPING;
-			}
-		case JOB_START:
-			return JOB_STOPPING;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_PRE_STOP:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_STOPPING;
-		case JOB_START:
-			return JOB_RUNNING;
-		case JOB_RESPAWN:
-			job_change_goal (job, JOB_START);
-			return JOB_STOPPING;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_STOPPING:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_KILLED;
-		case JOB_START:
-			return JOB_KILLED;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_KILLED:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_POST_STOP;
-		case JOB_START:
-			return JOB_POST_STOP;
-		default:
-			nih_assert_not_reached ();
-		}
-	case JOB_POST_STOP:
-		switch (job->goal) {
-		case JOB_STOP:
-			return JOB_WAITING;
-		case JOB_START:
-			return JOB_STARTING;
-		default:
-			nih_assert_not_reached ();
-		}
-	default:
-		nih_assert_not_reached ();
+	state = job_transitions[job->state][job->goal];
+	nih_assert (state >= 0);
+
+	/* A running job only needs to go through pre-stop if there's a
+	 * main process for it to be run alongside.
+	 */
+	if ((state == JOB_PRE_STOP)
+	    && ! (job->class->process[PROCESS_MAIN]
+		  && (job->pid[PROCESS_MAIN] > 0)))
+		state = JOB_STOPPING;
+
+	/* A respawn goal is satisfied by stopping and starting again */
+	if (job->goal == JOB_RESPAWN)
+		job_change_goal (job, JOB_START);
+
+	/* A respawn that's being backed off waits in post-stop for its
+	 * delay before starting again.
+	 */
+	if (job->state == JOB_POST_STOP) {
+		if (job->respawn_pending && (state == JOB_STARTING))
+			job->respawn_timer = NIH_MUST (nih_timer_add_timeout (
+					job, job->respawn_delay,
+					(NihTimerCb)job_respawn_timer, job));
+
+		job->respawn_pending = FALSE;
+
+		if (job->respawn_timer)
+			state = JOB_POST_STOP;
 	}
+
+	return state;
+}
+
+/**
+ * job_respawn_timer:
+ * @job: job to respawn,
+ * @timer: timer that caused us to be called.
+ *
+ * This callback is called once the delay before a backed off respawn of
+ * @job has passed, and starts it again.
+ **/
+void
+job_respawn_timer (Job      *job,
+		   NihTimer *timer)
+{
+	nih_assert (job != NULL);
+	nih_assert (timer != NULL);
+	nih_assert (job->respawn_timer == timer);
+	nih_assert (job->state == JOB_POST_STOP);
+
+	job->respawn_timer = NULL;
+
+	job_change_state (job, job_next_state (job));
 }
 
 
@@ -810,12 +880,11 @@ job_finished (Job *job,
 Event *
 job_emit_event (Job *job)
 {
-	Event           *event;
-	const char      *name;
-	int              block = FALSE, stop = FALSE;
-	nih_local char **env = NULL;
-	char           **e;
-	size_t           len;
+	Event                  *event;
+	const char             *name;
+	int                     block = FALSE, stop = FALSE;
+	nih_local EnvironTable *env = NULL;
+	char                  **e;
 
 	nih_assert (job != NULL);
 
@@ -840,21 +909,20 @@ job_emit_event (Job *job)
 		nih_assert_not_reached ();
 	}
 
-	len = 0;
-	env = NIH_MUST (nih_str_array_new (NULL));
+	env = NIH_MUST (environ_table_new (NULL, NULL));
 
 	/* Add the job and instance name */
-	NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-			       "JOB=%s", job->class->name));
-	NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-			       "INSTANCE=%s", job->name));
+	NIH_MUST (environ_table_set (env, TRUE,
+				     "JOB=%s", job->class->name));
+	NIH_MUST (environ_table_set (env, TRUE,
+				     "INSTANCE=%s", job->name));
 
 	/* Stop events include a "failed" argument if a process failed,
 	 * otherwise stop events have an "ok" argument.
 	 */
 	if (stop && job->failed) {
-		NIH_MUST (environ_add (&env, NULL, &len, TRUE,
-				       "RESULT=failed"));
+		NIH_MUST (environ_table_add (env, TRUE,
+					     "RESULT=failed"));
 
 		/* Include information about the process that failed, and
 		 * the signal/exit information.  If it was the spawn itself
@@ -864,9 +932,9 @@ job_emit_event (Job *job)
 		 */
 		if ((job->failed_process != (ProcessType)-1)
 		    && (job->exit_status != -1)) {
-			NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-					       "PROCESS=%s",
-					       process_name (job->failed_process)));
+			NIH_MUST (environ_table_set (env, TRUE,
+						     "PROCESS=%s",
+						     process_name (job->failed_process)));
 
 			/* If the job was terminated by a signal, that
 			 * will be stored in the higher byte and we
@@ -877,38 +945,44 @@ job_emit_event (Job *job)
 
 				sig = nih_signal_to_name (job->exit_status >> 8);
 				if (sig) {
-					NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-							       "EXIT_SIGNAL=%s", sig));
+					NIH_MUST (environ_table_set (env, TRUE,
+								     "EXIT_SIGNAL=%s", sig));
 				} else {
-					NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-							       "EXIT_SIGNAL=%d", job->exit_status >> 8));
+					NIH_MUST (environ_table_set (env, TRUE,
+								     "EXIT_SIGNAL=%d", job->exit_status >> 8));
 				}
 			} else {
-				NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-						       "EXIT_STATUS=%d", job->exit_status));
+				NIH_MUST (environ_table_set (env, TRUE,
+							     "EXIT_STATUS=%d", job->exit_status));
 			}
 		} else if (job->failed_process != (ProcessType)-1) {
-			NIH_MUST (environ_set (&env, NULL, &len, TRUE,
-					       "PROCESS=%s",
-					       process_name (job->failed_process)));
+			NIH_MUST (environ_table_set (env, TRUE,
+						     "PROCESS=%s",
+						     process_name (job->failed_process)));
 		} else {
-			NIH_MUST (environ_add (&env, NULL, &len, TRUE,
-					       "PROCESS=respawn"));
+			NIH_MUST (environ_table_add (env, TRUE,
+						     "PROCESS=respawn"));
 		}
 	} else if (stop) {
-		NIH_MUST (environ_add (&env, NULL, &len, TRUE, "RESULT=ok"));
+		NIH_MUST (environ_table_add (env, TRUE, "RESULT=ok"));
 	}
 
 	/* Add any exported variables from the job environment */
-	for (e = job->class->export; e && *e; e++) {
-		char * const *str;
+	if (job->class->export && *job->class->export) {
+		nih_local EnvironTable *job_env = NULL;
+
+		job_env = NIH_MUST (environ_table_copy (NULL, job->env));
 
-		str = environ_lookup (job->env, *e, strlen (*e));
-		if (str)
-			NIH_MUST (environ_add (&env, NULL, &len, FALSE, *str));
+		for (e = job->class->export; *e; e++) {
+			char * const *str;
+
+			str = environ_table_lookup (job_env, *e, strlen (*e));
+			if (str)
+				NIH_MUST (environ_table_add (env, FALSE, *str));
+		}
 	}
 
-	event = NIH_MUST (event_new (NULL, name, env));
+	event = NIH_MUST (event_new (NULL, name, env->env));
 
 	if (block) {
 		Blocked *blocked;
@@ -1438,3 +1512,90 @@ job_get_processes (Job *                  job,
 
 	return 0;
 }
+
+
+/**
+ * job_get_cpu_usage:
+ * @job: job to obtain usage from,
+ * @message: D-Bus connection and message received,
+ * @cpu_usage: pointer for reply value.
+ *
+ * Implements the get method for the cpu_usage property of the
+ * com.ubuntu.Upstart.Instance interface.
+ *
+ * Called to obtain the total CPU time in microseconds consumed by the
+ * processes of the given @job, which will be stored in @cpu_usage.  This
+ * is only known while the job has a control group, and is zero otherwise.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+job_get_cpu_usage (Job            *job,
+		   NihDBusMessage *message,
+		   uint64_t       *cpu_usage)
+{
+	nih_assert (job != NULL);
+	nih_assert (message != NULL);
+	nih_assert (cpu_usage != NULL);
+
+	*cpu_usage = 0;
+
+	if (job->cgroup && (cgroup_cpu_usage (job->cgroup, cpu_usage) < 0)) {
+		NihError *err;
+
+		err = nih_error_get ();
+		if (err->number == ENOMEM) {
+			nih_error_raise_error (err);
+			return -1;
+		}
+		nih_free (err);
+
+		*cpu_usage = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * job_get_memory_usage:
+ * @job: job to obtain usage from,
+ * @message: D-Bus connection and message received,
+ * @memory_usage: pointer for reply value.
+ *
+ * Implements the get method for the memory_usage property of the
+ * com.ubuntu.Upstart.Instance interface.
+ *
+ * Called to obtain the memory in bytes currently used by the processes of
+ * the given @job, which will be stored in @memory_usage.  This is only
+ * known while the job has a control group with the memory controller
+ * enabled, and is zero otherwise.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+job_get_memory_usage (Job            *job,
+		      NihDBusMessage *message,
+		      uint64_t       *memory_usage)
+{
+	nih_assert (job != NULL);
+	nih_assert (message != NULL);
+	nih_assert (memory_usage != NULL);
+
+	*memory_usage = 0;
+
+	if (job->cgroup
+	    && (cgroup_memory_usage (job->cgroup, memory_usage) < 0)) {
+		NihError *err;
+
+		err = nih_error_get ();
+		if (err->number == ENOMEM) {
+			nih_error_raise_error (err);
+			return -1;
+		}
+		nih_free (err);
+
+		*memory_usage = 0;
+	}
+
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include <nih/macros.h>
 #include <nih/list.h>
 #include <nih/timer.h>
+#include <nih/io.h>
 
 #include <nih-dbus/dbus_message.h>
 
@@ -101,19 +102,29 @@ typedef enum trace_state {
  * @env: NULL-terminated list of environment variables,
  * @start_env: environment to use next time the job is started,
  * @stop_env: environment to add for the next pre-stop script,
- * @stop_on: event operator expression that can stop this job.
+ * @stop_on: state of the class's stop on expression for this job.
+ * @fds: file descriptors passed to the job's processes,
+ * @fd_names: NULL-terminated list of names for @fds,
+ * @num_fds: number of entries in @fds,
  * @pid: current process ids,
  * @blocker: emitted event we're waiting to finish,
  * @blocking: list of events we're blocking from finishing,
  * @kill_timer: timer to kill process,
  * @kill_process: process @kill_timer will kill,
+ * @kill_step: number of escalation signals sent to @kill_process,
  * @failed: whether the last process ran failed,
  * @failed_process: the last process that failed,
  * @exit_status: exit status of the last failed process,
  * @respawn_time: time job was first respawned,
  * @respawn_count: number of respawns since @respawn_time,
+ * @respawn_delay: delay before the last respawn that was backed off,
+ * @respawn_pending: whether the next start waits for @respawn_delay,
+ * @respawn_timer: timer to start the job again after @respawn_delay,
+ * @spawn_time: time the main process was last spawned,
  * @trace_forks: number of forks traced,
- * @trace_state: state of trace.
+ * @trace_state: state of trace,
+ * @cgroup: control group for main process,
+ * @cgroup_watch: watch on @cgroup while main process is running.
  *
  * This structure holds the state of an active job instance being tracked
  * by the init daemon, the configuration details of the job are available
@@ -132,10 +143,11 @@ typedef struct job {
 
 	char          **start_env;
 	char          **stop_env;
-	EventOperator  *stop_on;
+	EventOperatorState *stop_on;
 
-	int *fds;
-	size_t num_fds;
+	int            *fds;
+	char          **fd_names;
+	size_t          num_fds;
 
 	pid_t          *pid;
 	Event          *blocker;
@@ -143,6 +155,7 @@ typedef struct job {
 
 	NihTimer       *kill_timer;
 	ProcessType     kill_process;
+	int             kill_step;
 
 	int             failed;
 	ProcessType     failed_process;
@@ -150,9 +163,16 @@ typedef struct job {
 
 	time_t          respawn_time;
 	int             respawn_count;
+	time_t          respawn_delay;
+	int             respawn_pending;
+	NihTimer       *respawn_timer;
+	time_t          spawn_time;
 
 	int             trace_forks;
 	TraceState      trace_state;
+
+	char           *cgroup;
+	NihIo          *cgroup_watch;
 } Job;
 
 
@@ -160,13 +180,18 @@ NIH_BEGIN_EXTERN
 
 Job *       job_new             (JobClass *class, const char *name)
 	__attribute__ ((warn_unused_result, malloc));
+int         job_destroy         (Job *job);
 void        job_register        (Job *job, DBusConnection *conn, int signal);
 
+void        job_close_fds       (Job *job);
+
 void        job_change_goal     (Job *job, JobGoal goal);
 
 void        job_change_state    (Job *job, JobState state);
 JobState    job_next_state      (Job *job);
 
+void        job_respawn_timer   (Job *job, NihTimer *timer);
+
 void        job_failed          (Job *job, ProcessType process, int status);
 void        job_finished        (Job *job, int failed);
 
@@ -205,6 +230,13 @@ int         job_get_processes   (Job *job, NihDBusMessage *message,
 				 JobProcessesElement ***processes)
 	__attribute__ ((warn_unused_result));
 
+int         job_get_cpu_usage   (Job *job, NihDBusMessage *message,
+				 uint64_t *cpu_usage)
+	__attribute__ ((warn_unused_result));
+int         job_get_memory_usage (Job *job, NihDBusMessage *message,
+				  uint64_t *memory_usage)
+	__attribute__ ((warn_unused_result));
+
 NIH_END_EXTERN
 
 #endif /* INIT_JOB_H */
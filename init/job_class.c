@@ -44,6 +44,8 @@
 #include "dbus/upstart.h"
 
 #include "environ.h"
+#include "hash.h"
+#include "intern.h"
 #include "process.h"
 #include "job_class.h"
 #include "job.h"
@@ -51,14 +53,21 @@
 #include "blocked.h"
 #include "conf.h"
 #include "control.h"
+#include "parse_job.h"
 
 #include "com.ubuntu.Upstart.h"
 #include "com.ubuntu.Upstart.Job.h"
 
 
 /* Prototypes for static functions */
-static void job_class_add    (JobClass *class);
-static int  job_class_remove (JobClass *class);
+static void job_class_add         (JobClass *class);
+static int  job_class_remove      (JobClass *class);
+static int  job_class_adopt       (JobClass *class, JobClass *old_class);
+
+static int  job_class_str_equal   (const char *str, const char *other);
+static int  job_class_strv_equal  (char * const *strv, char * const *other);
+static int  job_class_array_equal (const int *array, size_t len,
+				   const int *other, size_t other_len);
 
 
 /**
@@ -119,7 +128,7 @@ job_class_new (const void *parent,
 
 	nih_alloc_set_destructor (class, nih_list_destroy);
 
-	class->name = nih_strdup (class, name);
+	class->name = intern_string (class, name);
 	if (! class->name)
 		goto error;
 
@@ -132,6 +141,8 @@ job_class_new (const void *parent,
 	if (! class->instance)
 		goto error;
 
+	class->instance_template = NULL;
+
 	class->instances = nih_hash_string_new (class, 0);
 	if (! class->instances)
 		goto error;
@@ -143,6 +154,7 @@ job_class_new (const void *parent,
 	class->env = NULL;
 	class->export = NULL;
 	class->import = NULL;
+	class->base_env = NULL;
 
 	class->start_on = NULL;
 	class->stop_on = NULL;
@@ -160,10 +172,17 @@ job_class_new (const void *parent,
 
 	class->kill_timeout = JOB_DEFAULT_KILL_TIMEOUT;
 	class->kill_signal = SIGTERM;
+	class->kill_escalate = NULL;
+	class->kill_escalate_len = 0;
+	class->kill_mode = KILL_GROUP;
 
 	class->respawn = FALSE;
 	class->respawn_limit = JOB_DEFAULT_RESPAWN_LIMIT;
 	class->respawn_interval = JOB_DEFAULT_RESPAWN_INTERVAL;
+	class->respawn_backoff_delay = 0;
+	class->respawn_backoff_multiplier = 1;
+	class->respawn_backoff_max = 0;
+	class->respawn_backoff_reset = 0;
 
 	class->normalexit = NULL;
 	class->normalexit_len = 0;
@@ -177,9 +196,14 @@ job_class_new (const void *parent,
 	for (i = 0; i < RLIMIT_NLIMITS; i++)
 		class->limits[i] = NULL;
 
+	for (i = 0; i < CGROUP_SETTING_LAST; i++)
+		class->cgroup_settings[i] = NULL;
+
 	class->chroot = NULL;
 	class->chdir = NULL;
 
+	class->deferred = NULL;
+
 	class->deleted = FALSE;
 	class->debug   = FALSE;
 
@@ -215,11 +239,29 @@ job_class_consider (JobClass *class)
 
 	registered = (JobClass *)nih_hash_lookup (job_classes, class->name);
 	if (registered != best) {
-		if (registered)
-			if (! job_class_remove (registered))
+		int adopted = FALSE;
+
+		/* A class with active instances can still be replaced if
+		 * nothing that differs would affect them, in which case the
+		 * instances are handed over to the best class.
+		 */
+		if (registered && (! job_class_remove (registered))) {
+			if (! job_class_adopt (best, registered))
 				return FALSE;
 
+			adopted = job_class_remove (registered);
+			nih_assert (adopted);
+		}
+
 		job_class_add (best);
+
+		/* A deleted class was only kept for its instances; now
+		 * they have been handed over, nothing refers to it.
+		 */
+		if (adopted && registered->deleted) {
+			nih_debug ("Destroyed replaced job %s", registered->name);
+			nih_free (registered);
+		}
 	}
 
 	return (class == best ? TRUE : FALSE);
@@ -266,6 +308,89 @@ job_class_reconsider (JobClass *class)
 	return TRUE;
 }
 
+/**
+ * job_class_materialise:
+ * @class: job class to complete.
+ *
+ * Completes the definition of @class if parts of it were deferred when
+ * it was loaded, see parse_job_header(); this must be done before any
+ * instance of @class is started, or its definition is otherwise used.
+ *
+ * Any error in the deferred definitions is logged, and @class is left
+ * incomplete so that it can never be started.
+ *
+ * Returns: zero if @class is complete, negative value otherwise.
+ **/
+int
+job_class_materialise (JobClass *class)
+{
+	size_t lineno = 1;
+
+	nih_assert (class != NULL);
+
+	if (! class->deferred)
+		return 0;
+
+	if (parse_job_deferred (class, &lineno) < 0) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_error ("%s:%zi: %s", class->name, lineno, err->message);
+		nih_free (err);
+
+		return -1;
+	}
+
+	nih_debug ("Completed job %s", class->name);
+
+	return 0;
+}
+
+/**
+ * job_class_pack:
+ * @class: job class to pack.
+ *
+ * Replaces the start on and stop on expressions of @class with copies
+ * packed into single blocks by event_operator_pack().  This should be
+ * called again whenever either expression is parsed again.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+job_class_pack (JobClass *class)
+{
+	EventOperator *start_on = NULL, *stop_on = NULL;
+
+	nih_assert (class != NULL);
+
+	if (class->start_on) {
+		start_on = event_operator_pack (class, class->start_on);
+		if (! start_on)
+			return -1;
+	}
+
+	if (class->stop_on) {
+		stop_on = event_operator_pack (class, class->stop_on);
+		if (! stop_on) {
+			if (start_on)
+				nih_unref (start_on, class);
+			return -1;
+		}
+	}
+
+	if (start_on) {
+		nih_unref (class->start_on, class);
+		class->start_on = start_on;
+	}
+
+	if (stop_on) {
+		nih_unref (class->stop_on, class);
+		class->stop_on = stop_on;
+	}
+
+	return 0;
+}
+
 /**
  * job_class_add:
  * @class: new class to select.
@@ -324,6 +449,263 @@ job_class_remove (JobClass *class)
 	return TRUE;
 }
 
+/**
+ * job_class_adopt:
+ * @class: class to take the instances,
+ * @old_class: class to take them from.
+ *
+ * Moves the active instances of @old_class to @class so that @class can
+ * replace it without waiting for them to finish.  This is only done when
+ * every difference between the two classes is one that can be applied
+ * while instances are active, see JOB_CLASS_CHANGE_LIVE.
+ *
+ * The instances are unregistered from all current D-Bus connections, they
+ * will be registered again along with @class.
+ *
+ * Returns: TRUE if the instances were moved, FALSE otherwise.
+ **/
+static int
+job_class_adopt (JobClass *class,
+		 JobClass *old_class)
+{
+	int changes;
+
+	nih_assert (old_class != NULL);
+
+	control_init ();
+
+	if (! class)
+		return FALSE;
+
+	if (job_class_materialise (class) < 0)
+		return FALSE;
+
+	changes = job_class_diff (old_class, class);
+	if (changes & ~JOB_CLASS_CHANGE_LIVE)
+		return FALSE;
+
+	/* The stop on expression is unchanged, so once numbered the same
+	 * way the state each instance holds for it remains valid.
+	 */
+	if (class->stop_on)
+		event_operator_index (class->stop_on);
+
+	nih_info (_("Applying changes to %s to its active instances"),
+		  class->name);
+
+	NIH_HASH_FOREACH_SAFE (old_class->instances, iter) {
+		Job *job = (Job *)iter;
+
+		NIH_LIST_FOREACH (control_conns, conn_iter) {
+			NihListEntry   *entry = (NihListEntry *)conn_iter;
+			DBusConnection *conn = (DBusConnection *)entry->data;
+
+			NIH_MUST (dbus_connection_unregister_object_path (
+					  conn, job->path));
+		}
+
+		nih_ref (job, class);
+		nih_unref (job, old_class);
+
+		nih_list_remove (&job->entry);
+		hash_add (class, &class->instances, &job->entry);
+
+		job->class = class;
+	}
+
+	return TRUE;
+}
+
+/**
+ * job_class_diff:
+ * @class: job class,
+ * @other: job class to compare with.
+ *
+ * Compares the definition of @class with that of @other, usually a newer
+ * definition of the same job, ignoring the name and any state such as
+ * active instances or matched events.
+ *
+ * Returns: JobClassChange flags for each part that differs, or
+ * JOB_CLASS_CHANGE_NONE if the definitions are the same.
+ **/
+int
+job_class_diff (const JobClass *class,
+		const JobClass *other)
+{
+	int changes = JOB_CLASS_CHANGE_NONE;
+	int i;
+
+	nih_assert (class != NULL);
+	nih_assert (other != NULL);
+
+	if ((! job_class_str_equal (class->description, other->description))
+	    || (! job_class_str_equal (class->author, other->author))
+	    || (! job_class_str_equal (class->version, other->version))
+	    || (! job_class_strv_equal (class->emits, other->emits))
+	    || (class->debug != other->debug))
+		changes |= JOB_CLASS_CHANGE_INFO;
+
+	if (! event_operator_equal (class->start_on, other->start_on))
+		changes |= JOB_CLASS_CHANGE_START_ON;
+
+	if (! event_operator_equal (class->stop_on, other->stop_on))
+		changes |= JOB_CLASS_CHANGE_STOP_ON;
+
+	if (! job_class_str_equal (class->instance, other->instance))
+		changes |= JOB_CLASS_CHANGE_INSTANCE;
+
+	if ((! job_class_strv_equal (class->env, other->env))
+	    || (! job_class_strv_equal (class->export, other->export))
+	    || (! job_class_strv_equal (class->import, other->import)))
+		changes |= JOB_CLASS_CHANGE_ENV;
+
+	for (i = 0; i < PROCESS_LAST; i++) {
+		Process *process = class->process[i];
+		Process *other_process = other->process[i];
+
+		if ((! process) || (! other_process)) {
+			if (process != other_process)
+				changes |= JOB_CLASS_CHANGE_PROCESS;
+		} else if ((process->script != other_process->script)
+			   || strcmp (process->command,
+				      other_process->command)) {
+			changes |= JOB_CLASS_CHANGE_PROCESS;
+		}
+	}
+
+	if ((class->expect != other->expect)
+	    || (class->task != other->task))
+		changes |= JOB_CLASS_CHANGE_EXPECT;
+
+	if ((class->kill_timeout != other->kill_timeout)
+	    || (class->kill_signal != other->kill_signal)
+	    || (class->kill_mode != other->kill_mode)
+	    || (! job_class_array_equal (class->kill_escalate,
+					 class->kill_escalate_len,
+					 other->kill_escalate,
+					 other->kill_escalate_len)))
+		changes |= JOB_CLASS_CHANGE_KILL;
+
+	if ((class->respawn != other->respawn)
+	    || (class->respawn_limit != other->respawn_limit)
+	    || (class->respawn_interval != other->respawn_interval)
+	    || (class->respawn_backoff_delay != other->respawn_backoff_delay)
+	    || (class->respawn_backoff_multiplier
+		!= other->respawn_backoff_multiplier)
+	    || (class->respawn_backoff_max != other->respawn_backoff_max)
+	    || (class->respawn_backoff_reset != other->respawn_backoff_reset)
+	    || (! job_class_array_equal (class->normalexit,
+					 class->normalexit_len,
+					 other->normalexit,
+					 other->normalexit_len)))
+		changes |= JOB_CLASS_CHANGE_RESPAWN;
+
+	if ((class->console != other->console)
+	    || (class->umask != other->umask)
+	    || (class->nice != other->nice)
+	    || (class->oom_score_adj != other->oom_score_adj)
+	    || (! job_class_str_equal (class->chroot, other->chroot))
+	    || (! job_class_str_equal (class->chdir, other->chdir)))
+		changes |= JOB_CLASS_CHANGE_LIMITS;
+
+	for (i = 0; i < RLIMIT_NLIMITS; i++) {
+		struct rlimit *limit = class->limits[i];
+		struct rlimit *other_limit = other->limits[i];
+
+		if ((! limit) || (! other_limit)) {
+			if (limit != other_limit)
+				changes |= JOB_CLASS_CHANGE_LIMITS;
+		} else if ((limit->rlim_cur != other_limit->rlim_cur)
+			   || (limit->rlim_max != other_limit->rlim_max)) {
+			changes |= JOB_CLASS_CHANGE_LIMITS;
+		}
+	}
+
+	for (i = 0; i < CGROUP_SETTING_LAST; i++)
+		if (! job_class_str_equal (class->cgroup_settings[i],
+					   other->cgroup_settings[i]))
+			changes |= JOB_CLASS_CHANGE_CGROUP;
+
+	return changes;
+}
+
+/**
+ * job_class_str_equal:
+ * @str: string,
+ * @other: string to compare with.
+ *
+ * Compares two strings, either of which may be NULL.
+ *
+ * Returns: TRUE if the strings are equal, FALSE otherwise.
+ **/
+static int
+job_class_str_equal (const char *str,
+		     const char *other)
+{
+	if ((! str) || (! other))
+		return (str == other ? TRUE : FALSE);
+
+	return (strcmp (str, other) ? FALSE : TRUE);
+}
+
+/**
+ * job_class_strv_equal:
+ * @strv: NULL-terminated array of strings,
+ * @other: array to compare with.
+ *
+ * Compares two NULL-terminated arrays of strings, either of which may be
+ * NULL; an empty array is considered equal to NULL.
+ *
+ * Returns: TRUE if the arrays are equal, FALSE otherwise.
+ **/
+static int
+job_class_strv_equal (char * const *strv,
+		      char * const *other)
+{
+	size_t i;
+
+	for (i = 0; strv && strv[i] && other && other[i]; i++)
+		if (strcmp (strv[i], other[i]))
+			return FALSE;
+
+	if (strv && strv[i])
+		return FALSE;
+	if (other && other[i])
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * job_class_array_equal:
+ * @array: array of integers,
+ * @len: length of @array,
+ * @other: array to compare with,
+ * @other_len: length of @other.
+ *
+ * Compares two arrays of integers.
+ *
+ * Returns: TRUE if the arrays are equal, FALSE otherwise.
+ **/
+static int
+job_class_array_equal (const int *array,
+		       size_t     len,
+		       const int *other,
+		       size_t     other_len)
+{
+	size_t i;
+
+	if (len != other_len)
+		return FALSE;
+
+	for (i = 0; i < len; i++)
+		if (array[i] != other[i])
+			return FALSE;
+
+	return TRUE;
+}
+
+
 /**
  * job_class_register:
  * @class: class to register,
@@ -398,6 +780,13 @@ job_class_unregister (JobClass       *class,
  * This table is suitable for storing in @job's env member so that it is
  * used for all processes spawned by the job.
  *
+ * The table is built once and cached in @class as its base_env member,
+ * the returned table being a copy that shares its strings with the cache
+ * (see environ_copy()) so that only the entries replaced or added by the
+ * caller are allocated for each new instance.  Since a class is never
+ * modified once it has been parsed, with reloaded configuration replacing
+ * it with a new class, the cache need never be invalidated.
+ *
  * If @len is not NULL it will be updated to contain the new array length.
  *
  * If @parent is not NULL, it should be a pointer to another object which
@@ -414,29 +803,33 @@ job_class_environment (const void *parent,
 {
 	char * const   builtin[] = { JOB_DEFAULT_ENVIRONMENT, NULL };
 	char         **env;
+	size_t         env_len = 0;
 
 	nih_assert (class != NULL);
 
-	env = nih_str_array_new (parent);
+	if (class->base_env)
+		return environ_copy (parent, len, class->base_env);
+
+	env = nih_str_array_new (class);
 	if (! env)
 		return NULL;
-	if (len)
-		*len = 0;
 
 	/* Copy the builtin set of environment variables, usually these just
 	 * pick up the values from init's own environment.
 	 */
-	if (! environ_append (&env, parent, len, TRUE, builtin))
+	if (! environ_append (&env, class, &env_len, TRUE, builtin))
 		goto error;
 
 	/* Copy the set of environment variables from the job configuration,
 	 * these often have values but also often don't and we want them to
 	 * override the builtins.
 	 */
-	if (! environ_append (&env, parent, len, TRUE, class->env))
+	if (! environ_append (&env, class, &env_len, TRUE, class->env))
 		goto error;
 
-	return env;
+	class->base_env = env;
+
+	return environ_copy (parent, len, class->base_env);
 
 error:
 	nih_free (env);
@@ -469,7 +862,9 @@ job_class_import_environment (JobClass     *class,
 			      size_t       *len,
 			      char * const *new_env)
 {
-	char * const *e;
+	nih_local char **imported = NULL;
+	char * const    *e;
+	size_t           n = 0;
 
 	nih_assert (env != NULL);
 
@@ -481,6 +876,17 @@ job_class_import_environment (JobClass     *class,
 			*len = 0;
 	}
 
+	/* Gather the entries to be imported first, so they can all be
+	 * appended to @env at once.
+	 */
+	for (e = new_env; e && *e; e++)
+		n++;
+
+	imported = nih_alloc (NULL, sizeof (char *) * (n + 1));
+	if (! imported)
+		return NULL;
+
+	n = 0;
 	for (e = new_env; e && *e; e++) {
 		char * const *match = NULL;
 		size_t elen;
@@ -497,13 +903,56 @@ job_class_import_environment (JobClass     *class,
 		if (! match || ! *match)
 			continue;
 
-		if (! environ_add (env, parent, len, TRUE, *e))
-			return NULL;
+		imported[n++] = *e;
 	}
+	imported[n] = NULL;
+
+	if (! environ_append (env, parent, len, TRUE, imported))
+		return NULL;
 
 	return *env;
 }
 
+/**
+ * job_class_expand_instance:
+ * @parent: parent object for new string,
+ * @class: job class,
+ * @env: NULL-terminated list of environment variables to use.
+ *
+ * Expands the instance name pattern of @class using @env, returning the
+ * name of the instance that should be used for that environment.
+ *
+ * The pattern is normally compiled when the instance stanza is parsed,
+ * otherwise it is compiled on first use and kept in @class so that it
+ * need not be parsed again; any change to the instance member of @class
+ * must therefore also discard its instance_template member.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: newly allocated string or NULL on raised error.
+ **/
+char *
+job_class_expand_instance (const void   *parent,
+			   JobClass     *class,
+			   char * const *env)
+{
+	nih_assert (class != NULL);
+	nih_assert (class->instance != NULL);
+
+	if (! class->instance_template) {
+		class->instance_template = environ_template_new (
+			class, class->instance);
+		if (! class->instance_template)
+			return NULL;
+	}
+
+	return environ_template_expand (parent, class->instance_template,
+					env);
+}
+
 
 /**
  * job_class_get_instance:
@@ -545,6 +994,16 @@ job_class_get_instance (JobClass        *class,
 		return -1;
 	}
 
+	/* The environment below depends on the complete definition of
+	 * the class, which may have been deferred.
+	 */
+	if (job_class_materialise (class) < 0) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.InvalidJob",
+			_("Job definition of %s is invalid"), class->name);
+		return -1;
+	}
+
 	/* Construct the full environment for the instance based on the class
 	 * and that provided.
 	 */
@@ -559,7 +1018,7 @@ job_class_get_instance (JobClass        *class,
 	/* Use the environment to expand the instance name and look it up
 	 * in the job.
 	 */
-	name = environ_expand (NULL, class->instance, instance_env);
+	name = job_class_expand_instance (NULL, class, instance_env);
 	if (! name) {
 		NihError *error;
 
@@ -662,21 +1121,33 @@ job_class_get_all_instances (JobClass         *class,
 	nih_assert (message != NULL);
 	nih_assert (instances != NULL);
 
+	/* Size the array once rather than growing it for each of what may
+	 * be thousands of instances.
+	 */
 	len = 0;
-	list = nih_str_array_new (message);
+	NIH_HASH_FOREACH (class->instances, iter)
+		len++;
+
+	list = nih_alloc (message, sizeof (char *) * (len + 1));
 	if (! list)
 		nih_return_system_error (-1);
 
+	len = 0;
 	NIH_HASH_FOREACH (class->instances, iter) {
 		Job *job = (Job *)iter;
 
-		if (! nih_str_array_add (&list, message, &len, job->path)) {
+		list[len] = nih_strdup (list, job->path);
+		if (! list[len]) {
 			nih_error_raise_system ();
 			nih_free (list);
 			return -1;
 		}
+
+		len++;
 	}
 
+	list[len] = NULL;
+
 	*instances = list;
 
 	return 0;
@@ -734,6 +1205,16 @@ job_class_start (JobClass        *class,
 		return -1;
 	}
 
+	/* The environment below depends on the complete definition of
+	 * the class, which may have been deferred.
+	 */
+	if (job_class_materialise (class) < 0) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.InvalidJob",
+			_("Job definition of %s is invalid"), class->name);
+		return -1;
+	}
+
 	/* Construct the full environment for the instance based on the class
 	 * and that provided.
 	 */
@@ -747,7 +1228,7 @@ job_class_start (JobClass        *class,
 	/* Use the environment to expand the instance name and look it up
 	 * in the job.
 	 */
-	name = environ_expand (NULL, class->instance, start_env);
+	name = job_class_expand_instance (NULL, class, start_env);
 	if (! name) {
 		NihError *error;
 
@@ -853,6 +1334,16 @@ job_class_stop (JobClass       *class,
 		return -1;
 	}
 
+	/* The environment below depends on the complete definition of
+	 * the class, which may have been deferred.
+	 */
+	if (job_class_materialise (class) < 0) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.InvalidJob",
+			_("Job definition of %s is invalid"), class->name);
+		return -1;
+	}
+
 	/* Construct the full environment for the instance based on the class
 	 * and that provided; while we don't pass this to the instance itself,
 	 * we need this to look up the instance in the first place.
@@ -867,7 +1358,7 @@ job_class_stop (JobClass       *class,
 	/* Use the environment to expand the instance name and look it up
 	 * in the job.
 	 */
-	name = environ_expand (NULL, class->instance, stop_env);
+	name = job_class_expand_instance (NULL, class, stop_env);
 	if (! name) {
 		NihError *error;
 
@@ -977,6 +1468,16 @@ job_class_restart (JobClass        *class,
 		return -1;
 	}
 
+	/* The environment below depends on the complete definition of
+	 * the class, which may have been deferred.
+	 */
+	if (job_class_materialise (class) < 0) {
+		nih_dbus_error_raise_printf (
+			DBUS_INTERFACE_UPSTART ".Error.InvalidJob",
+			_("Job definition of %s is invalid"), class->name);
+		return -1;
+	}
+
 	/* Construct the full environment for the instance based on the class
 	 * and that provided.
 	 */
@@ -991,7 +1492,7 @@ job_class_restart (JobClass        *class,
 	/* Use the environment to expand the instance name and look it up
 	 * in the job.
 	 */
-	name = environ_expand (NULL, class->instance, restart_env);
+	name = job_class_expand_instance (NULL, class, restart_env);
 	if (! name) {
 		NihError *error;
 
@@ -1105,6 +1606,8 @@ job_class_get_description (JobClass        *class,
 	nih_assert (message != NULL);
 	nih_assert (description != NULL);
 
+	job_class_materialise (class);
+
 	if (class->description) {
 		*description = class->description;
 		nih_ref (*description, message);
@@ -1140,6 +1643,8 @@ job_class_get_author (JobClass        *class,
 	nih_assert (message != NULL);
 	nih_assert (author != NULL);
 
+	job_class_materialise (class);
+
 	if (class->author) {
 		*author = class->author;
 		nih_ref (*author, message);
@@ -1175,6 +1680,8 @@ job_class_get_version (JobClass        *class,
 	nih_assert (message != NULL);
 	nih_assert (version != NULL);
 
+	job_class_materialise (class);
+
 	if (class->version) {
 		*version = class->version;
 		nih_ref (*version, message);
@@ -1369,6 +1876,8 @@ job_class_get_emits (JobClass *      class,
 	nih_assert (message != NULL);
 	nih_assert (emits != NULL);
 
+	job_class_materialise (class);
+
 	if (class->emits) {
 		*emits = nih_str_array_copy (message, NULL, class->emits);
 		if (! *emits)
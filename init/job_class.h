@@ -33,8 +33,10 @@
 
 #include <nih-dbus/dbus_message.h>
 
+#include "environ.h"
 #include "process.h"
 #include "event_operator.h"
+#include "cgroup.h"
 
 
 /**
@@ -65,6 +67,53 @@ typedef enum console_type {
 	CONSOLE_OWNER
 } ConsoleType;
 
+/**
+ * KillMode:
+ *
+ * This is used to determine which processes are sent signals when a job's
+ * process is killed.  KILL_GROUP signals the process group of the process,
+ * KILL_TREE additionally signals every descendant of the process and every
+ * process remaining in the job's control group, including those that have
+ * left both the process group and the session.
+ **/
+typedef enum kill_mode {
+	KILL_GROUP,
+	KILL_TREE
+} KillMode;
+
+/**
+ * JobClassChange:
+ *
+ * Flags returned by job_class_diff() naming each part of a job class that
+ * differs between two definitions of it.
+ **/
+typedef enum job_class_change {
+	JOB_CLASS_CHANGE_NONE     = 0,
+	JOB_CLASS_CHANGE_INFO     = 1 << 0,
+	JOB_CLASS_CHANGE_START_ON = 1 << 1,
+	JOB_CLASS_CHANGE_STOP_ON  = 1 << 2,
+	JOB_CLASS_CHANGE_INSTANCE = 1 << 3,
+	JOB_CLASS_CHANGE_ENV      = 1 << 4,
+	JOB_CLASS_CHANGE_PROCESS  = 1 << 5,
+	JOB_CLASS_CHANGE_EXPECT   = 1 << 6,
+	JOB_CLASS_CHANGE_KILL     = 1 << 7,
+	JOB_CLASS_CHANGE_RESPAWN  = 1 << 8,
+	JOB_CLASS_CHANGE_LIMITS   = 1 << 9,
+	JOB_CLASS_CHANGE_CGROUP   = 1 << 10
+} JobClassChange;
+
+
+/**
+ * JOB_CLASS_CHANGE_LIVE:
+ *
+ * Changes that may be applied to a job class while it has active
+ * instances, since they cannot affect processes that are already running
+ * or the state kept for each instance.
+ **/
+#define JOB_CLASS_CHANGE_LIVE (JOB_CLASS_CHANGE_INFO		\
+			       | JOB_CLASS_CHANGE_START_ON	\
+			       | JOB_CLASS_CHANGE_ENV		\
+			       | JOB_CLASS_CHANGE_RESPAWN)
 
 /**
  * JOB_DEFAULT_KILL_TIMEOUT:
@@ -128,6 +177,7 @@ typedef enum console_type {
  * @name: unique name,
  * @path: path of D-Bus object,
  * @instance: pattern to uniquely identify multiple instances,
+ * @instance_template: @instance compiled for expansion,
  * @instances: hash table of active instances,
  * @description: description; intended for humans,
  * @author: author; intended for humans,
@@ -135,6 +185,7 @@ typedef enum console_type {
  * @env: NULL-terminated array of default environment variables,
  * @export: NULL-terminated array of environment exported to events,
  * @import: NULL-terminated array of environment to be imported from IPC,
+ * @base_env: cached environment built from the built-ins and @env,
  * @start_on: event operator expression that can start an instance,
  * @stop_on: event operator expression that stops instances,
  * @emits: NULL-terminated array of events that may be emitted by instances,
@@ -143,9 +194,16 @@ typedef enum console_type {
  * @task: start requests are not unblocked until instances have finished,
  * @kill_timeout: time to wait between sending TERM and KILL signals,
  * @kill_signal: first signal to send (usually SIGTERM),
+ * @kill_escalate: signals to send in turn before the KILL signal,
+ * @kill_escalate_len: length of @kill_escalate array,
+ * @kill_mode: which processes are sent the kill signals,
  * @respawn: instances should be restarted if main process fails,
  * @respawn_limit: number of respawns in @respawn_interval that we permit,
  * @respawn_interval: barrier for @respawn_limit,
+ * @respawn_backoff_delay: delay before the first respawn, or zero,
+ * @respawn_backoff_multiplier: growth of the delay for each further respawn,
+ * @respawn_backoff_max: maximum delay before a respawn,
+ * @respawn_backoff_reset: uptime after which the delay returns to the first,
  * @normalexit: array of exit codes that prevent a respawn,
  * @normalexit_len: length of @normalexit array,
  * @console: how to arrange processes' stdin/out/err file descriptors,
@@ -153,8 +211,10 @@ typedef enum console_type {
  * @nice: process priority,
  * @oom_score_adj: OOM killer score adjustment,
  * @limits: resource limits indexed by resource,
+ * @cgroup_settings: control group settings indexed by setting,
  * @chroot: root directory of process (implies @chdir if not set),
  * @chdir: working directory of process,
+ * @deferred: NULL-terminated array of definitions yet to be parsed in full,
  * @deleted: whether job should be deleted when finished.
  *
  * This structure holds the configuration of a known task or service that
@@ -169,6 +229,7 @@ typedef struct job_class {
 	char           *path;
 
 	char           *instance;
+	EnvironTemplate *instance_template;
 	NihHash        *instances;
 
 	char           *description;
@@ -178,6 +239,7 @@ typedef struct job_class {
 	char          **env;
 	char          **export;
 	char          **import;
+	char          **base_env;
 
 	EventOperator  *start_on;
 	EventOperator  *stop_on;
@@ -189,10 +251,17 @@ typedef struct job_class {
 
 	time_t          kill_timeout;
 	int		kill_signal;
+	int            *kill_escalate;
+	size_t          kill_escalate_len;
+	KillMode        kill_mode;
 
 	int             respawn;
 	int             respawn_limit;
 	time_t          respawn_interval;
+	time_t          respawn_backoff_delay;
+	int             respawn_backoff_multiplier;
+	time_t          respawn_backoff_max;
+	time_t          respawn_backoff_reset;
 
 	int            *normalexit;
 	size_t          normalexit_len;
@@ -203,9 +272,12 @@ typedef struct job_class {
 	int             nice;
 	int             oom_score_adj;
 	struct rlimit  *limits[RLIMIT_NLIMITS];
+	char           *cgroup_settings[CGROUP_SETTING_LAST];
 	char           *chroot;
 	char           *chdir;
 
+	char          **deferred;
+
 	int             deleted;
 	int             debug;
 } JobClass;
@@ -224,6 +296,11 @@ JobClass  * job_class_new                  (const void *parent,
 
 int         job_class_consider             (JobClass *class);
 int         job_class_reconsider           (JobClass *class);
+int         job_class_materialise          (JobClass *class);
+int         job_class_pack                 (JobClass *class)
+	__attribute__ ((warn_unused_result));
+int         job_class_diff                 (const JobClass *class,
+					    const JobClass *other);
 
 void        job_class_register             (JobClass *class,
 					    DBusConnection *conn, int signal);
@@ -238,6 +315,10 @@ char**      job_class_import_environment   (JobClass     *class,
 					    void         *parent,
 					    size_t       *len,
 					    char * const *new_env);
+char       *job_class_expand_instance      (const void *parent,
+					    JobClass *class,
+					    char * const *env)
+	__attribute__ ((warn_unused_result, malloc));
 
 int         job_class_get_instance         (JobClass *class,
 					    NihDBusMessage *message,
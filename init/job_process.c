@@ -26,12 +26,15 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <sys/time.h>
 #include <sys/ptrace.h>
 #include <sys/resource.h>
 
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <alloca.h>
 #include <stdio.h>
 #include <limits.h>
 #include <signal.h>
@@ -56,6 +59,8 @@
 #include "job_process.h"
 #include "job_class.h"
 #include "job.h"
+#include "hash.h"
+#include "cgroup.h"
 #include "errors.h"
 
 
@@ -81,6 +86,23 @@ typedef struct job_process_wire_error {
 	int                 errnum;
 } JobProcessWireError;
 
+/**
+ * JobProcessPid:
+ * @entry: list header,
+ * @pid: process id,
+ * @job: job the process belongs to,
+ * @process: which of @job's processes it is.
+ *
+ * Entries in the job_process_pids hash; each is allocated as a child of
+ * @job so that it is removed from the hash once the job is freed.
+ **/
+typedef struct job_process_pid {
+	NihList      entry;
+	pid_t        pid;
+	Job         *job;
+	ProcessType  process;
+} JobProcessPid;
+
 
 /* Prototypes for static functions */
 static void job_process_error_abort     (int fd, JobProcessErrorType type,
@@ -89,10 +111,14 @@ static void job_process_error_abort     (int fd, JobProcessErrorType type,
 static int  job_process_error_read      (int fd)
 	__attribute__ ((warn_unused_result));
 
-static void job_process_kill_timer      (Job *job, NihTimer *timer);
+static int  job_process_signal          (Job *job, ProcessType process,
+					 int signal)
+	__attribute__ ((warn_unused_result));
+static void job_process_kill_leftovers  (Job *job);
 static void job_process_terminated      (Job *job, ProcessType process,
 					 int status);
 static int  job_process_catch_runaway   (Job *job);
+static void job_process_backoff         (Job *job);
 static void job_process_stopped         (Job *job, ProcessType process);
 static void job_process_trace_new       (Job *job, ProcessType process);
 static void job_process_trace_new_child (Job *job, ProcessType process);
@@ -100,6 +126,25 @@ static void job_process_trace_signal    (Job *job, ProcessType process,
 					 int signum);
 static void job_process_trace_fork      (Job *job, ProcessType process);
 static void job_process_trace_exec      (Job *job, ProcessType process);
+static int  job_process_cgroup_forked   (Job *job, ProcessType process);
+static void job_process_cgroup_modified (Job *job, NihIo *io,
+					 const char *buf, size_t len);
+static void job_process_cgroup_error    (Job *job, NihIo *io);
+static void job_process_untrack         (Job *job, ProcessType process);
+static const void *job_process_pid_key  (NihList *entry);
+static uint32_t job_process_pid_hash    (const void *key);
+static int  job_process_pid_cmp         (const void *key1,
+					 const void *key2);
+
+
+/**
+ * job_process_pids:
+ *
+ * This hash table holds the processes of jobs that are running, indexed
+ * by pid, so that job_process_find() need not search every instance of
+ * every class; each entry is a JobProcessPid.
+ **/
+static NihHash *job_process_pids = NULL;
 
 
 /**
@@ -138,14 +183,17 @@ int
 job_process_run (Job         *job,
 		 ProcessType  process)
 {
-	Process         *proc;
-	nih_local char **argv = NULL;
-	nih_local char **env = NULL;
-	nih_local char  *script = NULL;
-	char           **e;
-	size_t           argc, envc;
-	int              fds[2] = { -1, -1 };
-	int              error = FALSE, trace = FALSE, shell = FALSE;
+	Process                *proc;
+	nih_local char        **argv = NULL;
+	nih_local EnvironTable *env_table = NULL;
+	char                  **env;
+	nih_local char         *script = NULL;
+	const char             *cgroup = NULL;
+	size_t                  argc;
+	int                     fds[2] = { -1, -1 };
+	int                     error = FALSE, trace = FALSE, shell = FALSE;
+	int                     follow = FALSE, settings = FALSE;
+	int                     group = FALSE;
 
 	nih_assert (job != NULL);
 
@@ -226,37 +274,96 @@ job_process_run (Job         *job,
 	 * except for pre-stop which also has the stop event environment,
 	 * adding special variables that indicate which job it was -- mostly
 	 * so that initctl can have clever behaviour when called within them.
+	 * The table shares its strings with the job's own, so only those
+	 * entries we add or replace are allocated.
 	 */
-	envc = 0;
-	if (job->env) {
-		env = NIH_MUST (nih_str_array_copy (NULL, &envc, job->env));
-	} else {
-		env = NIH_MUST (nih_str_array_new (NULL));
-	}
+	env_table = NIH_MUST (environ_table_copy (NULL, job->env));
 
 	if (job->stop_env
 	    && ((process == PROCESS_PRE_STOP)
 		|| (process == PROCESS_POST_STOP)))
-		for (e = job->stop_env; *e; e++)
-			NIH_MUST (environ_set (&env, NULL, &envc, TRUE, *e));
+		NIH_MUST (environ_table_append (env_table, TRUE,
+						job->stop_env));
+
+	NIH_MUST (environ_table_set (env_table, TRUE,
+				     "UPSTART_JOB=%s", job->class->name));
+	NIH_MUST (environ_table_set (env_table, TRUE,
+				     "UPSTART_INSTANCE=%s", job->name));
+
+	/* List the file descriptors passed by the start events, as they
+	 * will be numbered in the child, along with their names in the
+	 * same order.
+	 */
+	if (job->num_fds) {
+		nih_local char *fdlist = NULL;
+		nih_local char *namelist = NULL;
+
+		fdlist = NIH_MUST (nih_strdup (NULL, "UPSTART_FDS="));
+		namelist = NIH_MUST (nih_strdup (NULL, "UPSTART_FD_NAMES="));
+
+		for (size_t i = 0; i < job->num_fds; i++) {
+			NIH_MUST (nih_strcat_sprintf (&fdlist, NULL, "%s%d",
+						      i ? " " : "",
+						      JOB_PROCESS_FD_BASE + (int)i));
+			NIH_MUST (nih_strcat_sprintf (&namelist, NULL, "%s%s",
+						      i ? " " : "",
+						      job->fd_names[i]));
+		}
 
-	NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
-			       "UPSTART_JOB=%s", job->class->name));
-	NIH_MUST (environ_set (&env, NULL, &envc, TRUE,
-			       "UPSTART_INSTANCE=%s", job->name));
+		NIH_MUST (environ_table_add (env_table, TRUE, fdlist));
+		NIH_MUST (environ_table_add (env_table, TRUE, namelist));
+	}
+
+	env = env_table->env;
 
 	/* If we're about to spawn the main job and we expect it to become
 	 * a daemon or fork before we can move out of spawned, we need to
-	 * set a trace on it.
+	 * follow it; either by placing it in a control group of its own,
+	 * where we can find it once the process we spawned exits, or
+	 * failing that by setting a trace on it.
 	 */
 	if ((process == PROCESS_MAIN)
 	    && ((job->class->expect == EXPECT_DAEMON)
 		|| (job->class->expect == EXPECT_FORK)))
+		follow = TRUE;
+
+	/* Every process of a job with control group settings is placed
+	 * in its group, so that they're all subject to them; as is every
+	 * process of a job killed as a tree, so that we can find those
+	 * that leave the session.
+	 */
+	for (int i = 0; i < CGROUP_SETTING_LAST; i++)
+		if (job->class->cgroup_settings[i])
+			settings = TRUE;
+
+	if (job->class->kill_mode == KILL_TREE)
+		group = TRUE;
+
+	if (settings && (! job->cgroup))
+		nih_warn (_("Ignoring control group settings of %s without "
+			    "a control group root"), job_name (job));
+
+	if (job->cgroup && (follow || settings || group)) {
+		if (cgroup_create (job->cgroup) < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_warn (_("Failed to create control group for %s: %s"),
+				  job_name (job), err->message);
+			nih_free (err);
+		} else {
+			cgroup = job->cgroup;
+		}
+	}
+
+	if (follow && (! cgroup))
 		trace = TRUE;
 
 	/* Spawn the process, repeat until fork() works */
 	while ((job->pid[process] = job_process_spawn (job->class, argv,
-						       env, trace, fds[0])) < 0) {
+						       env, trace, cgroup,
+						       fds[0], job->fds,
+						       job->num_fds)) < 0) {
 		NihError *err;
 
 		err = nih_error_get ();
@@ -286,12 +393,31 @@ job_process_run (Job         *job,
 		error = TRUE;
 	}
 
+	job_process_track (job, process);
+
 	nih_info (_("%s %s process (%d)"),
 		  job_name (job), process_name (process), job->pid[process]);
 
 	job->trace_forks = 0;
 	job->trace_state = trace ? TRACE_NEW : TRACE_NONE;
 
+	/* Remember when the main process started so that we know how long
+	 * it stayed up should it need to be respawned.
+	 */
+	if (process == PROCESS_MAIN) {
+		struct timespec now;
+
+		nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+		job->spawn_time = now.tv_sec;
+	}
+
+	/* Watch the control group so we know when it empties, since once
+	 * the process we spawned has exited the one we follow may not be
+	 * our child and we might never be told when it terminates.
+	 */
+	if (follow && cgroup && (! job->cgroup_watch))
+		job_process_watch_cgroup (job);
+
 	/* Feed the script to the child process */
 	if (shell) {
 		NihIo *io;
@@ -335,7 +461,10 @@ job_process_run (Job         *job,
  * @argv: NULL-terminated list of arguments for the process,
  * @env: NULL-terminated list of environment variables for the process,
  * @trace: whether to trace this process,
- * @script_fd: script file descriptor.
+ * @cgroup: control group to place process in,
+ * @script_fd: script file descriptor,
+ * @fds: file descriptors to pass to the process,
+ * @num_fds: number of entries in @fds.
  *
  * This function spawns a new process using the @class details to set up the
  * environment for it; the process is always a session and process group
@@ -351,9 +480,18 @@ job_process_run (Job         *job,
  * wait for this and then may use it to set options before continuing the
  * process.
  *
+ * If @cgroup is not NULL, the control group settings of @class are
+ * written for that group and the process moved into it before anything
+ * else is done, so that it, and any process it creates, is subject to
+ * them and may be found there.
+ *
  * If @script_fd is not -1, this file descriptor is dup()d to the special fd 9
  * (moving any other out of the way if necessary).
  *
+ * Each of @fds is dup()d into consecutive descriptors starting from
+ * JOB_PROCESS_FD_BASE, without the close-on-exec flag, so that the process
+ * may find them at known positions.
+ *
  * This function only spawns the process, it is up to the caller to ensure
  * that the information is saved into the job and that the process is watched,
  * etc.
@@ -370,7 +508,10 @@ job_process_spawn (JobClass     *class,
 		   char * const  argv[],
 		   char * const *env,
 		   int           trace,
-		   int           script_fd)
+		   const char   *cgroup,
+		   int           script_fd,
+		   const int    *fds_in,
+		   size_t        num_fds)
 {
 	sigset_t  child_set, orig_set;
 	pid_t     pid;
@@ -445,6 +586,73 @@ job_process_spawn (JobClass     *class,
 	}
 	nih_io_set_cloexec (fds[1]);
 
+	/* Move into the control group first, having set the resources
+	 * available to it; nothing we do from here can create another
+	 * process, but the job may do so as soon as it starts.
+	 */
+	if (cgroup) {
+		for (i = 0; i < CGROUP_SETTING_LAST; i++) {
+			if (! class->cgroup_settings[i])
+				continue;
+
+			if (cgroup_set (cgroup, i,
+					class->cgroup_settings[i]) < 0)
+				job_process_error_abort (
+					fds[1], JOB_PROCESS_ERROR_CGROUP_SETTING, i);
+		}
+
+		if (cgroup_enter (cgroup, getpid ()) < 0)
+			job_process_error_abort (fds[1],
+						 JOB_PROCESS_ERROR_CGROUP, 0);
+	}
+
+	/* Move the passed file descriptors into place; since the targets
+	 * may overlap with the originals, our error descriptor or the
+	 * script, first move everything out of the range we're about to
+	 * fill (and away from the special script fd).
+	 */
+	if (num_fds) {
+		int *tmp_fds;
+		int  top = JOB_PROCESS_FD_BASE + (int)num_fds;
+
+		if (fds[1] >= JOB_PROCESS_SCRIPT_FD) {
+			int tmp = fcntl (fds[1], F_DUPFD_CLOEXEC, top);
+			if (tmp < 0) {
+				nih_error_raise_system ();
+				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+			close (fds[1]);
+			fds[1] = tmp;
+		}
+
+		if (script_fd >= JOB_PROCESS_SCRIPT_FD) {
+			int tmp = fcntl (script_fd, F_DUPFD, top);
+			if (tmp < 0) {
+				nih_error_raise_system ();
+				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+			close (script_fd);
+			script_fd = tmp;
+		}
+
+		tmp_fds = alloca (sizeof (int) * num_fds);
+		for (i = 0; i < (int)num_fds; i++) {
+			tmp_fds[i] = fcntl (fds_in[i], F_DUPFD_CLOEXEC, top);
+			if (tmp_fds[i] < 0) {
+				nih_error_raise_system ();
+				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+		}
+
+		for (i = 0; i < (int)num_fds; i++) {
+			if (dup2 (tmp_fds[i], JOB_PROCESS_FD_BASE + i) < 0) {
+				nih_error_raise_system ();
+				job_process_error_abort (fds[1], JOB_PROCESS_ERROR_DUP, 0);
+			}
+			close (tmp_fds[i]);
+		}
+	}
+
 	/* Move the script fd to special fd 9; the only gotcha is if that
 	 * would be our error descriptor, but that's handled above.
 	 */
@@ -783,6 +991,17 @@ job_process_error_read (int fd)
 				  err, _("unable to set trace: %s"),
 				  strerror (err->errnum)));
 		break;
+	case JOB_PROCESS_ERROR_CGROUP:
+		err->error.message = NIH_MUST (nih_sprintf (
+				  err, _("unable to enter control group: %s"),
+				  strerror (err->errnum)));
+		break;
+	case JOB_PROCESS_ERROR_CGROUP_SETTING:
+		err->error.message = NIH_MUST (nih_sprintf (
+				  err, _("unable to set \"%s\" control group setting: %s"),
+				  cgroup_setting_file (err->arg),
+				  strerror (err->errnum)));
+		break;
 	case JOB_PROCESS_ERROR_EXEC:
 		err->error.message = NIH_MUST (nih_sprintf (
 				  err, _("unable to execute: %s"),
@@ -804,8 +1023,9 @@ job_process_error_read (int fd)
  *
  * This function forces a @job to leave its current state by sending
  * @process the "kill signal" defined signal (TERM by default), and maybe
- * later the KILL signal.  The actual state changes are performed by
- * job_child_reaper when the process has actually terminated.
+ * later each of the escalation signals and finally the KILL signal.  The
+ * actual state changes are performed by job_child_reaper when the process
+ * has actually terminated.
  **/
 void
 job_process_kill (Job         *job,
@@ -820,7 +1040,7 @@ job_process_kill (Job         *job,
 		  nih_signal_to_name (job->class->kill_signal),
 		  job_name (job), process_name (process), job->pid[process]);
 
-	if (system_kill (job->pid[process], job->class->kill_signal) < 0) {
+	if (job_process_signal (job, process, job->class->kill_signal) < 0) {
 		NihError *err;
 
 		err = nih_error_get ();
@@ -835,6 +1055,7 @@ job_process_kill (Job         *job,
 	}
 
 	job->kill_process = process;
+	job->kill_step = 0;
 	job->kill_timer = NIH_MUST (nih_timer_add_timeout (
 			  job, job->class->kill_timeout,
 			  (NihTimerCb)job_process_kill_timer, job));
@@ -846,14 +1067,16 @@ job_process_kill (Job         *job,
  * @timer: timer that caused us to be called.
  *
  * This callback is called if the process failed to terminate within
- * a particular time of being sent the TERM signal.  The process is killed
- * more forcibly by sending the KILL signal.
+ * a particular time of being sent the previous signal.  The process is
+ * sent the next escalation signal, with the timer set again, or once
+ * there are no more it is killed more forcibly by sending the KILL signal.
  **/
-static void
+void
 job_process_kill_timer (Job      *job,
 			NihTimer *timer)
 {
 	ProcessType process;
+	int         signal;
 
 	nih_assert (job != NULL);
 	nih_assert (timer != NULL);
@@ -864,23 +1087,164 @@ job_process_kill_timer (Job      *job,
 	nih_assert (job->pid[process] > 0);
 
 	job->kill_timer = NULL;
-	job->kill_process = -1;
+
+	if (job->kill_step < job->class->kill_escalate_len) {
+		signal = job->class->kill_escalate[job->kill_step++];
+	} else {
+		signal = SIGKILL;
+
+		job->kill_process = -1;
+		job->kill_step = 0;
+	}
 
 	nih_info (_("Sending %s signal to %s %s process (%d)"),
-		  "KILL",
+		  nih_signal_to_name (signal),
 		  job_name (job), process_name (process), job->pid[process]);
 
-	if (system_kill (job->pid[process], SIGKILL) < 0) {
+	if (job_process_signal (job, process, signal) < 0) {
 		NihError *err;
 
 		err = nih_error_get ();
 		if (err->number != ESRCH)
 			nih_warn (_("Failed to send %s signal to %s %s process (%d): %s"),
-				  "KILL",
+				  nih_signal_to_name (signal),
 				  job_name (job), process_name (process),
 				  job->pid[process], err->message);
 		nih_free (err);
+
+		job->kill_process = -1;
+		job->kill_step = 0;
+
+		return;
+	}
+
+	if (signal != SIGKILL)
+		job->kill_timer = NIH_MUST (nih_timer_add_timeout (
+				  job, job->class->kill_timeout,
+				  (NihTimerCb)job_process_kill_timer, job));
+}
+
+/**
+ * job_process_signal:
+ * @job: job to signal process of,
+ * @process: process to be signalled,
+ * @signal: signal to send.
+ *
+ * Sends @signal to the process group of @process; when the job is killed
+ * as a tree, every descendant of @process and every other process in the
+ * job's control group is sent @signal as well.  These are found before
+ * any signal is sent, since children are lost to us once their parent
+ * has exited.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+job_process_signal (Job         *job,
+		    ProcessType  process,
+		    int          signal)
+{
+	nih_local pid_t *descendants = NULL;
+	nih_local pid_t *members = NULL;
+	size_t           descendants_len = 0, members_len = 0;
+	int              ret;
+
+	nih_assert (job != NULL);
+	nih_assert (job->pid[process] > 0);
+
+	if (job->class->kill_mode != KILL_TREE)
+		return system_kill (job->pid[process], signal);
+
+	descendants = system_descendants (NULL, job->pid[process],
+					  &descendants_len);
+	if (! descendants) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn (_("Failed to find descendants of %s %s process (%d): %s"),
+			  job_name (job), process_name (process),
+			  job->pid[process], err->message);
+		nih_free (err);
 	}
+
+	if (job->cgroup) {
+		members = cgroup_procs (NULL, job->cgroup, &members_len);
+		if (! members) {
+			NihError *err;
+
+			err = nih_error_get ();
+			if (err->number != ENOENT)
+				nih_warn (_("Failed to read control group of %s: %s"),
+					  job_name (job), err->message);
+			nih_free (err);
+		}
+	}
+
+	ret = system_kill (job->pid[process], signal);
+
+	for (size_t i = 0; i < descendants_len; i++)
+		kill (descendants[i], signal);
+
+	/* Leave the job's other processes alone, only this one is being
+	 * killed.
+	 */
+	for (size_t i = 0; i < members_len; i++) {
+		int other = FALSE;
+
+		for (ProcessType j = 0; j < PROCESS_LAST; j++)
+			if ((j != process) && (job->pid[j] == members[i]))
+				other = TRUE;
+
+		if (! other)
+			kill (members[i], signal);
+	}
+
+	return ret;
+}
+
+/**
+ * job_process_kill_leftovers:
+ * @job: job whose main process has terminated.
+ *
+ * Kills any process remaining in the control group of @job, other than
+ * the job's own processes, once its main process has gone; for jobs killed
+ * as a tree nothing the main process started should outlive it.
+ **/
+static void
+job_process_kill_leftovers (Job *job)
+{
+	nih_local pid_t *members = NULL;
+	size_t           members_len = 0, killed = 0;
+
+	nih_assert (job != NULL);
+	nih_assert (job->cgroup != NULL);
+
+	members = cgroup_procs (NULL, job->cgroup, &members_len);
+	if (! members) {
+		NihError *err;
+
+		err = nih_error_get ();
+		if (err->number != ENOENT)
+			nih_warn (_("Failed to read control group of %s: %s"),
+				  job_name (job), err->message);
+		nih_free (err);
+
+		return;
+	}
+
+	for (size_t i = 0; i < members_len; i++) {
+		int other = FALSE;
+
+		for (ProcessType j = 0; j < PROCESS_LAST; j++)
+			if (job->pid[j] == members[i])
+				other = TRUE;
+
+		if ((! other) && (kill (members[i], SIGKILL) == 0))
+			killed++;
+	}
+
+	if (killed)
+		nih_info (_("Killed %zu processes left behind by %s"),
+			  killed, job_name (job));
 }
 
 
@@ -932,6 +1296,13 @@ job_process_handler (void           *data,
 
 	switch (event) {
 	case NIH_CHILD_EXITED:
+		/* A forking job followed through its control group exits
+		 * normally once it has forked, leaving behind the process
+		 * we should supervise instead.
+		 */
+		if ((! status) && job_process_cgroup_forked (job, process))
+			break;
+
 		/* Child exited; check status to see whether it exited
 		 * normally (zero) or with a non-zero status.
 		 */
@@ -1129,7 +1500,20 @@ job_process_terminated (Job         *job,
 			 * that's a simple matter of doing nothing.  Check
 			 * the job isn't running away first though.
 			 */
-			if (failed && job->class->respawn) {
+			if (failed && job->class->respawn
+			    && job->class->respawn_backoff_delay) {
+				job_process_backoff (job);
+
+				nih_warn (_("%s %s process ended, respawning in %d seconds"),
+					  job_name (job),
+					  process_name (process),
+					  (int)job->respawn_delay);
+				failed = FALSE;
+
+				if (! state)
+					job_change_goal (job, JOB_RESPAWN);
+				break;
+			} else if (failed && job->class->respawn) {
 				if (job_process_catch_runaway (job)) {
 					nih_warn (_("%s respawning too fast, stopped"),
 						  job_name (job));
@@ -1220,6 +1604,7 @@ job_process_terminated (Job         *job,
 		nih_unref (job->kill_timer, job);
 		job->kill_timer = NULL;
 		job->kill_process = -1;
+		job->kill_step = 0;
 	}
 
 	/* Find existing utmp entry for the process pid */
@@ -1249,8 +1634,24 @@ job_process_terminated (Job         *job,
 	endutxent();
 
 	/* Clear the process pid field */
+	job_process_untrack (job, process);
 	job->pid[process] = 0;
 
+	/* Stop watching the control group once there's no main process
+	 * left in it to follow.
+	 */
+	if ((process == PROCESS_MAIN) && job->cgroup_watch) {
+		nih_unref (job->cgroup_watch, job);
+		job->cgroup_watch = NULL;
+	}
+
+	/* Nothing a job killed as a tree started should survive its main
+	 * process, or it would be left behind by every restart.
+	 */
+	if ((process == PROCESS_MAIN) && (job->class->kill_mode == KILL_TREE)
+	    && job->cgroup)
+		job_process_kill_leftovers (job);
+
 
 	/* Mark the job as failed */
 	if (failed)
@@ -1312,6 +1713,52 @@ job_process_catch_runaway (Job *job)
 	return FALSE;
 }
 
+/**
+ * job_process_backoff:
+ * @job: job being respawned.
+ *
+ * This function is called instead of job_process_catch_runaway() for jobs
+ * that back off their respawns.  Rather than giving up on the job, each
+ * respawn is delayed by longer than the one before, up to a maximum; once
+ * the job stays up for long enough it's considered to have recovered and
+ * the delay returns to the first.
+ *
+ * The delay is stored in @job, which is marked so that it waits in the
+ * post-stop state for that long before starting again.
+ **/
+static void
+job_process_backoff (Job *job)
+{
+	struct timespec now;
+	time_t          delay, max;
+
+	nih_assert (job != NULL);
+	nih_assert (job->class->respawn_backoff_delay > 0);
+	nih_assert (job->class->respawn_backoff_max
+		    >= job->class->respawn_backoff_delay);
+
+	nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+
+	if (job->respawn_delay && job->class->respawn_backoff_reset
+	    && (now.tv_sec - job->spawn_time
+		>= job->class->respawn_backoff_reset))
+		job->respawn_delay = 0;
+
+	delay = job->respawn_delay;
+	max = job->class->respawn_backoff_max;
+
+	if (! delay) {
+		delay = job->class->respawn_backoff_delay;
+	} else if (delay > max / job->class->respawn_backoff_multiplier) {
+		delay = max;
+	} else {
+		delay *= job->class->respawn_backoff_multiplier;
+	}
+
+	job->respawn_delay = delay;
+	job->respawn_pending = TRUE;
+}
+
 
 /**
  * job_process_stopped:
@@ -1528,7 +1975,10 @@ job_process_trace_fork (Job         *job,
 	/* Update the process we're supervising which is about to get SIGSTOP
 	 * so set the trace options to capture it.
 	 */
+	job_process_untrack (job, process);
 	job->pid[process] = (pid_t)data;
+	job_process_track (job, process);
+
 	job->trace_state = TRACE_NEW_CHILD;
 
 	/* We may have already had the wait notification for the new child
@@ -1591,6 +2041,226 @@ job_process_trace_exec (Job         *job,
 	}
 }
 
+/**
+ * job_process_cgroup_forked:
+ * @job: job that changed,
+ * @process: specific process.
+ *
+ * This function is called whenever a @process attached to @job exits
+ * normally, to check whether it was the process we spawned into the
+ * control group of a job expected to fork or become a daemon.
+ *
+ * If so, the process it left behind in the group is found and becomes
+ * the one we supervise, moving the job out of the spawned state; or in
+ * the case of a daemon caught between its two forks, it becomes the one
+ * we wait to exit in turn.
+ *
+ * Returns: TRUE if @process was replaced, FALSE if it has terminated.
+ **/
+static int
+job_process_cgroup_forked (Job         *job,
+			   ProcessType  process)
+{
+	pid_t pid;
+	int   daemon;
+
+	nih_assert (job != NULL);
+
+	/* Any process can exit, but we only care about the main process
+	 * when the state is still spawned and it's not being traced.
+	 */
+	if ((process != PROCESS_MAIN) || (job->state != JOB_SPAWNED)
+	    || (! job->cgroup) || (job->trace_state != TRACE_NONE))
+		return FALSE;
+
+	if ((job->class->expect != EXPECT_DAEMON)
+	    && (job->class->expect != EXPECT_FORK))
+		return FALSE;
+
+	daemon = (job->class->expect == EXPECT_DAEMON);
+
+	pid = cgroup_main_pid (job->cgroup, daemon);
+	if (pid < 0) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn (_("Failed to find new process for %s %s process (%d): %s"),
+			  job_name (job), process_name (process),
+			  job->pid[process], err->message);
+		nih_free (err);
+
+		return FALSE;
+	} else if (! pid) {
+		return FALSE;
+	}
+
+	nih_info (_("%s %s process (%d) became new process (%d)"),
+		  job_name (job), process_name (process),
+		  job->pid[process], pid);
+
+	job_process_untrack (job, process);
+	job->pid[process] = pid;
+	job_process_track (job, process);
+
+	/* A daemon that hasn't forked for the second time is still the
+	 * leader of the session it created.
+	 */
+	if (daemon && (getsid (pid) == pid))
+		return TRUE;
+
+	job_change_state (job, job_next_state (job));
+	return TRUE;
+}
+
+/**
+ * job_process_watch_cgroup:
+ * @job: job to watch.
+ *
+ * Watches the cgroup.events file of the control group of @job so that we
+ * know when the group empties; failure to watch it is logged, and the job
+ * is then only followed for as long as the process we spawned runs.
+ *
+ * The kernel reports changes to the file as modifications, which NihWatch
+ * doesn't ask for, so we hold our own inotify descriptor.
+ **/
+void
+job_process_watch_cgroup (Job *job)
+{
+	nih_local char *filename = NULL;
+	int             fd;
+
+	nih_assert (job != NULL);
+	nih_assert (job->cgroup != NULL);
+	nih_assert (job->cgroup_watch == NULL);
+
+	filename = NIH_MUST (nih_sprintf (NULL, "%s/cgroup.events",
+					  job->cgroup));
+
+	fd = inotify_init ();
+	if (fd < 0)
+		goto error;
+
+	if ((inotify_add_watch (fd, filename, IN_MODIFY) < 0)
+	    || (nih_io_set_cloexec (fd) < 0))
+		goto error;
+
+	job->cgroup_watch = nih_io_reopen (
+		job, fd, NIH_IO_STREAM,
+		(NihIoReader)job_process_cgroup_modified,
+		NULL,
+		(NihIoErrorHandler)job_process_cgroup_error, job);
+	if (! job->cgroup_watch) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn (_("Failed to watch control group for %s: %s"),
+			  job_name (job), err->message);
+		nih_free (err);
+
+		close (fd);
+	}
+
+	return;
+
+error:
+	nih_warn (_("Failed to watch control group for %s: %s"),
+		  job_name (job), strerror (errno));
+
+	if (fd >= 0)
+		close (fd);
+}
+
+/**
+ * job_process_cgroup_modified:
+ * @job: job being watched,
+ * @io: NihIo for inotify descriptor,
+ * @buf: inotify events read,
+ * @len: length of @buf.
+ *
+ * This function is called whenever the cgroup.events file of the control
+ * group of @job is modified, which happens when the group becomes empty
+ * but also for other changes, so the file is checked again each time.
+ *
+ * Should the main process we supervise no longer exist by then, it was
+ * not our child to reap and we'd otherwise not notice it terminate, so
+ * it is handled as if it exited normally.
+ **/
+static void
+job_process_cgroup_modified (Job        *job,
+			     NihIo      *io,
+			     const char *buf,
+			     size_t      len)
+{
+	pid_t pid;
+	int   populated;
+
+	nih_assert (job != NULL);
+	nih_assert (io != NULL);
+	nih_assert (buf != NULL);
+
+	/* The events only tell us the file changed, which is all we
+	 * needed to know.
+	 */
+	nih_io_buffer_shrink (io->recv_buf, len);
+
+	pid = job->pid[PROCESS_MAIN];
+	if (pid <= 0)
+		return;
+
+	populated = cgroup_populated (job->cgroup);
+	if (populated < 0) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn (_("Failed to check control group for %s: %s"),
+			  job_name (job), err->message);
+		nih_free (err);
+
+		return;
+	} else if (populated) {
+		return;
+	}
+
+	/* A child of ours stays until we've reaped it, and then we'll be
+	 * told how it exited.
+	 */
+	if ((kill (pid, 0) == 0) || (errno != ESRCH))
+		return;
+
+	nih_info (_("%s %s process (%d) ended with its control group"),
+		  job_name (job), process_name (PROCESS_MAIN), pid);
+
+	job_process_terminated (job, PROCESS_MAIN, 0);
+}
+
+/**
+ * job_process_cgroup_error:
+ * @job: job being watched,
+ * @io: NihIo for inotify descriptor.
+ *
+ * This function is called should reading the inotify descriptor watching
+ * the control group of @job fail; the error is logged and the watch
+ * dropped, the job then only being followed for as long as the process
+ * we spawned runs.
+ **/
+static void
+job_process_cgroup_error (Job   *job,
+			  NihIo *io)
+{
+	NihError *err;
+
+	nih_assert (job != NULL);
+	nih_assert (io != NULL);
+	nih_assert (job->cgroup_watch == io);
+
+	err = nih_error_get ();
+	nih_warn (_("Failed to watch control group for %s: %s"),
+		  job_name (job), err->message);
+	nih_free (err);
+
+	job->cgroup_watch = NULL;
+	nih_unref (io, job);
+}
 
 /**
  * job_process_find:
@@ -1601,16 +2271,43 @@ job_process_trace_exec (Job         *job,
  * If @process is not NULL, the @process variable is set to point at the
  * process entry in the table which has @pid.
  *
+ * Processes recorded with job_process_track() are found directly by
+ * their pid; otherwise every instance of every class is searched, and a
+ * process found that way is recorded for next time.
+ *
  * Returns: job found or NULL if not known.
  **/
 Job *
 job_process_find (pid_t        pid,
 		  ProcessType *process)
 {
+	NihList *pid_iter;
+
 	nih_assert (pid > 0);
 
 	job_class_init ();
 
+	/* Entries whose job has since moved on to another process are
+	 * stale; discard them as we find them.
+	 */
+	pid_iter = (job_process_pids
+		    ? nih_hash_search (job_process_pids, &pid, NULL) : NULL);
+	while (pid_iter) {
+		JobProcessPid *entry = (JobProcessPid *)pid_iter;
+
+		pid_iter = nih_hash_search (job_process_pids, &pid, pid_iter);
+
+		if (entry->job->pid[entry->process] != pid) {
+			nih_free (entry);
+			continue;
+		}
+
+		if (process)
+			*process = entry->process;
+
+		return entry->job;
+	}
+
 	NIH_HASH_FOREACH (job_classes, iter) {
 		JobClass *class = (JobClass *)iter;
 
@@ -1620,6 +2317,8 @@ job_process_find (pid_t        pid,
 
 			for (i = 0; i < PROCESS_LAST; i++) {
 				if (job->pid[i] == pid) {
+					job_process_track (job, i);
+
 					if (process)
 						*process = i;
 
@@ -1631,3 +2330,132 @@ job_process_find (pid_t        pid,
 
 	return NULL;
 }
+
+/**
+ * job_process_track:
+ * @job: job to record,
+ * @process: process of @job to record.
+ *
+ * Records the current pid of @process of @job in the job_process_pids
+ * hash so that job_process_find() can find it directly; this must be
+ * called whenever the pid is set to a new process, and
+ * job_process_untrack() before it is changed again.
+ *
+ * Should there be insufficient memory to record it, the process can
+ * still be found by searching all jobs.
+ **/
+void
+job_process_track (Job         *job,
+		   ProcessType  process)
+{
+	JobProcessPid *entry;
+
+	nih_assert (job != NULL);
+	nih_assert (process < PROCESS_LAST);
+
+	if (job->pid[process] <= 0)
+		return;
+
+	if (! job_process_pids) {
+		job_process_pids = nih_hash_new (NULL, 0,
+						 job_process_pid_key,
+						 job_process_pid_hash,
+						 job_process_pid_cmp);
+		if (! job_process_pids)
+			return;
+	}
+
+	entry = nih_new (job, JobProcessPid);
+	if (! entry)
+		return;
+
+	nih_list_init (&entry->entry);
+	nih_alloc_set_destructor (entry, nih_list_destroy);
+
+	entry->pid = job->pid[process];
+	entry->job = job;
+	entry->process = process;
+
+	hash_add (NULL, &job_process_pids, &entry->entry);
+}
+
+/**
+ * job_process_untrack:
+ * @job: job to forget,
+ * @process: process of @job to forget.
+ *
+ * Removes the entry for the current pid of @process of @job from the
+ * job_process_pids hash, if there is one, before the pid is changed.
+ **/
+static void
+job_process_untrack (Job         *job,
+		     ProcessType  process)
+{
+	pid_t    pid;
+	NihList *iter;
+
+	nih_assert (job != NULL);
+	nih_assert (process < PROCESS_LAST);
+
+	pid = job->pid[process];
+	if ((pid <= 0) || (! job_process_pids))
+		return;
+
+	iter = nih_hash_search (job_process_pids, &pid, NULL);
+	while (iter) {
+		JobProcessPid *entry = (JobProcessPid *)iter;
+
+		iter = nih_hash_search (job_process_pids, &pid, iter);
+
+		if ((entry->job == job) && (entry->process == process))
+			nih_free (entry);
+	}
+}
+
+/**
+ * job_process_pid_key:
+ * @entry: hash entry.
+ *
+ * Returns: pointer to the pid of @entry, which is compared by
+ * job_process_pid_hash() and job_process_pid_cmp().
+ **/
+static const void *
+job_process_pid_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return &((JobProcessPid *)entry)->pid;
+}
+
+/**
+ * job_process_pid_hash:
+ * @key: pointer to pid.
+ *
+ * Process ids are allocated in sequence, so serve as their own hash.
+ *
+ * Returns: hash value.
+ **/
+static uint32_t
+job_process_pid_hash (const void *key)
+{
+	nih_assert (key != NULL);
+
+	return (uint32_t)*(const pid_t *)key;
+}
+
+/**
+ * job_process_pid_cmp:
+ * @key1: pointer to pid,
+ * @key2: pointer to pid.
+ *
+ * Returns: zero if the pids are the same, non-zero otherwise.
+ **/
+static int
+job_process_pid_cmp (const void *key1,
+		     const void *key2)
+{
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	return *(const pid_t *)key1 != *(const pid_t *)key2;
+}
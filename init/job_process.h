@@ -40,6 +40,15 @@
  **/
 #define JOB_PROCESS_SCRIPT_FD 9
 
+/**
+ * JOB_PROCESS_FD_BASE:
+ *
+ * File descriptors passed to the job by the events that started it are
+ * placed in consecutive order starting from this fd, which is chosen to
+ * sit above JOB_PROCESS_SCRIPT_FD so the two never collide.
+ **/
+#define JOB_PROCESS_FD_BASE (JOB_PROCESS_SCRIPT_FD + 1)
+
 
 /**
  * JobProcessErrorType:
@@ -56,6 +65,8 @@ typedef enum job_process_error_type {
 	JOB_PROCESS_ERROR_CHROOT,
 	JOB_PROCESS_ERROR_CHDIR,
 	JOB_PROCESS_ERROR_PTRACE,
+	JOB_PROCESS_ERROR_CGROUP,
+	JOB_PROCESS_ERROR_CGROUP_SETTING,
 	JOB_PROCESS_ERROR_EXEC
 } JobProcessErrorType;
 
@@ -88,18 +99,24 @@ typedef struct job_process_error {
 
 NIH_BEGIN_EXTERN
 
-int    job_process_run     (Job *job, ProcessType process);
+int    job_process_run          (Job *job, ProcessType process);
 
-pid_t  job_process_spawn   (JobClass *class, char * const argv[],
-			    char * const *env, int trace, int script_fd)
+pid_t  job_process_spawn        (JobClass *class, char * const argv[],
+				 char * const *env, int trace,
+				 const char *cgroup, int script_fd,
+				 const int *fds, size_t num_fds)
 	__attribute__ ((warn_unused_result));
 
-void   job_process_kill    (Job *job, ProcessType process);
+void   job_process_kill         (Job *job, ProcessType process);
+void   job_process_kill_timer   (Job *job, NihTimer *timer);
+
+void   job_process_watch_cgroup (Job *job);
 
-void   job_process_handler (void *ptr, pid_t pid,
-			    NihChildEvents event, int status);
+void   job_process_handler      (void *ptr, pid_t pid,
+				 NihChildEvents event, int status);
 
-Job   *job_process_find    (pid_t pid, ProcessType *process);
+Job   *job_process_find         (pid_t pid, ProcessType *process);
+void   job_process_track        (Job *job, ProcessType process);
 
 NIH_END_EXTERN
 
@@ -55,6 +55,7 @@
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
+#include <nih/string.h>
 #include <nih/list.h>
 #include <nih/timer.h>
 #include <nih/signal.h>
@@ -73,6 +74,12 @@
 #include "event.h"
 #include "conf.h"
 #include "control.h"
+#include "shutdown.h"
+#include "runlevel.h"
+#include "state.h"
+#include "cgroup.h"
+
+#include "../util/utmp.h"
 
 
 /* Prototypes for static functions */
@@ -84,6 +91,8 @@ static void kbd_handler     (void *data, NihSignal *signal);
 static void pwr_handler     (void *data, NihSignal *signal);
 static void hup_handler     (void *data, NihSignal *signal);
 static void usr1_handler    (void *data, NihSignal *signal);
+static void term_handler    (void *data, NihSignal *signal);
+static void stateful_reexec (void);
 #endif /* DEBUG */
 
 #ifdef HAVE_SELINUX
@@ -106,6 +115,22 @@ static const char *argv0 = NULL;
  **/
 static int restart = FALSE;
 
+/**
+ * state_fd:
+ *
+ * File descriptor to read the state of the init daemon that exec'd us
+ * from, or -1 if we're to start afresh.
+ **/
+static int state_fd = -1;
+
+/**
+ * args_copy:
+ *
+ * Copy of the arguments we were executed with, passed on again when we
+ * re-execute ourselves.
+ **/
+static char **args_copy = NULL;
+
 
 /**
  * options:
@@ -114,6 +139,28 @@ static int restart = FALSE;
  **/
 static NihOption options[] = {
 	{ 0, "restart", NULL, NULL, NULL, &restart, NULL },
+	{ 0, "state-fd", NULL, NULL, "FD", &state_fd, nih_option_int },
+	{ 0, "shutdown-deadline",
+	  N_("stop independent jobs together at shutdown, killing any left after SECONDS"),
+	  NULL, "SECONDS", &shutdown_deadline, nih_option_int },
+	{ 0, "event-source-limit",
+	  N_("handle at most NUMBER pending events from each D-Bus client at a time"),
+	  NULL, "NUMBER", &event_source_limit, nih_option_int },
+	{ 0, "max-queued-events",
+	  N_("refuse events from D-Bus clients while NUMBER are pending"),
+	  NULL, "NUMBER", &event_max_queued, nih_option_int },
+	{ 0, "max-client-events",
+	  N_("refuse events from a D-Bus client while it has NUMBER pending"),
+	  NULL, "NUMBER", &event_max_queued_source, nih_option_int },
+	{ 0, "cgroup-root",
+	  N_("follow forking jobs through control groups under PATH instead of tracing them"),
+	  NULL, "PATH", &cgroup_root, NULL },
+	{ 0, "lazy-jobs",
+	  N_("parse only the start and stop conditions of jobs until they are needed"),
+	  NULL, NULL, &conf_lazy, NULL },
+	{ 0, "pack-jobs",
+	  N_("allocate the start and stop conditions of each job in a single block"),
+	  NULL, NULL, &conf_packed, NULL },
 
 	/* Ignore invalid options */
 	{ '-', "--", NULL, NULL, NULL, NULL, NULL },
@@ -133,6 +180,8 @@ main (int   argc,
 	argv0 = argv[0];
 	nih_main_init (argv0);
 
+	args_copy = NIH_MUST (nih_str_array_copy (NULL, NULL, argv));
+
 	nih_option_set_synopsis (_("Process management daemon."));
 	nih_option_set_help (
 		_("This daemon is normally executed by the kernel and given "
@@ -422,6 +471,10 @@ main (int   argc,
 	/* SIGUSR1 instructs us to reconnect to D-Bus */
 	nih_signal_set_handler (SIGUSR1, nih_signal_handler);
 	NIH_MUST (nih_signal_add_handler (NULL, SIGUSR1, usr1_handler, NULL));
+
+	/* SIGTERM instructs us to re-exec ourselves */
+	nih_signal_set_handler (SIGTERM, nih_signal_handler);
+	NIH_MUST (nih_signal_add_handler (NULL, SIGTERM, term_handler, NULL));
 #endif /* DEBUG */
 
 
@@ -466,11 +519,45 @@ main (int   argc,
 	}
 
 
-	/* Read configuration */
-	NIH_MUST (conf_source_new (NULL, CONFFILE, CONF_FILE));
-	NIH_MUST (conf_source_new (NULL, CONFDIR, CONF_JOB_DIR));
+#ifndef DEBUG
+	/* Keep the runlevel where it can be read without scanning utmp,
+	 * picking it up again from there if we've been re-exec'd.
+	 */
+	runlevel_state = RUNLEVEL_STATE;
+	if (restart && (runlevel_restore (runlevel_state) < 0)) {
+		NihError *err;
 
-	conf_reload ();
+		err = nih_error_get ();
+		nih_warn ("%s: %s: %s", runlevel_state,
+			  _("Unable to read runlevel state"), err->message);
+		nih_free (err);
+	}
+#endif /* DEBUG */
+
+
+	/* Restore the state of the init daemon that exec'd us, which
+	 * includes its configuration, or read the configuration afresh.
+	 */
+	if (state_fd >= 0) {
+		nih_info (_("Restoring state"));
+
+		if (state_read (state_fd) < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_warn ("%s: %s", _("Unable to restore state"),
+				  err->message);
+			nih_free (err);
+		}
+	}
+
+	conf_init ();
+	if (NIH_LIST_EMPTY (conf_sources)) {
+		NIH_MUST (conf_source_new (NULL, CONFFILE, CONF_FILE));
+		NIH_MUST (conf_source_new (NULL, CONFDIR, CONF_JOB_DIR));
+
+		conf_reload ();
+	}
 
 	/* Create a listening server for private connections. */
 	while (control_server_open () < 0) {
@@ -769,6 +856,111 @@ usr1_handler (void      *data,
 		}
 	}
 }
+
+/**
+ * term_handler:
+ * @data: unused,
+ * @signal: signal that called this handler.
+ *
+ * Handle having recieved the SIGTERM signal, which we use to instruct us
+ * to re-exec ourselves, usually after being upgraded.
+ **/
+static void
+term_handler (void      *data,
+	      NihSignal *signal)
+{
+	nih_info (_("Re-executing %s"), argv0);
+	stateful_reexec ();
+}
+
+/**
+ * stateful_reexec:
+ *
+ * Re-executes the init binary with the same arguments, passing our state
+ * to the new process down a pipe written to by a child process so that
+ * the new process can carry on from where we left off.  The child is
+ * reaped by the new process like any other.
+ *
+ * Signals are blocked until the new process has restored the state, so
+ * that none are lost; if the exec fails, we carry on as before.
+ **/
+static void
+stateful_reexec (void)
+{
+	nih_local char **args = NULL;
+	nih_local char  *fd_arg = NULL;
+	sigset_t         mask, oldmask;
+	int              fds[2];
+	pid_t            pid;
+
+	nih_assert (argv0 != NULL);
+	nih_assert (args_copy != NULL);
+
+	sigfillset (&mask);
+	sigprocmask (SIG_BLOCK, &mask, &oldmask);
+
+	if (pipe (fds) < 0) {
+		nih_error ("%s: %s", _("Unable to create state pipe"),
+			   strerror (errno));
+		goto error;
+	}
+
+	pid = fork ();
+	if (pid < 0) {
+		nih_error ("%s: %s", _("Unable to fork state writer"),
+			   strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		goto error;
+	} else if (pid == 0) {
+		close (fds[0]);
+
+		if (state_write (fds[1]) < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_error ("%s: %s", _("Unable to write state"),
+				   err->message);
+			nih_free (err);
+
+			exit (1);
+		}
+
+		exit (0);
+	}
+
+	close (fds[1]);
+
+	/* Pass on the arguments we were given, other than those that
+	 * told us about a previous re-exec.
+	 */
+	args = NIH_MUST (nih_str_array_new (NULL));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, argv0));
+
+	for (char **arg = args_copy + 1; *arg; arg++) {
+		if ((! strcmp (*arg, "--restart"))
+		    || (! strncmp (*arg, "--state-fd", 10)))
+			continue;
+
+		NIH_MUST (nih_str_array_add (&args, NULL, NULL, *arg));
+	}
+
+	fd_arg = NIH_MUST (nih_sprintf (NULL, "--state-fd=%d", fds[0]));
+
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "--restart"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, fd_arg));
+
+	state_set_cloexec (FALSE);
+
+	execv (argv0, args);
+
+	nih_error ("%s: %s", _("Failed to re-execute init"), strerror (errno));
+
+	state_set_cloexec (TRUE);
+	close (fds[0]);
+error:
+	sigprocmask (SIG_SETMASK, &oldmask, NULL);
+}
 #endif /* DEBUG */
 
 #ifdef HAVE_SELINUX
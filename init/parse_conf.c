@@ -24,15 +24,27 @@
 #endif /* HAVE_CONFIG_H */
 
 
+#include <string.h>
+
 #include <nih/macros.h>
 #include <nih/alloc.h>
+#include <nih/string.h>
 #include <nih/list.h>
 #include <nih/config.h>
 #include <nih/logging.h>
 #include <nih/error.h>
 
+#include "event.h"
 #include "conf.h"
 #include "parse_conf.h"
+#include "errors.h"
+
+
+/* Prototypes for static functions */
+static int stanza_event (ConfFile *conffile, NihConfigStanza *stanza,
+			 const char *file, size_t len,
+			 size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
 
 
 /**
@@ -42,6 +54,8 @@
  * that handle parsing them.
  **/
 static NihConfigStanza stanzas[] = {
+	{ "event", (NihConfigHandler)stanza_event },
+
 	NIH_CONFIG_LAST
 };
 
@@ -74,15 +88,125 @@ parse_conf (ConfFile   *conffile,
 	nih_assert (file != NULL);
 	nih_assert (pos != NULL);
 
-	/* If we update 'stanzas' to allow content in init.conf, this
-	 * function must be updated in a similar manner to parse_job()
-	 * to handle overrides files.
+	/* Unlike parse_job(), there's no need to reset anything before
+	 * parsing an override file; the rules it contains are simply added
+	 * after those from the configuration file, and so take precedence.
 	 */
-	nih_assert (sizeof(stanzas) / sizeof(stanzas[0]) == 1);
-
 	if (nih_config_parse_file (file, len, pos, lineno,
 				   stanzas, conffile) < 0)
 		return -1;
 
 	return 0;
 }
+
+
+/**
+ * stanza_event:
+ * @conffile: configuration file being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Parse an event stanza from @file.  This stanza expects a second-level
+ * "priority" token followed by a priority name and one or more patterns,
+ * or a "coalesce" token followed by one or more patterns; a rule is
+ * created for each pattern and attached to @conffile, so that it's
+ * discarded with it.
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_event (ConfFile        *conffile,
+	      NihConfigStanza *stanza,
+	      const char      *file,
+	      size_t           len,
+	      size_t          *pos,
+	      size_t          *lineno)
+{
+	size_t           a_pos, a_lineno;
+	int              ret = -1;
+	nih_local char  *arg = NULL;
+	nih_local char **args = NULL;
+	EventPriority    priority = EVENT_PRIORITY_NORMAL;
+	int              coalesce;
+
+	nih_assert (conffile != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	arg = nih_config_next_token (NULL, file, len, &a_pos, &a_lineno,
+				     NIH_CONFIG_CNLWS, FALSE);
+	if (! arg)
+		goto finish;
+
+	if (! strcmp (arg, "priority")) {
+		nih_local char *priarg = NULL;
+
+		coalesce = FALSE;
+
+		/* Update error position to the priority */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		priarg = nih_config_next_arg (NULL, file, len,
+					      &a_pos, &a_lineno);
+		if (! priarg)
+			goto finish;
+
+		priority = event_priority_from_name (priarg);
+		if (priority == (EventPriority)-1)
+			nih_return_error (-1, PARSE_ILLEGAL_PRIORITY,
+					  _(PARSE_ILLEGAL_PRIORITY_STR));
+	} else if (! strcmp (arg, "coalesce")) {
+		coalesce = TRUE;
+	} else {
+		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
+				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
+	}
+
+	/* Update error position to the patterns */
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	if (! nih_config_has_token (file, len, &a_pos, &a_lineno)) {
+		nih_return_error (-1, NIH_CONFIG_EXPECTED_TOKEN,
+				  _(NIH_CONFIG_EXPECTED_TOKEN_STR));
+	}
+
+	args = nih_config_parse_args (NULL, file, len, &a_pos, &a_lineno);
+	if (! args)
+		goto finish;
+
+	for (char **pattern = args; *pattern; pattern++) {
+		void *rule;
+
+		if (coalesce) {
+			rule = event_coalesce_rule_new (conffile, *pattern);
+		} else {
+			rule = event_priority_rule_new (conffile, *pattern,
+							priority);
+		}
+
+		if (! rule) {
+			nih_error_raise_no_memory ();
+			goto finish;
+		}
+	}
+
+	ret = 0;
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
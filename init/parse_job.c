@@ -205,6 +205,10 @@ static int stanza_limit       (JobClass *class, NihConfigStanza *stanza,
 			       const char *file, size_t len,
 			       size_t *pos, size_t *lineno)
 	__attribute__ ((warn_unused_result));
+static int stanza_cgroup      (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
 static int stanza_chroot      (JobClass *class, NihConfigStanza *stanza,
 			       const char *file, size_t len,
 			       size_t *pos, size_t *lineno)
@@ -222,6 +226,15 @@ static int stanza_manual      (JobClass *class, NihConfigStanza *stanza,
 			       size_t *pos, size_t *lineno)
 	__attribute__ ((warn_unused_result));
 
+static int stanza_defer       (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
+static int stanza_defer_on    (JobClass *class, NihConfigStanza *stanza,
+			       const char *file, size_t len,
+			       size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result));
+
 
 /**
  * stanzas:
@@ -256,6 +269,7 @@ static NihConfigStanza stanzas[] = {
 	{ "nice",        (NihConfigHandler)stanza_nice        },
 	{ "oom",         (NihConfigHandler)stanza_oom         },
 	{ "limit",       (NihConfigHandler)stanza_limit       },
+	{ "cgroup",      (NihConfigHandler)stanza_cgroup      },
 	{ "chroot",      (NihConfigHandler)stanza_chroot      },
 	{ "chdir",       (NihConfigHandler)stanza_chdir       },
 	{ "debug",       (NihConfigHandler)stanza_debug       },
@@ -264,6 +278,91 @@ static NihConfigStanza stanzas[] = {
 	NIH_CONFIG_LAST
 };
 
+/**
+ * header_stanzas:
+ *
+ * Table of job definition stanzas used by parse_job_header(), only those
+ * needed to decide when instances of the job are started and stopped are
+ * parsed, all others are skipped.
+ **/
+static NihConfigStanza header_stanzas[] = {
+	{ "instance",    (NihConfigHandler)stanza_instance    },
+	{ "description", (NihConfigHandler)stanza_defer       },
+	{ "author",      (NihConfigHandler)stanza_defer       },
+	{ "version",     (NihConfigHandler)stanza_defer       },
+	{ "env",         (NihConfigHandler)stanza_defer       },
+	{ "export",      (NihConfigHandler)stanza_defer       },
+	{ "import",      (NihConfigHandler)stanza_defer       },
+	{ "start",       (NihConfigHandler)stanza_start       },
+	{ "stop",        (NihConfigHandler)stanza_stop        },
+	{ "emits",       (NihConfigHandler)stanza_defer       },
+	{ "exec",        (NihConfigHandler)stanza_defer       },
+	{ "script",      (NihConfigHandler)stanza_defer       },
+	{ "pre-start",   (NihConfigHandler)stanza_defer       },
+	{ "post-start",  (NihConfigHandler)stanza_defer       },
+	{ "pre-stop",    (NihConfigHandler)stanza_defer       },
+	{ "post-stop",   (NihConfigHandler)stanza_defer       },
+	{ "expect",      (NihConfigHandler)stanza_defer       },
+	{ "task",        (NihConfigHandler)stanza_defer       },
+	{ "kill",        (NihConfigHandler)stanza_defer       },
+	{ "respawn",     (NihConfigHandler)stanza_defer       },
+	{ "normal",      (NihConfigHandler)stanza_defer       },
+	{ "console",     (NihConfigHandler)stanza_defer       },
+	{ "umask",       (NihConfigHandler)stanza_defer       },
+	{ "nice",        (NihConfigHandler)stanza_defer       },
+	{ "oom",         (NihConfigHandler)stanza_defer       },
+	{ "limit",       (NihConfigHandler)stanza_defer       },
+	{ "cgroup",      (NihConfigHandler)stanza_defer       },
+	{ "chroot",      (NihConfigHandler)stanza_defer       },
+	{ "chdir",       (NihConfigHandler)stanza_defer       },
+	{ "debug",       (NihConfigHandler)stanza_defer       },
+	{ "manual",      (NihConfigHandler)stanza_manual      },
+
+	NIH_CONFIG_LAST
+};
+
+/**
+ * body_stanzas:
+ *
+ * Table of job definition stanzas used by parse_job_deferred(), the
+ * opposite of header_stanzas; those already parsed are skipped.
+ **/
+static NihConfigStanza body_stanzas[] = {
+	{ "instance",    (NihConfigHandler)stanza_defer       },
+	{ "description", (NihConfigHandler)stanza_description },
+	{ "author",      (NihConfigHandler)stanza_author      },
+	{ "version",     (NihConfigHandler)stanza_version     },
+	{ "env",         (NihConfigHandler)stanza_env         },
+	{ "export",      (NihConfigHandler)stanza_export      },
+	{ "import",      (NihConfigHandler)stanza_import      },
+	{ "start",       (NihConfigHandler)stanza_defer_on    },
+	{ "stop",        (NihConfigHandler)stanza_defer_on    },
+	{ "emits",       (NihConfigHandler)stanza_emits       },
+	{ "exec",        (NihConfigHandler)stanza_exec        },
+	{ "script",      (NihConfigHandler)stanza_script      },
+	{ "pre-start",   (NihConfigHandler)stanza_pre_start   },
+	{ "post-start",  (NihConfigHandler)stanza_post_start  },
+	{ "pre-stop",    (NihConfigHandler)stanza_pre_stop    },
+	{ "post-stop",   (NihConfigHandler)stanza_post_stop   },
+	{ "expect",      (NihConfigHandler)stanza_expect      },
+	{ "task",        (NihConfigHandler)stanza_task        },
+	{ "kill",        (NihConfigHandler)stanza_kill        },
+	{ "respawn",     (NihConfigHandler)stanza_respawn     },
+	{ "normal",      (NihConfigHandler)stanza_normal      },
+	{ "console",     (NihConfigHandler)stanza_console     },
+	{ "umask",       (NihConfigHandler)stanza_umask       },
+	{ "nice",        (NihConfigHandler)stanza_nice        },
+	{ "oom",         (NihConfigHandler)stanza_oom         },
+	{ "limit",       (NihConfigHandler)stanza_limit       },
+	{ "cgroup",      (NihConfigHandler)stanza_cgroup      },
+	{ "chroot",      (NihConfigHandler)stanza_chroot      },
+	{ "chdir",       (NihConfigHandler)stanza_chdir       },
+	{ "debug",       (NihConfigHandler)stanza_debug       },
+	{ "manual",      (NihConfigHandler)stanza_defer       },
+
+	NIH_CONFIG_LAST
+};
+
 
 /**
  * parse_job:
@@ -324,6 +423,153 @@ parse_job (const void *parent,
 	return class;
 }
 
+/**
+ * parse_job_header:
+ * @parent: parent object for new job,
+ * @update: if not NULL, update the existing specified JobClass,
+ * @name: name of new job,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * This function is used in place of parse_job() to parse only the parts of
+ * a job definition from @file needed to decide when instances of the job
+ * should be started or stopped: the start on, stop on, instance and manual
+ * stanzas.  All other stanzas are skipped, and the definition kept in the
+ * class's deferred member to be parsed by parse_job_deferred() once the
+ * job is first needed.
+ *
+ * If @update has already been parsed in full, @file is parsed in full too.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned job.  When all parents
+ * of the returned job are freed, the returned job will also be
+ * freed.
+ *
+ * Returns: if @update is NULL, returns new JobClass structure on success, NULL on raised error.
+ * If @update is not NULL, returns @update or NULL on error.
+ **/
+JobClass *
+parse_job_header (const void *parent,
+		  JobClass   *update,
+		  const char *name,
+		  const char *file,
+		  size_t      len,
+		  size_t     *pos,
+		  size_t     *lineno)
+{
+	JobClass       *class;
+	nih_local char *deferred = NULL;
+	size_t          start;
+
+	nih_assert (name != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	if (update && (! update->deferred))
+		return parse_job (parent, update, name, file, len, pos, lineno);
+
+	if (update) {
+		class = update;
+	} else {
+		class = job_class_new (parent, name);
+		if (! class)
+			nih_return_system_error (NULL);
+	}
+
+	start = *pos;
+
+	if (nih_config_parse_file (file, len, pos, lineno,
+				   header_stanzas, class) < 0)
+		goto error;
+
+	deferred = nih_strndup (NULL, file + start, len - start);
+	if (! deferred)
+		goto enomem;
+
+	if (! class->deferred) {
+		class->deferred = nih_str_array_new (class);
+		if (! class->deferred)
+			goto enomem;
+	}
+
+	if (! nih_str_array_addp (&class->deferred, class, NULL, deferred))
+		goto enomem;
+
+	return class;
+
+enomem:
+	nih_error_raise_no_memory ();
+error:
+	if (! update)
+		nih_free (class);
+	return NULL;
+}
+
+/**
+ * parse_job_deferred:
+ * @class: job class to complete,
+ * @lineno: line number.
+ *
+ * This function is used to complete the definition of a job class whose
+ * definitions were only partially parsed by parse_job_header(), parsing
+ * the stanzas that were skipped then.
+ *
+ * The definitions are first parsed in full into a separate class, so that
+ * any error is found before @class is modified; in which case @lineno is
+ * set to the line of the error and the definitions are kept so that the
+ * error can be found again.  The definitions are also kept should memory
+ * run out while @class is being completed, so that it can be tried again.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+parse_job_deferred (JobClass *class,
+		    size_t   *lineno)
+{
+	nih_local JobClass *check = NULL;
+	size_t              i;
+
+	nih_assert (class != NULL);
+
+	if (! class->deferred)
+		return 0;
+
+	check = job_class_new (NULL, class->name);
+	if (! check)
+		nih_return_no_memory_error (-1);
+
+	for (i = 0; class->deferred[i]; i++) {
+		size_t pos = 0, line = 1;
+
+		if (! parse_job (NULL, check, class->name, class->deferred[i],
+				 strlen (class->deferred[i]), &pos, &line)) {
+			if (lineno)
+				*lineno = line;
+			return -1;
+		}
+	}
+
+	for (i = 0; class->deferred[i]; i++) {
+		size_t pos = 0, line = 1;
+
+		if (nih_config_parse_file (class->deferred[i],
+					   strlen (class->deferred[i]),
+					   &pos, &line,
+					   body_stanzas, class) < 0) {
+			if (lineno)
+				*lineno = line;
+			return -1;
+		}
+	}
+
+	nih_unref (class->deferred, class);
+	class->deferred = NULL;
+
+	return 0;
+}
+
 
 /**
  * parse_exec:
@@ -1062,6 +1308,130 @@ stanza_manual (JobClass           *class,
 	return 0;
 }
 
+/**
+ * stanza_defer:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Skip any stanza from @file that is not being parsed now, the arguments
+ * are skipped up to the end of the line along with the following block
+ * for the script stanza and for process stanzas followed by script.
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_defer (JobClass        *class,
+	      NihConfigStanza *stanza,
+	      const char      *file,
+	      size_t           len,
+	      size_t          *pos,
+	      size_t          *lineno)
+{
+	int    script, first = TRUE;
+	size_t t_pos, toklen;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	script = (strcmp (stanza->name, "script") ? FALSE : TRUE);
+
+	while (nih_config_has_token (file, len, pos, lineno)) {
+		t_pos = *pos;
+
+		if (nih_config_token (file, len, pos, lineno, NULL,
+				      NIH_CONFIG_CNLWS, FALSE, &toklen) < 0)
+			return -1;
+
+		if (first && (process_from_name (stanza->name) >= 0)
+		    && (*pos - t_pos == strlen ("script"))
+		    && (! strncmp (file + t_pos, "script", *pos - t_pos)))
+			script = TRUE;
+
+		first = FALSE;
+
+		if (nih_config_skip_whitespace (file, len, pos, lineno) < 0)
+			return -1;
+	}
+
+	if (nih_config_skip_comment (file, len, pos, lineno) < 0)
+		return -1;
+
+	if (script)
+		return nih_config_skip_block (file, len, pos, lineno,
+					      "script", NULL);
+
+	return 0;
+}
+
+/**
+ * stanza_defer_on:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Skip a start or stop stanza from @file that has already been parsed;
+ * since the event expression may span multiple lines, it is parsed again
+ * and discarded.
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_defer_on (JobClass        *class,
+		 NihConfigStanza *stanza,
+		 const char      *file,
+		 size_t           len,
+		 size_t          *pos,
+		 size_t          *lineno)
+{
+	nih_local char *arg = NULL;
+	EventOperator  *oper;
+	size_t          a_pos, a_lineno;
+	int             ret = -1;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	arg = nih_config_next_token (NULL, file, len, &a_pos, &a_lineno,
+				     NIH_CONFIG_CNLWS, FALSE);
+	if (! arg)
+		goto finish;
+
+	if (! strcmp (arg, "on")) {
+		oper = parse_on (class, stanza, file, len, &a_pos, &a_lineno);
+		if (! oper)
+			goto finish;
+
+		nih_free (oper);
+
+		ret = 0;
+
+	} else {
+		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
+				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
+	}
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
+
 /**
  * stanza_instance:
  * @class: job class being parsed,
@@ -1097,6 +1467,27 @@ stanza_instance (JobClass        *class,
 	if (! class->instance)
 		return -1;
 
+	/* Compile the pattern now rather than each time an instance is
+	 * started; a malformed pattern is only reported when it's expanded,
+	 * so any other error here is discarded and it'll be compiled again
+	 * then.
+	 */
+	if (class->instance_template)
+		nih_unref (class->instance_template, class);
+
+	class->instance_template = environ_template_new (class,
+							 class->instance);
+	if (! class->instance_template) {
+		NihError *err;
+
+		err = nih_error_get ();
+		if (err->number == ENOMEM) {
+			nih_free (err);
+			nih_return_no_memory_error (-1);
+		}
+		nih_free (err);
+	}
+
 	return nih_config_skip_comment (file, len, pos, lineno);
 }
 
@@ -1831,7 +2222,9 @@ stanza_task (JobClass        *class,
  * @lineno: line number.
  *
  * Parse a kill stanza from @file, extracting a second-level stanza that
- * states which value to set from its argument.
+ * states which value to set from its argument.  The escalate stanza takes
+ * one or more signals to send in turn, each after the kill timeout, before
+ * finally sending the KILL signal.
  *
  * Returns: zero on success, negative value on error.
  **/
@@ -1906,6 +2299,84 @@ stanza_kill (JobClass        *class,
 
 		/* Set the signal */
 		class->kill_signal = signal;
+	} else if (! strcmp (arg, "escalate")) {
+		int    *escalate = NULL;
+		size_t  escalate_len = 0;
+
+		/* Each stanza gives the whole ladder, replacing any given
+		 * before.
+		 */
+		do {
+			unsigned long   status;
+			nih_local char *sigarg = NULL;
+			int            *new_escalate, signal;
+
+			/* Update error position to the signal */
+			*pos = a_pos;
+			if (lineno)
+				*lineno = a_lineno;
+
+			sigarg = nih_config_next_arg (NULL, file, len,
+						      &a_pos, &a_lineno);
+			if (! sigarg) {
+				if (escalate)
+					nih_free (escalate);
+				goto finish;
+			}
+
+			signal = nih_signal_from_name (sigarg);
+			if (signal < 0) {
+				errno = 0;
+				status = strtoul (sigarg, &endptr, 10);
+				if (errno || *endptr || (! status)
+				    || (status > INT_MAX)) {
+					if (escalate)
+						nih_free (escalate);
+					nih_return_error (-1, PARSE_ILLEGAL_SIGNAL,
+							  _(PARSE_ILLEGAL_SIGNAL_STR));
+				}
+
+				signal = (int)status;
+			}
+
+			new_escalate = nih_realloc (escalate, class,
+						    sizeof (int) * (escalate_len + 1));
+			if (! new_escalate) {
+				if (escalate)
+					nih_free (escalate);
+				nih_return_system_error (-1);
+			}
+
+			escalate = new_escalate;
+			escalate[escalate_len++] = signal;
+		} while (nih_config_has_token (file, len, &a_pos, &a_lineno));
+
+		if (class->kill_escalate)
+			nih_unref (class->kill_escalate, class);
+
+		class->kill_escalate = escalate;
+		class->kill_escalate_len = escalate_len;
+	} else if (! strcmp (arg, "mode")) {
+		nih_local char *modearg = NULL;
+
+		/* Update error position to the mode */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		modearg = nih_config_next_arg (NULL, file, len,
+					       &a_pos, &a_lineno);
+		if (! modearg)
+			goto finish;
+
+		if (! strcmp (modearg, "group")) {
+			class->kill_mode = KILL_GROUP;
+		} else if (! strcmp (modearg, "tree")) {
+			class->kill_mode = KILL_TREE;
+		} else {
+			nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
+					  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
+		}
 	} else {
 		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
 				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
@@ -1933,7 +2404,8 @@ finish:
  *
  * Parse a daemon stanza from @file.  This either has no arguments, in
  * which case it sets the respawn flag for the job, or it has the "limit"
- * argument and sets the respawn rate limit.
+ * argument and sets the respawn rate limit, or the "backoff" argument and
+ * sets the delays between respawns.
  *
  * Returns: zero on success, negative value on error.
  **/
@@ -1961,7 +2433,6 @@ stanza_respawn (JobClass        *class,
 		return nih_config_skip_comment (file, len, pos, lineno);
 	}
 
-
 	/* Take the next argument, a sub-stanza keyword. */
 	a_pos = *pos;
 	a_lineno = (lineno ? *lineno : 1);
@@ -2018,6 +2489,92 @@ stanza_respawn (JobClass        *class,
 
 		ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
 
+	} else if (! strcmp (arg, "backoff")) {
+		nih_local char *delayarg = NULL;
+		nih_local char *multarg = NULL;
+		nih_local char *maxarg = NULL;
+		nih_local char *resetarg = NULL;
+		char           *endptr;
+		time_t          delay, max, reset;
+		long            mult;
+
+		/* Update error position to the delay value */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		/* Parse the initial delay */
+		delayarg = nih_config_next_arg (NULL, file, len,
+						&a_pos, &a_lineno);
+		if (! delayarg)
+			goto finish;
+
+		errno = 0;
+		delay = strtol (delayarg, &endptr, 10);
+		if (errno || *endptr || (delay <= 0))
+			nih_return_error (-1, PARSE_ILLEGAL_INTERVAL,
+					  _(PARSE_ILLEGAL_INTERVAL_STR));
+
+		/* Update error position to the multiplier */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		/* Parse the multiplier */
+		multarg = nih_config_next_arg (NULL, file, len,
+					       &a_pos, &a_lineno);
+		if (! multarg)
+			goto finish;
+
+		errno = 0;
+		mult = strtol (multarg, &endptr, 10);
+		if (errno || *endptr || (mult < 1) || (mult > INT_MAX))
+			nih_return_error (-1, PARSE_ILLEGAL_MULTIPLIER,
+					  _(PARSE_ILLEGAL_MULTIPLIER_STR));
+
+		/* Update error position to the maximum delay */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		/* Parse the maximum delay, which can't be less than the
+		 * initial one.
+		 */
+		maxarg = nih_config_next_arg (NULL, file, len,
+					      &a_pos, &a_lineno);
+		if (! maxarg)
+			goto finish;
+
+		errno = 0;
+		max = strtol (maxarg, &endptr, 10);
+		if (errno || *endptr || (max < delay))
+			nih_return_error (-1, PARSE_ILLEGAL_INTERVAL,
+					  _(PARSE_ILLEGAL_INTERVAL_STR));
+
+		/* Update error position to the reset interval */
+		*pos = a_pos;
+		if (lineno)
+			*lineno = a_lineno;
+
+		/* Parse the uptime after which the delay is reset */
+		resetarg = nih_config_next_arg (NULL, file, len,
+						&a_pos, &a_lineno);
+		if (! resetarg)
+			goto finish;
+
+		errno = 0;
+		reset = strtol (resetarg, &endptr, 10);
+		if (errno || *endptr || (reset < 0))
+			nih_return_error (-1, PARSE_ILLEGAL_INTERVAL,
+					  _(PARSE_ILLEGAL_INTERVAL_STR));
+
+		class->respawn_backoff_delay = delay;
+		class->respawn_backoff_multiplier = (int)mult;
+		class->respawn_backoff_max = max;
+		class->respawn_backoff_reset = reset;
+
+		ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
 	} else {
 		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
 				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
@@ -2514,6 +3071,173 @@ finish:
 	return ret;
 }
 
+/**
+ * stanza_cgroup:
+ * @class: job class being parsed,
+ * @stanza: stanza found,
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number.
+ *
+ * Parse a cgroup stanza from @file, extracting a controller and a
+ * second-level stanza that together state which control group setting
+ * to give from the following argument.
+ *
+ * CPU weight and IO weight are given as an integer from 1 to 10000, and
+ * the CPU quota as a percentage of a single CPU; memory limits are given
+ * in bytes, optionally with a K, M, G or T suffix, and the process limit
+ * as an integer.  All but the weights may instead be "unlimited".
+ *
+ * Returns: zero on success, negative value on error.
+ **/
+static int
+stanza_cgroup (JobClass        *class,
+	       NihConfigStanza *stanza,
+	       const char      *file,
+	       size_t           len,
+	       size_t          *pos,
+	       size_t          *lineno)
+{
+	CgroupSetting       setting;
+	nih_local char     *controller = NULL, *key = NULL, *arg = NULL;
+	char               *endptr, *value;
+	unsigned long long  num = 0;
+	size_t              a_pos, a_lineno;
+	int                 ret = -1;
+
+	nih_assert (class != NULL);
+	nih_assert (stanza != NULL);
+	nih_assert (file != NULL);
+	nih_assert (pos != NULL);
+
+	a_pos = *pos;
+	a_lineno = (lineno ? *lineno : 1);
+
+	controller = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+	if (! controller)
+		goto finish;
+
+	key = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+	if (! key)
+		goto finish;
+
+	if ((! strcmp (controller, "cpu")) && (! strcmp (key, "weight"))) {
+		setting = CGROUP_CPU_WEIGHT;
+	} else if ((! strcmp (controller, "cpu")) && (! strcmp (key, "quota"))) {
+		setting = CGROUP_CPU_MAX;
+	} else if ((! strcmp (controller, "memory")) && (! strcmp (key, "max"))) {
+		setting = CGROUP_MEMORY_MAX;
+	} else if ((! strcmp (controller, "memory")) && (! strcmp (key, "high"))) {
+		setting = CGROUP_MEMORY_HIGH;
+	} else if ((! strcmp (controller, "io")) && (! strcmp (key, "weight"))) {
+		setting = CGROUP_IO_WEIGHT;
+	} else if ((! strcmp (controller, "pids")) && (! strcmp (key, "max"))) {
+		setting = CGROUP_PIDS_MAX;
+	} else {
+		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
+				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
+	}
+
+	/* Update error position to the value */
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	arg = nih_config_next_arg (NULL, file, len, &a_pos, &a_lineno);
+	if (! arg)
+		goto finish;
+
+	if ((setting != CGROUP_CPU_WEIGHT) && (setting != CGROUP_IO_WEIGHT)
+	    && (! strcmp (arg, "unlimited"))) {
+		value = nih_strdup (class, ((setting == CGROUP_CPU_MAX)
+					    ? "max 100000" : "max"));
+		if (! value)
+			nih_return_system_error (-1);
+	} else {
+		errno = 0;
+		num = strtoull (arg, &endptr, 10);
+		if (errno || (endptr == arg) || (*arg == '-'))
+			nih_return_error (-1, PARSE_ILLEGAL_CGROUP,
+					  _(PARSE_ILLEGAL_CGROUP_STR));
+
+		/* Memory limits may be scaled by a binary suffix */
+		if ((setting == CGROUP_MEMORY_MAX)
+		    || (setting == CGROUP_MEMORY_HIGH)) {
+			int shift = 0;
+
+			switch (*endptr) {
+			case 'K':
+				shift = 10;
+				break;
+			case 'M':
+				shift = 20;
+				break;
+			case 'G':
+				shift = 30;
+				break;
+			case 'T':
+				shift = 40;
+				break;
+			}
+
+			if (shift) {
+				if (num > (ULLONG_MAX >> shift))
+					nih_return_error (-1, PARSE_ILLEGAL_CGROUP,
+							  _(PARSE_ILLEGAL_CGROUP_STR));
+
+				num <<= shift;
+				endptr++;
+			}
+		}
+
+		if (*endptr)
+			nih_return_error (-1, PARSE_ILLEGAL_CGROUP,
+					  _(PARSE_ILLEGAL_CGROUP_STR));
+
+		switch (setting) {
+		case CGROUP_CPU_WEIGHT:
+		case CGROUP_IO_WEIGHT:
+			if ((num < 1) || (num > 10000))
+				nih_return_error (-1, PARSE_ILLEGAL_CGROUP,
+						  _(PARSE_ILLEGAL_CGROUP_STR));
+
+			value = nih_sprintf (class, "%llu", num);
+			break;
+		case CGROUP_CPU_MAX:
+			/* Quota is given in microseconds per 100ms period,
+			 * so one percent of a CPU is a thousand of them.
+			 */
+			if ((num < 1) || (num > (ULLONG_MAX / 1000)))
+				nih_return_error (-1, PARSE_ILLEGAL_CGROUP,
+						  _(PARSE_ILLEGAL_CGROUP_STR));
+
+			value = nih_sprintf (class, "%llu 100000", num * 1000);
+			break;
+		default:
+			value = nih_sprintf (class, "%llu", num);
+			break;
+		}
+
+		if (! value)
+			nih_return_system_error (-1);
+	}
+
+	if (class->cgroup_settings[setting])
+		nih_unref (class->cgroup_settings[setting], class);
+
+	class->cgroup_settings[setting] = value;
+
+	ret = nih_config_skip_comment (file, len, &a_pos, &a_lineno);
+
+finish:
+	*pos = a_pos;
+	if (lineno)
+		*lineno = a_lineno;
+
+	return ret;
+}
+
 /**
  * stanza_chroot:
  * @class: job class being parsed,
@@ -31,6 +31,13 @@ JobClass *parse_job (const void *parent, JobClass *update,
 		     const char *name, const char *file,
 		     size_t len, size_t *pos, size_t *lineno)
 	__attribute__ ((warn_unused_result, malloc));
+JobClass *parse_job_header (const void *parent, JobClass *update,
+			    const char *name, const char *file,
+			    size_t len, size_t *pos, size_t *lineno)
+	__attribute__ ((warn_unused_result, malloc));
+
+int       parse_job_deferred (JobClass *class, size_t *lineno)
+	__attribute__ ((warn_unused_result));
 
 NIH_END_EXTERN
 
@@ -0,0 +1,201 @@
+/* upstart
+ *
+ * runlevel.c - record of the current and previous runlevel
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "events.h"
+#include "environ.h"
+#include "event.h"
+#include "runlevel.h"
+
+#include "../util/utmp.h"
+
+
+/**
+ * runlevel_current:
+ *
+ * Runlevel of the most recent runlevel event, 'N' before there has been
+ * one.
+ **/
+int runlevel_current = 'N';
+
+/**
+ * runlevel_previous:
+ *
+ * Runlevel before the most recent runlevel event, 'N' if there was none.
+ **/
+int runlevel_previous = 'N';
+
+/**
+ * runlevel_state:
+ *
+ * File that the current and previous runlevel are written to whenever
+ * they change, so that runlevel, shutdown and telinit can find them
+ * without scanning utmp.  NULL if they are only kept in memory.
+ **/
+const char *runlevel_state = NULL;
+
+
+/**
+ * runlevel_event:
+ * @event: event being handled.
+ *
+ * Checks whether @event is a runlevel event and if so records the new
+ * runlevel from its RUNLEVEL variable, and the previous one from its
+ * PREVLEVEL variable or from the runlevel we last recorded, then writes
+ * both to runlevel_state if set.
+ *
+ * Failing to write the state file isn't fatal, tools fall back to utmp.
+ *
+ * Returns: TRUE if @event changed the runlevel, FALSE otherwise.
+ **/
+int
+runlevel_event (Event *event)
+{
+	const char *runlevel;
+	const char *prevlevel;
+
+	nih_assert (event != NULL);
+
+	if (strcmp (event->name, RUNLEVEL_EVENT))
+		return FALSE;
+
+	runlevel = environ_get (event->env, "RUNLEVEL");
+	if ((! runlevel) || (! *runlevel))
+		return FALSE;
+
+	prevlevel = environ_get (event->env, "PREVLEVEL");
+	if (prevlevel && *prevlevel) {
+		runlevel_previous = prevlevel[0];
+	} else {
+		runlevel_previous = runlevel_current;
+	}
+	runlevel_current = runlevel[0];
+
+	if (runlevel_state && (runlevel_write (runlevel_state) < 0)) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_warn ("%s: %s: %s", runlevel_state,
+			  _("Unable to write runlevel state"), err->message);
+		nih_free (err);
+	}
+
+	return TRUE;
+}
+
+
+/**
+ * runlevel_write:
+ * @path: file to write to.
+ *
+ * Writes the previous and current runlevel to @path as two characters
+ * separated by a space, the format of the runlevel command's output.  The
+ * file is written under a temporary name and renamed over @path so that
+ * readers never see a partial file.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+runlevel_write (const char *path)
+{
+	nih_local char *tmp = NULL;
+	char            buf[4];
+	int             fd;
+
+	nih_assert (path != NULL);
+
+	tmp = nih_sprintf (NULL, "%s.new", path);
+	if (! tmp)
+		nih_return_no_memory_error (-1);
+
+	buf[0] = runlevel_previous;
+	buf[1] = ' ';
+	buf[2] = runlevel_current;
+	buf[3] = '\n';
+
+	fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	if (write (fd, buf, sizeof buf) != sizeof buf) {
+		nih_error_raise_system ();
+		close (fd);
+		goto error;
+	}
+
+	if (close (fd) < 0) {
+		nih_error_raise_system ();
+		goto error;
+	}
+
+	if (rename (tmp, path) < 0) {
+		nih_error_raise_system ();
+		goto error;
+	}
+
+	return 0;
+
+error:
+	unlink (tmp);
+	return -1;
+}
+
+/**
+ * runlevel_restore:
+ * @path: file to read from.
+ *
+ * Reads the previous and current runlevel back from @path, as written by
+ * runlevel_write(); used after a re-exec to pick up where the previous
+ * init daemon left off.  The file is parsed by state_read_runlevel(), as
+ * it is by the runlevel, shutdown and telinit tools.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+runlevel_restore (const char *path)
+{
+	int runlevel, prevlevel;
+
+	nih_assert (path != NULL);
+
+	runlevel = state_read_runlevel (path, &prevlevel);
+	if (runlevel < 0)
+		return -1;
+
+	runlevel_previous = prevlevel;
+	runlevel_current = runlevel;
+
+	return 0;
+}
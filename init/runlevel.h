@@ -0,0 +1,43 @@
+/* upstart
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_RUNLEVEL_H
+#define INIT_RUNLEVEL_H
+
+#include <nih/macros.h>
+
+#include "event.h"
+
+
+NIH_BEGIN_EXTERN
+
+extern int         runlevel_current;
+extern int         runlevel_previous;
+extern const char *runlevel_state;
+
+
+int runlevel_event   (Event *event);
+
+int runlevel_write   (const char *path)
+	__attribute__ ((warn_unused_result));
+int runlevel_restore (const char *path)
+	__attribute__ ((warn_unused_result));
+
+NIH_END_EXTERN
+
+#endif /* INIT_RUNLEVEL_H */
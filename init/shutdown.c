@@ -0,0 +1,338 @@
+/* upstart
+ *
+ * shutdown.c - parallel stopping of jobs at shutdown
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/tree.h>
+#include <nih/timer.h>
+#include <nih/signal.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "events.h"
+#include "environ.h"
+#include "system.h"
+#include "process.h"
+#include "job_class.h"
+#include "job.h"
+#include "event_operator.h"
+#include "event.h"
+#include "shutdown.h"
+
+
+/* Prototypes for static functions */
+static int  shutdown_class_active    (JobClass *class);
+static int  shutdown_class_dependent (JobClass *class);
+static void shutdown_timer_expired   (void *data, NihTimer *timer);
+
+
+/**
+ * shutdown_deadline:
+ *
+ * Time in seconds from the start of a shutdown or reboot after which any
+ * job process still running while its job is stopping is sent the KILL
+ * signal, regardless of the kill timeout of its job.  Zero disables the
+ * parallel shutdown altogether, leaving jobs to be stopped purely by
+ * their own stop events.
+ **/
+int shutdown_deadline = 0;
+
+/**
+ * shutdown_timer:
+ *
+ * Timer for shutdown_deadline, set once a shutdown has begun.
+ **/
+NihTimer *shutdown_timer = NULL;
+
+
+/**
+ * shutdown_event:
+ * @event: event being handled.
+ *
+ * Checks whether @event is the runlevel event emitted by shutdown and
+ * telinit for a change to runlevel 0 (halt) or 6 (reboot).
+ *
+ * Returns: TRUE if @event begins a shutdown, FALSE otherwise.
+ **/
+int
+shutdown_event (Event *event)
+{
+	const char *runlevel;
+
+	nih_assert (event != NULL);
+
+	if (strcmp (event->name, RUNLEVEL_EVENT))
+		return FALSE;
+
+	runlevel = environ_get (event->env, "RUNLEVEL");
+	if (! runlevel)
+		return FALSE;
+
+	return ((! strcmp (runlevel, "0")) || (! strcmp (runlevel, "6")));
+}
+
+/**
+ * shutdown_begin:
+ *
+ * Called once a shutdown event has been handled by the jobs that wait
+ * for it, this stops in a single pass every service that has no stop
+ * ordering dependency on another active job, rather than leaving them to
+ * be stopped one after the other, and starts the shutdown deadline timer.
+ *
+ * Tasks, which include the rc scripts, and services started by the
+ * runlevel event are left alone since they're part of the shutdown;
+ * services whose stop events refer to another active job, or are
+ * referred to by those of another active job, are left to be stopped
+ * in order by those events.
+ *
+ * Does nothing unless shutdown_deadline is set, or if a shutdown has
+ * already begun.
+ **/
+void
+shutdown_begin (void)
+{
+	nih_local Job **jobs = NULL;
+	size_t          num_jobs = 0;
+
+	if ((! shutdown_deadline) || shutdown_timer)
+		return;
+
+	job_class_init ();
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		if (class->task)
+			continue;
+		if (class->start_on
+		    && shutdown_operator_references (class->start_on, NULL))
+			continue;
+		if (shutdown_class_dependent (class))
+			continue;
+
+		NIH_HASH_FOREACH (class->instances, job_iter) {
+			Job *job = (Job *)job_iter;
+
+			if (job->goal != JOB_START)
+				continue;
+
+			jobs = NIH_MUST (nih_realloc (jobs, NULL,
+						      sizeof (Job *)
+						      * (num_jobs + 1)));
+			jobs[num_jobs++] = job;
+		}
+	}
+
+	nih_info (_("Stopping %zu independent jobs for shutdown"), num_jobs);
+
+	/* Changing the goal only emits the stopping event for each job,
+	 * so none of the others can have been freed as a side effect.
+	 */
+	for (size_t i = 0; i < num_jobs; i++)
+		job_change_goal (jobs[i], JOB_STOP);
+
+	shutdown_timer = NIH_MUST (nih_timer_add_timeout (
+			NULL, shutdown_deadline,
+			shutdown_timer_expired, NULL));
+}
+
+/**
+ * shutdown_operator_references:
+ * @root: operator tree to search,
+ * @name: name of job class.
+ *
+ * Checks whether any of the events matched by the tree @root may be
+ * the starting, started, stopping or stopped event of the job class
+ * named @name; when @name is NULL, whether any may be the runlevel event
+ * instead.
+ *
+ * Events matched without a JOB argument, or with one that depends on
+ * the environment or is negated, may refer to any job and so are always
+ * counted.
+ *
+ * Returns: TRUE if @root refers to the job class, FALSE otherwise.
+ **/
+int
+shutdown_operator_references (EventOperator *root,
+			      const char    *name)
+{
+	nih_assert (root != NULL);
+
+	NIH_TREE_FOREACH_POST (&root->node, iter) {
+		EventOperator *oper = (EventOperator *)iter;
+		const char    *value = NULL;
+
+		if (oper->type != EVENT_MATCH)
+			continue;
+
+		if (! name) {
+			if (! strcmp (oper->name, RUNLEVEL_EVENT))
+				return TRUE;
+
+			continue;
+		}
+
+		if (strcmp (oper->name, JOB_STARTING_EVENT)
+		    && strcmp (oper->name, JOB_STARTED_EVENT)
+		    && strcmp (oper->name, JOB_STOPPING_EVENT)
+		    && strcmp (oper->name, JOB_STOPPED_EVENT))
+			continue;
+
+		/* The job name is the first positional argument, or the
+		 * JOB variable when given by name.
+		 */
+		for (char **e = oper->env; e && *e; e++) {
+			if (((e == oper->env) && (! strchr (*e, '=')))
+			    || (! strncmp (*e, "JOB=", 4))) {
+				value = strchr (*e, '=') ? *e + 4 : *e;
+				break;
+			} else if (! strncmp (*e, "JOB!=", 5)) {
+				return TRUE;
+			}
+		}
+
+		if ((! value) || strchr (value, '$')
+		    || (! fnmatch (value, name, 0)))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * shutdown_class_active:
+ * @class: job class to check.
+ *
+ * Returns: TRUE if @class has any instances, FALSE otherwise.
+ **/
+static int
+shutdown_class_active (JobClass *class)
+{
+	nih_assert (class != NULL);
+
+	NIH_HASH_FOREACH (class->instances, iter)
+		return TRUE;
+
+	return FALSE;
+}
+
+/**
+ * shutdown_class_dependent:
+ * @class: job class to check.
+ *
+ * Checks whether the stop events of @class refer to another job class
+ * with active instances, or the stop events of such a class refer to
+ * @class; in either case stopping @class has an ordering dependency
+ * that its events take care of.
+ *
+ * Returns: TRUE if @class has a stop ordering dependency, FALSE otherwise.
+ **/
+static int
+shutdown_class_dependent (JobClass *class)
+{
+	nih_assert (class != NULL);
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *other = (JobClass *)iter;
+
+		if ((other == class) || (! shutdown_class_active (other)))
+			continue;
+
+		if (class->stop_on
+		    && shutdown_operator_references (class->stop_on,
+						     other->name))
+			return TRUE;
+		if (other->stop_on
+		    && shutdown_operator_references (other->stop_on,
+						     class->name))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * shutdown_timer_expired:
+ * @data: unused,
+ * @timer: timer that caused us to be called.
+ *
+ * Called once shutdown_deadline has passed since the shutdown began,
+ * this sends the KILL signal to every process of any job that is still
+ * stopping so that none can delay the shutdown further.
+ **/
+static void
+shutdown_timer_expired (void     *data,
+			NihTimer *timer)
+{
+	nih_assert (timer != NULL);
+	nih_assert (shutdown_timer == timer);
+
+	shutdown_timer = NULL;
+
+	nih_warn (_("Shutdown deadline reached, killing remaining processes"));
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		NIH_HASH_FOREACH (class->instances, job_iter) {
+			Job *job = (Job *)job_iter;
+
+			if (job->goal != JOB_STOP)
+				continue;
+
+			for (ProcessType process = 0; process < PROCESS_LAST;
+			     process++) {
+				if (job->pid[process] <= 0)
+					continue;
+
+				nih_info (_("Sending %s signal to %s %s process (%d)"),
+					  "KILL", job_name (job),
+					  process_name (process),
+					  job->pid[process]);
+
+				if (system_kill (job->pid[process],
+						 SIGKILL) < 0) {
+					NihError *err;
+
+					err = nih_error_get ();
+					if (err->number != ESRCH)
+						nih_warn (_("Failed to send %s signal to %s %s process (%d): %s"),
+							  "KILL", job_name (job),
+							  process_name (process),
+							  job->pid[process],
+							  err->message);
+					nih_free (err);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,1311 @@
+/* upstart
+ *
+ * state.c - serialisation of state across re-execution
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/tree.h>
+#include <nih/timer.h>
+#include <nih/io.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+#include "process.h"
+#include "job_class.h"
+#include "job_process.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "blocked.h"
+#include "conf.h"
+#include "state.h"
+#include "errors.h"
+
+
+/**
+ * StateOperator:
+ * @type: operator type,
+ * @name: name of event to match,
+ * @value: whether the operator is satisfied,
+ * @event: event matched.
+ *
+ * An event operator as read by state_read_operator(), before it has been
+ * checked against the operator in the tree being restored.
+ **/
+typedef struct state_operator {
+	long   type;
+	char  *name;
+	long   value;
+	Event *event;
+} StateOperator;
+
+
+/* Prototypes for static functions */
+static void   state_write_int      (FILE *stream, long value);
+static void   state_write_str      (FILE *stream, const char *str);
+static void   state_write_strv     (FILE *stream, char * const *array);
+static void   state_write_fds      (FILE *stream, const int *fds,
+				    size_t num_fds, char * const *fd_names);
+static void   state_write_operator (FILE *stream, EventOperator *root,
+				    EventOperatorState *state);
+static void   state_write_job      (FILE *stream, Job *job);
+static long   state_event_index    (Event *event);
+
+static int    state_read_int       (FILE *stream, long *value);
+static int    state_read_null      (FILE *stream);
+static int    state_read_str       (const void *parent, FILE *stream,
+				    char **str);
+static int    state_read_strv      (const void *parent, FILE *stream,
+				    char ***array);
+static int    state_read_fds       (const void *parent, FILE *stream,
+				    int **fds, size_t *num_fds,
+				    char ***fd_names);
+static int    state_read_event_ref (FILE *stream, Event **table,
+				    size_t table_len, Event **event);
+static int    state_read_operator  (FILE *stream, EventOperator *root,
+				    EventOperatorState *state,
+				    Event **table, size_t table_len);
+static int    state_read_source    (FILE *stream);
+static int    state_read_event     (FILE *stream, Event ***table,
+				    size_t *table_len);
+static int    state_read_class     (FILE *stream, Event **table,
+				    size_t table_len);
+static int    state_read_job       (FILE *stream, Event **table,
+				    size_t table_len);
+static int    state_read_blocking  (FILE *stream, Event **table,
+				    size_t table_len);
+
+
+/**
+ * state_write:
+ * @fd: file descriptor to write to.
+ *
+ * Serialises the state of the init daemon to @fd, which is closed
+ * afterwards, so that a newly executed init daemon may pick up where
+ * this one left off by calling state_read().
+ *
+ * The state is written as a stream of records, one per line, each a
+ * keyword followed by its fields; numbers are written in decimal and
+ * strings prefixed with their length so that they may contain any
+ * character, with "-" standing for NULL.  After the version line come
+ * the configuration sources, the event queue, the start events matched
+ * by each job class, every job and finally those jobs that events are
+ * blocking; records only refer to those written before them, events by
+ * their position in the queue and jobs by name, so that the stream can
+ * be restored in a single pass.
+ *
+ * Job classes themselves are not written, since the new init daemon
+ * parses them from the configuration sources again; nor are references
+ * to D-Bus method calls, since connections are not carried over.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+state_write (int fd)
+{
+	FILE *stream;
+	long  index;
+
+	nih_assert (fd >= 0);
+
+	conf_init ();
+	event_init ();
+	job_class_init ();
+
+	stream = fdopen (fd, "w");
+	if (! stream)
+		nih_return_system_error (-1);
+
+	fprintf (stream, "upstart-state %d\n", STATE_VERSION);
+
+	NIH_LIST_FOREACH (conf_sources, iter) {
+		ConfSource *source = (ConfSource *)iter;
+
+		fprintf (stream, "source");
+		state_write_str (stream, source->path);
+		state_write_int (stream, source->type);
+		fprintf (stream, "\n");
+	}
+
+	NIH_LIST_FOREACH (events, iter) {
+		Event *event = (Event *)iter;
+
+		fprintf (stream, "event");
+		state_write_str (stream, event->name);
+		state_write_strv (stream, event->env);
+		state_write_int (stream, event->progress);
+		state_write_int (stream, event->failed);
+		state_write_fds (stream, event->fds, event->num_fds,
+				 event->fd_names);
+		fprintf (stream, "\n");
+	}
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		if (class->start_on) {
+			fprintf (stream, "class");
+			state_write_str (stream, class->name);
+			state_write_operator (stream, class->start_on, NULL);
+			fprintf (stream, "\n");
+		}
+
+		NIH_HASH_FOREACH (class->instances, job_iter)
+			state_write_job (stream, (Job *)job_iter);
+	}
+
+	index = 0;
+	NIH_LIST_FOREACH (events, iter) {
+		Event *event = (Event *)iter;
+
+		NIH_LIST_FOREACH (&event->blocking, blocked_iter) {
+			Blocked *blocked = (Blocked *)blocked_iter;
+
+			if (blocked->type != BLOCKED_JOB)
+				continue;
+
+			fprintf (stream, "blocking");
+			state_write_int (stream, index);
+			state_write_str (stream, blocked->job->class->name);
+			state_write_str (stream, blocked->job->name);
+			fprintf (stream, "\n");
+		}
+
+		index++;
+	}
+
+	fprintf (stream, "end\n");
+
+	if (ferror (stream)) {
+		nih_error_raise_system ();
+		fclose (stream);
+		return -1;
+	}
+
+	if (fclose (stream) < 0)
+		nih_return_system_error (-1);
+
+	return 0;
+}
+
+/**
+ * state_write_job:
+ * @stream: stream to write to,
+ * @job: job to write.
+ *
+ * Writes the record for @job to @stream; its timers are written only as
+ * whether they were set, and are set again with their full timeout when
+ * read.
+ **/
+static void
+state_write_job (FILE *stream,
+		 Job  *job)
+{
+	long count;
+
+	nih_assert (stream != NULL);
+	nih_assert (job != NULL);
+
+	fprintf (stream, "job");
+	state_write_str (stream, job->class->name);
+	state_write_str (stream, job->name);
+	state_write_int (stream, job->goal);
+	state_write_int (stream, job->state);
+	state_write_strv (stream, job->env);
+	state_write_strv (stream, job->start_env);
+	state_write_strv (stream, job->stop_env);
+	state_write_operator (stream, job->class->stop_on, job->stop_on);
+	state_write_fds (stream, job->fds, job->num_fds, job->fd_names);
+
+	state_write_int (stream, PROCESS_LAST);
+	for (int i = 0; i < PROCESS_LAST; i++)
+		state_write_int (stream, job->pid[i]);
+
+	state_write_int (stream, state_event_index (job->blocker));
+
+	count = 0;
+	NIH_LIST_FOREACH (&job->blocking, iter) {
+		Blocked *blocked = (Blocked *)iter;
+
+		if (blocked->type == BLOCKED_EVENT)
+			count++;
+	}
+
+	state_write_int (stream, count);
+	NIH_LIST_FOREACH (&job->blocking, iter) {
+		Blocked *blocked = (Blocked *)iter;
+
+		if (blocked->type == BLOCKED_EVENT)
+			state_write_int (stream,
+					 state_event_index (blocked->event));
+	}
+
+	state_write_int (stream, job->kill_timer != NULL);
+	state_write_int (stream, job->kill_process);
+	state_write_int (stream, job->kill_step);
+
+	state_write_int (stream, job->failed);
+	state_write_int (stream, job->failed_process);
+	state_write_int (stream, job->exit_status);
+
+	state_write_int (stream, job->respawn_time);
+	state_write_int (stream, job->respawn_count);
+	state_write_int (stream, job->respawn_delay);
+	state_write_int (stream, job->respawn_pending);
+	state_write_int (stream, job->respawn_timer != NULL);
+	state_write_int (stream, job->spawn_time);
+
+	state_write_int (stream, job->trace_forks);
+	state_write_int (stream, job->trace_state);
+
+	state_write_int (stream, job->cgroup_watch != NULL);
+
+	fprintf (stream, "\n");
+}
+
+/**
+ * state_write_int:
+ * @stream: stream to write to,
+ * @value: value to write.
+ *
+ * Writes @value to @stream as a field of the current record.
+ **/
+static void
+state_write_int (FILE *stream,
+		 long  value)
+{
+	nih_assert (stream != NULL);
+
+	fprintf (stream, " %ld", value);
+}
+
+/**
+ * state_write_str:
+ * @stream: stream to write to,
+ * @str: string to write.
+ *
+ * Writes @str to @stream as a field of the current record, prefixed by
+ * its length; @str may be NULL.
+ **/
+static void
+state_write_str (FILE       *stream,
+		 const char *str)
+{
+	nih_assert (stream != NULL);
+
+	if (str) {
+		fprintf (stream, " %zu:%s", strlen (str), str);
+	} else {
+		fprintf (stream, " -");
+	}
+}
+
+/**
+ * state_write_strv:
+ * @stream: stream to write to,
+ * @array: NULL-terminated array to write.
+ *
+ * Writes @array to @stream as a field of the current record, the number
+ * of strings followed by each one; @array may be NULL.
+ **/
+static void
+state_write_strv (FILE         *stream,
+		  char * const *array)
+{
+	size_t len = 0;
+
+	nih_assert (stream != NULL);
+
+	if (! array) {
+		fprintf (stream, " -");
+		return;
+	}
+
+	while (array[len])
+		len++;
+
+	state_write_int (stream, len);
+	for (size_t i = 0; i < len; i++)
+		state_write_str (stream, array[i]);
+}
+
+/**
+ * state_write_fds:
+ * @stream: stream to write to,
+ * @fds: file descriptors to write,
+ * @num_fds: number of descriptors in @fds,
+ * @fd_names: names of @fds.
+ *
+ * Writes the number of @fds to @stream followed by each descriptor and
+ * its name; the descriptors themselves are kept open across the exec by
+ * state_set_cloexec().
+ **/
+static void
+state_write_fds (FILE         *stream,
+		 const int    *fds,
+		 size_t        num_fds,
+		 char * const *fd_names)
+{
+	nih_assert (stream != NULL);
+
+	state_write_int (stream, num_fds);
+	for (size_t i = 0; i < num_fds; i++) {
+		state_write_int (stream, fds[i]);
+		state_write_str (stream, fd_names[i]);
+	}
+}
+
+/**
+ * state_write_operator:
+ * @stream: stream to write to,
+ * @root: event operator tree to write,
+ * @state: state of @root, or NULL.
+ *
+ * Writes the number of operators in the tree rooted at @root to @stream,
+ * followed by the type, name, value and matched event of each in
+ * post-order so that they can be checked against the tree parsed by the
+ * new init daemon; @root may be NULL.  The values and matched events are
+ * taken from @state if not NULL.
+ **/
+static void
+state_write_operator (FILE               *stream,
+		      EventOperator      *root,
+		      EventOperatorState *state)
+{
+	long count = 0;
+
+	nih_assert (stream != NULL);
+
+	if (root) {
+		NIH_TREE_FOREACH_POST (&root->node, iter)
+			count++;
+	}
+
+	state_write_int (stream, count);
+	if (! root)
+		return;
+
+	NIH_TREE_FOREACH_POST (&root->node, iter) {
+		EventOperator *oper = (EventOperator *)iter;
+
+		state_write_int (stream, oper->type);
+		state_write_str (stream, oper->name);
+		state_write_int (stream, EVENT_OPERATOR_VALUE (oper, state));
+		state_write_int (stream, state_event_index (
+					 EVENT_OPERATOR_EVENT (oper, state)));
+	}
+}
+
+/**
+ * state_event_index:
+ * @event: event to find.
+ *
+ * Returns: position of @event in the event queue, or -1 if @event is NULL.
+ **/
+static long
+state_event_index (Event *event)
+{
+	long index = 0;
+
+	if (! event)
+		return -1;
+
+	NIH_LIST_FOREACH (events, iter) {
+		if ((Event *)iter == event)
+			return index;
+
+		index++;
+	}
+
+	nih_assert_not_reached ();
+}
+
+
+/**
+ * state_read:
+ * @fd: file descriptor to read from.
+ *
+ * Restores the state written by state_write() of the init daemon that
+ * executed us from @fd, which is closed afterwards.
+ *
+ * The configuration sources are created first and parsed, the events
+ * placed back in the queue and then each job restored as an instance of
+ * the newly parsed class of the same name, with the events it and the
+ * start events of its class had matched; jobs whose class no longer
+ * exists are dropped with a warning, and matched events are dropped for
+ * any event operators that changed.  Timers are set again with their
+ * full timeout and processes are not run again, so the jobs carry on
+ * from the state they were in.
+ *
+ * Should the stream end or be invalid before the configuration has been
+ * parsed, the sources already created are freed again since there's no
+ * telling whether any are missing; the caller should then create the
+ * usual ones.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+state_read (int fd)
+{
+	FILE             *stream;
+	nih_local Event **table = NULL;
+	size_t            table_len = 0;
+	int               version;
+	int               reloaded = FALSE;
+
+	nih_assert (fd >= 0);
+
+	conf_init ();
+	event_init ();
+	job_class_init ();
+
+	stream = fdopen (fd, "r");
+	if (! stream)
+		nih_return_system_error (-1);
+
+	if ((fscanf (stream, "upstart-state %d", &version) != 1)
+	    || (version != STATE_VERSION))
+		goto invalid;
+
+	for (;;) {
+		char record[16];
+		int  ret;
+
+		if (fscanf (stream, " %15s", record) != 1)
+			goto invalid;
+
+		if (! strcmp (record, "source")) {
+			if (reloaded)
+				goto invalid;
+
+			ret = state_read_source (stream);
+			if (ret < 0)
+				goto error;
+
+			continue;
+		}
+
+		/* The records after the sources refer to the job classes
+		 * parsed from them.
+		 */
+		if (! reloaded) {
+			conf_reload ();
+			reloaded = TRUE;
+		}
+
+		if (! strcmp (record, "end")) {
+			break;
+		} else if (! strcmp (record, "event")) {
+			ret = state_read_event (stream, &table, &table_len);
+		} else if (! strcmp (record, "class")) {
+			ret = state_read_class (stream, table, table_len);
+		} else if (! strcmp (record, "job")) {
+			ret = state_read_job (stream, table, table_len);
+		} else if (! strcmp (record, "blocking")) {
+			ret = state_read_blocking (stream, table, table_len);
+		} else {
+			goto invalid;
+		}
+
+		if (ret < 0)
+			goto error;
+	}
+
+	fclose (stream);
+
+	return 0;
+
+invalid:
+	nih_error_raise (STATE_INVALID, _(STATE_INVALID_STR));
+error:
+	if (! reloaded)
+		NIH_LIST_FOREACH_SAFE (conf_sources, iter)
+			nih_free (iter);
+
+	fclose (stream);
+	return -1;
+}
+
+/**
+ * state_read_source:
+ * @stream: stream to read from.
+ *
+ * Reads a configuration source record from @stream and creates the
+ * source.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_source (FILE *stream)
+{
+	nih_local char *path = NULL;
+	long            type;
+
+	nih_assert (stream != NULL);
+
+	if ((state_read_str (NULL, stream, &path) < 0)
+	    || (state_read_int (stream, &type) < 0))
+		return -1;
+
+	if ((! path) || (type < CONF_FILE) || (type > CONF_JOB_DIR))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	NIH_MUST (conf_source_new (NULL, path, type));
+
+	return 0;
+}
+
+/**
+ * state_read_event:
+ * @stream: stream to read from,
+ * @table: pointer to table of events read,
+ * @table_len: pointer to number of events in @table.
+ *
+ * Reads an event record from @stream, placing the event back in the
+ * queue and appending it to @table so that later records may refer to it.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_event (FILE     *stream,
+		  Event  ***table,
+		  size_t   *table_len)
+{
+	nih_local char  *name = NULL;
+	nih_local char **env = NULL;
+	long             progress;
+	long             failed;
+	Event           *event;
+
+	nih_assert (stream != NULL);
+	nih_assert (table != NULL);
+	nih_assert (table_len != NULL);
+
+	if ((state_read_str (NULL, stream, &name) < 0)
+	    || (state_read_strv (NULL, stream, &env) < 0)
+	    || (state_read_int (stream, &progress) < 0)
+	    || (state_read_int (stream, &failed) < 0))
+		return -1;
+
+	if ((! name) || (! *name)
+	    || (progress < EVENT_PENDING) || (progress > EVENT_FINISHED))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	event = NIH_MUST (event_new (NULL, name, env));
+	event->progress = progress;
+	event->failed = failed ? TRUE : FALSE;
+
+	*table = NIH_MUST (nih_realloc (*table, NULL,
+					sizeof (Event *) * (*table_len + 1)));
+	(*table)[(*table_len)++] = event;
+
+	if (state_read_fds (event, stream, &event->fds, &event->num_fds,
+			    &event->fd_names) < 0)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * state_read_class:
+ * @stream: stream to read from,
+ * @table: table of events read,
+ * @table_len: number of events in @table.
+ *
+ * Reads a job class record from @stream, restoring the start events that
+ * the class of that name had matched if its start condition is the same.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_class (FILE    *stream,
+		  Event  **table,
+		  size_t   table_len)
+{
+	nih_local char *name = NULL;
+	JobClass       *class;
+
+	nih_assert (stream != NULL);
+
+	if (state_read_str (NULL, stream, &name) < 0)
+		return -1;
+
+	if (! name)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	class = (JobClass *)nih_hash_lookup (job_classes, name);
+
+	return state_read_operator (stream, class ? class->start_on : NULL,
+				    NULL, table, table_len);
+}
+
+/**
+ * state_read_job:
+ * @stream: stream to read from,
+ * @table: table of events read,
+ * @table_len: number of events in @table.
+ *
+ * Reads a job record from @stream and restores the job as an instance
+ * of the class of the same name; if there is no longer such a class the
+ * record is read and discarded, and the descriptors passed to the job
+ * closed.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_job (FILE    *stream,
+		Event  **table,
+		size_t   table_len)
+{
+	nih_local char  *class_name = NULL;
+	nih_local char  *name = NULL;
+	nih_local char **env = NULL;
+	nih_local char **start_env = NULL;
+	nih_local char **stop_env = NULL;
+	nih_local int   *fds = NULL;
+	nih_local char **fd_names = NULL;
+	size_t           num_fds = 0;
+	JobClass        *class;
+	Job             *job = NULL;
+	Event           *event;
+	long             goal, state, count, value;
+	long             kill_timer, kill_process, kill_step;
+	long             failed, failed_process, exit_status;
+	long             respawn_time, respawn_count, respawn_delay;
+	long             respawn_pending, respawn_timer, spawn_time;
+	long             trace_forks, trace_state, cgroup_watch;
+
+	nih_assert (stream != NULL);
+
+	if ((state_read_str (NULL, stream, &class_name) < 0)
+	    || (state_read_str (NULL, stream, &name) < 0)
+	    || (state_read_int (stream, &goal) < 0)
+	    || (state_read_int (stream, &state) < 0))
+		return -1;
+
+	if ((! class_name) || (! name)
+	    || (goal < JOB_STOP) || (goal > JOB_RESPAWN)
+	    || (state < JOB_WAITING) || (state > JOB_POST_STOP))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	class = (JobClass *)nih_hash_lookup (job_classes, class_name);
+	if (class && (! nih_hash_lookup (class->instances, name))
+	    && (job_class_materialise (class) == 0)) {
+		job = NIH_MUST (job_new (class, name));
+		job->goal = goal;
+		job->state = state;
+	} else {
+		nih_warn (_("Unable to restore %s job instance \"%s\""),
+			  class_name, name);
+	}
+
+	if ((state_read_strv (NULL, stream, &env) < 0)
+	    || (state_read_strv (NULL, stream, &start_env) < 0)
+	    || (state_read_strv (NULL, stream, &stop_env) < 0)
+	    || (state_read_operator (stream, job ? class->stop_on : NULL,
+				     job ? job->stop_on : NULL,
+				     table, table_len) < 0)
+	    || (state_read_fds (NULL, stream, &fds, &num_fds, &fd_names) < 0))
+		return -1;
+
+	if (job) {
+		if (env) {
+			job->env = env;
+			nih_ref (job->env, job);
+		}
+
+		if (start_env) {
+			job->start_env = start_env;
+			nih_ref (job->start_env, job);
+		}
+
+		if (stop_env) {
+			job->stop_env = stop_env;
+			nih_ref (job->stop_env, job);
+		}
+
+		if (fds) {
+			job->fds = fds;
+			job->fd_names = fd_names;
+			job->num_fds = num_fds;
+
+			nih_ref (job->fds, job);
+			nih_ref (job->fd_names, job);
+		}
+	} else {
+		for (size_t i = 0; i < num_fds; i++)
+			close (fds[i]);
+	}
+
+	if (state_read_int (stream, &count) < 0)
+		return -1;
+	if (count != PROCESS_LAST)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	for (int i = 0; i < PROCESS_LAST; i++) {
+		if (state_read_int (stream, &value) < 0)
+			return -1;
+
+		if (job) {
+			job->pid[i] = value;
+			job_process_track (job, i);
+		}
+	}
+
+	if (state_read_event_ref (stream, table, table_len, &event) < 0)
+		return -1;
+
+	if (job)
+		job->blocker = event;
+
+	if (state_read_int (stream, &count) < 0)
+		return -1;
+
+	while (count-- > 0) {
+		Blocked *blocked;
+
+		if (state_read_event_ref (stream, table, table_len, &event) < 0)
+			return -1;
+		if (! event)
+			nih_return_error (-1, STATE_INVALID,
+					  _(STATE_INVALID_STR));
+
+		if (! job)
+			continue;
+
+		blocked = NIH_MUST (blocked_new (job, BLOCKED_EVENT, event));
+		nih_list_add (&job->blocking, &blocked->entry);
+
+		event_block (event);
+	}
+
+	if ((state_read_int (stream, &kill_timer) < 0)
+	    || (state_read_int (stream, &kill_process) < 0)
+	    || (state_read_int (stream, &kill_step) < 0)
+	    || (state_read_int (stream, &failed) < 0)
+	    || (state_read_int (stream, &failed_process) < 0)
+	    || (state_read_int (stream, &exit_status) < 0)
+	    || (state_read_int (stream, &respawn_time) < 0)
+	    || (state_read_int (stream, &respawn_count) < 0)
+	    || (state_read_int (stream, &respawn_delay) < 0)
+	    || (state_read_int (stream, &respawn_pending) < 0)
+	    || (state_read_int (stream, &respawn_timer) < 0)
+	    || (state_read_int (stream, &spawn_time) < 0)
+	    || (state_read_int (stream, &trace_forks) < 0)
+	    || (state_read_int (stream, &trace_state) < 0)
+	    || (state_read_int (stream, &cgroup_watch) < 0))
+		return -1;
+
+	if ((kill_process < -1) || (kill_process >= PROCESS_LAST)
+	    || (failed_process < -1) || (failed_process >= PROCESS_LAST)
+	    || (trace_state < TRACE_NONE) || (trace_state > TRACE_NORMAL))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	if (! job)
+		return 0;
+
+	job->kill_process = kill_process;
+	job->kill_step = kill_step;
+
+	job->failed = failed ? TRUE : FALSE;
+	job->failed_process = failed_process;
+	job->exit_status = exit_status;
+
+	job->respawn_time = respawn_time;
+	job->respawn_count = respawn_count;
+	job->respawn_delay = respawn_delay;
+	job->respawn_pending = respawn_pending ? TRUE : FALSE;
+	job->spawn_time = spawn_time;
+
+	job->trace_forks = trace_forks;
+	job->trace_state = trace_state;
+
+	if (kill_timer && (job->kill_process != (ProcessType)-1))
+		job->kill_timer = NIH_MUST (nih_timer_add_timeout (
+				  job, job->class->kill_timeout,
+				  (NihTimerCb)job_process_kill_timer, job));
+
+	if (respawn_timer)
+		job->respawn_timer = NIH_MUST (nih_timer_add_timeout (
+				  job, job->respawn_delay,
+				  (NihTimerCb)job_respawn_timer, job));
+
+	if (cgroup_watch && job->cgroup)
+		job_process_watch_cgroup (job);
+
+	nih_debug ("Restored %s", job_name (job));
+
+	return 0;
+}
+
+/**
+ * state_read_blocking:
+ * @stream: stream to read from,
+ * @table: table of events read,
+ * @table_len: number of events in @table.
+ *
+ * Reads a record from @stream of a job that an event was blocking, and
+ * blocks the restored job on the event again; nothing is done if the job
+ * was not restored.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_blocking (FILE    *stream,
+		     Event  **table,
+		     size_t   table_len)
+{
+	nih_local char *class_name = NULL;
+	nih_local char *name = NULL;
+	Event          *event;
+	JobClass       *class;
+	Job            *job = NULL;
+	Blocked        *blocked;
+
+	nih_assert (stream != NULL);
+
+	if ((state_read_event_ref (stream, table, table_len, &event) < 0)
+	    || (state_read_str (NULL, stream, &class_name) < 0)
+	    || (state_read_str (NULL, stream, &name) < 0))
+		return -1;
+
+	if ((! event) || (! class_name) || (! name))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	class = (JobClass *)nih_hash_lookup (job_classes, class_name);
+	if (class)
+		job = (Job *)nih_hash_lookup (class->instances, name);
+	if (! job)
+		return 0;
+
+	blocked = NIH_MUST (blocked_new (event, BLOCKED_JOB, job));
+	nih_list_add (&event->blocking, &blocked->entry);
+
+	return 0;
+}
+
+
+/**
+ * state_read_int:
+ * @stream: stream to read from,
+ * @value: pointer to store value in.
+ *
+ * Reads the next field of the current record from @stream as a number.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_int (FILE *stream,
+		long *value)
+{
+	nih_assert (stream != NULL);
+	nih_assert (value != NULL);
+
+	if (fscanf (stream, " %ld", value) != 1)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	return 0;
+}
+
+/**
+ * state_read_null:
+ * @stream: stream to read from.
+ *
+ * Skips whitespace in @stream and checks whether the next field is "-",
+ * consuming it if so.
+ *
+ * Returns: TRUE if the next field is NULL, FALSE otherwise.
+ **/
+static int
+state_read_null (FILE *stream)
+{
+	int c;
+
+	nih_assert (stream != NULL);
+
+	do {
+		c = getc (stream);
+	} while ((c == ' ') || (c == '\n'));
+
+	if (c == '-')
+		return TRUE;
+
+	if (c != EOF)
+		ungetc (c, stream);
+
+	return FALSE;
+}
+
+/**
+ * state_read_str:
+ * @parent: parent object for new string,
+ * @stream: stream to read from,
+ * @str: pointer to store string in.
+ *
+ * Reads the next field of the current record from @stream as a string
+ * written by state_write_str(), storing it in @str, or NULL if that was
+ * written.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_str (const void  *parent,
+		FILE        *stream,
+		char       **str)
+{
+	size_t len;
+
+	nih_assert (stream != NULL);
+	nih_assert (str != NULL);
+
+	if (state_read_null (stream)) {
+		*str = NULL;
+		return 0;
+	}
+
+	if ((fscanf (stream, "%zu", &len) != 1)
+	    || (len > STATE_MAX_STR)
+	    || (getc (stream) != ':'))
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	*str = NIH_MUST (nih_alloc (parent, len + 1));
+
+	if (fread (*str, 1, len, stream) != len) {
+		nih_free (*str);
+		*str = NULL;
+
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+	}
+
+	(*str)[len] = '\0';
+
+	return 0;
+}
+
+/**
+ * state_read_strv:
+ * @parent: parent object for new array,
+ * @stream: stream to read from,
+ * @array: pointer to store array in.
+ *
+ * Reads the next field of the current record from @stream as an array
+ * written by state_write_strv(), storing it in @array, or NULL if that
+ * was written.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_strv (const void   *parent,
+		 FILE         *stream,
+		 char       ***array)
+{
+	long   count;
+	size_t len = 0;
+
+	nih_assert (stream != NULL);
+	nih_assert (array != NULL);
+
+	*array = NULL;
+
+	if (state_read_null (stream))
+		return 0;
+
+	if (state_read_int (stream, &count) < 0)
+		return -1;
+	if (count < 0)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	*array = NIH_MUST (nih_str_array_new (parent));
+
+	while (count-- > 0) {
+		nih_local char *str = NULL;
+
+		if (state_read_str (NULL, stream, &str) < 0)
+			goto error;
+		if (! str) {
+			nih_error_raise (STATE_INVALID, _(STATE_INVALID_STR));
+			goto error;
+		}
+
+		NIH_MUST (nih_str_array_add (array, parent, &len, str));
+	}
+
+	return 0;
+
+error:
+	nih_free (*array);
+	*array = NULL;
+	return -1;
+}
+
+/**
+ * state_read_fds:
+ * @parent: parent object for new arrays,
+ * @stream: stream to read from,
+ * @fds: pointer to store descriptors in,
+ * @num_fds: pointer to store number of descriptors in,
+ * @fd_names: pointer to store names of descriptors in.
+ *
+ * Reads the next field of the current record from @stream as the
+ * descriptors written by state_write_fds(), storing them in newly
+ * allocated arrays at @fds and @fd_names, which are left as NULL if there
+ * are none.  The descriptors were inherited across the exec and are
+ * marked to be closed on the next one again.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_fds (const void   *parent,
+		FILE         *stream,
+		int         **fds,
+		size_t       *num_fds,
+		char       ***fd_names)
+{
+	long count;
+
+	nih_assert (stream != NULL);
+	nih_assert (fds != NULL);
+	nih_assert (num_fds != NULL);
+	nih_assert (fd_names != NULL);
+
+	if (state_read_int (stream, &count) < 0)
+		return -1;
+	if (count < 0)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	while (count-- > 0) {
+		nih_local char *name = NULL;
+		long            fd;
+		size_t          len;
+
+		if ((state_read_int (stream, &fd) < 0)
+		    || (state_read_str (NULL, stream, &name) < 0))
+			return -1;
+		if ((fd < 0) || (! name))
+			nih_return_error (-1, STATE_INVALID,
+					  _(STATE_INVALID_STR));
+
+		nih_io_set_cloexec (fd);
+
+		if (! *fd_names)
+			*fd_names = NIH_MUST (nih_str_array_new (parent));
+
+		*fds = NIH_MUST (nih_realloc (*fds, parent,
+					      sizeof (int) * (*num_fds + 1)));
+
+		len = *num_fds;
+		NIH_MUST (nih_str_array_add (fd_names, parent, &len, name));
+
+		(*fds)[(*num_fds)++] = fd;
+	}
+
+	return 0;
+}
+
+/**
+ * state_read_event_ref:
+ * @stream: stream to read from,
+ * @table: table of events read,
+ * @table_len: number of events in @table,
+ * @event: pointer to store event in.
+ *
+ * Reads the next field of the current record from @stream as the
+ * position of an event in @table, storing the event in @event, or NULL
+ * if no event was referred to.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_event_ref (FILE    *stream,
+		      Event  **table,
+		      size_t   table_len,
+		      Event  **event)
+{
+	long index;
+
+	nih_assert (stream != NULL);
+	nih_assert (event != NULL);
+
+	if (state_read_int (stream, &index) < 0)
+		return -1;
+
+	if (index < 0) {
+		*event = NULL;
+	} else if ((size_t)index < table_len) {
+		*event = table[index];
+	} else {
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+	}
+
+	return 0;
+}
+
+/**
+ * state_read_operator:
+ * @stream: stream to read from,
+ * @root: event operator tree to restore,
+ * @state: state of @root, or NULL,
+ * @table: table of events read,
+ * @table_len: number of events in @table.
+ *
+ * Reads the next field of the current record from @stream as an event
+ * operator tree written by state_write_operator() and, if it has the same
+ * shape as the tree rooted at @root, restores the values and matched
+ * events of each operator in @root, or in @state if not NULL.  If the
+ * tree has changed, or @root is NULL, the field is read and nothing is
+ * restored.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+state_read_operator (FILE               *stream,
+		     EventOperator      *root,
+		     EventOperatorState *state,
+		     Event             **table,
+		     size_t              table_len)
+{
+	nih_local StateOperator *opers = NULL;
+	long                     count;
+	long                     index;
+	int                      match = (root != NULL);
+
+	nih_assert (stream != NULL);
+
+	if (state_read_int (stream, &count) < 0)
+		return -1;
+	if (count < 0)
+		nih_return_error (-1, STATE_INVALID, _(STATE_INVALID_STR));
+
+	if (count)
+		opers = NIH_MUST (nih_alloc (NULL,
+					     sizeof (StateOperator) * count));
+
+	for (index = 0; index < count; index++) {
+		if ((state_read_int (stream, &opers[index].type) < 0)
+		    || (state_read_str (opers, stream,
+					&opers[index].name) < 0)
+		    || (state_read_int (stream, &opers[index].value) < 0)
+		    || (state_read_event_ref (stream, table, table_len,
+					      &opers[index].event) < 0))
+			return -1;
+	}
+
+	/* Only restore the tree if the new one matches it operator for
+	 * operator, otherwise the configuration has changed and the job
+	 * starts afresh.
+	 */
+	index = 0;
+	if (match) {
+		NIH_TREE_FOREACH_POST (&root->node, iter) {
+			EventOperator *oper = (EventOperator *)iter;
+
+			if ((index >= count)
+			    || (oper->type != opers[index].type)
+			    || ((oper->name == NULL)
+				!= (opers[index].name == NULL))
+			    || (oper->name
+				&& strcmp (oper->name, opers[index].name))) {
+				match = FALSE;
+				break;
+			}
+
+			index++;
+		}
+	}
+
+	if ((! match) || (index != count))
+		return 0;
+
+	index = 0;
+	NIH_TREE_FOREACH_POST (&root->node, iter) {
+		EventOperator *oper = (EventOperator *)iter;
+
+		EVENT_OPERATOR_VALUE (oper, state) = (opers[index].value
+						      ? TRUE : FALSE);
+
+		if (opers[index].event) {
+			EVENT_OPERATOR_EVENT (oper, state) = opers[index].event;
+			event_block (opers[index].event);
+		}
+
+		index++;
+	}
+
+	return 0;
+}
+
+
+/**
+ * state_set_cloexec:
+ * @cloexec: whether descriptors should be closed on exec.
+ *
+ * Sets or clears the close-on-exec flag of every descriptor held by an
+ * event or job, which are cleared before re-executing so that the new
+ * init daemon inherits them, and set again should that fail.
+ **/
+void
+state_set_cloexec (int cloexec)
+{
+	event_init ();
+	job_class_init ();
+
+	NIH_LIST_FOREACH (events, iter) {
+		Event *event = (Event *)iter;
+
+		for (size_t i = 0; i < event->num_fds; i++)
+			fcntl (event->fds[i], F_SETFD,
+			       cloexec ? FD_CLOEXEC : 0);
+	}
+
+	NIH_HASH_FOREACH (job_classes, iter) {
+		JobClass *class = (JobClass *)iter;
+
+		NIH_HASH_FOREACH (class->instances, job_iter) {
+			Job *job = (Job *)job_iter;
+
+			for (size_t i = 0; i < job->num_fds; i++)
+				fcntl (job->fds[i], F_SETFD,
+				       cloexec ? FD_CLOEXEC : 0);
+		}
+	}
+}
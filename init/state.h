@@ -0,0 +1,56 @@
+/* upstart
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_STATE_H
+#define INIT_STATE_H
+
+#include <nih/macros.h>
+
+
+/**
+ * STATE_VERSION:
+ *
+ * Version of the serialised state written by state_write(), which must be
+ * increased whenever the fields written for any record change; state
+ * written with any other version is refused by state_read().
+ **/
+#define STATE_VERSION 1
+
+/**
+ * STATE_MAX_STR:
+ *
+ * Longest string accepted by state_read(); this is the most the kernel
+ * allows for a single argument or environment variable, so no longer
+ * string could have been used by a job and any length beyond it must
+ * come from a corrupt stream.
+ **/
+#define STATE_MAX_STR 131072
+
+
+NIH_BEGIN_EXTERN
+
+int  state_write       (int fd)
+	__attribute__ ((warn_unused_result));
+int  state_read        (int fd)
+	__attribute__ ((warn_unused_result));
+
+void state_set_cloexec (int cloexec);
+
+NIH_END_EXTERN
+
+#endif /* INIT_STATE_H */
@@ -28,8 +28,13 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <termios.h>
@@ -45,6 +50,23 @@
 #include "job_class.h"
 
 
+/**
+ * SystemProc:
+ * @pid: process id of process,
+ * @ppid: process id of its parent.
+ *
+ * A process found in the process table by system_descendants().
+ **/
+typedef struct system_proc {
+	pid_t pid;
+	pid_t ppid;
+} SystemProc;
+
+
+/* Prototypes for static functions */
+static int system_proc_cmp (const void *a, const void *b);
+
+
 /**
  * system_kill:
  * @pid: process id of process,
@@ -71,6 +93,172 @@ system_kill (pid_t pid,
 	return 0;
 }
 
+/**
+ * system_descendants:
+ * @parent: parent object for new array,
+ * @pid: process id of process,
+ * @len: number of processes found.
+ *
+ * Scans the process table for the children of @pid, their children and
+ * so on; the process ids of all of those found are returned in a newly
+ * allocated array, the length of which is stored in @len.  @pid itself
+ * is not included, and processes that have been reparented since their
+ * parent exited can no longer be found this way.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated array or NULL on raised error.
+ **/
+pid_t *
+system_descendants (const void *parent,
+		    pid_t       pid,
+		    size_t     *len)
+{
+	DIR                  *dir;
+	struct dirent        *ent;
+	nih_local SystemProc *procs = NULL;
+	size_t                procs_len = 0, procs_size = 0;
+	pid_t                *pids, ppid;
+	size_t                next;
+
+	nih_assert (pid > 0);
+	nih_assert (len != NULL);
+
+	/* Gather the parent of every process in one pass, since reading
+	 * the process table is the expensive part.
+	 */
+	dir = opendir ("/proc");
+	if (! dir)
+		nih_return_system_error (NULL);
+
+	while ((ent = readdir (dir)) != NULL) {
+		char   filename[PATH_MAX];
+		char   buf[1024], *ptr, *endptr;
+		FILE  *f;
+		SystemProc *new_procs;
+		pid_t       proc;
+
+		proc = strtol (ent->d_name, &endptr, 10);
+		if (*endptr || (proc <= 0))
+			continue;
+
+		snprintf (filename, sizeof filename, "/proc/%d/stat", proc);
+
+		/* Processes may exit while we're scanning */
+		f = fopen (filename, "r");
+		if (! f)
+			continue;
+
+		ptr = fgets (buf, sizeof buf, f);
+		fclose (f);
+		if (! ptr)
+			continue;
+
+		/* The command name may contain anything, so skip past the
+		 * last parenthesis to reach the state and the parent.
+		 */
+		ptr = strrchr (buf, ')');
+		if ((! ptr) || (sscanf (ptr + 1, " %*c %d", &ppid) != 1))
+			continue;
+
+		/* Double the array as it fills so that a large process
+		 * table doesn't cost a reallocation for each entry.
+		 */
+		if (procs_len == procs_size) {
+			procs_size = procs_size ? procs_size * 2 : 64;
+
+			new_procs = nih_realloc (procs, NULL,
+						 sizeof (SystemProc) * procs_size);
+			if (! new_procs) {
+				closedir (dir);
+				nih_return_no_memory_error (NULL);
+			}
+			procs = new_procs;
+		}
+
+		procs[procs_len].pid = proc;
+		procs[procs_len++].ppid = ppid;
+	}
+
+	closedir (dir);
+
+	pids = nih_alloc (parent, sizeof (pid_t) * (procs_len + 1));
+	if (! pids)
+		nih_return_no_memory_error (NULL);
+
+	/* Sort the processes by their parent so that the children of any
+	 * process lie together and can be found with a binary search, then
+	 * walk down from @pid using the returned array as the queue of
+	 * processes whose children are yet to be found.  Each process
+	 * found is marked by clearing its id, so none can be added twice
+	 * even should the table have changed under us.
+	 */
+	qsort (procs, procs_len, sizeof (SystemProc), system_proc_cmp);
+
+	*len = 0;
+	next = 0;
+	ppid = pid;
+	for (;;) {
+		size_t lo = 0, hi = procs_len;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (procs[mid].ppid < ppid) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		for (size_t i = lo; (i < procs_len) && (procs[i].ppid == ppid);
+		     i++) {
+			if ((! procs[i].pid) || (procs[i].pid == pid))
+				continue;
+
+			pids[(*len)++] = procs[i].pid;
+			procs[i].pid = 0;
+		}
+
+		if (next == *len)
+			break;
+
+		ppid = pids[next++];
+	}
+
+	return pids;
+}
+
+/**
+ * system_proc_cmp:
+ * @a: first process,
+ * @b: second process.
+ *
+ * Orders processes found by system_descendants() by their parent, for
+ * qsort().
+ *
+ * Returns: negative, zero or positive value as @a sorts before, with or
+ * after @b.
+ **/
+static int
+system_proc_cmp (const void *a,
+		 const void *b)
+{
+	const SystemProc *proc_a = a;
+	const SystemProc *proc_b = b;
+
+	if (proc_a->ppid < proc_b->ppid) {
+		return -1;
+	} else if (proc_a->ppid > proc_b->ppid) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
 
 /**
  * system_setup_console:
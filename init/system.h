@@ -29,14 +29,16 @@
 
 NIH_BEGIN_EXTERN
 
-int system_kill          (pid_t pid, int signal)
+int    system_kill          (pid_t pid, int signal)
 	__attribute__ ((warn_unused_result));
+pid_t *system_descendants   (const void *parent, pid_t pid, size_t *len)
+	__attribute__ ((warn_unused_result, malloc));
 
-int system_setup_console (ConsoleType type, int reset)
+int    system_setup_console (ConsoleType type, int reset)
 	__attribute__ ((warn_unused_result));
 
-int system_mount         (const char *type, const char *dir, unsigned int opts,
-			  const char *options)
+int    system_mount         (const char *type, const char *dir,
+			     unsigned int opts, const char *options)
 	__attribute__ ((warn_unused_result));
 
 NIH_END_EXTERN
@@ -0,0 +1,119 @@
+/* upstart
+ *
+ * bench.c - timing and allocation counting shared by the benchmarks
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+
+#include "bench.h"
+
+
+/* Prototypes for static functions */
+static void *counting_malloc  (size_t size);
+static void *counting_realloc (void *ptr, size_t size);
+
+
+/**
+ * bench_allocations:
+ *
+ * Number of calls made to the allocator while they are being counted;
+ * reset it before the operations to be measured.
+ **/
+size_t bench_allocations = 0;
+
+/**
+ * real_malloc:
+ * real_realloc:
+ *
+ * Allocator functions replaced by those counting calls, or NULL when
+ * calls aren't being counted.
+ **/
+static void *(*real_malloc) (size_t size) = NULL;
+static void *(*real_realloc) (void *ptr, size_t size) = NULL;
+
+
+/**
+ * bench_now:
+ *
+ * Returns: current value of the monotonic clock in nanoseconds.
+ **/
+double
+bench_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+
+/**
+ * bench_count_allocations:
+ * @count: whether to count allocations.
+ *
+ * Replaces the allocator functions used by nih_alloc() with ones that
+ * count each call in bench_allocations when @count is TRUE, and puts the
+ * real ones back when @count is FALSE.
+ **/
+void
+bench_count_allocations (int count)
+{
+	if (count && (! real_malloc)) {
+		real_malloc = __nih_malloc;
+		real_realloc = __nih_realloc;
+		__nih_malloc = counting_malloc;
+		__nih_realloc = counting_realloc;
+	} else if ((! count) && real_malloc) {
+		__nih_malloc = real_malloc;
+		__nih_realloc = real_realloc;
+		real_malloc = NULL;
+		real_realloc = NULL;
+	}
+}
+
+/**
+ * counting_malloc:
+ * @size: size of block.
+ *
+ * Counts the call and passes it on to the real allocator.
+ **/
+static void *
+counting_malloc (size_t size)
+{
+	bench_allocations++;
+	return real_malloc (size);
+}
+
+/**
+ * counting_realloc:
+ * @ptr: block to resize,
+ * @size: new size of block.
+ *
+ * Counts the call and passes it on to the real allocator.
+ **/
+static void *
+counting_realloc (void   *ptr,
+		  size_t  size)
+{
+	bench_allocations++;
+	return real_realloc (ptr, size);
+}
@@ -0,0 +1,38 @@
+/* upstart
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INIT_TESTS_BENCH_H
+#define INIT_TESTS_BENCH_H
+
+#include <stddef.h>
+
+#include <nih/macros.h>
+
+
+NIH_BEGIN_EXTERN
+
+extern size_t bench_allocations;
+
+
+double bench_now               (void);
+
+void   bench_count_allocations (int count);
+
+NIH_END_EXTERN
+
+#endif /* INIT_TESTS_BENCH_H */
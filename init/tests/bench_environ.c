@@ -0,0 +1,132 @@
+/* upstart
+ *
+ * bench_environ.c - benchmark of init/environ.c expansion
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/error.h>
+
+#include "environ.h"
+
+#include "bench.h"
+
+
+/**
+ * ITERATIONS:
+ *
+ * Number of times each string is expanded.
+ **/
+#define ITERATIONS 200000
+
+
+/**
+ * env:
+ *
+ * Environment used for expansion, similar in size to that of a job
+ * started by a udev event.
+ **/
+static char *env[] = {
+	"PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin",
+	"TERM=linux",
+	"UPSTART_EVENTS=net-device-added",
+	"UPSTART_JOB=network-interface",
+	"ACTION=add",
+	"DEVPATH=/devices/pci0000:00/0000:00:19.0/net/eth0",
+	"SUBSYSTEM=net",
+	"INTERFACE=eth0",
+	"IFINDEX=2",
+	"SEQNUM=1418",
+	"DEVTYPE=",
+	"ID_BUS=pci",
+	"ID_VENDOR_ID=0x8086",
+	"ID_MODEL_ID=0x1502",
+	"ID_MM_CANDIDATE=1",
+	"ID_NET_NAME_MAC=enx001122334455",
+	"ID_NET_NAME_PATH=enp0s25",
+	"MATCHADDR=00:11:22:33:44:55",
+	"MATCHIFTYPE=1",
+	"USEC_INITIALIZED=1025832",
+	NULL,
+};
+
+/**
+ * strings:
+ *
+ * Strings expanded, ranging from the typical instance names to the more
+ * complicated expressions.
+ **/
+static const char *strings[] = {
+	"",
+	"$INTERFACE",
+	"${INTERFACE}",
+	"$SUBSYSTEM-$INTERFACE",
+	"${DEVTYPE:-ethernet}/${INTERFACE}",
+	"${ID_NET_NAME_PATH:+$ID_NET_NAME_PATH.}$INTERFACE ($MATCHADDR)",
+	NULL,
+};
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	printf ("%-62s %10s %10s\n", "string", "expand", "template");
+
+	for (const char **s = strings; *s; s++) {
+		EnvironTemplate *template;
+		double           start, expand_ns, template_ns;
+
+		start = bench_now ();
+		for (int i = 0; i < ITERATIONS; i++) {
+			char *str;
+
+			str = environ_expand (NULL, *s, env);
+			if (! str)
+				abort ();
+
+			nih_free (str);
+		}
+		expand_ns = (bench_now () - start) / ITERATIONS;
+
+		template = environ_template_new (NULL, *s);
+		if (! template)
+			abort ();
+
+		start = bench_now ();
+		for (int i = 0; i < ITERATIONS; i++) {
+			char *str;
+
+			str = environ_template_expand (NULL, template, env);
+			if (! str)
+				abort ();
+
+			nih_free (str);
+		}
+		template_ns = (bench_now () - start) / ITERATIONS;
+
+		nih_free (template);
+
+		printf ("%-62s %8.0fns %8.0fns\n", *s, expand_ns, template_ns);
+	}
+
+	return 0;
+}
@@ -0,0 +1,476 @@
+/* upstart
+ *
+ * bench_event.c - benchmark of init/event.c event handling
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/logging.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "parse_job.h"
+#include "control.h"
+
+#include "bench.h"
+
+
+/**
+ * num_classes:
+ *
+ * Number of job classes generated, set by the --classes option.
+ **/
+static int num_classes = 300;
+
+/**
+ * num_boots:
+ *
+ * Number of times the boot and shutdown events are emitted, set by the
+ * --boots option.
+ **/
+static int num_boots = 20;
+
+/**
+ * num_events:
+ *
+ * Number of udev events emitted in the storm, set by the --events option.
+ **/
+static int num_events = 20000;
+
+/**
+ * num_devices:
+ *
+ * Number of distinct devices the udev events are for, each being added
+ * and later removed, set by the --devices option.
+ **/
+static int num_devices = 256;
+
+/**
+ * seed:
+ *
+ * Seed for the choice of job classes, set by the --seed option.
+ **/
+static int seed = 1;
+
+
+/**
+ * templates:
+ *
+ * Job definitions the classes are generated from, each modelled on a kind
+ * of job commonly found in /etc/init.  Each is expanded with the name of
+ * the previous class generated or, where @fs_type is TRUE, a filesystem
+ * type pattern.
+ **/
+static const struct {
+	const char *definition;
+	int         fs_type;
+} templates[] = {
+	/* A service started in turn after another */
+	{ "start on (filesystem and started %s)\n"
+	  "stop on runlevel [!2345]\n", FALSE },
+
+	/* A service started with the runlevel */
+	{ "start on runlevel [2345]\n"
+	  "stop on runlevel [!2345]\n", FALSE },
+
+	/* A service needing the network */
+	{ "start on (local-filesystems and net-device-up IFACE!=lo)\n"
+	  "stop on (runlevel [!2345] or deconfiguring-networking)\n", FALSE },
+
+	/* A job run for each filesystem found */
+	{ "instance $DEVNAME\n"
+	  "start on block-device-added DEVTYPE=partition ID_FS_TYPE=%s\n"
+	  "stop on (block-device-removed DEVNAME=$DEVNAME or runlevel [06])\n",
+	  TRUE },
+
+	/* A job run for each network interface found */
+	{ "instance $INTERFACE\n"
+	  "start on net-device-added INTERFACE!=lo SUBSYSTEM=net\n"
+	  "stop on (net-device-removed INTERFACE=$INTERFACE\n"
+	  "         or deconfiguring-networking)\n", FALSE },
+
+	/* A task run around another job */
+	{ "task\n"
+	  "start on (starting %1$s or stopped %1$s RESULT=failed\n"
+	  "          or mounted MOUNTPOINT=/var/*)\n", FALSE },
+};
+
+/**
+ * fs_types:
+ *
+ * Filesystem type patterns matched by jobs run for each filesystem.
+ **/
+static const char *fs_types[] = {
+	"ext*",
+	"vfat",
+	"swap",
+	"[bx][tf]*",
+};
+
+/**
+ * fs_names:
+ *
+ * Filesystem types of the block devices added by the udev events.
+ **/
+static const char *fs_names[] = {
+	"ext4",
+	"vfat",
+	"swap",
+	"btrfs",
+	"xfs",
+};
+
+/**
+ * boot_events:
+ *
+ * Events emitted, in order, to boot the system.
+ **/
+static const char *boot_events[][4] = {
+	{ "startup", NULL },
+	{ "virtual-filesystems", NULL },
+	{ "local-filesystems", NULL },
+	{ "filesystem", NULL },
+	{ "net-device-up", "IFACE=lo", NULL },
+	{ "net-device-up", "IFACE=eth0", NULL },
+	{ "mounted", "MOUNTPOINT=/var/log", NULL },
+	{ "runlevel", "RUNLEVEL=2", "PREVLEVEL=N", NULL },
+	{ NULL },
+};
+
+/**
+ * shutdown_events:
+ *
+ * Events emitted, in order, to shut the system down.
+ **/
+static const char *shutdown_events[][4] = {
+	{ "runlevel", "RUNLEVEL=0", "PREVLEVEL=2", NULL },
+	{ "deconfiguring-networking", NULL },
+	{ NULL },
+};
+
+
+/**
+ * options:
+ *
+ * Command-line options accepted by this program.
+ **/
+static NihOption options[] = {
+	{ 0, "classes", "number of job classes to generate",
+	  NULL, "NUMBER", &num_classes, nih_option_int },
+	{ 0, "boots", "number of times to boot and shut down",
+	  NULL, "NUMBER", &num_boots, nih_option_int },
+	{ 0, "events", "number of udev events in the storm",
+	  NULL, "NUMBER", &num_events, nih_option_int },
+	{ 0, "devices", "number of devices the udev events are for",
+	  NULL, "NUMBER", &num_devices, nih_option_int },
+	{ 0, "seed", "seed for the choice of job classes",
+	  NULL, "NUMBER", &seed, nih_option_int },
+
+	NIH_OPTION_LAST
+};
+
+
+/**
+ * compare_double:
+ * @a: pointer to first value,
+ * @b: pointer to second value.
+ *
+ * qsort() comparison function for doubles.
+ *
+ * Returns: less than, equal to or greater than zero as @a is less than,
+ * equal to or greater than @b.
+ **/
+static int
+compare_double (const void *a,
+		const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * generate_classes:
+ *
+ * Parses and registers num_classes job classes from templates, choosing
+ * the template and filesystem type of each at random.
+ **/
+static void
+generate_classes (void)
+{
+	unsigned int state = seed;
+	char         prev[32] = "job0";
+
+	for (int i = 0; i < num_classes; i++) {
+		nih_local char *definition = NULL;
+		char            name[32];
+		size_t          t;
+		const char     *fs_type;
+		JobClass       *class;
+		size_t          pos = 0, lineno = 1;
+
+		t = rand_r (&state)
+			% (sizeof (templates) / sizeof (templates[0]));
+		fs_type = fs_types[rand_r (&state)
+				   % (sizeof (fs_types)
+				      / sizeof (fs_types[0]))];
+
+		definition = nih_sprintf (NULL, templates[t].definition,
+					  (templates[t].fs_type
+					   ? fs_type : prev));
+		if (! definition)
+			abort ();
+
+		sprintf (name, "job%d", i);
+
+		class = parse_job (NULL, NULL, name, definition,
+				   strlen (definition), &pos, &lineno);
+		if (! class)
+			abort ();
+
+		nih_hash_add (job_classes, &class->entry);
+
+		strcpy (prev, name);
+	}
+}
+
+/**
+ * emit:
+ * @args: event name followed by its environment, NULL-terminated.
+ *
+ * Emits the event described by @args and handles it, along with any
+ * events emitted by jobs in response, as the main loop would.
+ *
+ * Returns: time taken in nanoseconds.
+ **/
+static double
+emit (const char * const *args)
+{
+	char   **env;
+	Event   *event;
+	double   start;
+
+	env = nih_str_array_new (NULL);
+	if (! env)
+		abort ();
+
+	for (const char * const *arg = args + 1; *arg; arg++)
+		if (! nih_str_array_add (&env, NULL, NULL, *arg))
+			abort ();
+
+	start = bench_now ();
+
+	event = event_new (NULL, args[0], env);
+	if (! event)
+		abort ();
+
+	event_poll ();
+
+	return bench_now () - start;
+}
+
+/**
+ * storm_event:
+ * @i: position in storm,
+ * @args: array to fill,
+ * @env: buffer for environment.
+ *
+ * Fills @args with the @i'th udev event of the storm.  A quarter of the
+ * events are for block devices and a quarter for network interfaces; each
+ * device is added in one sweep through the devices and removed in the
+ * next.  The remaining half are for other subsystems that no job is
+ * interested in.
+ **/
+static void
+storm_event (int          i,
+	     const char  *args[],
+	     char         env[][64])
+{
+	int device = (i / 4) % num_devices;
+	int add = ((i / 4) / num_devices) % 2 == 0;
+
+	switch (i % 4) {
+	case 0:
+		sprintf (env[0], "DEVNAME=/dev/sd%c%d",
+			 'a' + (device / 16) % 26, device % 16 + 1);
+		sprintf (env[1], "ID_FS_TYPE=%s",
+			 fs_names[device % (sizeof (fs_names)
+					    / sizeof (fs_names[0]))]);
+
+		args[0] = add ? "block-device-added" : "block-device-removed";
+		args[1] = "SUBSYSTEM=block";
+		args[2] = "DEVTYPE=partition";
+		args[3] = env[0];
+		args[4] = env[1];
+		args[5] = NULL;
+		break;
+	case 1:
+		sprintf (env[0], "INTERFACE=eth%d", device);
+		sprintf (env[1], "IFINDEX=%d", device + 2);
+
+		args[0] = add ? "net-device-added" : "net-device-removed";
+		args[1] = "SUBSYSTEM=net";
+		args[2] = env[0];
+		args[3] = env[1];
+		args[4] = NULL;
+		break;
+	default:
+		sprintf (env[0], "DEVPATH=/devices/pci0000:00/usb%d/%d-%d",
+			 device % 4 + 1, device % 4 + 1, device);
+
+		args[0] = ((i % 4 == 2) ? "usb-device-changed"
+			   : "input-device-added");
+		args[1] = "SUBSYSTEM=usb";
+		args[2] = env[0];
+		args[3] = NULL;
+		break;
+	}
+}
+
+/**
+ * report:
+ * @stream: name of event stream,
+ * @latency: time taken for each event in nanoseconds,
+ * @count: number of events,
+ * @allocs: allocations made emitting and handling them.
+ *
+ * Prints the rate of events handled, percentiles of the time taken for
+ * each, including any events emitted by jobs in response, and the
+ * allocations made per event.  @latency is sorted.
+ **/
+static void
+report (const char *stream,
+	double     *latency,
+	size_t      count,
+	size_t      allocs)
+{
+	double total = 0;
+
+	nih_assert (count > 0);
+
+	for (size_t i = 0; i < count; i++)
+		total += latency[i];
+
+	qsort (latency, count, sizeof (double), compare_double);
+
+	printf ("%-6s %7zu %10.0f %9.0f %9.0f %9.0f %9.0f %8.1f\n",
+		stream, count, count / (total / 1000000000.0),
+		latency[count / 2], latency[count * 90 / 100],
+		latency[count * 99 / 100], latency[count - 1],
+		(double)allocs / count);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char   **args;
+	double  *boot_latency, *storm_latency;
+	size_t   boot_count = 0, boot_allocs, storm_allocs;
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_synopsis ("Benchmark of event handling.");
+	nih_option_set_help (
+		"Generates job classes with start and stop conditions like "
+		"those of typical jobs, then measures handling the events "
+		"of booting and shutting down the system, and of a storm of "
+		"udev events with the system running.");
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	if ((num_classes < 1) || (num_boots < 1) || (num_events < 1)
+	    || (num_devices < 1)) {
+		fprintf (stderr, "%s: numbers must be positive\n",
+			 program_name);
+		exit (1);
+	}
+
+	nih_log_set_priority (NIH_LOG_FATAL);
+
+	control_init ();
+	event_init ();
+	job_class_init ();
+
+	generate_classes ();
+
+	boot_latency = malloc (sizeof (double) * num_boots
+			       * (sizeof (boot_events) / sizeof (boot_events[0])
+				  + (sizeof (shutdown_events)
+				     / sizeof (shutdown_events[0]))));
+	storm_latency = malloc (sizeof (double) * num_events);
+	if ((! boot_latency) || (! storm_latency))
+		abort ();
+
+	bench_count_allocations (TRUE);
+
+	/* Boot and shut down the system repeatedly */
+	bench_allocations = 0;
+	for (int i = 0; i < num_boots; i++) {
+		for (int j = 0; boot_events[j][0]; j++)
+			boot_latency[boot_count++] = emit (boot_events[j]);
+
+		for (int j = 0; shutdown_events[j][0]; j++)
+			boot_latency[boot_count++] = emit (shutdown_events[j]);
+	}
+	boot_allocs = bench_allocations;
+
+	/* Boot it once more, and leave it running for the storm */
+	for (int j = 0; boot_events[j][0]; j++)
+		emit (boot_events[j]);
+
+	bench_allocations = 0;
+	for (int i = 0; i < num_events; i++) {
+		const char *event_args[6];
+		char        env[2][64];
+
+		storm_event (i, event_args, env);
+		storm_latency[i] = emit (event_args);
+	}
+	storm_allocs = bench_allocations;
+
+	bench_count_allocations (FALSE);
+
+	printf ("%d classes, seed %d\n", num_classes, seed);
+	printf ("%-6s %7s %10s %9s %9s %9s %9s %8s\n", "stream",
+		"events", "events/s", "p50 ns", "p90 ns", "p99 ns",
+		"max ns", "allocs");
+
+	report ("boot", boot_latency, boot_count, boot_allocs);
+	report ("udev", storm_latency, num_events, storm_allocs);
+
+	free (boot_latency);
+	free (storm_latency);
+
+	return 0;
+}
@@ -0,0 +1,288 @@
+/* upstart
+ *
+ * bench_instances.c - benchmark of operations on many job instances
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/tree.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include <nih-dbus/dbus_message.h>
+
+#include "job_class.h"
+#include "job_process.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "control.h"
+
+#include "bench.h"
+
+
+/**
+ * sizes:
+ *
+ * Numbers of instances of the job the operations are measured with; the
+ * time per operation should stay roughly the same as this grows.
+ **/
+static const int sizes[] = { 1000, 10000, 40000 };
+
+/**
+ * EVENTS:
+ *
+ * Number of events emitted that the job's stop condition cannot match.
+ **/
+#define EVENTS 10000
+
+/**
+ * UNKNOWN_PIDS:
+ *
+ * Number of times a pid that belongs to no job is looked up.
+ **/
+#define UNKNOWN_PIDS 20
+
+/**
+ * NAMED_EVENTS:
+ *
+ * Number of events emitted that the job's stop condition names, but
+ * which stop none of the instances.
+ **/
+#define NAMED_EVENTS 20
+
+
+/**
+ * new_class:
+ *
+ * Creates and registers a class with an instance for each device, that
+ * stops when its device is removed or on deconfiguring-networking.
+ *
+ * Returns: new class.
+ **/
+static JobClass *
+new_class (void)
+{
+	JobClass      *class;
+	EventOperator *oper;
+	char         **env;
+
+	class = job_class_new (NULL, "bench");
+	if (! class)
+		abort ();
+
+	class->stop_on = event_operator_new (class, EVENT_OR, NULL, NULL);
+	if (! class->stop_on)
+		abort ();
+
+	env = nih_str_array_new (NULL);
+	if ((! env) || (! nih_str_array_add (&env, NULL, NULL,
+					     "DEVICE=$DEVICE")))
+		abort ();
+
+	oper = event_operator_new (class->stop_on, EVENT_MATCH,
+				   "device-removed", env);
+	if (! oper)
+		abort ();
+	nih_free (env);
+
+	nih_tree_add (&class->stop_on->node, &oper->node, NIH_TREE_LEFT);
+
+	oper = event_operator_new (class->stop_on, EVENT_MATCH,
+				   "deconfiguring-networking", NULL);
+	if (! oper)
+		abort ();
+
+	nih_tree_add (&class->stop_on->node, &oper->node, NIH_TREE_RIGHT);
+
+	nih_hash_add (job_classes, &class->entry);
+
+	return class;
+}
+
+/**
+ * emit:
+ * @name: name of event,
+ * @count: number of events.
+ *
+ * Emits @count events named @name, each handled in turn as the main loop
+ * would.
+ *
+ * Returns: time taken in nanoseconds.
+ **/
+static double
+emit (const char *name,
+      int         count)
+{
+	double start;
+
+	start = bench_now ();
+	for (int i = 0; i < count; i++) {
+		Event  *event;
+		char  **env;
+
+		env = nih_str_array_new (NULL);
+		if ((! env) || (! nih_str_array_add (&env, NULL, NULL,
+						     "DEVICE=none")))
+			abort ();
+
+		event = event_new (NULL, name, env);
+		if (! event)
+			abort ();
+
+		event_poll ();
+	}
+
+	return bench_now () - start;
+}
+
+/**
+ * measure:
+ * @instances: number of instances.
+ *
+ * Creates @instances instances of a job, then times looking them up by
+ * name and by process, handling events and listing them, printing the
+ * time taken per operation.
+ **/
+static void
+measure (int instances)
+{
+	JobClass        *class;
+	Job            **jobs;
+	NihDBusMessage  *message;
+	char           **paths;
+	ProcessType      process;
+	double           start;
+	double           start_ns, lookup_ns, find_ns, unknown_ns;
+	double           event_ns, named_ns, list_ns;
+
+	class = new_class ();
+
+	jobs = nih_alloc (NULL, sizeof (Job *) * instances);
+	if (! jobs)
+		abort ();
+
+	/* Create each instance, as a start of the job with a new device
+	 * would; the pid of its main process is set as though spawned.
+	 */
+	start = bench_now ();
+	for (int i = 0; i < instances; i++) {
+		char var[32];
+
+		sprintf (var, "DEVICE=dev%d", i);
+
+		if (nih_hash_lookup (class->instances, var + 7))
+			abort ();
+
+		jobs[i] = job_new (class, var + 7);
+		if (! jobs[i])
+			abort ();
+
+		jobs[i]->env = nih_str_array_new (jobs[i]);
+		if ((! jobs[i]->env)
+		    || (! nih_str_array_add (&jobs[i]->env, jobs[i], NULL,
+					     var)))
+			abort ();
+
+		jobs[i]->pid[PROCESS_MAIN] = 10000 + i;
+		job_process_track (jobs[i], PROCESS_MAIN);
+	}
+	start_ns = bench_now () - start;
+
+	start = bench_now ();
+	for (int i = 0; i < instances; i++) {
+		char name[32];
+
+		sprintf (name, "dev%d", i);
+		if ((Job *)nih_hash_lookup (class->instances, name) != jobs[i])
+			abort ();
+	}
+	lookup_ns = bench_now () - start;
+
+	start = bench_now ();
+	for (int i = 0; i < instances; i++) {
+		if (job_process_find (10000 + i, &process) != jobs[i])
+			abort ();
+	}
+	find_ns = bench_now () - start;
+
+	/* A pid that isn't a job's, such as an orphan reparented to us,
+	 * isn't recorded and so has every job searched for it.
+	 */
+	start = bench_now ();
+	for (int i = 0; i < UNKNOWN_PIDS; i++) {
+		if (job_process_find (1, &process))
+			abort ();
+	}
+	unknown_ns = bench_now () - start;
+
+	event_ns = emit ("block-device-added", EVENTS);
+	named_ns = emit ("device-removed", NAMED_EVENTS);
+
+	for (int i = 0; i < instances; i++) {
+		if (jobs[i]->goal != JOB_STOP)
+			abort ();
+	}
+
+	message = nih_new (NULL, NihDBusMessage);
+	if (! message)
+		abort ();
+	message->connection = NULL;
+	message->message = NULL;
+
+	start = bench_now ();
+	if (job_class_get_all_instances (class, message, &paths) < 0)
+		abort ();
+	list_ns = bench_now () - start;
+
+	nih_free (message);
+
+	printf ("%6d instances: start %6.0fns  lookup %5.0fns  "
+		"find %5.0fns  find unknown %8.0fns\n",
+		instances, start_ns / instances, lookup_ns / instances,
+		find_ns / instances, unknown_ns / UNKNOWN_PIDS);
+	printf ("%6s            event %6.0fns  named event %8.0fns  "
+		"list %5.0fns per instance\n",
+		"", event_ns / EVENTS, named_ns / NAMED_EVENTS,
+		list_ns / instances);
+
+	nih_free (jobs);
+	nih_free (class);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	nih_log_set_priority (NIH_LOG_FATAL);
+
+	control_init ();
+	event_init ();
+	job_class_init ();
+
+	for (size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+		measure (sizes[i]);
+
+	return 0;
+}
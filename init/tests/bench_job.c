@@ -0,0 +1,127 @@
+/* upstart
+ *
+ * bench_job.c - benchmark of init/job.c state changes
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "control.h"
+
+#include "bench.h"
+
+
+/**
+ * INSTANCES:
+ *
+ * Number of instances of the job started and stopped together.
+ **/
+#define INSTANCES 10000
+
+/**
+ * ROUNDS:
+ *
+ * Number of times the instances are started and stopped.
+ **/
+#define ROUNDS 10
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	JobClass *class;
+	double    start, start_ns = 0, stop_ns = 0;
+
+	nih_log_set_priority (NIH_LOG_FATAL);
+
+	control_init ();
+	event_init ();
+	job_class_init ();
+
+	class = job_class_new (NULL, "bench");
+	if (! class)
+		abort ();
+
+	nih_hash_add (job_classes, &class->entry);
+
+	for (int round = 0; round < ROUNDS; round++) {
+		/* Start every instance, then let the starting and started
+		 * events be handled together as the main loop would.
+		 */
+		start = bench_now ();
+		for (int i = 0; i < INSTANCES; i++) {
+			char *name;
+			Job  *job;
+
+			name = nih_sprintf (NULL, "%d", i);
+			if (! name)
+				abort ();
+
+			job = job_new (class, name);
+			if (! job)
+				abort ();
+
+			nih_free (name);
+
+			job_change_goal (job, JOB_START);
+		}
+		event_poll ();
+		start_ns += bench_now () - start;
+
+		NIH_HASH_FOREACH (class->instances, iter) {
+			Job *job = (Job *)iter;
+
+			if (job->state != JOB_RUNNING)
+				abort ();
+		}
+
+		/* Stop every instance, which frees them once the stopping
+		 * and stopped events have been handled.
+		 */
+		start = bench_now ();
+		NIH_HASH_FOREACH_SAFE (class->instances, iter) {
+			Job *job = (Job *)iter;
+
+			job_change_goal (job, JOB_STOP);
+		}
+		event_poll ();
+		stop_ns += bench_now () - start;
+
+		NIH_HASH_FOREACH (class->instances, iter)
+			abort ();
+	}
+
+	printf ("%d instances, %d rounds\n", INSTANCES, ROUNDS);
+	printf ("start %8.0fns per instance\n",
+		start_ns / ((double)INSTANCES * ROUNDS));
+	printf ("stop  %8.0fns per instance\n",
+		stop_ns / ((double)INSTANCES * ROUNDS));
+
+	return 0;
+}
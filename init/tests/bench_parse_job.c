@@ -0,0 +1,216 @@
+/* upstart
+ *
+ * bench_parse_job.c - benchmark of init/parse_job.c and packed expressions
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "parse_job.h"
+#include "control.h"
+
+#include "bench.h"
+
+
+/**
+ * ITERATIONS:
+ *
+ * Number of times the job definition is parsed.
+ **/
+#define ITERATIONS 20000
+
+/**
+ * INSTANCES:
+ *
+ * Number of instances of the job created.
+ **/
+#define INSTANCES 10000
+
+/**
+ * MATCHES:
+ *
+ * Number of events matched against the start condition.
+ **/
+#define MATCHES 200000
+
+
+/**
+ * definition:
+ *
+ * Job definition parsed, similar to that of a job started for each
+ * network interface by udev.
+ **/
+static const char *definition =
+	"description \"configure network interface\"\n"
+	"\n"
+	"instance $INTERFACE\n"
+	"\n"
+	"start on (net-device-added INTERFACE!=lo SUBSYSTEM=net\n"
+	"          and (local-filesystems or virtual-filesystems))\n"
+	"stop on (net-device-removed INTERFACE=$INTERFACE\n"
+	"         or deconfiguring-networking\n"
+	"         or runlevel [016])\n"
+	"\n"
+	"env IFACE_CONF=/etc/network/interfaces\n"
+	"export INTERFACE\n"
+	"\n"
+	"pre-start script\n"
+	"    mkdir -p /run/network\n"
+	"end script\n"
+	"\n"
+	"exec ifup --allow auto $INTERFACE\n";
+
+
+/**
+ * parse:
+ * @packed: whether to pack the expressions.
+ *
+ * Returns: newly parsed job class.
+ **/
+static JobClass *
+parse (int packed)
+{
+	JobClass *class;
+	size_t    pos = 0, lineno = 1;
+
+	class = parse_job (NULL, NULL, "network-interface", definition,
+			   strlen (definition), &pos, &lineno);
+	if (! class)
+		abort ();
+
+	if (packed && (job_class_pack (class) < 0))
+		abort ();
+
+	return class;
+}
+
+/**
+ * bench:
+ * @packed: whether to pack the expressions.
+ *
+ * Measures parsing the job definition, creating instances of the job and
+ * matching events against its start condition.
+ **/
+static void
+bench (int packed)
+{
+	JobClass *class;
+	Event    *events[3];
+	Job     **jobs;
+	double    start, parse_ns, instance_ns, match_ns;
+	size_t    parse_allocs, instance_allocs;
+
+	bench_allocations = 0;
+	start = bench_now ();
+	for (int i = 0; i < ITERATIONS; i++)
+		nih_free (parse (packed));
+	parse_ns = (bench_now () - start) / ITERATIONS;
+	parse_allocs = bench_allocations / ITERATIONS;
+
+	class = parse (packed);
+
+	jobs = malloc (sizeof (Job *) * INSTANCES);
+	if (! jobs)
+		abort ();
+
+	bench_allocations = 0;
+	start = bench_now ();
+	for (int i = 0; i < INSTANCES; i++) {
+		char *name;
+
+		name = nih_sprintf (NULL, "eth%d", i);
+		if (! name)
+			abort ();
+
+		jobs[i] = job_new (class, name);
+		if (! jobs[i])
+			abort ();
+
+		nih_free (name);
+	}
+	instance_ns = (bench_now () - start) / INSTANCES;
+	instance_allocs = bench_allocations / INSTANCES;
+
+	for (int i = 0; i < INSTANCES; i++)
+		nih_free (jobs[i]);
+	free (jobs);
+
+	events[0] = event_new (NULL, "net-device-added", NULL);
+	if ((! events[0])
+	    || (! nih_str_array_add (&events[0]->env, events[0], NULL,
+				     "INTERFACE=eth0"))
+	    || (! nih_str_array_add (&events[0]->env, events[0], NULL,
+				     "SUBSYSTEM=net")))
+		abort ();
+
+	events[1] = event_new (NULL, "local-filesystems", NULL);
+	events[2] = event_new (NULL, "virtual-filesystems", NULL);
+	if ((! events[1]) || (! events[2]))
+		abort ();
+
+	start = bench_now ();
+	for (int i = 0; i < MATCHES; i++) {
+		event_operator_handle (class->start_on, NULL,
+				       events[i % 3], NULL);
+		if (i % 3 == 2)
+			event_operator_reset (class->start_on, NULL);
+	}
+	match_ns = (bench_now () - start) / MATCHES;
+
+	nih_free (class);
+	for (int i = 0; i < 3; i++)
+		nih_free (events[i]);
+
+	printf ("%-8s %8.0fns %6zu allocs %8.0fns %6zu allocs %8.0fns\n",
+		packed ? "packed" : "default",
+		parse_ns, parse_allocs, instance_ns, instance_allocs,
+		match_ns);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	nih_log_set_priority (NIH_LOG_FATAL);
+
+	control_init ();
+	event_init ();
+	job_class_init ();
+
+	bench_count_allocations (TRUE);
+
+	printf ("%-8s %10s %13s %10s %13s %10s\n", "mode",
+		"parse", "", "instance", "", "match");
+
+	bench (FALSE);
+	bench (TRUE);
+
+	return 0;
+}
@@ -0,0 +1,910 @@
+/* upstart
+ *
+ * test_cgroup.c - test suite for init/cgroup.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/error.h>
+
+#include "cgroup.h"
+
+
+/**
+ * write_procs:
+ * @dirname: group directory,
+ * @pids: processes to list,
+ * @len: number of entries in @pids.
+ *
+ * Writes a cgroup.procs file into @dirname listing each of @pids, as the
+ * kernel would for a control group.
+ **/
+static void
+write_procs (const char  *dirname,
+	     const pid_t *pids,
+	     size_t       len)
+{
+	char  filename[PATH_MAX];
+	FILE *procs;
+
+	sprintf (filename, "%s/cgroup.procs", dirname);
+	procs = fopen (filename, "w");
+	assert (procs != NULL);
+
+	for (size_t i = 0; i < len; i++)
+		fprintf (procs, "%d\n", pids[i]);
+
+	fclose (procs);
+}
+
+/**
+ * spawn_tree:
+ * @leader: whether the child should become a session leader,
+ * @fork_again: whether the child should fork a grandchild,
+ * @grandchild: pointer to store grandchild.
+ *
+ * Forks a child process that waits to be killed, optionally first
+ * becoming the leader of a new session and forking a grandchild of its
+ * own that waits likewise.
+ *
+ * Returns: process id of child.
+ **/
+static pid_t
+spawn_tree (int    leader,
+	    int    fork_again,
+	    pid_t *grandchild)
+{
+	pid_t pid;
+	int   fds[2];
+
+	assert0 (pipe (fds));
+
+	TEST_CHILD (pid) {
+		pid_t child = 0;
+
+		close (fds[0]);
+
+		if (leader)
+			setsid ();
+
+		if (fork_again) {
+			TEST_CHILD (child) {
+				close (fds[1]);
+				for (;;)
+					pause ();
+			}
+		}
+
+		assert (write (fds[1], &child, sizeof (child)) == sizeof (child));
+		close (fds[1]);
+
+		for (;;)
+			pause ();
+	}
+
+	close (fds[1]);
+	assert (read (fds[0], grandchild, sizeof (pid_t)) == sizeof (pid_t));
+	close (fds[0]);
+
+	return pid;
+}
+
+
+void
+test_path (void)
+{
+	char *path;
+
+	TEST_FUNCTION ("cgroup_path");
+	cgroup_root = nih_strdup (NULL, "/sys/fs/cgroup/upstart");
+
+
+	/* Check that the path of an instance's group is constructed from
+	 * the root, class name and instance name.
+	 */
+	TEST_FEATURE ("with instance");
+	TEST_ALLOC_FAIL {
+		path = cgroup_path (NULL, "foo", "bar");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (path, NULL);
+			continue;
+		}
+
+		TEST_EQ_STR (path, "/sys/fs/cgroup/upstart/foo/bar");
+
+		nih_free (path);
+	}
+
+
+	/* Check that the empty name of a singleton instance is replaced
+	 * with an underscore.
+	 */
+	TEST_FEATURE ("with singleton");
+	TEST_ALLOC_FAIL {
+		path = cgroup_path (NULL, "foo", "");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (path, NULL);
+			continue;
+		}
+
+		TEST_EQ_STR (path, "/sys/fs/cgroup/upstart/foo/_");
+
+		nih_free (path);
+	}
+
+
+	/* Check that characters which may not appear in a group name,
+	 * especially path separators, are escaped.
+	 */
+	TEST_FEATURE ("with special characters");
+	TEST_ALLOC_FAIL {
+		path = cgroup_path (NULL, "foo-bar", "tty/1");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (path, NULL);
+			continue;
+		}
+
+		TEST_EQ_STR (path, "/sys/fs/cgroup/upstart/foo_2dbar/tty_2f1");
+
+		nih_free (path);
+	}
+
+
+	nih_free (cgroup_root);
+	cgroup_root = NULL;
+}
+
+
+void
+test_create (void)
+{
+	char         dirname[PATH_MAX], path[PATH_MAX];
+	struct stat  statbuf;
+	NihError    *err;
+	FILE        *f;
+	int          ret;
+
+	TEST_FUNCTION ("cgroup_create");
+	TEST_FILENAME (dirname);
+	sprintf (path, "%s/foo/bar", dirname);
+
+
+	/* Check that the group is created along with its parents. */
+	TEST_FEATURE ("with new group");
+	ret = cgroup_create (path);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (stat (path, &statbuf), 0);
+	TEST_TRUE (S_ISDIR (statbuf.st_mode));
+
+
+	/* Check that it isn't an error for the group to exist already. */
+	TEST_FEATURE ("with existing group");
+	ret = cgroup_create (path);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (stat (path, &statbuf), 0);
+	TEST_TRUE (S_ISDIR (statbuf.st_mode));
+
+	rmdir (path);
+
+
+	/* Check that an error is raised if the group can't be created. */
+	TEST_FEATURE ("with file in the way");
+	sprintf (path, "%s/foo/bar", dirname);
+	f = fopen (path, "w");
+	fclose (f);
+
+	sprintf (path, "%s/foo/bar/baz", dirname);
+	ret = cgroup_create (path);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOTDIR);
+	nih_free (err);
+
+	sprintf (path, "%s/foo/bar", dirname);
+	unlink (path);
+
+
+	sprintf (path, "%s/foo", dirname);
+	rmdir (path);
+	rmdir (dirname);
+}
+
+void
+test_remove (void)
+{
+	char         dirname[PATH_MAX], path[PATH_MAX];
+	struct stat  statbuf;
+	NihError    *err;
+	int          ret;
+
+	TEST_FUNCTION ("cgroup_remove");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+
+	/* Check that an empty group is removed. */
+	TEST_FEATURE ("with empty group");
+	ret = cgroup_remove (dirname);
+
+	TEST_EQ (ret, 0);
+	TEST_LT (stat (dirname, &statbuf), 0);
+
+
+	/* Check that it isn't an error for the group not to exist. */
+	TEST_FEATURE ("with missing group");
+	ret = cgroup_remove (dirname);
+
+	TEST_EQ (ret, 0);
+
+
+	/* Check that a group containing another isn't removed, and that
+	 * an error is raised.
+	 */
+	TEST_FEATURE ("with child group");
+	mkdir (dirname, 0755);
+	sprintf (path, "%s/foo", dirname);
+	mkdir (path, 0755);
+
+	ret = cgroup_remove (dirname);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOTEMPTY);
+	nih_free (err);
+
+	TEST_EQ (stat (dirname, &statbuf), 0);
+
+
+	rmdir (path);
+	rmdir (dirname);
+}
+
+
+void
+test_enter (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	NihError *err;
+	FILE     *procs;
+	int       ret;
+
+	TEST_FUNCTION ("cgroup_enter");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cgroup.procs", dirname);
+
+
+	/* Check that the process id is written to the cgroup.procs file
+	 * of the group.
+	 */
+	TEST_FEATURE ("with group");
+	write_procs (dirname, NULL, 0);
+
+	ret = cgroup_enter (dirname, 1234);
+
+	TEST_EQ (ret, 0);
+
+	procs = fopen (filename, "r");
+	TEST_FILE_EQ (procs, "1234\n");
+	TEST_FILE_END (procs);
+	fclose (procs);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the group doesn't exist. */
+	TEST_FEATURE ("with missing group");
+	ret = cgroup_enter (dirname, 1234);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+
+void
+test_set (void)
+{
+	char      dirname[PATH_MAX], path[PATH_MAX], filename[PATH_MAX];
+	NihError *err;
+	FILE     *f;
+	int       ret;
+
+	TEST_FUNCTION ("cgroup_set");
+	TEST_FILENAME (dirname);
+
+	cgroup_root = dirname;
+	sprintf (path, "%s/foo/bar", dirname);
+
+	assert0 (cgroup_create (path));
+
+
+	/* Check that the value is written to the file for the setting, and
+	 * that its controller is enabled for the group by the root and the
+	 * group of the job class.
+	 */
+	TEST_FEATURE ("with setting");
+	sprintf (filename, "%s/cgroup.subtree_control", dirname);
+	f = fopen (filename, "w");
+	fclose (f);
+
+	sprintf (filename, "%s/foo/cgroup.subtree_control", dirname);
+	f = fopen (filename, "w");
+	fclose (f);
+
+	sprintf (filename, "%s/memory.max", path);
+	f = fopen (filename, "w");
+	fclose (f);
+
+	ret = cgroup_set (path, CGROUP_MEMORY_MAX, "1048576");
+
+	TEST_EQ (ret, 0);
+
+	f = fopen (filename, "r");
+	TEST_FILE_EQ (f, "1048576");
+	TEST_FILE_END (f);
+	fclose (f);
+	unlink (filename);
+
+	sprintf (filename, "%s/cgroup.subtree_control", dirname);
+	f = fopen (filename, "r");
+	TEST_FILE_EQ (f, "+memory");
+	TEST_FILE_END (f);
+	fclose (f);
+	unlink (filename);
+
+	sprintf (filename, "%s/foo/cgroup.subtree_control", dirname);
+	f = fopen (filename, "r");
+	TEST_FILE_EQ (f, "+memory");
+	TEST_FILE_END (f);
+	fclose (f);
+
+
+	/* Check that an error is raised if the controller can't be
+	 * enabled, and that the setting isn't written.
+	 */
+	TEST_FEATURE ("with controller unavailable");
+	sprintf (filename, "%s/pids.max", path);
+	f = fopen (filename, "w");
+	fclose (f);
+
+	ret = cgroup_set (path, CGROUP_PIDS_MAX, "64");
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+	f = fopen (filename, "r");
+	TEST_FILE_END (f);
+	fclose (f);
+	unlink (filename);
+
+	sprintf (filename, "%s/foo/cgroup.subtree_control", dirname);
+	unlink (filename);
+
+
+	/* Check that only the value is written for a group outside of
+	 * the root.
+	 */
+	TEST_FEATURE ("with group outside root");
+	cgroup_root = "/sys/fs/cgroup/upstart";
+
+	sprintf (filename, "%s/io.weight", path);
+	f = fopen (filename, "w");
+	fclose (f);
+
+	ret = cgroup_set (path, CGROUP_IO_WEIGHT, "10");
+
+	TEST_EQ (ret, 0);
+
+	f = fopen (filename, "r");
+	TEST_FILE_EQ (f, "10");
+	TEST_FILE_END (f);
+	fclose (f);
+	unlink (filename);
+
+
+	cgroup_root = NULL;
+
+	rmdir (path);
+	sprintf (path, "%s/foo", dirname);
+	rmdir (path);
+	rmdir (dirname);
+}
+
+
+void
+test_procs (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	pid_t     list[20];
+	pid_t    *pids;
+	size_t    len;
+	NihError *err;
+
+	TEST_FUNCTION ("cgroup_procs");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cgroup.procs", dirname);
+
+
+	/* Check that an empty group gives an empty array. */
+	TEST_FEATURE ("with empty group");
+	write_procs (dirname, NULL, 0);
+
+	TEST_ALLOC_FAIL {
+		len = 99;
+		pids = cgroup_procs (NULL, dirname, &len);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (pids, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+			continue;
+		}
+
+		TEST_NE_P (pids, NULL);
+		TEST_EQ (len, 0);
+
+		nih_free (pids);
+	}
+
+
+	/* Check that each process in the group is returned in the order
+	 * listed, growing the array as necessary.
+	 */
+	TEST_FEATURE ("with many processes");
+	for (size_t i = 0; i < 20; i++)
+		list[i] = 1000 + i;
+	write_procs (dirname, list, 20);
+
+	TEST_ALLOC_FAIL {
+		len = 0;
+		pids = cgroup_procs (NULL, dirname, &len);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (pids, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+			continue;
+		}
+
+		TEST_NE_P (pids, NULL);
+		TEST_EQ (len, 20);
+
+		for (size_t i = 0; i < 20; i++)
+			TEST_EQ (pids[i], 1000 + (pid_t)i);
+
+		nih_free (pids);
+	}
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the group doesn't exist. */
+	TEST_FEATURE ("with missing group");
+	pids = cgroup_procs (NULL, dirname, &len);
+
+	TEST_EQ_P (pids, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+void
+test_populated (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	NihError *err;
+	FILE     *events;
+	int       ret;
+
+	TEST_FUNCTION ("cgroup_populated");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cgroup.events", dirname);
+
+
+	/* Check that TRUE is returned for a group with processes. */
+	TEST_FEATURE ("with populated group");
+	events = fopen (filename, "w");
+	fprintf (events, "populated 1\nfrozen 0\n");
+	fclose (events);
+
+	ret = cgroup_populated (dirname);
+
+	TEST_EQ (ret, TRUE);
+
+
+	/* Check that FALSE is returned for an empty group, and that the
+	 * key needn't be the first.
+	 */
+	TEST_FEATURE ("with empty group");
+	events = fopen (filename, "w");
+	fprintf (events, "frozen 0\npopulated 0\n");
+	fclose (events);
+
+	ret = cgroup_populated (dirname);
+
+	TEST_EQ (ret, FALSE);
+
+
+	/* Check that an error is raised if the file doesn't have the
+	 * key we need.
+	 */
+	TEST_FEATURE ("with missing key");
+	events = fopen (filename, "w");
+	fprintf (events, "frozen 0\n");
+	fclose (events);
+
+	ret = cgroup_populated (dirname);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, EILSEQ);
+	nih_free (err);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the group doesn't exist. */
+	TEST_FEATURE ("with missing group");
+	ret = cgroup_populated (dirname);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+
+void
+test_main_pid (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	pid_t     list[3], pid, child, grandchild, dead;
+	NihError *err;
+
+	TEST_FUNCTION ("cgroup_main_pid");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cgroup.procs", dirname);
+
+
+	/* Check that zero is returned for an empty group. */
+	TEST_FEATURE ("with empty group");
+	write_procs (dirname, NULL, 0);
+
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_EQ (pid, 0);
+
+
+	/* Check that the only process in a group is returned. */
+	TEST_FEATURE ("with single process");
+	child = spawn_tree (FALSE, FALSE, &grandchild);
+
+	list[0] = child;
+	write_procs (dirname, list, 1);
+
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_EQ (pid, child);
+
+	kill (child, SIGKILL);
+	waitpid (child, NULL, 0);
+
+
+	/* Check that the process at the top of the tree is returned even
+	 * when listed after its children.
+	 */
+	TEST_FEATURE ("with process tree");
+	child = spawn_tree (FALSE, TRUE, &grandchild);
+
+	list[0] = grandchild;
+	list[1] = child;
+	write_procs (dirname, list, 2);
+
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_EQ (pid, child);
+
+	pid = cgroup_main_pid (dirname, TRUE);
+
+	TEST_EQ (pid, child);
+
+	kill (grandchild, SIGKILL);
+	kill (child, SIGKILL);
+	waitpid (child, NULL, 0);
+
+
+	/* Check that when a daemon is expected and the top of the tree is
+	 * a session leader that has forked, its child is returned instead.
+	 */
+	TEST_FEATURE ("with daemon between forks");
+	child = spawn_tree (TRUE, TRUE, &grandchild);
+
+	list[0] = child;
+	list[1] = grandchild;
+	write_procs (dirname, list, 2);
+
+	pid = cgroup_main_pid (dirname, TRUE);
+
+	TEST_EQ (pid, grandchild);
+
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_EQ (pid, child);
+
+	kill (grandchild, SIGKILL);
+	kill (child, SIGKILL);
+	waitpid (child, NULL, 0);
+
+
+	/* Check that a session leader which hasn't yet forked is returned
+	 * when a daemon is expected.
+	 */
+	TEST_FEATURE ("with daemon yet to fork");
+	child = spawn_tree (TRUE, FALSE, &grandchild);
+
+	list[0] = child;
+	write_procs (dirname, list, 1);
+
+	pid = cgroup_main_pid (dirname, TRUE);
+
+	TEST_EQ (pid, child);
+
+	kill (child, SIGKILL);
+	waitpid (child, NULL, 0);
+
+
+	/* Check that processes which have exited since the group was
+	 * read are skipped over.
+	 */
+	TEST_FEATURE ("with exited process");
+	dead = spawn_tree (FALSE, FALSE, &grandchild);
+	kill (dead, SIGKILL);
+	waitpid (dead, NULL, 0);
+
+	child = spawn_tree (FALSE, FALSE, &grandchild);
+
+	list[0] = dead;
+	list[1] = child;
+	write_procs (dirname, list, 2);
+
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_EQ (pid, child);
+
+	kill (child, SIGKILL);
+	waitpid (child, NULL, 0);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the group doesn't exist. */
+	TEST_FEATURE ("with missing group");
+	pid = cgroup_main_pid (dirname, FALSE);
+
+	TEST_LT (pid, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+
+void
+test_cpu_usage (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	uint64_t  usec;
+	NihError *err;
+	FILE     *f;
+	int       ret;
+
+	TEST_FUNCTION ("cgroup_cpu_usage");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cpu.stat", dirname);
+
+
+	/* Check that the usage is read from the usage_usec key of the
+	 * cpu.stat file.
+	 */
+	TEST_FEATURE ("with usage");
+	f = fopen (filename, "w");
+	fprintf (f, "usage_usec 123456789\n");
+	fprintf (f, "user_usec 100000000\n");
+	fprintf (f, "system_usec 23456789\n");
+	fclose (f);
+
+	TEST_ALLOC_FAIL {
+		usec = 0;
+		ret = cgroup_cpu_usage (dirname, &usec);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (usec, 123456789);
+	}
+
+
+	/* Check that an error is raised if the file lacks the key. */
+	TEST_FEATURE ("with missing key");
+	f = fopen (filename, "w");
+	fprintf (f, "user_usec 100000000\n");
+	fclose (f);
+
+	ret = cgroup_cpu_usage (dirname, &usec);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, EILSEQ);
+	nih_free (err);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the group doesn't exist. */
+	TEST_FEATURE ("with missing group");
+	ret = cgroup_cpu_usage (dirname, &usec);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+void
+test_memory_usage (void)
+{
+	char      dirname[PATH_MAX], filename[PATH_MAX];
+	uint64_t  bytes;
+	NihError *err;
+	FILE     *f;
+	int       ret;
+
+	TEST_FUNCTION ("cgroup_memory_usage");
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/memory.current", dirname);
+
+
+	/* Check that the usage is read from the memory.current file. */
+	TEST_FEATURE ("with usage");
+	f = fopen (filename, "w");
+	fprintf (f, "5368709120\n");
+	fclose (f);
+
+	TEST_ALLOC_FAIL {
+		bytes = 0;
+		ret = cgroup_memory_usage (dirname, &bytes);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (bytes, 5368709120ULL);
+	}
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the memory controller isn't
+	 * enabled for the group.
+	 */
+	TEST_FEATURE ("without memory controller");
+	ret = cgroup_memory_usage (dirname, &bytes);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+
+
+	rmdir (dirname);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_path ();
+	test_create ();
+	test_remove ();
+	test_enter ();
+	test_set ();
+	test_procs ();
+	test_populated ();
+	test_main_pid ();
+	test_cpu_usage ();
+	test_memory_usage ();
+
+	return 0;
+}
@@ -1364,6 +1364,43 @@ no_inotify:
 	nih_free (source);
 
 
+	/* Check that a reload of the directory without any changes keeps
+	 * the files and jobs already parsed rather than parsing them again.
+	 */
+	TEST_FEATURE ("with reload of unchanged job directory");
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+	ret = conf_source_reload (source);
+
+	TEST_EQ (ret, 0);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/bar.conf");
+	old_file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	old_job = old_file->job;
+
+	TEST_FREE_TAG (old_file);
+	TEST_FREE_TAG (old_job);
+
+	ret = conf_source_reload (source);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (source->flag, FALSE);
+
+	TEST_NOT_FREE (old_file);
+	TEST_NOT_FREE (old_job);
+
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+
+	TEST_EQ_P (file, old_file);
+	TEST_EQ (file->flag, source->flag);
+	TEST_EQ_P (file->job, old_job);
+
+	job = (JobClass *)nih_hash_lookup (job_classes, "bar");
+	TEST_EQ_P (job, old_job);
+
+	nih_free (source);
+
+
 	/* Check that a physical error parsing a file initially is caught,
 	 * and doesn't affect later jobs.
 	 */
@@ -2511,12 +2548,12 @@ void
 test_override (void)
 {
 	ConfSource *source;
-	ConfFile   *file;
+	ConfFile   *file, *old_file;
 	FILE       *f;
 	int         ret, fd[4096], i = 0;
 	char        dirname[PATH_MAX];
 	char        filename[PATH_MAX], override[PATH_MAX];
-	JobClass   *job;
+	JobClass   *job, *old_job;
 	NihError   *err;
 
 	program_name = "test";
@@ -3699,6 +3736,95 @@ no_inotify:
 	TEST_EQ (rmdir (dirname), 0);
 
 
+	/* Check that reloading when neither the conf file nor the override
+	 * file have changed keeps the job already parsed, but that a change
+	 * to or deletion of the override file alone causes the conf file to
+	 * be parsed again with the new override.
+	 */
+	TEST_FEATURE ("reload of unchanged conf+override files");
+	TEST_ENSURE_CLEAN_ENV ();
+	TEST_FILENAME (dirname);
+	TEST_EQ (mkdir (dirname, 0755), 0);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/foo.conf");
+	f = fopen (filename, "w");
+	TEST_NE_P (f, NULL);
+	fprintf (f, "start on started\n");
+	fprintf (f, "author \"me\"\n");
+	fclose (f);
+
+	strcpy (override, dirname);
+	strcat (override, "/foo.override");
+	f = fopen (override, "w");
+	TEST_NE_P (f, NULL);
+	fprintf (f, "author \"you\"\n");
+	fclose (f);
+
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+	TEST_NE_P (source, NULL);
+	ret = conf_source_reload (source);
+	TEST_EQ (ret, 0);
+
+	old_file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	TEST_NE_P (old_file, NULL);
+	old_job = old_file->job;
+	TEST_EQ_STR (old_job->author, "you");
+
+	TEST_FREE_TAG (old_file);
+	TEST_FREE_TAG (old_job);
+
+	ret = conf_source_reload (source);
+	TEST_EQ (ret, 0);
+
+	TEST_NOT_FREE (old_file);
+	TEST_NOT_FREE (old_job);
+
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	TEST_EQ_P (file, old_file);
+	TEST_EQ (file->flag, source->flag);
+	job = (JobClass *)nih_hash_lookup (job_classes, "foo");
+	TEST_EQ_P (job, old_job);
+	TEST_EQ_STR (job->author, "you");
+
+	/* modify override */
+	f = fopen (override, "w");
+	TEST_NE_P (f, NULL);
+	fprintf (f, "author \"them\"\n");
+	fclose (f);
+
+	ret = conf_source_reload (source);
+	TEST_EQ (ret, 0);
+
+	TEST_FREE (old_job);
+
+	file = (ConfFile *)nih_hash_lookup (source->files, filename);
+	TEST_NE_P (file, NULL);
+	job = (JobClass *)nih_hash_lookup (job_classes, "foo");
+	TEST_EQ_P (file->job, job);
+	TEST_EQ_STR (job->author, "them");
+	TEST_NE_P (job->start_on, NULL);
+
+	/* delete override */
+	old_job = job;
+	TEST_FREE_TAG (old_job);
+
+	unlink (override);
+
+	ret = conf_source_reload (source);
+	TEST_EQ (ret, 0);
+
+	TEST_FREE (old_job);
+
+	job = (JobClass *)nih_hash_lookup (job_classes, "foo");
+	TEST_NE_P (job, NULL);
+	TEST_EQ_STR (job->author, "me");
+
+	nih_free (source);
+	unlink (filename);
+	TEST_EQ (rmdir (dirname), 0);
+
+
 	nih_log_set_priority (NIH_LOG_MESSAGE);
 
 	/* Release consumed instances */
@@ -4506,6 +4632,118 @@ no_inotify:
 }
 
 
+void
+test_source_reload_error (void)
+{
+	FILE       *f, *output;
+	ConfSource *source;
+	char        dirname[PATH_MAX], filename[PATH_MAX];
+	char        expected[PATH_MAX + 80];
+	int         ret;
+
+	/* Check that parse errors raised by stanzas are warned about along
+	 * with the path and line number, rather than failing the load.
+	 */
+	TEST_FUNCTION ("conf_source_reload");
+	program_name = "test";
+	output = tmpfile ();
+
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	strcpy (filename, dirname);
+	strcat (filename, "/foo.conf");
+
+
+	/* Check that an illegal cgroup setting is reported as a parse error
+	 * on the line of the stanza.
+	 */
+	TEST_FEATURE ("with illegal cgroup stanza");
+	f = fopen (filename, "w");
+	fprintf (f, "exec /sbin/daemon\n");
+	fprintf (f, "cgroup memory max lots\n");
+	fclose (f);
+
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+
+	TEST_DIVERT_STDERR (output) {
+		ret = conf_source_reload (source);
+	}
+	rewind (output);
+
+	TEST_EQ (ret, 0);
+
+	sprintf (expected, "test: %s:2: %s\n", filename,
+		 "Illegal control group setting");
+	TEST_FILE_EQ (output, expected);
+	TEST_FILE_END (output);
+	TEST_FILE_RESET (output);
+
+	nih_free (source);
+
+
+	/* Check that an illegal respawn backoff multiplier is reported as
+	 * a parse error on the line of the stanza.
+	 */
+	TEST_FEATURE ("with illegal respawn backoff multiplier");
+	f = fopen (filename, "w");
+	fprintf (f, "exec /sbin/daemon\n");
+	fprintf (f, "respawn\n");
+	fprintf (f, "respawn backoff 1 0 60 300\n");
+	fclose (f);
+
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+
+	TEST_DIVERT_STDERR (output) {
+		ret = conf_source_reload (source);
+	}
+	rewind (output);
+
+	TEST_EQ (ret, 0);
+
+	sprintf (expected, "test: %s:3: %s\n", filename,
+		 "Illegal multiplier, expected positive integer");
+	TEST_FILE_EQ (output, expected);
+	TEST_FILE_END (output);
+	TEST_FILE_RESET (output);
+
+	nih_free (source);
+
+
+	/* Check that an illegal event priority in a configuration file is
+	 * reported as a parse error on the line of the stanza.
+	 */
+	TEST_FEATURE ("with illegal event priority");
+	f = fopen (filename, "w");
+	fprintf (f, "# Network devices may wait\n");
+	fprintf (f, "event priority urgent net-device-*\n");
+	fclose (f);
+
+	source = conf_source_new (NULL, filename, CONF_FILE);
+
+	TEST_DIVERT_STDERR (output) {
+		ret = conf_source_reload (source);
+	}
+	rewind (output);
+
+	TEST_EQ (ret, 0);
+
+	sprintf (expected, "test: %s:2: %s\n", filename,
+		 "Illegal priority, expected 'high', 'normal' or 'low'");
+	TEST_FILE_EQ (output, expected);
+	TEST_FILE_END (output);
+	TEST_FILE_RESET (output);
+
+	nih_free (source);
+
+
+	unlink (filename);
+	rmdir (dirname);
+
+	fclose (output);
+}
+
+
 void
 test_source_reload (void)
 {
@@ -4746,6 +4984,7 @@ main (int   argc,
 	test_source_reload_conf_dir ();
 	test_source_reload_file ();
 	test_source_reload ();
+	test_source_reload_error ();
 	test_toggle_conf_name ();
 	test_override ();
 	test_file_destroy ();
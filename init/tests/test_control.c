@@ -58,6 +58,7 @@
 #include "job_class.h"
 #include "job.h"
 #include "conf.h"
+#include "runlevel.h"
 #include "control.h"
 #include "errors.h"
 
@@ -839,10 +840,12 @@ test_disconnected (void)
 {
 	FILE         *output;
 	NihListEntry *entry;
+	Event        *event;
 	pid_t         dbus_pid;
 
 	/* Check that if the bus connection is disconnected, control_bus is
-	 * set back to NULL automatically.
+	 * set back to NULL automatically, and that events it emitted no
+	 * longer belong to it.
 	 */
 	TEST_FUNCTION ("control_disconnected");
 	program_name = "test";
@@ -865,6 +868,9 @@ test_disconnected (void)
 
 	TEST_FREE_TAG (entry);
 
+	event = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event, control_bus));
+
 	TEST_DBUS_END (dbus_pid);
 
 	TEST_DIVERT_STDERR (output) {
@@ -880,6 +886,10 @@ test_disconnected (void)
 
 	TEST_LIST_EMPTY (control_conns);
 
+	TEST_EQ_P (event->source, NULL);
+	TEST_EQ (event->progress, EVENT_PENDING);
+	nih_free (event);
+
 	TEST_FILE_EQ (output, "test: Disconnected from system bus\n");
 	TEST_FILE_END (output);
 	TEST_FILE_RESET (output);
@@ -1200,17 +1210,22 @@ test_get_all_jobs (void)
 void
 test_emit_event (void)
 {
-	DBusConnection  *conn, *client_conn;
-	pid_t            dbus_pid;
-	DBusMessage     *method, *reply;
-	NihDBusMessage  *message = NULL;
-	dbus_uint32_t    serial;
-	char           **env;
-	int              ret;
-	Event           *event;
-	Blocked *        blocked;
-	NihError        *error;
-	NihDBusError    *dbus_error;
+	DBusConnection     *conn, *client_conn;
+	pid_t               dbus_pid;
+	DBusMessage        *method, *reply;
+	NihDBusMessage     *message = NULL;
+	NihDBusMessage     *messages[2];
+	dbus_uint32_t       serial;
+	char              **env;
+	char              **file_names;
+	int                 fds[2];
+	int                 ret;
+	size_t              i;
+	Event              *event;
+	Blocked *           blocked;
+	EventCoalesceRule  *rule;
+	NihError           *error;
+	NihDBusError       *dbus_error;
 
 	TEST_FUNCTION ("control_emit_event");
 	nih_error_init ();
@@ -1577,6 +1592,127 @@ test_emit_event (void)
 	dbus_message_unref (method);
 
 
+	/* Check that an emission identical to a pending event whose name
+	 * is coalesced doesn't queue another event, but blocks on the
+	 * pending one so that both callers get their reply when it
+	 * finishes.
+	 */
+	TEST_FEATURE ("with coalesced event");
+	rule = event_coalesce_rule_new (NULL, "test");
+
+	for (i = 0; i < 2; i++) {
+		method = dbus_message_new_method_call (
+			dbus_bus_get_unique_name (conn),
+			DBUS_PATH_UPSTART,
+			DBUS_INTERFACE_UPSTART,
+			"EmitEvent");
+
+		dbus_connection_send (client_conn, method, &serial);
+		dbus_connection_flush (client_conn);
+		dbus_message_unref (method);
+
+		TEST_DBUS_MESSAGE (conn, method);
+		assert (dbus_message_get_serial (method) == serial);
+
+		message = nih_new (NULL, NihDBusMessage);
+		message->connection = conn;
+		message->message = method;
+
+		env = nih_str_array_new (message);
+		NIH_MUST (nih_str_array_add (&env, message, NULL, "FOO=BAR"));
+
+		ret = control_emit_event (NULL, message, "test", env, TRUE);
+
+		TEST_EQ (ret, 0);
+
+		nih_discard (message);
+		messages[i] = message;
+	}
+
+	TEST_LIST_NOT_EMPTY (events);
+
+	event = (Event *)events->next;
+	TEST_EQ_P (event->entry.next, events);
+	TEST_EQ_STR (event->name, "test");
+
+	blocked = (Blocked *)event->blocking.next;
+	TEST_EQ_P (blocked->message, messages[0]);
+
+	blocked = (Blocked *)blocked->entry.next;
+	TEST_EQ_P (blocked->message, messages[1]);
+	TEST_EQ_P (blocked->entry.next, &event->blocking);
+
+	TEST_FREE_TAG (event);
+
+	event_poll ();
+
+	TEST_FREE (event);
+	TEST_LIST_EMPTY (events);
+
+	dbus_connection_flush (conn);
+
+	for (i = 0; i < 2; i++) {
+		TEST_DBUS_MESSAGE (client_conn, reply);
+
+		TEST_EQ (dbus_message_get_type (reply),
+			 DBUS_MESSAGE_TYPE_METHOD_RETURN);
+
+		dbus_message_unref (reply);
+	}
+
+	nih_free (rule);
+
+
+	/* Check that if the client already has as many events pending as
+	 * it is allowed, a retryable error is returned immediately and no
+	 * event is queued.
+	 */
+	TEST_FEATURE ("with full event queue");
+	event_max_queued_source = 1;
+
+	event = event_new (NULL, "wibble", NULL);
+	assert0 (event_set_source (event, conn));
+
+	method = dbus_message_new_method_call (
+		dbus_bus_get_unique_name (conn),
+		DBUS_PATH_UPSTART,
+		DBUS_INTERFACE_UPSTART,
+		"EmitEvent");
+
+	dbus_connection_send (client_conn, method, &serial);
+	dbus_connection_flush (client_conn);
+	dbus_message_unref (method);
+
+	TEST_DBUS_MESSAGE (conn, method);
+	assert (dbus_message_get_serial (method) == serial);
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = conn;
+	message->message = method;
+
+	env = nih_str_array_new (message);
+
+	ret = control_emit_event (NULL, message, "test", env, FALSE);
+
+	TEST_LT (ret, 0);
+
+	dbus_error = (NihDBusError *)nih_error_get ();
+	TEST_ALLOC_SIZE (dbus_error, sizeof (NihDBusError));
+	TEST_EQ (dbus_error->number, NIH_DBUS_ERROR);
+	TEST_EQ_STR (dbus_error->name,
+		     DBUS_INTERFACE_UPSTART ".Error.QueueFull");
+	nih_free (dbus_error);
+
+	TEST_EQ_P (events->next, &event->entry);
+	TEST_EQ_P (event->entry.next, events);
+
+	nih_free (message);
+	dbus_message_unref (method);
+
+	nih_free (event);
+	event_max_queued_source = EVENT_MAX_QUEUED_SOURCE;
+
+
 	/* Check that if an entry in the environment list is missing an
 	 * equals, an error is returned immediately.
 	 */
@@ -1615,6 +1751,120 @@ test_emit_event (void)
 	dbus_message_unref (method);
 
 
+	/* Check that we can emit an event with several named files, which
+	 * are attached to the event in order and closed once it has
+	 * finished.
+	 */
+	TEST_FEATURE ("with files");
+	method = dbus_message_new_method_call (
+		dbus_bus_get_unique_name (conn),
+		DBUS_PATH_UPSTART,
+		DBUS_INTERFACE_UPSTART,
+		"EmitEventWithFiles");
+
+	dbus_connection_send (client_conn, method, &serial);
+	dbus_connection_flush (client_conn);
+	dbus_message_unref (method);
+
+	TEST_DBUS_MESSAGE (conn, method);
+	assert (dbus_message_get_serial (method) == serial);
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = conn;
+	message->message = method;
+
+	TEST_FREE_TAG (message);
+
+	env = nih_str_array_new (message);
+	file_names = nih_str_array_new (message);
+	assert (nih_str_array_add (&file_names, message, NULL, "http"));
+	assert (nih_str_array_add (&file_names, message, NULL, "https"));
+
+	assert0 (pipe (fds));
+
+	ret = control_emit_event_with_files (NULL, message, "test", env,
+					     FALSE, fds, 2, file_names);
+
+	TEST_EQ (ret, 0);
+
+	TEST_LIST_NOT_EMPTY (events);
+
+	event = (Event *)events->next;
+	TEST_EQ_STR (event->name, "test");
+	TEST_EQ (event->num_fds, 2);
+	TEST_EQ (event->fds[0], fds[0]);
+	TEST_EQ (event->fds[1], fds[1]);
+	TEST_EQ_STR (event->fd_names[0], "http");
+	TEST_EQ_STR (event->fd_names[1], "https");
+	TEST_EQ_P (event->fd_names[2], NULL);
+
+	TEST_TRUE (fcntl (fds[0], F_GETFD) & FD_CLOEXEC);
+
+	nih_discard (message);
+	TEST_FREE (message);
+	dbus_message_unref (method);
+
+	dbus_connection_flush (conn);
+
+	TEST_DBUS_MESSAGE (client_conn, reply);
+	TEST_EQ (dbus_message_get_type (reply),
+		 DBUS_MESSAGE_TYPE_METHOD_RETURN);
+	dbus_message_unref (reply);
+
+	event_poll ();
+
+	TEST_LIST_EMPTY (events);
+
+	TEST_LT (fcntl (fds[0], F_GETFD), 0);
+	TEST_LT (fcntl (fds[1], F_GETFD), 0);
+
+
+	/* Check that if there isn't a name for each file, an error is
+	 * returned immediately and the files are closed.
+	 */
+	TEST_FEATURE ("with missing file name");
+	method = dbus_message_new_method_call (
+		dbus_bus_get_unique_name (conn),
+		DBUS_PATH_UPSTART,
+		DBUS_INTERFACE_UPSTART,
+		"EmitEventWithFiles");
+
+	dbus_connection_send (client_conn, method, &serial);
+	dbus_connection_flush (client_conn);
+	dbus_message_unref (method);
+
+	TEST_DBUS_MESSAGE (conn, method);
+	assert (dbus_message_get_serial (method) == serial);
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = conn;
+	message->message = method;
+
+	env = nih_str_array_new (message);
+	file_names = nih_str_array_new (message);
+	assert (nih_str_array_add (&file_names, message, NULL, "http"));
+
+	assert0 (pipe (fds));
+
+	ret = control_emit_event_with_files (NULL, message, "test", env,
+					     TRUE, fds, 2, file_names);
+
+	TEST_LT (ret, 0);
+
+	dbus_error = (NihDBusError *)nih_error_get ();
+	TEST_EQ (dbus_error->number, NIH_DBUS_ERROR);
+	TEST_EQ_STR (dbus_error->name, DBUS_ERROR_INVALID_ARGS);
+	nih_free (dbus_error);
+
+	TEST_LIST_EMPTY (events);
+
+	TEST_LT (fcntl (fds[0], F_GETFD), 0);
+	TEST_LT (fcntl (fds[1], F_GETFD), 0);
+
+	nih_free (message);
+	dbus_message_unref (method);
+
+
 	TEST_DBUS_CLOSE (conn);
 	TEST_DBUS_CLOSE (client_conn);
 	TEST_DBUS_END (dbus_pid);
@@ -2175,6 +2425,105 @@ test_set_log_priority (void)
 }
 
 
+void
+test_get_runlevel (void)
+{
+	NihDBusMessage *message = NULL;
+	char           *runlevel;
+	NihError       *error;
+	int             ret;
+
+	/* Check that the current runlevel is returned as a single character
+	 * string, allocated as a child of the message.
+	 */
+	TEST_FUNCTION ("control_get_runlevel");
+	nih_error_init ();
+	job_class_init ();
+
+	runlevel_current = '2';
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_runlevel (NULL, message, &runlevel);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (runlevel, message);
+		TEST_EQ_STR (runlevel, "2");
+
+		nih_free (message);
+	}
+
+	runlevel_current = 'N';
+}
+
+void
+test_get_prevlevel (void)
+{
+	NihDBusMessage *message = NULL;
+	char           *prevlevel;
+	NihError       *error;
+	int             ret;
+
+	/* Check that the previous runlevel is returned as a single character
+	 * string, allocated as a child of the message.
+	 */
+	TEST_FUNCTION ("control_get_prevlevel");
+	nih_error_init ();
+	job_class_init ();
+
+	runlevel_previous = 'S';
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		ret = control_get_prevlevel (NULL, message, &prevlevel);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_ALLOC_PARENT (prevlevel, message);
+		TEST_EQ_STR (prevlevel, "S");
+
+		nih_free (message);
+	}
+
+	runlevel_previous = 'N';
+}
+
+
 int
 main (int   argc,
       char *argv[])
@@ -2200,5 +2549,8 @@ main (int   argc,
 	test_get_log_priority ();
 	test_set_log_priority ();
 
+	test_get_runlevel ();
+	test_get_prevlevel ();
+
 	return 0;
 }
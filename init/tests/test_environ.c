@@ -27,6 +27,7 @@
 #include <nih/error.h>
 
 #include <errno.h>
+#include <stdlib.h>
 
 #include "environ.h"
 #include "errors.h"
@@ -699,6 +700,303 @@ test_append (void)
 	}
 
 	nih_free (new_env);
+
+
+	/* Check that appending to a table large enough to be hashed gives
+	 * the same results, with new entries in order on the end and
+	 * existing ones replaced in place.
+	 */
+	TEST_FEATURE ("with large table");
+	new_env = nih_str_array_new (NULL);
+	for (int i = 0; i < ENVIRON_INDEX_THRESHOLD; i++)
+		assert (environ_set (&new_env, NULL, NULL, TRUE,
+				     "NEW%d=%d", i, i));
+	assert (environ_add (&new_env, NULL, NULL, TRUE, "FOO=apricot"));
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			len = 0;
+			env = nih_str_array_new (NULL);
+			assert (environ_add (&env, NULL, &len, TRUE, "FOO=BAR"));
+			assert (environ_add (&env, NULL, &len, TRUE, "BAR=BAZ"));
+		}
+
+		ret = environ_append (&env, NULL, &len, TRUE, new_env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			nih_free (env);
+			continue;
+		}
+
+		TEST_EQ_P (ret, env);
+		TEST_EQ (len, ENVIRON_INDEX_THRESHOLD + 2);
+
+		TEST_EQ_STR (env[0], "FOO=apricot");
+		TEST_EQ_STR (env[1], "BAR=BAZ");
+		TEST_EQ_STR (env[2], "NEW0=0");
+		TEST_EQ_STR (env[ENVIRON_INDEX_THRESHOLD + 1], "NEW15=15");
+		TEST_EQ_P (env[ENVIRON_INDEX_THRESHOLD + 2], NULL);
+
+		nih_free (env);
+	}
+
+	nih_free (new_env);
+}
+
+
+void
+test_copy (void)
+{
+	char   **env, **copy;
+	size_t   len;
+
+	/* Check that a copy of a table contains the same strings, shared
+	 * with the original and referenced by the copy so that they remain
+	 * after the original is freed.
+	 */
+	TEST_FUNCTION ("environ_copy");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			env = nih_str_array_new (NULL);
+			assert (environ_add (&env, NULL, NULL, TRUE, "FOO=BAR"));
+			assert (environ_add (&env, NULL, NULL, TRUE, "BAR=BAZ"));
+		}
+
+		len = 0;
+		copy = environ_copy (NULL, &len, env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (copy, NULL);
+			nih_free (env);
+			continue;
+		}
+
+		TEST_EQ (len, 2);
+		TEST_ALLOC_SIZE (copy, sizeof (char *) * 3);
+		TEST_EQ_P (copy[0], env[0]);
+		TEST_EQ_P (copy[1], env[1]);
+		TEST_EQ_P (copy[2], NULL);
+
+		TEST_ALLOC_PARENT (copy[0], copy);
+		TEST_ALLOC_PARENT (copy[1], copy);
+
+		nih_free (env);
+
+		TEST_EQ_STR (copy[0], "FOO=BAR");
+		TEST_EQ_STR (copy[1], "BAR=BAZ");
+
+		/* Replacing an entry in the copy must leave the original
+		 * string alone.
+		 */
+		TEST_ALLOC_SAFE {
+			env = environ_copy (NULL, NULL, copy);
+			assert (environ_add (&copy, NULL, &len, TRUE,
+					     "FOO=apricot"));
+		}
+
+		TEST_EQ_STR (copy[0], "FOO=apricot");
+		TEST_EQ_STR (env[0], "FOO=BAR");
+
+		nih_free (env);
+		nih_free (copy);
+	}
+}
+
+void
+test_table_new (void)
+{
+	EnvironTable  *table;
+	char         **env;
+
+	/* Check that we can create a new table from an existing one, the
+	 * entries should be copied in order and be found through the
+	 * hash.
+	 */
+	TEST_FUNCTION ("environ_table_new");
+	env = nih_str_array_new (NULL);
+	assert (environ_add (&env, NULL, NULL, TRUE, "FOO=BAR"));
+	assert (environ_add (&env, NULL, NULL, TRUE, "BAR=BAZ"));
+
+	TEST_ALLOC_FAIL {
+		table = environ_table_new (NULL, env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (table, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (table, sizeof (EnvironTable));
+		TEST_EQ (table->len, 2);
+		TEST_ALLOC_PARENT (table->env, table);
+		TEST_EQ_STR (table->env[0], "FOO=BAR");
+		TEST_EQ_STR (table->env[1], "BAR=BAZ");
+		TEST_EQ_P (table->env[2], NULL);
+
+		TEST_EQ_STR (environ_table_get (table, "BAR"), "BAZ");
+
+		nih_free (table);
+	}
+
+	nih_free (env);
+}
+
+void
+test_table_copy (void)
+{
+	EnvironTable  *table;
+	char         **env;
+
+	/* Check that we can create a table that shares the strings of an
+	 * existing one, the entries being found through the hash and
+	 * replacing them leaving the original alone.
+	 */
+	TEST_FUNCTION ("environ_table_copy");
+	env = nih_str_array_new (NULL);
+	assert (environ_add (&env, NULL, NULL, TRUE, "FOO=BAR"));
+	assert (environ_add (&env, NULL, NULL, TRUE, "BAR=BAZ"));
+
+	TEST_ALLOC_FAIL {
+		table = environ_table_copy (NULL, env);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (table, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (table, sizeof (EnvironTable));
+		TEST_EQ (table->len, 2);
+		TEST_ALLOC_PARENT (table->env, table);
+		TEST_EQ_P (table->env[0], env[0]);
+		TEST_EQ_P (table->env[1], env[1]);
+		TEST_EQ_P (table->env[2], NULL);
+
+		TEST_EQ_STR (environ_table_get (table, "BAR"), "BAZ");
+
+		TEST_ALLOC_SAFE {
+			assert (environ_table_add (table, TRUE, "BAR=apricot"));
+		}
+
+		TEST_EQ_STR (environ_table_get (table, "BAR"), "apricot");
+		TEST_EQ_STR (env[1], "BAR=BAZ");
+
+		nih_free (table);
+	}
+
+	nih_free (env);
+}
+
+void
+test_table_add (void)
+{
+	EnvironTable  *table;
+	char         **ret;
+
+	TEST_FUNCTION ("environ_table_add");
+
+	/* Check that entries are appended in order and replace existing
+	 * entries in place, the hash being kept up to date.
+	 */
+	TEST_FEATURE ("with new and replacement variables");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			table = environ_table_new (NULL, NULL);
+			assert (environ_table_add (table, TRUE, "FOO=BAR"));
+			assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+		}
+
+		ret = environ_table_add (table, TRUE, "FOO=apricot");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			nih_free (table);
+			continue;
+		}
+
+		TEST_EQ_P (ret, table->env);
+		TEST_EQ (table->len, 2);
+		TEST_EQ_STR (table->env[0], "FOO=apricot");
+		TEST_EQ_STR (table->env[1], "BAR=BAZ");
+		TEST_EQ_P (table->env[2], NULL);
+
+		TEST_EQ_STR (environ_table_get (table, "FOO"), "apricot");
+
+		nih_free (table);
+	}
+
+
+	/* Check that an existing entry is left alone when not replacing.
+	 */
+	TEST_FEATURE ("with existing variable but no replace");
+	table = environ_table_new (NULL, NULL);
+	assert (environ_table_add (table, TRUE, "FOO=BAR"));
+
+	ret = environ_table_add (table, FALSE, "FOO=apricot");
+
+	TEST_EQ_P (ret, table->env);
+	TEST_EQ (table->len, 1);
+	TEST_EQ_STR (environ_table_get (table, "FOO"), "BAR");
+
+	nih_free (table);
+
+
+	/* Check that replacing a variable with one unset in init's own
+	 * environment removes it, with the following entries moving down
+	 * and still being found.
+	 */
+	TEST_FEATURE ("with replacement variable unset in environment");
+	unsetenv ("BAR");
+
+	table = environ_table_new (NULL, NULL);
+	assert (environ_table_add (table, TRUE, "FOO=BAR"));
+	assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+	assert (environ_table_add (table, TRUE, "TEA=green"));
+
+	ret = environ_table_add (table, TRUE, "BAR");
+
+	TEST_EQ_P (ret, table->env);
+	TEST_EQ (table->len, 2);
+	TEST_EQ_STR (table->env[0], "FOO=BAR");
+	TEST_EQ_STR (table->env[1], "TEA=green");
+	TEST_EQ_P (table->env[2], NULL);
+
+	TEST_EQ_P (environ_table_get (table, "BAR"), NULL);
+	TEST_EQ_STR (environ_table_get (table, "TEA"), "green");
+
+	assert (environ_table_add (table, TRUE, "TEA=black"));
+	TEST_EQ_STR (table->env[1], "TEA=black");
+
+	nih_free (table);
+}
+
+void
+test_table_lookup (void)
+{
+	EnvironTable  *table;
+	char * const  *ret;
+
+	TEST_FUNCTION ("environ_table_lookup");
+	table = environ_table_new (NULL, NULL);
+	assert (environ_table_add (table, TRUE, "FOOBAR=BAZ"));
+	assert (environ_table_add (table, TRUE, "BAR=BAZ"));
+
+	/* Check that a key is found, and that the key may be followed by
+	 * other characters.
+	 */
+	TEST_FEATURE ("with key to be found");
+	ret = environ_table_lookup (table, "BAR!=foo", 3);
+
+	TEST_EQ_P (ret, &table->env[1]);
+
+
+	/* Check that a key that's a prefix of another isn't found.
+	 */
+	TEST_FEATURE ("with key that is prefix of another");
+	ret = environ_table_lookup (table, "FOO", 3);
+
+	TEST_EQ_P (ret, NULL);
+
+	nih_free (table);
 }
 
 
@@ -1582,18 +1880,268 @@ test_expand (void)
 }
 
 
+void
+test_template_new (void)
+{
+	EnvironTemplate *template;
+	NihError        *error;
+
+	TEST_FUNCTION ("environ_template_new");
+
+	/* Check that a string is compiled into literal runs and variable
+	 * references, with simple bracketed names and empty arguments
+	 * kept inline.
+	 */
+	TEST_FEATURE ("with references");
+	TEST_ALLOC_FAIL {
+		template = environ_template_new (NULL,
+						 "a $FOO b ${BAR:-x}${}c");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (template, NULL);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (template, sizeof (EnvironTemplate));
+		TEST_ALLOC_PARENT (template->string, template);
+		TEST_EQ_STR (template->string, "a $FOO b ${BAR:-x}${}c");
+		TEST_EQ (template->num_parts, 6);
+
+		TEST_EQ (template->parts[0].op, ENVIRON_TEMPLATE_LITERAL);
+		TEST_EQ_MEM (template->parts[0].str, "a ", 2);
+		TEST_EQ (template->parts[0].len, 2);
+
+		TEST_EQ (template->parts[1].op, ENVIRON_TEMPLATE_VALUE);
+		TEST_EQ_MEM (template->parts[1].str, "FOO", 3);
+		TEST_EQ (template->parts[1].len, 3);
+		TEST_EQ_P (template->parts[1].name, NULL);
+		TEST_EQ_P (template->parts[1].arg, NULL);
+
+		TEST_EQ (template->parts[2].op, ENVIRON_TEMPLATE_LITERAL);
+		TEST_EQ_MEM (template->parts[2].str, " b ", 3);
+		TEST_EQ (template->parts[2].len, 3);
+
+		TEST_EQ (template->parts[3].op, ENVIRON_TEMPLATE_DEFAULT);
+		TEST_TRUE (template->parts[3].ignore_empty);
+		TEST_EQ_MEM (template->parts[3].str, "BAR", 3);
+		TEST_EQ (template->parts[3].len, 3);
+		TEST_EQ_P (template->parts[3].name, NULL);
+		TEST_NE_P (template->parts[3].arg, NULL);
+		TEST_EQ (template->parts[3].arg->num_parts, 1);
+
+		TEST_EQ (template->parts[4].op, ENVIRON_TEMPLATE_LITERAL);
+		TEST_EQ_MEM (template->parts[4].str, "$", 1);
+		TEST_EQ (template->parts[4].len, 1);
+
+		TEST_EQ (template->parts[5].op, ENVIRON_TEMPLATE_LITERAL);
+		TEST_EQ_MEM (template->parts[5].str, "c", 1);
+		TEST_EQ (template->parts[5].len, 1);
+
+		nih_free (template);
+	}
+
+
+	/* Check that a name containing references is compiled into a
+	 * template of its own.
+	 */
+	TEST_FEATURE ("with reference in name");
+	template = environ_template_new (NULL, "${$HOBBIT}");
+
+	TEST_NE_P (template, NULL);
+	TEST_EQ (template->num_parts, 1);
+	TEST_EQ (template->parts[0].op, ENVIRON_TEMPLATE_VALUE);
+	TEST_NE_P (template->parts[0].name, NULL);
+	TEST_ALLOC_PARENT (template->parts[0].name, template);
+	TEST_EQ (template->parts[0].name->num_parts, 1);
+	TEST_EQ (template->parts[0].name->parts[0].op,
+		 ENVIRON_TEMPLATE_VALUE);
+
+	nih_free (template);
+
+
+	/* Check that an unknown operator is raised as an error when the
+	 * string is compiled.
+	 */
+	TEST_FEATURE ("with unknown operator in expression");
+	template = environ_template_new (NULL, "this is a ${$FOO:!$BAR test");
+
+	TEST_EQ_P (template, NULL);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENVIRON_EXPECTED_OPERATOR);
+	nih_free (error);
+
+
+	/* Check that a missing close brace is raised as an error when the
+	 * string is compiled.
+	 */
+	TEST_FEATURE ("with missing close brace after expression");
+	template = environ_template_new (NULL, "this is a ${$FOO:-$BAR test");
+
+	TEST_EQ_P (template, NULL);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENVIRON_MISMATCHED_BRACES);
+	nih_free (error);
+}
+
+void
+test_template_expand (void)
+{
+	EnvironTemplate *template;
+	NihError        *error;
+	char            *env[7], *str, *expected;
+	const char      *strings[] = {
+		"this is a test",
+		"this is a $FOO test",
+		"this is a $BAZ test",
+		"test $FOO $BAR$BAZ",
+		"${BAR}${FOO}test${BAZ}",
+		"${$HOBBIT} baggins",
+		"${${HOBBIT}} baggins",
+		"${MEEP-a }test",
+		"${NULL-a }test",
+		"${MEEP:-a }test",
+		"${NULL:-a }test",
+		"${BAZ:-a }test",
+		"${MEEP+good }test",
+		"${NULL+good }test",
+		"${NULL:+good }test",
+		"${BAZ:+good }test",
+		"${$BAZ:-${$HOBBIT}}test",
+		"this is a $ test",
+		"$$FOO$",
+		"${}test",
+		NULL,
+	};
+
+	TEST_FUNCTION ("environ_template_expand");
+	env[0] = "FOO=frodo";
+	env[1] = "BAR=bilbo";
+	env[2] = "BAZ=xx";
+	env[3] = "HOBBIT=FOO";
+	env[4] = "NULL=";
+	env[5] = "DOH=oops";
+	env[6] = NULL;
+
+
+	/* Check that expanding a compiled string gives exactly the same
+	 * result as expanding the string with environ_expand().
+	 */
+	TEST_FEATURE ("with same result as environ_expand");
+	for (const char **s = strings; *s; s++) {
+		template = environ_template_new (NULL, *s);
+		TEST_NE_P (template, NULL);
+
+		expected = environ_expand (NULL, *s, env);
+		TEST_NE_P (expected, NULL);
+
+		TEST_ALLOC_FAIL {
+			str = environ_template_expand (NULL, template, env);
+
+			if (test_alloc_failed) {
+				TEST_EQ_P (str, NULL);
+
+				error = nih_error_get ();
+				TEST_EQ (error->number, ENOMEM);
+				nih_free (error);
+				continue;
+			}
+
+			TEST_ALLOC_SIZE (str, strlen (expected) + 1);
+			TEST_EQ_STR (str, expected);
+
+			nih_free (str);
+		}
+
+		nih_free (expected);
+		nih_free (template);
+	}
+
+
+	/* Check that the same template may be expanded against different
+	 * environments.
+	 */
+	TEST_FEATURE ("with different environment");
+	template = environ_template_new (NULL, "$FOO-$BAR");
+
+	str = environ_template_expand (NULL, template, env);
+	TEST_EQ_STR (str, "frodo-bilbo");
+	nih_free (str);
+
+	env[0] = "FOO=sam";
+	env[1] = "BAR=gollum";
+
+	str = environ_template_expand (NULL, template, env);
+	TEST_EQ_STR (str, "sam-gollum");
+	nih_free (str);
+
+	env[0] = "FOO=frodo";
+	env[1] = "BAR=bilbo";
+
+	nih_free (template);
+
+
+	/* Check that an unknown variable is raised as an error when the
+	 * template is expanded.
+	 */
+	TEST_FEATURE ("with expansion of unknown variable");
+	template = environ_template_new (NULL, "this is a ${WIBBLE} test");
+	TEST_NE_P (template, NULL);
+
+	str = environ_template_expand (NULL, template, env);
+
+	TEST_EQ_P (str, NULL);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENVIRON_UNKNOWN_PARAM);
+	nih_free (error);
+
+	nih_free (template);
+
+
+	/* Check that an unknown variable within an unused argument is
+	 * still raised as an error, as environ_expand() does.
+	 */
+	TEST_FEATURE ("with expansion of unknown variable within argument");
+	template = environ_template_new (NULL,
+					 "this is a ${FOO:-$WIBBLE} test");
+	TEST_NE_P (template, NULL);
+
+	str = environ_template_expand (NULL, template, env);
+
+	TEST_EQ_P (str, NULL);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENVIRON_UNKNOWN_PARAM);
+	nih_free (error);
+
+	nih_free (template);
+}
+
 int
 main (int   argc,
       char *argv[])
 {
 	test_add ();
 	test_append ();
+	test_copy ();
+	test_table_new ();
+	test_table_copy ();
+	test_table_add ();
+	test_table_lookup ();
 	test_set ();
 	test_lookup ();
 	test_get ();
 	test_getn ();
 	test_all_valid ();
 	test_expand ();
+	test_template_new ();
+	test_template_expand ();
 
 	return 0;
 }
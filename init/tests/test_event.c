@@ -24,6 +24,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/string.h>
@@ -78,6 +82,14 @@ test_new (void)
 		TEST_EQ (event->progress, EVENT_PENDING);
 		TEST_EQ (event->failed, FALSE);
 
+		TEST_EQ (event->priority, EVENT_PRIORITY_NORMAL);
+		TEST_EQ_P (event->source, NULL);
+		TEST_EQ (event->queued, FALSE);
+
+		TEST_EQ_P (event->fds, NULL);
+		TEST_EQ_P (event->fd_names, NULL);
+		TEST_EQ (event->num_fds, 0);
+
 		TEST_EQ (event->blockers, 0);
 		TEST_LIST_EMPTY (&event->blocking);
 
@@ -89,6 +101,66 @@ test_new (void)
 
 		nih_free (event);
 	}
+
+
+	/* Check that an event the system is waiting on is given a high
+	 * priority.
+	 */
+	TEST_FEATURE ("with high priority event");
+	event = event_new (NULL, "starting", NULL);
+
+	TEST_EQ (event->priority, EVENT_PRIORITY_HIGH);
+
+	nih_free (event);
+}
+
+
+void
+test_add_fd (void)
+{
+	Event *event;
+	int    ret;
+
+	/* Check that file descriptors can be attached to an event; each
+	 * is stored along with its name, or the name of the event if not
+	 * given one.
+	 */
+	TEST_FUNCTION ("event_add_fd");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			event = event_new (NULL, "test", NULL);
+		}
+
+		ret = event_add_fd (event, 4, "http");
+		if (test_alloc_failed && (ret < 0)) {
+			TEST_EQ (event->num_fds, 0);
+			nih_free (event);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		ret = event_add_fd (event, 5, NULL);
+		if (test_alloc_failed && (ret < 0)) {
+			TEST_EQ (event->num_fds, 1);
+			nih_free (event);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_EQ (event->num_fds, 2);
+		TEST_ALLOC_PARENT (event->fds, event);
+		TEST_EQ (event->fds[0], 4);
+		TEST_EQ (event->fds[1], 5);
+
+		TEST_ALLOC_PARENT (event->fd_names, event);
+		TEST_EQ_STR (event->fd_names[0], "http");
+		TEST_EQ_STR (event->fd_names[1], "test");
+		TEST_EQ_P (event->fd_names[2], NULL);
+
+		nih_free (event);
+	}
 }
 
 
@@ -131,10 +203,412 @@ test_unblock (void)
 }
 
 
+void
+test_queue_full (void)
+{
+	Event *event1, *event2, *event3, *event4;
+	int    source1, source2;
+
+	TEST_FUNCTION ("event_queue_full");
+	job_class_init ();
+	control_init ();
+
+	event_max_queued = 3;
+	event_max_queued_source = 2;
+
+	/* Check that a source may queue events while it, and the sources
+	 * together, are below their limits; internal events are not
+	 * counted.
+	 */
+	TEST_FEATURE ("with room in queue");
+	event1 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event1, &source1));
+
+	event2 = event_new (NULL, "test", NULL);
+
+	TEST_FALSE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+
+	/* Check that a source with as many events pending as it is allowed
+	 * is refused, while other sources are not.
+	 */
+	TEST_FEATURE ("with source at limit");
+	event3 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event3, &source1));
+
+	TEST_TRUE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+
+	/* Check that every source is refused when the queue as a whole
+	 * has reached its limit.
+	 */
+	TEST_FEATURE ("with queue at limit");
+	event4 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event4, &source2));
+
+	TEST_TRUE (event_queue_full (&source1));
+	TEST_TRUE (event_queue_full (&source2));
+
+
+	/* Check that nothing is refused when there are no limits.
+	 */
+	TEST_FEATURE ("with no limits");
+	event_max_queued = 0;
+	event_max_queued_source = 0;
+
+	TEST_FALSE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+	event_max_queued = 3;
+	event_max_queued_source = 2;
+
+
+	/* Check that an event freed while still pending is no longer
+	 * counted.
+	 */
+	TEST_FEATURE ("with freed event");
+	nih_free (event3);
+
+	TEST_FALSE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+
+	/* Check that events are no longer counted once they are being
+	 * handled, even while they remain blocked.
+	 */
+	TEST_FEATURE ("with handled events");
+	event3 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event3, &source1));
+
+	event_block (event1);
+
+	TEST_FREE_TAG (event2);
+	TEST_FREE_TAG (event3);
+	TEST_FREE_TAG (event4);
+
+	event_poll ();
+
+	TEST_EQ (event1->progress, EVENT_HANDLING);
+	TEST_FREE (event2);
+	TEST_FREE (event3);
+	TEST_FREE (event4);
+
+	TEST_FALSE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+	event_unblock (event1);
+	TEST_FREE_TAG (event1);
+
+	event_poll ();
+
+	TEST_FREE (event1);
+
+	event_max_queued = EVENT_MAX_QUEUED;
+	event_max_queued_source = EVENT_MAX_QUEUED_SOURCE;
+}
+
+
+void
+test_forget_source (void)
+{
+	Event *event1, *event2, *event3;
+	int    source1, source2;
+
+	TEST_FUNCTION ("event_forget_source");
+	event_max_queued = 3;
+	event_max_queued_source = 2;
+
+	event1 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event1, &source1));
+
+	event2 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event2, &source1));
+
+	event3 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event3, &source2));
+
+
+	/* Check that the events of a source that has gone away are kept,
+	 * but no longer belong to it or count against the queue, while the
+	 * events of other sources are unchanged.
+	 */
+	TEST_FEATURE ("with pending events");
+	TEST_TRUE (event_queue_full (&source1));
+	TEST_TRUE (event_queue_full (&source2));
+
+	event_forget_source (&source1);
+
+	TEST_EQ_P (event1->source, NULL);
+	TEST_EQ (event1->progress, EVENT_PENDING);
+	TEST_EQ_P (event2->source, NULL);
+	TEST_EQ (event2->progress, EVENT_PENDING);
+	TEST_EQ_P (event3->source, &source2);
+
+	TEST_FALSE (event_queue_full (&source1));
+	TEST_FALSE (event_queue_full (&source2));
+
+
+	/* Check that a source without any events can be forgotten.
+	 */
+	TEST_FEATURE ("without events");
+	event_forget_source (&source1);
+
+	TEST_EQ_P (event3->source, &source2);
+
+	nih_free (event1);
+	nih_free (event2);
+	nih_free (event3);
+
+	event_max_queued = EVENT_MAX_QUEUED;
+	event_max_queued_source = EVENT_MAX_QUEUED_SOURCE;
+}
+
+
+void
+test_priority_rule_new (void)
+{
+	EventPriorityRule *rule;
+
+	/* Check that we can create a new priority rule; the structure
+	 * should be allocated with nih_alloc(), placed in the rules list
+	 * and the details filled in.
+	 */
+	TEST_FUNCTION ("event_priority_rule_new");
+	TEST_ALLOC_FAIL {
+		rule = event_priority_rule_new (NULL, "net-*",
+						EVENT_PRIORITY_LOW);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (rule, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (rule, sizeof (EventPriorityRule));
+		TEST_LIST_NOT_EMPTY (&rule->entry);
+		TEST_EQ_P (event_priority_rules->prev, &rule->entry);
+
+		TEST_EQ_STR (rule->pattern, "net-*");
+		TEST_ALLOC_PARENT (rule->pattern, rule);
+
+		TEST_EQ (rule->priority, EVENT_PRIORITY_LOW);
+
+		nih_free (rule);
+
+		TEST_LIST_EMPTY (event_priority_rules);
+	}
+}
+
+void
+test_priority (void)
+{
+	EventPriorityRule *rule1, *rule2;
+
+	TEST_FUNCTION ("event_priority");
+
+	/* Check that events jobs are waiting on have a high priority by
+	 * default, and other events a normal priority.
+	 */
+	TEST_FEATURE ("with no rules");
+	TEST_EQ (event_priority ("starting"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("stopped"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("control-alt-delete"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("runlevel"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("net-device-added"), EVENT_PRIORITY_NORMAL);
+
+
+	/* Check that a matching rule overrides the default priority, and
+	 * that the last matching rule is used.
+	 */
+	TEST_FEATURE ("with matching rules");
+	rule1 = event_priority_rule_new (NULL, "*-device-*",
+					 EVENT_PRIORITY_LOW);
+	rule2 = event_priority_rule_new (NULL, "block-device-*",
+					 EVENT_PRIORITY_HIGH);
+
+	TEST_EQ (event_priority ("net-device-added"), EVENT_PRIORITY_LOW);
+	TEST_EQ (event_priority ("block-device-added"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("starting"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority ("wibble"), EVENT_PRIORITY_NORMAL);
+
+	nih_free (rule1);
+	nih_free (rule2);
+}
+
+void
+test_priority_name (void)
+{
+	TEST_FUNCTION ("event_priority_name");
+
+	/* Check that each priority returns the right string. */
+	TEST_FEATURE ("with known priorities");
+	TEST_EQ_STR (event_priority_name (EVENT_PRIORITY_HIGH), "high");
+	TEST_EQ_STR (event_priority_name (EVENT_PRIORITY_NORMAL), "normal");
+	TEST_EQ_STR (event_priority_name (EVENT_PRIORITY_LOW), "low");
+
+
+	/* Check that an invalid priority returns NULL. */
+	TEST_FEATURE ("with invalid priority");
+	TEST_EQ_P (event_priority_name (1234), NULL);
+}
+
+void
+test_priority_from_name (void)
+{
+	TEST_FUNCTION ("event_priority_from_name");
+
+	/* Check that each string returns the right priority. */
+	TEST_FEATURE ("with known priorities");
+	TEST_EQ (event_priority_from_name ("high"), EVENT_PRIORITY_HIGH);
+	TEST_EQ (event_priority_from_name ("normal"), EVENT_PRIORITY_NORMAL);
+	TEST_EQ (event_priority_from_name ("low"), EVENT_PRIORITY_LOW);
+
+
+	/* Check that an invalid string returns -1. */
+	TEST_FEATURE ("with invalid priority");
+	TEST_EQ (event_priority_from_name ("wibble"), -1);
+}
+
+
+void
+test_coalesce_rule_new (void)
+{
+	EventCoalesceRule *rule;
+
+	/* Check that we can create a new coalesce rule; the structure
+	 * should be allocated with nih_alloc(), placed in the rules list
+	 * and the details filled in.
+	 */
+	TEST_FUNCTION ("event_coalesce_rule_new");
+	TEST_ALLOC_FAIL {
+		rule = event_coalesce_rule_new (NULL, "net-*");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (rule, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (rule, sizeof (EventCoalesceRule));
+		TEST_LIST_NOT_EMPTY (&rule->entry);
+		TEST_EQ_P (event_coalesce_rules->prev, &rule->entry);
+
+		TEST_EQ_STR (rule->pattern, "net-*");
+		TEST_ALLOC_PARENT (rule->pattern, rule);
+
+		nih_free (rule);
+
+		TEST_LIST_EMPTY (event_coalesce_rules);
+	}
+}
+
+void
+test_coalesce (void)
+{
+	EventCoalesceRule  *rule;
+	Event              *event1, *event2;
+	char              **env;
+	int                 source;
+
+	TEST_FUNCTION ("event_coalesce");
+	event1 = event_new (NULL, "net-device-changed", NULL);
+	assert0 (event_set_source (event1, &source));
+	assert (nih_str_array_add (&event1->env, event1, NULL,
+				   "INTERFACE=eth0"));
+	assert (nih_str_array_add (&event1->env, event1, NULL,
+				   "ADDRESS=10.0.0.1"));
+
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "INTERFACE=eth0"));
+	assert (nih_str_array_add (&env, NULL, NULL, "ADDRESS=10.0.0.1"));
+
+
+	/* Check that nothing is coalesced when no rule names the event.
+	 */
+	TEST_FEATURE ("without rule");
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+
+	rule = event_coalesce_rule_new (NULL, "net-*");
+
+	/* Check that an identical pending event is found when a rule
+	 * names the event.
+	 */
+	TEST_FEATURE ("with identical pending event");
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), event1);
+
+
+	/* Check that an event with a different name is not coalesced.
+	 */
+	TEST_FEATURE ("with different name");
+	TEST_EQ_P (event_coalesce ("net-device-added", env), NULL);
+
+
+	/* Check that an event with different environment is not
+	 * coalesced, including where one is a prefix of the other.
+	 */
+	TEST_FEATURE ("with different environment");
+	assert (nih_str_array_add (&env, NULL, NULL, "METRIC=1"));
+
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+	nih_free (env);
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "INTERFACE=eth0"));
+
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+	nih_free (env);
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "INTERFACE=eth0"));
+	assert (nih_str_array_add (&env, NULL, NULL, "ADDRESS=10.0.0.1"));
+
+
+	/* Check that an identical event queued internally rather than
+	 * emitted by a client is not coalesced.
+	 */
+	TEST_FEATURE ("with internally queued event");
+	event1->progress = EVENT_HANDLING;
+
+	event2 = event_new (NULL, "net-device-changed", NULL);
+	event2->env = nih_str_array_copy (event2, NULL, env);
+
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+	nih_free (event2);
+	event1->progress = EVENT_PENDING;
+
+
+	/* Check that an event carrying files is not coalesced.
+	 */
+	TEST_FEATURE ("with files");
+	event2 = event_new (NULL, "net-device-changed", NULL);
+	event2->env = nih_str_array_copy (event2, NULL, env);
+	assert0 (event_set_source (event2, &source));
+	assert (event_add_fd (event2, 0, "STDIN") == 0);
+	event1->progress = EVENT_HANDLING;
+
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+	nih_free (event2);
+
+
+	/* Check that an event no longer pending is not coalesced.
+	 */
+	TEST_FEATURE ("with handling event");
+	TEST_EQ_P (event_coalesce ("net-device-changed", env), NULL);
+
+	nih_free (rule);
+	nih_free (event1);
+	nih_free (env);
+}
+
+
 void
 test_poll (void)
 {
-	Event *event = NULL;
+	EventPriorityRule *rule;
+	Event             *event = NULL, *event1, *event2, *event3;
 
 	TEST_FUNCTION ("event_poll");
 	job_class_init ();
@@ -213,6 +687,42 @@ test_poll (void)
 
 		TEST_FREE (event);
 	}
+
+
+	/* Check that pending events are handled highest priority first,
+	 * and that no more than the limit from a single source are handled
+	 * at once; the rest should remain pending for the next poll, while
+	 * events queued internally are not limited.
+	 */
+	TEST_FEATURE ("with events from busy source");
+	event_source_limit = 1;
+	rule = event_priority_rule_new (NULL, "urgent", EVENT_PRIORITY_HIGH);
+
+	event1 = event_new (NULL, "test", NULL);
+	assert0 (event_set_source (event1, &event_source_limit));
+
+	event2 = event_new (NULL, "urgent", NULL);
+	assert0 (event_set_source (event2, &event_source_limit));
+
+	event3 = event_new (NULL, "test", NULL);
+
+	TEST_FREE_TAG (event1);
+	TEST_FREE_TAG (event2);
+	TEST_FREE_TAG (event3);
+
+	event_poll ();
+
+	TEST_NOT_FREE (event1);
+	TEST_EQ (event1->progress, EVENT_PENDING);
+	TEST_FREE (event2);
+	TEST_FREE (event3);
+
+	event_poll ();
+
+	TEST_FREE (event1);
+
+	nih_free (rule);
+	event_source_limit = EVENT_SOURCE_LIMIT;
 }
 
 
@@ -1151,9 +1661,8 @@ test_pending_handle_jobs (void)
 
 		job = (Job *)nih_hash_lookup (class->instances, "");
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 		oper = class->stop_on;
 		TEST_EQ (oper->value, FALSE);
@@ -1215,9 +1724,8 @@ test_pending_handle_jobs (void)
 		TEST_EQ_P (job->stop_env[1], NULL);
 
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 
 		TEST_LIST_NOT_EMPTY (&job->blocking);
@@ -1296,9 +1804,8 @@ test_pending_handle_jobs (void)
 		TEST_EQ_P (job->stop_env[2], NULL);
 
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 
 		TEST_LIST_NOT_EMPTY (&job->blocking);
@@ -1397,9 +1904,8 @@ test_pending_handle_jobs (void)
 		TEST_EQ_P (job->stop_env[1], NULL);
 
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 
 		TEST_FREE (event3);
@@ -1491,9 +1997,8 @@ test_pending_handle_jobs (void)
 		TEST_NOT_FREE (env1);
 		TEST_EQ_P (job->stop_env, env1);
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 		TEST_NOT_FREE (event3);
 		TEST_NOT_FREE (event4);
@@ -1571,9 +2076,8 @@ test_pending_handle_jobs (void)
 		TEST_EQ_P (job->stop_env[1], NULL);
 
 
-		oper = job->stop_on;
-		TEST_EQ (oper->value, FALSE);
-		TEST_EQ_P (oper->event, NULL);
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 
 		TEST_LIST_NOT_EMPTY (&job->blocking);
@@ -1637,6 +2141,35 @@ test_finished (void)
 	}
 
 
+	/* Check that any file descriptors passed with the event are
+	 * closed once it has finished.
+	 */
+	TEST_FEATURE ("with file descriptors");
+	TEST_ALLOC_FAIL {
+		int fds[2];
+
+		TEST_ALLOC_SAFE {
+			assert0 (pipe (fds));
+
+			event = event_new (NULL, "test", NULL);
+			event->progress = EVENT_FINISHED;
+			assert0 (event_add_fd (event, fds[0], NULL));
+			assert0 (event_add_fd (event, fds[1], NULL));
+
+			TEST_FREE_TAG (event);
+		}
+
+		event_poll ();
+
+		TEST_FREE (event);
+
+		TEST_LT (fcntl (fds[0], F_GETFD), 0);
+		TEST_EQ (errno, EBADF);
+		TEST_LT (fcntl (fds[1], F_GETFD), 0);
+		TEST_EQ (errno, EBADF);
+	}
+
+
 	/* Check that a failed event causes another event to be emitted
 	 * that has "/failed" appended on the end.  We can obtain the
 	 * failed event by hooking a job on it, and using the
@@ -1969,8 +2502,17 @@ main (int   argc,
       char *argv[])
 {
 	test_new ();
+	test_add_fd ();
 	test_block ();
 	test_unblock ();
+	test_queue_full ();
+	test_forget_source ();
+	test_priority_rule_new ();
+	test_priority ();
+	test_priority_name ();
+	test_priority_from_name ();
+	test_coalesce_rule_new ();
+	test_coalesce ();
 	test_poll ();
 
 	test_pending ();
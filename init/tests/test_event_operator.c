@@ -21,10 +21,14 @@
 
 #include <nih/test.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/string.h>
 #include <nih/tree.h>
+#include <nih/error.h>
 
 #include "event_operator.h"
 #include "blocked.h"
@@ -385,6 +389,156 @@ test_operator_copy (void)
 	event_poll ();
 }
 
+void
+test_operator_pack (void)
+{
+	EventOperator *oper1, *oper2, *oper3, *oper4, *oper5, *oper6;
+	EventOperator *pack = NULL, *copy;
+	Event         *event1, *event2;
+
+	TEST_FUNCTION ("event_operator_pack");
+	event_init ();
+
+	oper1 = event_operator_new (NULL, EVENT_OR, NULL, NULL);
+	oper2 = event_operator_new (oper1, EVENT_AND, NULL, NULL);
+	oper3 = event_operator_new (oper2, EVENT_MATCH, "foo", NULL);
+	oper4 = event_operator_new (oper2, EVENT_MATCH, "bar", NULL);
+	oper5 = event_operator_new (oper1, EVENT_MATCH, "baz", NULL);
+
+	NIH_MUST (nih_str_array_add (&oper4->env, oper4, NULL, "FOO=foo"));
+	NIH_MUST (nih_str_array_add (&oper4->env, oper4, NULL, "BAR=bar"));
+
+	nih_tree_add (&oper1->node, &oper2->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper3->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper4->node, NIH_TREE_RIGHT);
+	nih_tree_add (&oper1->node, &oper5->node, NIH_TREE_RIGHT);
+
+	event1 = event_new (NULL, "foo", NULL);
+	event2 = event_new (NULL, "baz", NULL);
+
+	event_operator_handle (oper1, NULL, event1, NULL);
+	event_operator_handle (oper1, NULL, event2, NULL);
+
+
+	/* Check that a whole tree is copied into a single block with the
+	 * nodes in pre-order, along with the environment, values and
+	 * matched events; each event matched being blocked again by the
+	 * copy.
+	 */
+	TEST_FEATURE ("with tree");
+	TEST_ALLOC_FAIL {
+		pack = event_operator_pack (NULL, oper1);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (pack, NULL);
+			TEST_EQ (event1->blockers, 1);
+			TEST_EQ (event2->blockers, 1);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (pack, (sizeof (EventOperator) * 5
+					+ sizeof (char *) * 3
+					+ strlen ("FOO=foo") + 1
+					+ strlen ("BAR=bar") + 1));
+		TEST_EQ_P (pack->node.parent, NULL);
+		TEST_EQ_P (pack->node.left, &pack[1].node);
+		TEST_EQ_P (pack->node.right, &pack[4].node);
+		TEST_EQ (pack->type, EVENT_OR);
+		TEST_EQ (pack->value, TRUE);
+
+		TEST_EQ_P (pack[1].node.parent, &pack[0].node);
+		TEST_EQ_P (pack[1].node.left, &pack[2].node);
+		TEST_EQ_P (pack[1].node.right, &pack[3].node);
+		TEST_EQ (pack[1].type, EVENT_AND);
+		TEST_EQ (pack[1].value, FALSE);
+
+		TEST_EQ (pack[2].type, EVENT_MATCH);
+		TEST_EQ (pack[2].value, TRUE);
+		TEST_EQ_P (pack[2].name, oper3->name);
+		TEST_EQ_P (pack[2].env, NULL);
+		TEST_EQ_P (pack[2].event, event1);
+
+		TEST_EQ (pack[3].type, EVENT_MATCH);
+		TEST_EQ (pack[3].value, FALSE);
+		TEST_EQ_P (pack[3].name, oper4->name);
+		TEST_EQ_P (pack[3].env, (char **)&pack[5]);
+		TEST_EQ_STR (pack[3].env[0], "FOO=foo");
+		TEST_EQ_STR (pack[3].env[1], "BAR=bar");
+		TEST_EQ_P (pack[3].env[2], NULL);
+		TEST_EQ_P (pack[3].event, NULL);
+
+		TEST_EQ_P (pack[4].node.parent, &pack[0].node);
+		TEST_EQ (pack[4].type, EVENT_MATCH);
+		TEST_EQ (pack[4].value, TRUE);
+		TEST_EQ_P (pack[4].name, oper5->name);
+		TEST_EQ_P (pack[4].event, event2);
+
+		TEST_EQ (event1->blockers, 2);
+		TEST_EQ (event2->blockers, 2);
+
+
+		/* Check that the packed tree is matched, reset and copied
+		 * like any other.
+		 */
+		event_operator_reset (pack, NULL);
+
+		TEST_EQ (pack[0].value, FALSE);
+		TEST_EQ_P (pack[2].event, NULL);
+		TEST_EQ_P (pack[4].event, NULL);
+		TEST_EQ (event1->blockers, 1);
+		TEST_EQ (event2->blockers, 1);
+
+		TEST_ALLOC_SAFE {
+			TEST_TRUE (event_operator_handle (pack, NULL, event2,
+							  NULL));
+			TEST_EQ (pack[0].value, TRUE);
+
+			copy = event_operator_copy (NULL, pack);
+			TEST_TRUE (event_operator_equal (copy, oper1));
+			TEST_EQ_P (((EventOperator *)copy->node.right)->event,
+				   event2);
+			nih_free (copy);
+		}
+
+		TEST_EQ (event2->blockers, 2);
+
+
+		/* Check that freeing the block unblocks every event
+		 * matched by the tree.
+		 */
+		nih_free (pack);
+
+		TEST_EQ (event1->blockers, 1);
+		TEST_EQ (event2->blockers, 1);
+	}
+
+	nih_free (oper1);
+
+	TEST_EQ (event1->blockers, 0);
+	TEST_EQ (event2->blockers, 0);
+
+
+	/* Check that a single operator without environment is packed into
+	 * a block of its own size.
+	 */
+	TEST_FEATURE ("with single operator");
+	oper6 = event_operator_new (NULL, EVENT_MATCH, "foo", NULL);
+
+	pack = event_operator_pack (NULL, oper6);
+
+	TEST_ALLOC_SIZE (pack, sizeof (EventOperator));
+	TEST_EQ_P (pack->node.left, NULL);
+	TEST_EQ_P (pack->node.right, NULL);
+	TEST_EQ_STR (pack->name, "foo");
+	TEST_ALLOC_PARENT (pack->name, pack);
+
+	nih_free (pack);
+	nih_free (oper6);
+
+	event_poll ();
+}
+
+
 void
 test_operator_destroy (void)
 {
@@ -424,6 +578,76 @@ test_operator_destroy (void)
 }
 
 
+void
+test_operator_equal (void)
+{
+	EventOperator *oper1, *oper2, *oper;
+	char         **env;
+
+	TEST_FUNCTION ("event_operator_equal");
+	oper1 = event_operator_new (NULL, EVENT_OR, NULL, NULL);
+
+	oper = event_operator_new (oper1, EVENT_MATCH, "foo", NULL);
+	nih_tree_add (&oper1->node, &oper->node, NIH_TREE_LEFT);
+
+	env = nih_str_array_new (NULL);
+	assert (nih_str_array_add (&env, NULL, NULL, "BAR=baz"));
+	oper = event_operator_new (oper1, EVENT_MATCH, "bar", env);
+	nih_tree_add (&oper1->node, &oper->node, NIH_TREE_RIGHT);
+	nih_discard (env);
+
+
+	/* Check that two trees for the same expression are equal, even
+	 * when the state of the operators differs.
+	 */
+	TEST_FEATURE ("with same expression");
+	oper2 = event_operator_copy (NULL, oper1);
+	oper2->value = TRUE;
+
+	TEST_TRUE (event_operator_equal (oper1, oper2));
+
+	nih_free (oper2);
+
+
+	/* Check that trees differing in the environment of a match are
+	 * not equal.
+	 */
+	TEST_FEATURE ("with different environment");
+	oper2 = event_operator_copy (NULL, oper1);
+
+	oper = (EventOperator *)oper2->node.right;
+	nih_free (oper->env);
+	oper->env = NULL;
+
+	TEST_FALSE (event_operator_equal (oper1, oper2));
+
+	nih_free (oper2);
+
+
+	/* Check that trees of a different shape are not equal.
+	 */
+	TEST_FEATURE ("with different shape");
+	oper2 = event_operator_copy (NULL, oper1);
+
+	oper = (EventOperator *)oper2->node.right;
+	nih_free (oper);
+
+	TEST_FALSE (event_operator_equal (oper1, oper2));
+
+	nih_free (oper2);
+
+
+	/* Check that a tree is not equal to no tree, but that no tree is
+	 * equal to itself.
+	 */
+	TEST_FEATURE ("with no tree");
+	TEST_FALSE (event_operator_equal (oper1, NULL));
+	TEST_TRUE (event_operator_equal (NULL, NULL));
+
+	nih_free (oper1);
+}
+
+
 void
 test_operator_update (void)
 {
@@ -442,7 +666,7 @@ test_operator_update (void)
 	TEST_FEATURE ("with EVENT_OR and both children FALSE");
 	oper1->value = oper2->value = oper3->value = FALSE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, FALSE);
 
@@ -452,7 +676,7 @@ test_operator_update (void)
 	oper1->value = oper3->value = FALSE;
 	oper2->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, TRUE);
 
@@ -462,7 +686,7 @@ test_operator_update (void)
 	oper1->value = oper2->value = FALSE;
 	oper3->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, TRUE);
 
@@ -472,7 +696,7 @@ test_operator_update (void)
 	oper1->value = FALSE;
 	oper2->value = oper3->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, TRUE);
 
@@ -482,7 +706,7 @@ test_operator_update (void)
 	oper1->type = EVENT_AND;
 	oper1->value = oper2->value = oper3->value = FALSE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, FALSE);
 
@@ -492,7 +716,7 @@ test_operator_update (void)
 	oper1->value = oper3->value = FALSE;
 	oper2->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, FALSE);
 
@@ -502,7 +726,7 @@ test_operator_update (void)
 	oper1->value = oper2->value = FALSE;
 	oper3->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, FALSE);
 
@@ -512,7 +736,7 @@ test_operator_update (void)
 	oper1->value = FALSE;
 	oper2->value = oper3->value = TRUE;
 
-	event_operator_update (oper1);
+	event_operator_update (oper1, NULL);
 
 	TEST_EQ (oper1->value, TRUE);
 
@@ -874,7 +1098,7 @@ test_operator_handle (void)
 	/* Check that a non-matching event doesn't touch the tree. */
 	TEST_FEATURE ("with non-matching event");
 	event = event_new (NULL, "frodo", NULL);
-	ret = event_operator_handle (oper1, event, NULL);
+	ret = event_operator_handle (oper1, NULL, event, NULL);
 
 	TEST_EQ (ret, FALSE);
 	TEST_EQ (oper1->value, FALSE);
@@ -896,7 +1120,7 @@ test_operator_handle (void)
 	 */
 	TEST_FEATURE ("with matching event");
 	event = event_new (NULL, "foo", NULL);
-	ret = event_operator_handle (oper1, event, NULL);
+	ret = event_operator_handle (oper1, NULL, event, NULL);
 
 	TEST_EQ (ret, TRUE);
 	TEST_EQ (oper1->value, FALSE);
@@ -919,7 +1143,7 @@ test_operator_handle (void)
 
 	TEST_FREE_TAG (oper3->event);
 
-	ret = event_operator_handle (oper1, event, NULL);
+	ret = event_operator_handle (oper1, NULL, event, NULL);
 
 	TEST_EQ (ret, FALSE);
 	TEST_EQ (oper1->value, FALSE);
@@ -943,7 +1167,7 @@ test_operator_handle (void)
 	 */
 	TEST_FEATURE ("with matching event and complete expression");
 	event = event_new (NULL, "bar", NULL);
-	ret = event_operator_handle (oper1, event, NULL);
+	ret = event_operator_handle (oper1, NULL, event, NULL);
 
 	TEST_EQ (ret, TRUE);
 	TEST_EQ (oper1->value, TRUE);
@@ -957,7 +1181,7 @@ test_operator_handle (void)
 
 	TEST_EQ (event->blockers, 1);
 
-	event_operator_reset (oper1);
+	event_operator_reset (oper1, NULL);
 
 
 	/* Check that an environment array is passed through and used to
@@ -972,7 +1196,7 @@ test_operator_handle (void)
 
 	env[0] = "WIBBLE=baz";
 	env[1] = NULL;
-	ret = event_operator_handle (oper1, event, env);
+	ret = event_operator_handle (oper1, NULL, event, env);
 
 	TEST_EQ (ret, TRUE);
 	TEST_EQ (oper1->value, TRUE);
@@ -987,7 +1211,7 @@ test_operator_handle (void)
 	TEST_EQ (event->blockers, 1);
 
 
-	event_operator_reset (oper1);
+	event_operator_reset (oper1, NULL);
 
 	nih_free (oper1);
 	nih_free (oper2);
@@ -999,6 +1223,63 @@ test_operator_handle (void)
 }
 
 
+void
+test_operator_can_match (void)
+{
+	EventOperator *oper1, *oper2, *oper3, *oper4;
+	char          *env[2];
+	Event         *event;
+
+	TEST_FUNCTION ("event_operator_can_match");
+	oper1 = event_operator_new (NULL, EVENT_OR, NULL, NULL);
+	oper2 = event_operator_new (oper1, EVENT_AND, NULL, NULL);
+	oper3 = event_operator_new (oper1, EVENT_MATCH, "foo", NULL);
+	oper4 = event_operator_new (oper1, EVENT_MATCH, "bar", NULL);
+	oper4->env = env;
+	oper4->env[0] = "BAR=$WIBBLE";
+	oper4->env[1] = NULL;
+
+	nih_tree_add (&oper1->node, &oper2->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper3->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper4->node, NIH_TREE_RIGHT);
+
+
+	/* Check that an event named by an operator deep in the tree may
+	 * match it.
+	 */
+	TEST_FEATURE ("with named event");
+	event = event_new (NULL, "foo", NULL);
+
+	TEST_TRUE (event_operator_can_match (oper1, event));
+
+	nih_free (event);
+
+
+	/* Check that an event named by an operator may match it even if
+	 * its environment would not, since that depends on the environment
+	 * it is expanded against.
+	 */
+	TEST_FEATURE ("with named event and other environment");
+	event = event_new (NULL, "bar", NULL);
+
+	TEST_TRUE (event_operator_can_match (oper1, event));
+
+	nih_free (event);
+
+
+	/* Check that an event named by no operator cannot match. */
+	TEST_FEATURE ("with unnamed event");
+	event = event_new (NULL, "frodo", NULL);
+
+	TEST_FALSE (event_operator_can_match (oper1, event));
+
+	nih_free (event);
+
+
+	oper4->env = NULL;
+	nih_free (oper1);
+}
+
 void
 test_operator_environment (void)
 {
@@ -1064,7 +1345,8 @@ test_operator_environment (void)
 		env = NULL;
 		len = 0;
 
-		ptr = event_operator_environment (root, &env, NULL, &len, NULL);
+		ptr = event_operator_environment (root, NULL, &env, NULL,
+						  &len, NULL);
 
 		if (test_alloc_failed) {
 			TEST_EQ_P (ptr, NULL);
@@ -1100,7 +1382,7 @@ test_operator_environment (void)
 		env = NULL;
 		len = 0;
 
-		ptr = event_operator_environment (root, &env, NULL, &len,
+		ptr = event_operator_environment (root, NULL, &env, NULL, &len,
 						  "UPSTART_EVENTS");
 
 		if (test_alloc_failed) {
@@ -1139,7 +1421,7 @@ test_operator_environment (void)
 		env = NULL;
 		len = 0;
 
-		ptr = event_operator_environment (oper5, &env, NULL, &len,
+		ptr = event_operator_environment (oper5, NULL, &env, NULL, &len,
 						  "UPSTART_EVENTS");
 
 		if (test_alloc_failed) {
@@ -1167,6 +1449,123 @@ test_operator_environment (void)
 	nih_free (event3);
 }
 
+void
+test_operator_fds (void)
+{
+	EventOperator  *root, *oper1, *oper2, *oper3;
+	Event          *event1, *event2, *event3;
+	int             pipe1[2], pipe2[2], pipe3[2];
+	int            *fds;
+	char          **fd_names;
+	size_t          num_fds;
+	int             ret;
+
+	TEST_FUNCTION ("event_operator_fds");
+	root = event_operator_new (NULL, EVENT_OR, NULL, NULL);
+	oper1 = event_operator_new (root, EVENT_AND, NULL, NULL);
+	oper2 = event_operator_new (root, EVENT_MATCH, "foo", NULL);
+	oper3 = event_operator_new (root, EVENT_MATCH, "bar", NULL);
+
+	nih_tree_add (&root->node, &oper1->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper1->node, &oper2->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper1->node, &oper3->node, NIH_TREE_RIGHT);
+
+	assert0 (pipe (pipe1));
+	assert0 (pipe (pipe2));
+	assert0 (pipe (pipe3));
+
+	root->value = TRUE;
+	oper1->value = TRUE;
+
+	oper2->value = TRUE;
+	oper2->event = event1 = event_new (NULL, "foo", NULL);
+	event_block (oper2->event);
+	assert0 (event_add_fd (event1, pipe1[0], "one"));
+	assert0 (event_add_fd (event1, pipe2[0], "two"));
+
+	oper3->value = TRUE;
+	oper3->event = event2 = event_new (NULL, "bar", NULL);
+	event_block (oper3->event);
+	assert0 (event_add_fd (event2, pipe3[0], NULL));
+
+	/* An event that isn't part of the operator tree */
+	event3 = event_new (NULL, "baz", NULL);
+	assert0 (event_add_fd (event3, pipe3[1], NULL));
+
+
+	/* Check that the file descriptors from each of the events are
+	 * duplicated into the returned array, in tree order, along with
+	 * their names.
+	 */
+	TEST_FEATURE ("with file descriptors");
+	TEST_ALLOC_FAIL {
+		fds = NULL;
+		fd_names = NULL;
+		num_fds = 0;
+
+		ret = event_operator_fds (root, NULL, NULL, &fds, &fd_names,
+					  &num_fds);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_P (fds, NULL);
+			TEST_EQ_P (fd_names, NULL);
+			TEST_EQ (num_fds, 0);
+
+			nih_free (nih_error_get ());
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (num_fds, 3);
+
+		TEST_NE (fds[0], pipe1[0]);
+		TEST_NE (fds[1], pipe2[0]);
+		TEST_NE (fds[2], pipe3[0]);
+		for (size_t i = 0; i < num_fds; i++)
+			TEST_TRUE (fcntl (fds[i], F_GETFD) & FD_CLOEXEC);
+
+		TEST_EQ_STR (fd_names[0], "one");
+		TEST_EQ_STR (fd_names[1], "two");
+		TEST_EQ_STR (fd_names[2], "bar");
+		TEST_EQ_P (fd_names[3], NULL);
+
+		for (size_t i = 0; i < num_fds; i++)
+			close (fds[i]);
+
+		nih_free (fds);
+		nih_free (fd_names);
+	}
+
+
+	/* Check that when no events carried file descriptors, both arrays
+	 * are left NULL.
+	 */
+	TEST_FEATURE ("without file descriptors");
+	event1->num_fds = 0;
+	event2->num_fds = 0;
+
+	ret = event_operator_fds (root, NULL, NULL, &fds, &fd_names, &num_fds);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ_P (fds, NULL);
+	TEST_EQ_P (fd_names, NULL);
+	TEST_EQ (num_fds, 0);
+
+
+	close (pipe1[0]);
+	close (pipe1[1]);
+	close (pipe2[0]);
+	close (pipe2[1]);
+	close (pipe3[0]);
+	close (pipe3[1]);
+
+	nih_free (root);
+	nih_free (event1);
+	nih_free (event2);
+	nih_free (event3);
+}
+
 void
 test_operator_events (void)
 {
@@ -1218,7 +1617,7 @@ test_operator_events (void)
 			list = nih_list_new (NULL);
 		}
 
-		event_operator_events (root, NULL, list);
+		event_operator_events (root, NULL, NULL, list);
 
 		TEST_LIST_NOT_EMPTY (list);
 
@@ -1254,7 +1653,7 @@ test_operator_events (void)
 			list = nih_list_new (NULL);
 		}
 
-		event_operator_events (oper5, NULL, list);
+		event_operator_events (oper5, NULL, NULL, list);
 
 		TEST_LIST_EMPTY (list);
 
@@ -1298,8 +1697,8 @@ test_operator_reset (void)
 	event1 = event_new (NULL, "foo", NULL);
 	event2 = event_new (NULL, "bar", NULL);
 
-	event_operator_handle (oper1, event1, NULL);
-	event_operator_handle (oper1, event2, NULL);
+	event_operator_handle (oper1, NULL, event1, NULL);
+	event_operator_handle (oper1, NULL, event2, NULL);
 
 	TEST_EQ (oper1->value, TRUE);
 	TEST_EQ (oper2->value, TRUE);
@@ -1312,7 +1711,7 @@ test_operator_reset (void)
 	TEST_EQ (event1->blockers, 1);
 	TEST_EQ (event2->blockers, 1);
 
-	event_operator_reset (oper1);
+	event_operator_reset (oper1, NULL);
 
 	TEST_EQ (oper1->value, FALSE);
 	TEST_EQ (oper2->value, FALSE);
@@ -1335,19 +1734,152 @@ test_operator_reset (void)
 }
 
 
+void
+test_operator_state (void)
+{
+	EventOperator      *oper1, *oper2, *oper3, *oper4, *oper5;
+	EventOperatorState *state1, *state2;
+	Event              *event1, *event2;
+	int                 ret;
+
+	TEST_FUNCTION ("event_operator_state_new");
+	oper1 = event_operator_new (NULL, EVENT_OR, NULL, NULL);
+	oper2 = event_operator_new (oper1, EVENT_AND, NULL, NULL);
+	oper3 = event_operator_new (oper1, EVENT_MATCH, "foo", NULL);
+	oper4 = event_operator_new (oper1, EVENT_MATCH, "bar", NULL);
+	oper5 = event_operator_new (oper1, EVENT_MATCH, "baz", NULL);
+
+	nih_tree_add (&oper1->node, &oper2->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper3->node, NIH_TREE_LEFT);
+	nih_tree_add (&oper2->node, &oper4->node, NIH_TREE_RIGHT);
+	nih_tree_add (&oper1->node, &oper5->node, NIH_TREE_RIGHT);
+
+
+	/* Check that a new state array has an entry for each operator in
+	 * the tree, all FALSE, and that the operators are numbered with
+	 * the root first and each operator before its children.
+	 */
+	TEST_FEATURE ("with tree");
+	TEST_ALLOC_FAIL {
+		state1 = event_operator_state_new (NULL, oper1);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (state1, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (state1, sizeof (EventOperatorState) * 5);
+
+		for (size_t i = 0; i < 5; i++) {
+			TEST_EQ (state1[i].value, FALSE);
+			TEST_EQ_P (state1[i].event, NULL);
+		}
+
+		TEST_EQ (oper1->index, 0);
+		TEST_EQ (oper2->index, 1);
+		TEST_EQ (oper3->index, 2);
+		TEST_EQ (oper4->index, 3);
+		TEST_EQ (oper5->index, 4);
+
+		nih_free (state1);
+	}
+
+
+	/* Check that two state arrays may be matched against the same
+	 * tree independently of each other and of the tree itself, with
+	 * each holding a reference to the events it matched.
+	 */
+	TEST_FEATURE ("with shared tree");
+	state1 = event_operator_state_new (NULL, oper1);
+	state2 = event_operator_state_new (NULL, oper1);
+
+	event1 = event_new (NULL, "foo", NULL);
+	event2 = event_new (NULL, "bar", NULL);
+
+	ret = event_operator_handle (oper1, state1, event1, NULL);
+
+	TEST_EQ (ret, TRUE);
+	TEST_EQ (state1[0].value, FALSE);
+	TEST_EQ (state1[2].value, TRUE);
+	TEST_EQ_P (state1[2].event, event1);
+
+	ret = event_operator_handle (oper1, state1, event2, NULL);
+
+	TEST_EQ (ret, TRUE);
+	TEST_EQ (state1[0].value, TRUE);
+	TEST_EQ (state1[1].value, TRUE);
+	TEST_EQ (state1[3].value, TRUE);
+	TEST_EQ_P (state1[3].event, event2);
+
+	ret = event_operator_handle (oper1, state2, event2, NULL);
+
+	TEST_EQ (ret, TRUE);
+	TEST_EQ (state2[0].value, FALSE);
+	TEST_EQ (state2[2].value, FALSE);
+	TEST_EQ (state2[3].value, TRUE);
+	TEST_EQ_P (state2[3].event, event2);
+
+	TEST_EQ (oper1->value, FALSE);
+	TEST_EQ (oper3->value, FALSE);
+	TEST_EQ_P (oper3->event, NULL);
+	TEST_EQ (oper4->value, FALSE);
+	TEST_EQ_P (oper4->event, NULL);
+
+	TEST_EQ (event1->blockers, 1);
+	TEST_EQ (event2->blockers, 2);
+
+
+	/* Check that resetting one state array releases only the events
+	 * it referenced, leaving the other alone.
+	 */
+	TEST_FEATURE ("with reset");
+	event_operator_reset (oper1, state1);
+
+	for (size_t i = 0; i < 5; i++) {
+		TEST_EQ (state1[i].value, FALSE);
+		TEST_EQ_P (state1[i].event, NULL);
+	}
+
+	TEST_EQ (state2[3].value, TRUE);
+	TEST_EQ_P (state2[3].event, event2);
+
+	TEST_EQ (event1->blockers, 0);
+	TEST_EQ (event2->blockers, 1);
+
+
+	/* Check that freeing a state array releases the events it
+	 * still referenced.
+	 */
+	TEST_FEATURE ("with freed array");
+	nih_free (state2);
+
+	TEST_EQ (event2->blockers, 0);
+
+	nih_free (state1);
+	nih_free (oper1);
+
+	event_poll ();
+}
+
+
 int
 main (int   argc,
       char *argv[])
 {
 	test_operator_new ();
 	test_operator_copy ();
+	test_operator_pack ();
 	test_operator_destroy ();
+	test_operator_equal ();
 	test_operator_update ();
 	test_operator_match ();
 	test_operator_handle ();
+	test_operator_can_match ();
 	test_operator_environment ();
+	test_operator_fds ();
 	test_operator_events ();
 	test_operator_reset ();
+	test_operator_state ();
 
 	return 0;
 }
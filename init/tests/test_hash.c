@@ -0,0 +1,194 @@
+/* upstart
+ *
+ * test_hash.c - test suite for init/hash.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <stdio.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+
+#include "hash.h"
+
+
+/**
+ * ENTRIES:
+ *
+ * Number of entries added to the tables tested, enough to need them to
+ * grow several times.
+ **/
+#define ENTRIES 2000
+
+
+typedef struct test_entry {
+	NihList  entry;
+	char    *name;
+} TestEntry;
+
+
+static TestEntry *
+new_entry (const void *parent,
+	   int         i)
+{
+	TestEntry *entry;
+
+	entry = nih_new (parent, TestEntry);
+	assert (entry);
+
+	nih_list_init (&entry->entry);
+	nih_alloc_set_destructor (entry, nih_list_destroy);
+
+	entry->name = nih_sprintf (entry, "entry%d", i);
+	assert (entry->name);
+
+	return entry;
+}
+
+
+void
+test_add (void)
+{
+	void      *parent;
+	NihHash   *hash, *old_hash;
+	TestEntry *entries[ENTRIES];
+	TestEntry *entry1, *entry2;
+	NihList   *ret;
+	size_t     size;
+	char       name[32];
+
+	TEST_FUNCTION ("hash_add");
+
+
+	/* Check that an entry added to a table with room for it is found
+	 * in the same table, which is returned unchanged.
+	 */
+	TEST_FEATURE ("with few entries");
+	parent = nih_alloc (NULL, 0);
+	hash = nih_hash_string_new (parent, 0);
+	size = hash->size;
+
+	entry1 = new_entry (parent, 0);
+
+	TEST_FREE_TAG (hash);
+
+	ret = hash_add (parent, &hash, &entry1->entry);
+
+	TEST_EQ_P (ret, &entry1->entry);
+	TEST_NOT_FREE (hash);
+	TEST_EQ (hash->size, size);
+	TEST_EQ_P (nih_hash_lookup (hash, "entry0"), &entry1->entry);
+
+	nih_free (parent);
+
+
+	/* Check that as many entries are added the table is replaced with
+	 * larger ones allocated with the parent given, and that every
+	 * entry can still be found in the final table.
+	 */
+	TEST_FEATURE ("with many entries");
+	parent = nih_alloc (NULL, 0);
+	hash = nih_hash_string_new (parent, 0);
+	size = hash->size;
+
+	old_hash = hash;
+	TEST_FREE_TAG (old_hash);
+
+	for (int i = 0; i < ENTRIES; i++) {
+		entries[i] = new_entry (parent, i);
+
+		hash_add (parent, &hash, &entries[i]->entry);
+	}
+
+	TEST_FREE (old_hash);
+	TEST_GT (hash->size, size);
+	TEST_ALLOC_PARENT (hash, parent);
+
+	for (int i = 0; i < ENTRIES; i++) {
+		sprintf (name, "entry%d", i);
+
+		TEST_EQ_P (nih_hash_lookup (hash, name), &entries[i]->entry);
+	}
+
+	nih_free (parent);
+
+
+	/* Check that entries with the same key are kept in the order they
+	 * were added when the table is replaced.
+	 */
+	TEST_FEATURE ("with duplicate keys");
+	parent = nih_alloc (NULL, 0);
+	hash = nih_hash_string_new (parent, 0);
+
+	entry1 = new_entry (parent, 0);
+	entry2 = new_entry (parent, 0);
+
+	hash_add (parent, &hash, &entry1->entry);
+	hash_add (parent, &hash, &entry2->entry);
+
+	for (int i = 1; i < ENTRIES; i++)
+		hash_add (parent, &hash, &new_entry (parent, i)->entry);
+
+	TEST_EQ_P (nih_hash_lookup (hash, "entry0"), &entry1->entry);
+	TEST_EQ_P (nih_hash_search (hash, "entry0", &entry1->entry),
+		   &entry2->entry);
+
+	nih_free (parent);
+
+
+	/* Check that when there is not enough memory to replace the table
+	 * the entries are added to the existing one, and can all still
+	 * be found.
+	 */
+	TEST_FEATURE ("with insufficient memory");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			parent = nih_alloc (NULL, 0);
+			hash = nih_hash_string_new (parent, 0);
+
+			for (int i = 0; i < ENTRIES; i++)
+				entries[i] = new_entry (parent, i);
+		}
+
+		for (int i = 0; i < ENTRIES; i++)
+			hash_add (parent, &hash, &entries[i]->entry);
+
+		for (int i = 0; i < ENTRIES; i++) {
+			sprintf (name, "entry%d", i);
+
+			TEST_EQ_P (nih_hash_lookup (hash, name),
+				   &entries[i]->entry);
+		}
+
+		nih_free (parent);
+	}
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_add ();
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/* upstart
+ *
+ * test_intern.c - test suite for init/intern.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/hash.h>
+
+#include "intern.h"
+
+
+void
+test_string (void)
+{
+	void *parent1, *parent2;
+	char *str1, *str2;
+
+	TEST_FUNCTION ("intern_string");
+	intern_init ();
+
+
+	/* Check that interning a string not already in the table returns
+	 * a copy of it referenced by the parent, and adds it to the table.
+	 */
+	TEST_FEATURE ("with new string");
+	TEST_ALLOC_FAIL {
+		parent1 = nih_alloc (NULL, 0);
+
+		str1 = intern_string (parent1, "test");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str1, NULL);
+			TEST_EQ_P (nih_hash_lookup (intern_strings, "test"),
+				   NULL);
+
+			nih_free (parent1);
+			continue;
+		}
+
+		TEST_ALLOC_PARENT (str1, parent1);
+		TEST_EQ_STR (str1, "test");
+		TEST_NE_P (nih_hash_lookup (intern_strings, "test"), NULL);
+
+		nih_free (parent1);
+	}
+
+
+	/* Check that interning a string already in the table returns the
+	 * same pointer, now referenced by both parents.
+	 */
+	TEST_FEATURE ("with existing string");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			parent1 = nih_alloc (NULL, 0);
+			parent2 = nih_alloc (NULL, 0);
+
+			str1 = intern_string (parent1, "test");
+		}
+
+		str2 = intern_string (parent2, "test");
+
+		TEST_EQ_P (str2, str1);
+		TEST_ALLOC_PARENT (str2, parent1);
+		TEST_ALLOC_PARENT (str2, parent2);
+
+		nih_free (parent1);
+		nih_free (parent2);
+	}
+
+
+	/* Check that different strings are not shared.
+	 */
+	TEST_FEATURE ("with different string");
+	parent1 = nih_alloc (NULL, 0);
+
+	str1 = intern_string (parent1, "foo");
+	str2 = intern_string (parent1, "bar");
+
+	TEST_NE_P (str1, str2);
+	TEST_EQ_STR (str1, "foo");
+	TEST_EQ_STR (str2, "bar");
+
+	nih_free (parent1);
+
+
+	/* Check that the string remains in the table while any parent
+	 * references it, and is freed and removed from the table once the
+	 * last one has gone.
+	 */
+	TEST_FEATURE ("with last reference dropped");
+	parent1 = nih_alloc (NULL, 0);
+	parent2 = nih_alloc (NULL, 0);
+
+	str1 = intern_string (parent1, "test");
+	str2 = intern_string (parent2, "test");
+
+	TEST_FREE_TAG (str1);
+
+	nih_free (parent1);
+
+	TEST_NOT_FREE (str1);
+	TEST_NE_P (nih_hash_lookup (intern_strings, "test"), NULL);
+
+	nih_unref (str2, parent2);
+
+	TEST_FREE (str1);
+	TEST_EQ_P (nih_hash_lookup (intern_strings, "test"), NULL);
+
+	nih_free (parent2);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_string ();
+
+	return 0;
+}
@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <time.h>
 #include <stdio.h>
 #include <limits.h>
 #include <signal.h>
@@ -63,7 +64,6 @@ test_new (void)
 {
 	JobClass       *class;
 	Job            *job;
-	EventOperator  *oper;
 	pid_t           dbus_pid;
 	DBusError       dbus_error;
 	DBusConnection *conn, *client_conn;
@@ -116,13 +116,10 @@ test_new (void)
 		TEST_EQ_P (job->start_env, NULL);
 		TEST_EQ_P (job->stop_env, NULL);
 
-		oper = (EventOperator *)job->stop_on;
-		TEST_ALLOC_PARENT (oper, job);
-		TEST_ALLOC_SIZE (oper, sizeof (EventOperator));
-		TEST_EQ (oper->type, EVENT_MATCH);
-		TEST_EQ_STR (oper->name, "baz");
-		TEST_EQ_P (oper->env, NULL);
-		TEST_EQ (oper->value, FALSE);
+		TEST_ALLOC_PARENT (job->stop_on, job);
+		TEST_ALLOC_SIZE (job->stop_on, sizeof (EventOperatorState));
+		TEST_EQ (job->stop_on[0].value, FALSE);
+		TEST_EQ_P (job->stop_on[0].event, NULL);
 
 		TEST_NE_P (job->pid, NULL);
 		TEST_ALLOC_PARENT (job->pid, job);
@@ -136,6 +133,7 @@ test_new (void)
 
 		TEST_EQ_P (job->kill_timer, NULL);
 		TEST_EQ (job->kill_process, (ProcessType)-1);
+		TEST_EQ (job->kill_step, 0);
 
 		TEST_EQ (job->failed, FALSE);
 		TEST_EQ (job->failed_process, (ProcessType)-1);
@@ -143,11 +141,18 @@ test_new (void)
 
 		TEST_EQ (job->respawn_count, 0);
 		TEST_EQ (job->respawn_time, 0);
+		TEST_EQ (job->respawn_delay, 0);
+		TEST_EQ (job->respawn_pending, FALSE);
+		TEST_EQ_P (job->respawn_timer, NULL);
+		TEST_EQ (job->spawn_time, 0);
 
 		TEST_EQ (job->trace_forks, 0);
 		TEST_EQ (job->trace_state, TRACE_NONE);
 
-		event_operator_reset (job->stop_on);
+		TEST_EQ_P (job->cgroup, NULL);
+		TEST_EQ_P (job->cgroup_watch, NULL);
+
+		event_operator_reset (class->stop_on, job->stop_on);
 
 		nih_free (job);
 	}
@@ -174,7 +179,7 @@ test_new (void)
 		TEST_ALLOC_PARENT (job->path, job);
 		TEST_EQ_STR (job->path, DBUS_PATH_UPSTART "/jobs/test/fred");
 
-		event_operator_reset (job->stop_on);
+		event_operator_reset (class->stop_on, job->stop_on);
 
 		nih_free (job);
 	}
@@ -238,7 +243,7 @@ test_new (void)
 
 	dbus_message_unref (message);
 
-	event_operator_reset (job->stop_on);
+	event_operator_reset (class->stop_on, job->stop_on);
 
 	nih_free (job);
 
@@ -252,7 +257,7 @@ test_new (void)
 	dbus_shutdown ();
 
 
-	event_operator_reset (class->stop_on);
+	event_operator_reset (class->stop_on, NULL);
 
 	nih_free (class);
 }
@@ -3951,8 +3956,9 @@ test_change_state (void)
 void
 test_next_state (void)
 {
-	JobClass *class;
-	Job       *job;
+	JobClass        *class;
+	Job             *job;
+	struct timespec  now;
 
 	TEST_FUNCTION ("job_next_state");
 	class = job_class_new (NULL, "test");
@@ -4191,6 +4197,50 @@ test_next_state (void)
 	TEST_EQ (job_next_state (job), JOB_WAITING);
 
 
+	/* Check that the next state of a post-stop job with a backed off
+	 * respawn pending is to remain in post-stop, with a timer set to
+	 * start it again after the delay; until that expires, the job
+	 * remains where it is.
+	 */
+	TEST_FEATURE ("with post-stop job and a respawn delay");
+	job->goal = JOB_START;
+	job->state = JOB_POST_STOP;
+	job->respawn_delay = 10;
+	job->respawn_pending = TRUE;
+
+	TEST_EQ (job_next_state (job), JOB_POST_STOP);
+
+	assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+	TEST_EQ (job->respawn_pending, FALSE);
+	TEST_NE_P (job->respawn_timer, NULL);
+	TEST_ALLOC_PARENT (job->respawn_timer, job);
+	TEST_GE (job->respawn_timer->due, now.tv_sec + 9);
+	TEST_LE (job->respawn_timer->due, now.tv_sec + 10);
+
+	TEST_EQ (job_next_state (job), JOB_POST_STOP);
+
+	nih_free (job->respawn_timer);
+	job->respawn_timer = NULL;
+
+	TEST_EQ (job_next_state (job), JOB_STARTING);
+
+
+	/* Check that a respawn delay pending for a post-stop job that's
+	 * being stopped is forgotten.
+	 */
+	TEST_FEATURE ("with post-stop job, a goal of stop and a respawn delay");
+	job->goal = JOB_STOP;
+	job->state = JOB_POST_STOP;
+	job->respawn_delay = 10;
+	job->respawn_pending = TRUE;
+
+	TEST_EQ (job_next_state (job), JOB_WAITING);
+
+	TEST_EQ (job->respawn_pending, FALSE);
+	TEST_EQ_P (job->respawn_timer, NULL);
+
+
 	nih_free (class);
 }
 
@@ -7222,6 +7272,211 @@ test_get_processes (void)
 }
 
 
+void
+test_get_cpu_usage (void)
+{
+	NihDBusMessage *message = NULL;
+	JobClass       *class = NULL;
+	Job            *job = NULL;
+	NihError       *error;
+	char            dirname[PATH_MAX], filename[PATH_MAX];
+	uint64_t        usage;
+	FILE           *f;
+	int             ret;
+
+	TEST_FUNCTION ("job_get_cpu_usage");
+	nih_error_init ();
+	job_class_init ();
+
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/cpu.stat", dirname);
+	f = fopen (filename, "w");
+	fprintf (f, "usage_usec 4200\n");
+	fclose (f);
+
+
+	/* Check that the CPU time consumed by the control group of the
+	 * instance is returned.
+	 */
+	TEST_FEATURE ("with control group");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
+			job = job_new (class, "");
+			job->cgroup = nih_strdup (job, dirname);
+
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		usage = 99;
+
+		ret = job_get_cpu_usage (job, message, &usage);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+			nih_free (class);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (usage, 4200);
+
+		nih_free (message);
+		nih_free (class);
+	}
+
+	unlink (filename);
+
+
+	/* Check that zero is returned when the instance's control group
+	 * no longer exists.
+	 */
+	TEST_FEATURE ("with missing control group");
+	class = job_class_new (NULL, "test");
+	job = job_new (class, "");
+	job->cgroup = nih_strdup (job, dirname);
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = NULL;
+	message->message = NULL;
+
+	usage = 99;
+
+	ret = job_get_cpu_usage (job, message, &usage);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (usage, 0);
+
+	nih_free (message);
+	nih_free (class);
+
+
+	/* Check that zero is returned for an instance without a control
+	 * group.
+	 */
+	TEST_FEATURE ("without control group");
+	class = job_class_new (NULL, "test");
+	job = job_new (class, "");
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = NULL;
+	message->message = NULL;
+
+	usage = 99;
+
+	ret = job_get_cpu_usage (job, message, &usage);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (usage, 0);
+
+	nih_free (message);
+	nih_free (class);
+
+	rmdir (dirname);
+}
+
+void
+test_get_memory_usage (void)
+{
+	NihDBusMessage *message = NULL;
+	JobClass       *class = NULL;
+	Job            *job = NULL;
+	NihError       *error;
+	char            dirname[PATH_MAX], filename[PATH_MAX];
+	uint64_t        usage;
+	FILE           *f;
+	int             ret;
+
+	TEST_FUNCTION ("job_get_memory_usage");
+	nih_error_init ();
+	job_class_init ();
+
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (filename, "%s/memory.current", dirname);
+	f = fopen (filename, "w");
+	fprintf (f, "8388608\n");
+	fclose (f);
+
+
+	/* Check that the memory used by the control group of the instance
+	 * is returned.
+	 */
+	TEST_FEATURE ("with control group");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
+			job = job_new (class, "");
+			job->cgroup = nih_strdup (job, dirname);
+
+			message = nih_new (NULL, NihDBusMessage);
+			message->connection = NULL;
+			message->message = NULL;
+		}
+
+		usage = 99;
+
+		ret = job_get_memory_usage (job, message, &usage);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+
+			nih_free (message);
+			nih_free (class);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (usage, 8388608);
+
+		nih_free (message);
+		nih_free (class);
+	}
+
+	unlink (filename);
+
+
+	/* Check that zero is returned when the memory controller isn't
+	 * enabled for the instance's control group.
+	 */
+	TEST_FEATURE ("without memory controller");
+	class = job_class_new (NULL, "test");
+	job = job_new (class, "");
+	job->cgroup = nih_strdup (job, dirname);
+
+	message = nih_new (NULL, NihDBusMessage);
+	message->connection = NULL;
+	message->message = NULL;
+
+	usage = 99;
+
+	ret = job_get_memory_usage (job, message, &usage);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (usage, 0);
+
+	nih_free (message);
+	nih_free (class);
+
+	rmdir (dirname);
+}
+
+
 int
 main (int   argc,
       char *argv[])
@@ -7250,6 +7505,8 @@ main (int   argc,
 	test_get_state ();
 
 	test_get_processes ();
+	test_get_cpu_usage ();
+	test_get_memory_usage ();
 
 	return 0;
 }
@@ -92,6 +92,7 @@ test_new (void)
 
 		TEST_ALLOC_PARENT (class->instance, class);
 		TEST_EQ_STR (class->instance, "");
+		TEST_EQ_P (class->instance_template, NULL);
 
 		TEST_ALLOC_PARENT (class->instances, class);
 		TEST_ALLOC_SIZE (class->instances, sizeof (NihHash));
@@ -103,6 +104,7 @@ test_new (void)
 
 		TEST_EQ_P (class->env, NULL);
 		TEST_EQ_P (class->export, NULL);
+		TEST_EQ_P (class->base_env, NULL);
 
 		TEST_EQ_P (class->start_on, NULL);
 		TEST_EQ_P (class->stop_on, NULL);
@@ -120,10 +122,18 @@ test_new (void)
 		TEST_EQ (class->task, FALSE);
 
 		TEST_EQ (class->kill_timeout, 5);
+		TEST_EQ (class->kill_signal, SIGTERM);
+		TEST_EQ_P (class->kill_escalate, NULL);
+		TEST_EQ (class->kill_escalate_len, 0);
+		TEST_EQ (class->kill_mode, KILL_GROUP);
 
 		TEST_EQ (class->respawn, FALSE);
 		TEST_EQ (class->respawn_limit, 10);
 		TEST_EQ (class->respawn_interval, 5);
+		TEST_EQ (class->respawn_backoff_delay, 0);
+		TEST_EQ (class->respawn_backoff_multiplier, 1);
+		TEST_EQ (class->respawn_backoff_max, 0);
+		TEST_EQ (class->respawn_backoff_reset, 0);
 
 		TEST_EQ_P (class->normalexit, NULL);
 		TEST_EQ (class->normalexit_len, 0);
@@ -137,8 +147,12 @@ test_new (void)
 		for (i = 0; i < RLIMIT_NLIMITS; i++)
 			TEST_EQ_P (class->limits[i], NULL);
 
+		for (i = 0; i < CGROUP_SETTING_LAST; i++)
+			TEST_EQ_P (class->cgroup_settings[i], NULL);
+
 		TEST_EQ_P (class->chroot, NULL);
 		TEST_EQ_P (class->chdir, NULL);
+		TEST_EQ_P (class->deferred, NULL);
 		TEST_FALSE (class->deleted);
 
 		nih_free (class);
@@ -271,8 +285,8 @@ test_consider (void)
 
 
 	/* Check that when there is a registered class that cannot be
-	 * replaced because it has an active job, it is not replaced, even
-	 * if our class is better.
+	 * replaced because it has an active job that would be affected by
+	 * the differences, it is not replaced, even if our class is better.
 	 */
 	TEST_FEATURE ("with registered class that cannot be replaced");
 	nih_list_remove (&entry->entry);
@@ -286,6 +300,8 @@ test_consider (void)
 	nih_hash_add (job_classes, &class3->entry);
 	job_class_register (class3, conn, FALSE);
 
+	class1->task = TRUE;
+
 	ret = job_class_consider (class1);
 	ptr = (JobClass *)nih_hash_lookup (job_classes, "frodo");
 
@@ -319,6 +335,96 @@ test_consider (void)
 	nih_list_remove (&class3->entry);
 	dbus_connection_unregister_object_path (conn, class3->path);
 
+	class1->task = FALSE;
+
+
+	/* Check that when there is a registered class with an active job
+	 * and the only differences in our class are ones that can be
+	 * applied live, the job is handed over to our class which becomes
+	 * the hash table member.
+	 */
+	TEST_FEATURE ("with registered class that can be replaced live");
+	nih_list_remove (&entry->entry);
+
+	job = job_new (class3, "");
+	job->goal = JOB_START;
+	job->state = JOB_RUNNING;
+
+	nih_list_add (control_conns, &entry->entry);
+
+	nih_hash_add (job_classes, &class3->entry);
+	job_class_register (class3, conn, FALSE);
+
+	class1->description = nih_strdup (class1, "a new description");
+
+	ret = job_class_consider (class1);
+	ptr = (JobClass *)nih_hash_lookup (job_classes, "frodo");
+
+	TEST_TRUE (ret);
+	TEST_EQ_P (ptr, class1);
+
+	TEST_LIST_EMPTY (&class3->entry);
+	TEST_HASH_EMPTY (class3->instances);
+
+	TEST_EQ_P (job->class, class1);
+	TEST_ALLOC_PARENT (job, class1);
+	TEST_EQ_P ((Job *)nih_hash_lookup (class1->instances, ""), job);
+
+	TEST_EQ (job->goal, JOB_START);
+	TEST_EQ (job->state, JOB_RUNNING);
+
+	TEST_TRUE (dbus_connection_get_object_path_data (conn,
+							 job->path,
+							 (void **)&object));
+
+	TEST_ALLOC_SIZE (object, sizeof (NihDBusObject));
+	TEST_EQ_P (object->data, job);
+
+	dbus_connection_flush (conn);
+
+	TEST_DBUS_MESSAGE (client_conn, message);
+	TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART,
+					   "JobRemoved"));
+
+	TEST_TRUE (dbus_message_get_args (message, NULL,
+					  DBUS_TYPE_OBJECT_PATH, &path,
+					  DBUS_TYPE_INVALID));
+
+	TEST_EQ_STR (path, class3->path);
+
+	dbus_message_unref (message);
+
+	TEST_DBUS_MESSAGE (client_conn, message);
+	TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART,
+					   "JobAdded"));
+
+	TEST_TRUE (dbus_message_get_args (message, NULL,
+					  DBUS_TYPE_OBJECT_PATH, &path,
+					  DBUS_TYPE_INVALID));
+
+	TEST_EQ_STR (path, class1->path);
+
+	dbus_message_unref (message);
+
+	TEST_DBUS_MESSAGE (client_conn, message);
+	TEST_TRUE (dbus_message_is_signal (message, DBUS_INTERFACE_UPSTART_JOB,
+					   "InstanceAdded"));
+
+	TEST_TRUE (dbus_message_get_args (message, NULL,
+					  DBUS_TYPE_OBJECT_PATH, &path,
+					  DBUS_TYPE_INVALID));
+
+	TEST_EQ_STR (path, job->path);
+
+	dbus_message_unref (message);
+
+	nih_free (job);
+	nih_list_remove (&class1->entry);
+	dbus_connection_unregister_object_path (conn, class1->path);
+
+	nih_free (class1->description);
+	class1->description = NULL;
+
 
 	/* Check that when there is a registered class that can be
 	 * replaced, and our class is the best replacement, our class
@@ -760,6 +866,146 @@ test_reconsider (void)
 }
 
 
+void
+test_diff (void)
+{
+	JobClass *class1, *class2;
+	int       changes;
+
+	TEST_FUNCTION ("job_class_diff");
+	class1 = job_class_new (NULL, "test");
+	class1->process[PROCESS_MAIN] = process_new (class1->process);
+	class1->process[PROCESS_MAIN]->command = nih_strdup (
+		class1->process[PROCESS_MAIN], "echo");
+
+
+	/* Check that two definitions of the same class have no changes
+	 * between them.
+	 */
+	TEST_FEATURE ("with same definition");
+	class2 = job_class_new (NULL, "test");
+	class2->process[PROCESS_MAIN] = process_new (class2->process);
+	class2->process[PROCESS_MAIN]->command = nih_strdup (
+		class2->process[PROCESS_MAIN], "echo");
+
+	changes = job_class_diff (class1, class2);
+
+	TEST_EQ (changes, JOB_CLASS_CHANGE_NONE);
+
+
+	/* Check that changes which may be applied live are returned as
+	 * such.
+	 */
+	TEST_FEATURE ("with live changes");
+	class2->description = nih_strdup (class2, "a test job");
+	class2->start_on = event_operator_new (class2, EVENT_MATCH,
+					       "wibble", NULL);
+	class2->respawn = TRUE;
+
+	changes = job_class_diff (class1, class2);
+
+	TEST_EQ (changes, (JOB_CLASS_CHANGE_INFO
+			   | JOB_CLASS_CHANGE_START_ON
+			   | JOB_CLASS_CHANGE_RESPAWN));
+	TEST_FALSE (changes & ~JOB_CLASS_CHANGE_LIVE);
+
+
+	/* Check that changes to a process or the stop condition are
+	 * returned as such, and are not ones that may be applied live.
+	 */
+	TEST_FEATURE ("with changes affecting instances");
+	nih_free (class2);
+	class2 = job_class_new (NULL, "test");
+	class2->process[PROCESS_MAIN] = process_new (class2->process);
+	class2->process[PROCESS_MAIN]->command = nih_strdup (
+		class2->process[PROCESS_MAIN], "echo foo");
+	class2->stop_on = event_operator_new (class2, EVENT_MATCH,
+					      "wibble", NULL);
+
+	changes = job_class_diff (class1, class2);
+
+	TEST_EQ (changes, (JOB_CLASS_CHANGE_PROCESS
+			   | JOB_CLASS_CHANGE_STOP_ON));
+	TEST_TRUE (changes & ~JOB_CLASS_CHANGE_LIVE);
+
+	nih_free (class2);
+	nih_free (class1);
+}
+
+
+void
+test_pack (void)
+{
+	JobClass      *class;
+	EventOperator *start_on, *oper;
+	Job           *job;
+	int            ret;
+
+	TEST_FUNCTION ("job_class_pack");
+	job_class_init ();
+
+	/* Check that the start and stop conditions of the class are
+	 * replaced by packed copies, which instances created afterwards
+	 * share.
+	 */
+	TEST_FEATURE ("with start and stop conditions");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
+
+			class->start_on = event_operator_new (
+				class, EVENT_OR, NULL, NULL);
+			oper = event_operator_new (
+				class->start_on, EVENT_MATCH, "wibble", NULL);
+			nih_tree_add (&class->start_on->node, &oper->node,
+				      NIH_TREE_LEFT);
+			oper = event_operator_new (
+				class->start_on, EVENT_MATCH, "wobble", NULL);
+			nih_tree_add (&class->start_on->node, &oper->node,
+				      NIH_TREE_RIGHT);
+
+			class->stop_on = event_operator_new (
+				class, EVENT_MATCH, "wibble", NULL);
+		}
+
+		start_on = class->start_on;
+
+		ret = job_class_pack (class);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_P (class->start_on, start_on);
+
+			nih_free (class);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_NE_P (class->start_on, start_on);
+		TEST_ALLOC_PARENT (class->start_on, class);
+		TEST_ALLOC_SIZE (class->start_on, sizeof (EventOperator) * 3);
+		TEST_EQ (class->start_on->type, EVENT_OR);
+		TEST_EQ_STR (class->start_on[1].name, "wibble");
+		TEST_EQ_STR (class->start_on[2].name, "wobble");
+
+		TEST_ALLOC_PARENT (class->stop_on, class);
+		TEST_ALLOC_SIZE (class->stop_on, sizeof (EventOperator));
+		TEST_EQ_STR (class->stop_on->name, "wibble");
+
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+		}
+
+		TEST_ALLOC_PARENT (job->stop_on, job);
+		TEST_ALLOC_SIZE (job->stop_on, sizeof (EventOperatorState));
+		TEST_EQ (job->stop_on[0].value, FALSE);
+
+		nih_free (class);
+	}
+}
+
+
 void
 test_register (void)
 {
@@ -942,7 +1188,7 @@ void
 test_environment (void)
 {
 	JobClass  *class;
-	char     **env;
+	char     **env, **env1;
 	size_t     len;
 
 	TEST_FUNCTION ("job_class_environment");
@@ -951,13 +1197,16 @@ test_environment (void)
 	 * just have the built-ins in the returned environment.
 	 */
 	TEST_FEATURE ("with no configured environment");
-	class = job_class_new (NULL, "test");
-
 	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
+		}
+
 		env = job_class_environment (NULL, class, &len);
 
 		if (test_alloc_failed) {
 			TEST_EQ_P (env, NULL);
+			nih_free (class);
 			continue;
 		}
 
@@ -972,26 +1221,30 @@ test_environment (void)
 		TEST_EQ_P (env[2], NULL);
 
 		nih_free (env);
+		nih_free (class);
 	}
 
-	nih_free (class);
-
 
 	/* Check that a job class created with defined environment variables
 	 * will have those appended to the environment as well as the builtins.
 	 */
 	TEST_FEATURE ("with configured environment");
-	class = job_class_new (NULL, "test");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
 
-	class->env = nih_str_array_new (class);
-	assert (nih_str_array_add (&(class->env), class, NULL, "FOO=BAR"));
-	assert (nih_str_array_add (&(class->env), class, NULL, "BAR=BAZ"));
+			class->env = nih_str_array_new (class);
+			assert (nih_str_array_add (&(class->env), class,
+						   NULL, "FOO=BAR"));
+			assert (nih_str_array_add (&(class->env), class,
+						   NULL, "BAR=BAZ"));
+		}
 
-	TEST_ALLOC_FAIL {
 		env = job_class_environment (NULL, class, &len);
 
 		if (test_alloc_failed) {
 			TEST_EQ_P (env, NULL);
+			nih_free (class);
 			continue;
 		}
 
@@ -1010,26 +1263,31 @@ test_environment (void)
 		TEST_EQ_P (env[4], NULL);
 
 		nih_free (env);
+		nih_free (class);
 	}
 
-	nih_free (class);
-
 
 	/* Check that configured environment override built-ins.
 	 */
 	TEST_FEATURE ("with configuration overriding built-ins");
-	class = job_class_new (NULL, "test");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			class = job_class_new (NULL, "test");
 
-	class->env = nih_str_array_new (class);
-	assert (nih_str_array_add (&(class->env), class, NULL, "FOO=BAR"));
-	assert (nih_str_array_add (&(class->env), class, NULL, "BAR=BAZ"));
-	assert (nih_str_array_add (&(class->env), class, NULL, "TERM=elmo"));
+			class->env = nih_str_array_new (class);
+			assert (nih_str_array_add (&(class->env), class,
+						   NULL, "FOO=BAR"));
+			assert (nih_str_array_add (&(class->env), class,
+						   NULL, "BAR=BAZ"));
+			assert (nih_str_array_add (&(class->env), class,
+						   NULL, "TERM=elmo"));
+		}
 
-	TEST_ALLOC_FAIL {
 		env = job_class_environment (NULL, class, &len);
 
 		if (test_alloc_failed) {
 			TEST_EQ_P (env, NULL);
+			nih_free (class);
 			continue;
 		}
 
@@ -1047,9 +1305,50 @@ test_environment (void)
 		TEST_EQ_STR (env[3], "BAR=BAZ");
 		TEST_EQ_P (env[4], NULL);
 
+		nih_free (env);
+		nih_free (class);
+	}
+
+
+	/* Check that the environment is cached in the class, with later
+	 * calls returning tables that share its strings rather than copies
+	 * of them.
+	 */
+	TEST_FEATURE ("with cached environment");
+	class = job_class_new (NULL, "test");
+
+	class->env = nih_str_array_new (class);
+	assert (nih_str_array_add (&(class->env), class, NULL, "FOO=BAR"));
+
+	env1 = job_class_environment (NULL, class, NULL);
+
+	TEST_NE_P (class->base_env, NULL);
+	TEST_ALLOC_PARENT (class->base_env, class);
+
+	TEST_ALLOC_FAIL {
+		env = job_class_environment (NULL, class, &len);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (env, NULL);
+			continue;
+		}
+
+		TEST_EQ (len, 3);
+		TEST_NE_P (env, class->base_env);
+
+		TEST_EQ_P (env[0], class->base_env[0]);
+		TEST_EQ_P (env[1], class->base_env[1]);
+		TEST_EQ_P (env[2], class->base_env[2]);
+		TEST_EQ_STR (env[2], "FOO=BAR");
+		TEST_EQ_P (env[3], NULL);
+
+		TEST_EQ_P (env[2], env1[2]);
+		TEST_ALLOC_PARENT (env[2], env);
+
 		nih_free (env);
 	}
 
+	nih_free (env1);
 	nih_free (class);
 }
 
@@ -3656,6 +3955,8 @@ main (int   argc,
 	test_new ();
 	test_consider ();
 	test_reconsider ();
+	test_diff ();
+	test_pack ();
 	test_register ();
 	test_unregister ();
 	test_environment ();
@@ -32,6 +32,7 @@
 #include <sys/sysmacros.h>
 
 #include <time.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -66,7 +67,8 @@ enum child_tests {
 	TEST_PIDS,
 	TEST_CONSOLE,
 	TEST_PWD,
-	TEST_ENVIRONMENT
+	TEST_ENVIRONMENT,
+	TEST_FDS
 };
 
 static char *argv0;
@@ -111,6 +113,19 @@ child (enum child_tests  test,
 		for (char **env = environ; *env; env++)
 			fprintf (out, "%s\n", *env);
 		break;
+	case TEST_FDS:
+		for (i = JOB_PROCESS_FD_BASE; i < JOB_PROCESS_FD_BASE + 3; i++) {
+			struct stat buf;
+
+			if (fstat (i, &buf) < 0) {
+				fprintf (out, "%d: -1\n", i);
+			} else {
+				fprintf (out, "%d: %d\n", i,
+					 S_ISFIFO (buf.st_mode)
+					 && (! (fcntl (i, F_GETFD) & FD_CLOEXEC)));
+			}
+		}
+		break;
 	}
 
 	fsync (fileno (out));
@@ -796,6 +811,8 @@ test_spawn (void)
 {
 	FILE             *output;
 	char              function[PATH_MAX], filename[PATH_MAX];
+	char              dirname[PATH_MAX], procs_name[PATH_MAX];
+	char              setting_name[PATH_MAX];
 	char              buf[80];
 	char             *env[3], *args[4];
 	JobClass         *class;
@@ -804,6 +821,7 @@ test_spawn (void)
 	NihError         *err;
 	JobProcessError  *perr;
 	int               status;
+	int               fds[2];
 
 	TEST_FUNCTION ("job_process_spawn");
 	TEST_FILENAME (filename);
@@ -822,7 +840,7 @@ test_spawn (void)
 
 	class = job_class_new (NULL, "test");
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	waitpid (pid, NULL, 0);
@@ -860,7 +878,7 @@ test_spawn (void)
 	class = job_class_new (NULL, "test");
 	class->console = CONSOLE_NONE;
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	waitpid (pid, NULL, 0);
@@ -886,7 +904,7 @@ test_spawn (void)
 	class = job_class_new (NULL, "test");
 	class->chdir = "/tmp";
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	waitpid (pid, NULL, 0);
@@ -914,7 +932,7 @@ test_spawn (void)
 
 	class = job_class_new (NULL, "test");
 
-	pid = job_process_spawn (class, args, env, FALSE, -1);
+	pid = job_process_spawn (class, args, env, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	waitpid (pid, NULL, 0);
@@ -930,6 +948,42 @@ test_spawn (void)
 	nih_free (class);
 
 
+	/* Check that file descriptors passed to the job are placed in order
+	 * starting from the base fd, and that they don't have the
+	 * close-on-exec flag set even though the originals do.
+	 */
+	TEST_FEATURE ("with file descriptors");
+	sprintf (function, "%d", TEST_FDS);
+
+	class = job_class_new (NULL, "test");
+
+	assert0 (pipe (fds));
+	nih_io_set_cloexec (fds[0]);
+	nih_io_set_cloexec (fds[1]);
+
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, fds, 2);
+	TEST_GT (pid, 0);
+
+	waitpid (pid, NULL, 0);
+	output = fopen (filename, "r");
+
+	sprintf (buf, "%d: 1\n", JOB_PROCESS_FD_BASE);
+	TEST_FILE_EQ (output, buf);
+	sprintf (buf, "%d: 1\n", JOB_PROCESS_FD_BASE + 1);
+	TEST_FILE_EQ (output, buf);
+	sprintf (buf, "%d: -1\n", JOB_PROCESS_FD_BASE + 2);
+	TEST_FILE_EQ (output, buf);
+	TEST_FILE_END (output);
+
+	fclose (output);
+	unlink (filename);
+
+	close (fds[0]);
+	close (fds[1]);
+
+	nih_free (class);
+
+
 	/* Check that when we spawn an ordinary job, it isn't usually ptraced
 	 * since that's a special honour reserved for daemons that we expect
 	 * to fork.
@@ -939,7 +993,7 @@ test_spawn (void)
 
 	class = job_class_new (NULL, "test");
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	assert0 (waitid (P_PID, pid, &info, WEXITED | WSTOPPED | WCONTINUED));
@@ -959,7 +1013,7 @@ test_spawn (void)
 
 	class = job_class_new (NULL, "test");
 
-	pid = job_process_spawn (class, args, NULL, TRUE, -1);
+	pid = job_process_spawn (class, args, NULL, TRUE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	assert0 (waitid (P_PID, pid, &info, WEXITED | WSTOPPED | WCONTINUED));
@@ -977,6 +1031,133 @@ test_spawn (void)
 	nih_free (class);
 
 
+	/* Check that when we spawn a job into a control group, the process
+	 * moves itself into the group before it is executed.
+	 */
+	TEST_FEATURE ("with control group");
+	sprintf (function, "%d", TEST_SIMPLE);
+
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (procs_name, "%s/cgroup.procs", dirname);
+	output = fopen (procs_name, "w");
+	fclose (output);
+
+	class = job_class_new (NULL, "test");
+
+	pid = job_process_spawn (class, args, NULL, FALSE, dirname,
+				 -1, NULL, 0);
+	TEST_GT (pid, 0);
+
+	assert0 (waitid (P_PID, pid, &info, WEXITED | WSTOPPED | WCONTINUED));
+	TEST_EQ (info.si_code, CLD_EXITED);
+	TEST_EQ (info.si_status, 0);
+
+	sprintf (buf, "%d\n", pid);
+
+	output = fopen (procs_name, "r");
+	TEST_FILE_EQ (output, buf);
+	TEST_FILE_END (output);
+	fclose (output);
+
+	unlink (procs_name);
+	unlink (filename);
+
+	nih_free (class);
+
+
+	/* Check that the control group settings of the job are written
+	 * into the group before the process is moved into it.
+	 */
+	TEST_FEATURE ("with control group settings");
+	sprintf (function, "%d", TEST_SIMPLE);
+
+	output = fopen (procs_name, "w");
+	fclose (output);
+
+	sprintf (setting_name, "%s/pids.max", dirname);
+	output = fopen (setting_name, "w");
+	fclose (output);
+
+	class = job_class_new (NULL, "test");
+	class->cgroup_settings[CGROUP_PIDS_MAX] = nih_strdup (class, "64");
+
+	pid = job_process_spawn (class, args, NULL, FALSE, dirname,
+				 -1, NULL, 0);
+	TEST_GT (pid, 0);
+
+	assert0 (waitid (P_PID, pid, &info, WEXITED | WSTOPPED | WCONTINUED));
+	TEST_EQ (info.si_code, CLD_EXITED);
+	TEST_EQ (info.si_status, 0);
+
+	output = fopen (setting_name, "r");
+	TEST_FILE_EQ (output, "64");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	unlink (setting_name);
+	unlink (filename);
+
+
+	/* Check that attempting to spawn a process with a control group
+	 * setting that can't be written returns an error with the expected
+	 * information in the error structure, without moving the process
+	 * into the group.
+	 */
+	TEST_FEATURE ("with unwritable control group setting");
+	output = fopen (procs_name, "w");
+	fclose (output);
+
+	pid = job_process_spawn (class, args, NULL, FALSE, dirname,
+				 -1, NULL, 0);
+	TEST_LT (pid, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, JOB_PROCESS_ERROR);
+	TEST_ALLOC_SIZE (err, sizeof (JobProcessError));
+
+	perr = (JobProcessError *)err;
+	TEST_EQ (perr->type, JOB_PROCESS_ERROR_CGROUP_SETTING);
+	TEST_EQ (perr->arg, CGROUP_PIDS_MAX);
+	TEST_EQ (perr->errnum, ENOENT);
+	nih_free (perr);
+
+	output = fopen (procs_name, "r");
+	TEST_FILE_END (output);
+	fclose (output);
+
+	unlink (procs_name);
+
+	nih_free (class);
+
+
+	/* Check that attempting to spawn a process into a control group
+	 * that doesn't exist returns an error with the expected information
+	 * in the error structure.
+	 */
+	TEST_FEATURE ("with missing control group");
+	rmdir (dirname);
+
+	class = job_class_new (NULL, "test");
+
+	pid = job_process_spawn (class, args, NULL, FALSE, dirname,
+				 -1, NULL, 0);
+	TEST_LT (pid, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, JOB_PROCESS_ERROR);
+	TEST_ALLOC_SIZE (err, sizeof (JobProcessError));
+
+	perr = (JobProcessError *)err;
+	TEST_EQ (perr->type, JOB_PROCESS_ERROR_CGROUP);
+	TEST_EQ (perr->arg, 0);
+	TEST_EQ (perr->errnum, ENOENT);
+	nih_free (perr);
+
+	nih_free (class);
+
+
 	/* Check that attempting to spawn a binary that doesn't exist returns
 	 * an error immediately with all of the expected information in the
 	 * error structure.
@@ -988,7 +1169,7 @@ test_spawn (void)
 
 	class = job_class_new (NULL, "test");
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_LT (pid, 0);
 
 	err = nih_error_get ();
@@ -1013,7 +1194,7 @@ test_spawn (void)
 	args[1] = function;
 	args[2] = NULL;
 
-	pid = job_process_spawn (class, args, NULL, FALSE, -1);
+	pid = job_process_spawn (class, args, NULL, FALSE, NULL, -1, NULL, 0);
 	TEST_GT (pid, 0);
 
 	/* Ensure process is still running after some period of time.
@@ -1045,7 +1226,7 @@ test_kill (void)
 	NihTimer *      timer;
 	struct timespec now;
 	pid_t           pid;
-	int             status;
+	int             status, wait_fd = 0;
 
 	TEST_FUNCTION ("job_process_kill");
 	nih_timer_init ();
@@ -1177,6 +1358,150 @@ test_kill (void)
 		event_poll ();
 	}
 
+
+	/* Check that a process that ignores the kill signal is sent each
+	 * of the escalation signals by the kill timer before any KILL
+	 * signal, with the timer set again after each one.
+	 */
+	TEST_FEATURE ("with escalation signals");
+	class->kill_escalate = nih_alloc (class, sizeof (int));
+	class->kill_escalate[0] = SIGINT;
+	class->kill_escalate_len = 1;
+
+	TEST_ALLOC_FAIL {
+		int wait_fd = 0;
+
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+		}
+
+		job->goal = JOB_STOP;
+		job->state = JOB_KILLED;
+		TEST_CHILD_WAIT (job->pid[PROCESS_MAIN], wait_fd) {
+			struct sigaction act;
+
+			act.sa_handler = SIG_IGN;
+			act.sa_flags = 0;
+			sigemptyset (&act.sa_mask);
+			sigaction (SIGTERM, &act, NULL);
+
+			TEST_CHILD_RELEASE (wait_fd);
+
+			for (;;)
+				pause ();
+		}
+		pid = job->pid[PROCESS_MAIN];
+		setpgid (pid, pid);
+
+		job_process_kill (job, PROCESS_MAIN);
+
+		TEST_EQ (kill (job->pid[PROCESS_MAIN], 0), 0);
+
+		TEST_NE_P (job->kill_timer, NULL);
+		TEST_EQ (job->kill_process, PROCESS_MAIN);
+		TEST_EQ (job->kill_step, 0);
+
+		/* Run the kill timer */
+		timer = job->kill_timer;
+		timer->callback (timer->data, timer);
+		nih_free (timer);
+
+		TEST_EQ (job->goal, JOB_STOP);
+		TEST_EQ (job->state, JOB_KILLED);
+		TEST_EQ (job->pid[PROCESS_MAIN], pid);
+
+		waitpid (job->pid[PROCESS_MAIN], &status, 0);
+		TEST_TRUE (WIFSIGNALED (status));
+		TEST_EQ (WTERMSIG (status), SIGINT);
+
+		assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+		TEST_NE_P (job->kill_timer, NULL);
+		TEST_NE_P (job->kill_timer, timer);
+		TEST_ALLOC_PARENT (job->kill_timer, job);
+		TEST_GE (job->kill_timer->due, now.tv_sec + 950);
+		TEST_LE (job->kill_timer->due, now.tv_sec + 1000);
+
+		TEST_EQ (job->kill_process, PROCESS_MAIN);
+		TEST_EQ (job->kill_step, 1);
+
+		nih_free (job->kill_timer);
+		job->kill_timer = NULL;
+		job->kill_process = -1;
+
+		nih_free (job);
+
+		event_poll ();
+	}
+
+	nih_free (class->kill_escalate);
+	class->kill_escalate = NULL;
+	class->kill_escalate_len = 0;
+
+
+	/* Check that when the job is killed as a tree, a descendant of the
+	 * process that has left its process group and session is sent the
+	 * kill signal too.  The process itself ignores the signal, and
+	 * exits with the signal that killed its child.
+	 */
+	TEST_FEATURE ("with tree kill mode");
+	class->kill_mode = KILL_TREE;
+
+	job = job_new (class, "");
+
+	job->goal = JOB_STOP;
+	job->state = JOB_KILLED;
+	TEST_CHILD_WAIT (job->pid[PROCESS_MAIN], wait_fd) {
+		struct sigaction act;
+		pid_t            child;
+
+		act.sa_handler = SIG_IGN;
+		act.sa_flags = 0;
+		sigemptyset (&act.sa_mask);
+		sigaction (SIGTERM, &act, NULL);
+
+		child = fork ();
+		if (child == 0) {
+			act.sa_handler = SIG_DFL;
+			sigaction (SIGTERM, &act, NULL);
+
+			setsid ();
+
+			TEST_CHILD_RELEASE (wait_fd);
+
+			for (;;)
+				pause ();
+		}
+
+		waitpid (child, &status, 0);
+		exit (WIFSIGNALED (status) ? WTERMSIG (status) : 0);
+	}
+	pid = job->pid[PROCESS_MAIN];
+	setpgid (pid, pid);
+
+	job_process_kill (job, PROCESS_MAIN);
+
+	TEST_EQ (job->goal, JOB_STOP);
+	TEST_EQ (job->state, JOB_KILLED);
+	TEST_EQ (job->pid[PROCESS_MAIN], pid);
+
+	waitpid (job->pid[PROCESS_MAIN], &status, 0);
+	TEST_TRUE (WIFEXITED (status));
+	TEST_EQ (WEXITSTATUS (status), SIGTERM);
+
+	TEST_NE_P (job->kill_timer, NULL);
+	TEST_EQ (job->kill_process, PROCESS_MAIN);
+
+	nih_free (job->kill_timer);
+	job->kill_timer = NULL;
+	job->kill_process = -1;
+
+	nih_free (job);
+
+	event_poll ();
+
+	class->kill_mode = KILL_GROUP;
+
 	nih_free (class);
 }
 
@@ -1751,6 +2076,280 @@ test_handler (void)
 	class->respawn = FALSE;
 
 
+	/* Check that a service that backs off its respawns is respawned
+	 * after a delay that grows with each respawn, rather than being
+	 * counted against its respawn limit.
+	 */
+	TEST_FEATURE ("with backed off respawn of running service process");
+	class->respawn = TRUE;
+	class->respawn_backoff_delay = 1;
+	class->respawn_backoff_multiplier = 2;
+	class->respawn_backoff_max = 10;
+	class->respawn_backoff_reset = 300;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			blocked = blocked_new (job, BLOCKED_EVENT, event);
+			event_block (event);
+			nih_list_add (&job->blocking, &blocked->entry);
+		}
+
+		assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job->pid[PROCESS_MAIN] = 1;
+		job->respawn_delay = 4;
+		job->spawn_time = now.tv_sec - 5;
+
+		TEST_FREE_TAG (blocked);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = -1;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_EQ (job->respawn_count, 0);
+		TEST_EQ (job->respawn_delay, 8);
+		TEST_EQ (job->respawn_pending, TRUE);
+
+		TEST_EQ (event->blockers, 1);
+		TEST_EQ (event->failed, FALSE);
+
+		TEST_LIST_NOT_EMPTY (&job->blocking);
+		TEST_NOT_FREE (blocked);
+		TEST_EQ_P (blocked->event, event);
+		event_unblock (event);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		TEST_LIST_NOT_EMPTY (&job->blocker->blocking);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		TEST_ALLOC_SIZE (blocked, sizeof (Blocked));
+		TEST_ALLOC_PARENT (blocked, job->blocker);
+		TEST_EQ (blocked->type, BLOCKED_JOB);
+		TEST_EQ_P (blocked->job, job);
+		nih_free (blocked);
+
+		TEST_LIST_EMPTY (&job->blocker->blocking);
+
+		TEST_EQ (job->failed, FALSE);
+		TEST_EQ (job->failed_process, (ProcessType)-1);
+		TEST_EQ (job->exit_status, 0);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		TEST_FILE_EQ (output, ("test: test main process ended, "
+				       "respawning in 8 seconds\n"));
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_backoff_delay = 0;
+	class->respawn_backoff_multiplier = 1;
+	class->respawn_backoff_max = 0;
+	class->respawn_backoff_reset = 0;
+
+
+	/* Check that the delay before a backed off respawn grows no larger
+	 * than the maximum.
+	 */
+	TEST_FEATURE ("with backed off respawn at maximum delay");
+	class->respawn = TRUE;
+	class->respawn_backoff_delay = 1;
+	class->respawn_backoff_multiplier = 2;
+	class->respawn_backoff_max = 10;
+	class->respawn_backoff_reset = 300;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			blocked = blocked_new (job, BLOCKED_EVENT, event);
+			event_block (event);
+			nih_list_add (&job->blocking, &blocked->entry);
+		}
+
+		assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job->pid[PROCESS_MAIN] = 1;
+		job->respawn_delay = 8;
+		job->spawn_time = now.tv_sec - 5;
+
+		TEST_FREE_TAG (blocked);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = -1;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_EQ (job->respawn_count, 0);
+		TEST_EQ (job->respawn_delay, 10);
+		TEST_EQ (job->respawn_pending, TRUE);
+
+		TEST_EQ (event->blockers, 1);
+		TEST_EQ (event->failed, FALSE);
+
+		TEST_LIST_NOT_EMPTY (&job->blocking);
+		TEST_NOT_FREE (blocked);
+		TEST_EQ_P (blocked->event, event);
+		event_unblock (event);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		TEST_LIST_NOT_EMPTY (&job->blocker->blocking);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		TEST_ALLOC_SIZE (blocked, sizeof (Blocked));
+		TEST_ALLOC_PARENT (blocked, job->blocker);
+		TEST_EQ (blocked->type, BLOCKED_JOB);
+		TEST_EQ_P (blocked->job, job);
+		nih_free (blocked);
+
+		TEST_LIST_EMPTY (&job->blocker->blocking);
+
+		TEST_EQ (job->failed, FALSE);
+		TEST_EQ (job->failed_process, (ProcessType)-1);
+		TEST_EQ (job->exit_status, 0);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		TEST_FILE_EQ (output, ("test: test main process ended, "
+				       "respawning in 10 seconds\n"));
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_backoff_delay = 0;
+	class->respawn_backoff_multiplier = 1;
+	class->respawn_backoff_max = 0;
+	class->respawn_backoff_reset = 0;
+
+
+	/* Check that the delay before a backed off respawn returns to the
+	 * first once the service has stayed up for long enough.
+	 */
+	TEST_FEATURE ("with backed off respawn after healthy uptime");
+	class->respawn = TRUE;
+	class->respawn_backoff_delay = 1;
+	class->respawn_backoff_multiplier = 2;
+	class->respawn_backoff_max = 10;
+	class->respawn_backoff_reset = 300;
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			job = job_new (class, "");
+
+			blocked = blocked_new (job, BLOCKED_EVENT, event);
+			event_block (event);
+			nih_list_add (&job->blocking, &blocked->entry);
+		}
+
+		assert0 (clock_gettime (CLOCK_MONOTONIC, &now));
+
+		job->goal = JOB_START;
+		job->state = JOB_RUNNING;
+		job->pid[PROCESS_MAIN] = 1;
+		job->respawn_delay = 8;
+		job->spawn_time = now.tv_sec - 600;
+
+		TEST_FREE_TAG (blocked);
+
+		job->blocker = NULL;
+		event->failed = FALSE;
+
+		job->failed = FALSE;
+		job->failed_process = -1;
+		job->exit_status = 0;
+
+		TEST_DIVERT_STDERR (output) {
+			job_process_handler (NULL, 1, NIH_CHILD_EXITED, 1);
+		}
+		rewind (output);
+
+		TEST_EQ (job->goal, JOB_START);
+		TEST_EQ (job->state, JOB_STOPPING);
+		TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+		TEST_EQ (job->respawn_count, 0);
+		TEST_EQ (job->respawn_delay, 1);
+		TEST_EQ (job->respawn_pending, TRUE);
+
+		TEST_EQ (event->blockers, 1);
+		TEST_EQ (event->failed, FALSE);
+
+		TEST_LIST_NOT_EMPTY (&job->blocking);
+		TEST_NOT_FREE (blocked);
+		TEST_EQ_P (blocked->event, event);
+		event_unblock (event);
+
+		TEST_NE_P (job->blocker, NULL);
+
+		TEST_LIST_NOT_EMPTY (&job->blocker->blocking);
+
+		blocked = (Blocked *)job->blocker->blocking.next;
+		TEST_ALLOC_SIZE (blocked, sizeof (Blocked));
+		TEST_ALLOC_PARENT (blocked, job->blocker);
+		TEST_EQ (blocked->type, BLOCKED_JOB);
+		TEST_EQ_P (blocked->job, job);
+		nih_free (blocked);
+
+		TEST_LIST_EMPTY (&job->blocker->blocking);
+
+		TEST_EQ (job->failed, FALSE);
+		TEST_EQ (job->failed_process, (ProcessType)-1);
+		TEST_EQ (job->exit_status, 0);
+
+		TEST_FILE_EQ (output, ("test: test main process (1) "
+				       "terminated with status 1\n"));
+		TEST_FILE_EQ (output, ("test: test main process ended, "
+				       "respawning in 1 seconds\n"));
+		TEST_FILE_END (output);
+		TEST_FILE_RESET (output);
+
+		nih_free (job);
+	}
+
+	class->respawn = FALSE;
+	class->respawn_backoff_delay = 0;
+	class->respawn_backoff_multiplier = 1;
+	class->respawn_backoff_max = 0;
+	class->respawn_backoff_reset = 0;
+
+
 	/* Check that we can catch the running task of a service stopping
 	 * with an error, and if the job is to be respawned, go into
 	 * the stopping state but don't change the goal to stop.
@@ -4446,11 +5045,131 @@ test_handler (void)
 }
 
 
+void
+test_cgroup_watch (void)
+{
+	char      dirname[PATH_MAX];
+	char      events_name[PATH_MAX];
+	JobClass *class;
+	Job      *job;
+	NihIo    *io;
+	FILE     *output;
+	fd_set    readfds, writefds, exceptfds;
+	int       nfds;
+	pid_t     pid;
+
+	TEST_FUNCTION ("job_process_watch_cgroup");
+	event_init ();
+
+	TEST_FILENAME (dirname);
+	mkdir (dirname, 0755);
+
+	sprintf (events_name, "%s/cgroup.events", dirname);
+	output = fopen (events_name, "w");
+	fprintf (output, "populated 1\n");
+	fclose (output);
+
+	class = job_class_new (NULL, "test");
+	class->expect = EXPECT_DAEMON;
+	nih_hash_add (job_classes, &class->entry);
+
+	/* The main process is one we've already reaped, as a daemon that
+	 * wasn't our child would be once it exits.
+	 */
+	TEST_CHILD (pid) {
+		exit (0);
+	}
+	waitpid (pid, NULL, 0);
+
+	job = job_new (class, "");
+	job->cgroup = nih_strdup (job, dirname);
+	job->goal = JOB_START;
+	job->state = JOB_RUNNING;
+	job->pid[PROCESS_MAIN] = pid;
+
+
+	/* Check that watching the control group of a job registers an
+	 * inotify descriptor for its cgroup.events file.
+	 */
+	TEST_FEATURE ("with control group");
+	job_process_watch_cgroup (job);
+
+	TEST_NE_P (job->cgroup_watch, NULL);
+	TEST_ALLOC_PARENT (job->cgroup_watch, job);
+
+	io = job->cgroup_watch;
+	TEST_FREE_TAG (io);
+
+
+	/* Check that a modification of the file that leaves the group
+	 * populated doesn't change the job.
+	 */
+	TEST_FEATURE ("with populated control group");
+	output = fopen (events_name, "w");
+	fprintf (output, "populated 1\n");
+	fclose (output);
+
+	nfds = 0;
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+
+	nih_io_select_fds (&nfds, &readfds, &writefds, &exceptfds);
+	assert (select (nfds, &readfds, &writefds, &exceptfds, NULL) > 0);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_NOT_FREE (io);
+	TEST_EQ_P (job->cgroup_watch, io);
+	TEST_EQ (job->goal, JOB_START);
+	TEST_EQ (job->state, JOB_RUNNING);
+	TEST_EQ (job->pid[PROCESS_MAIN], pid);
+
+
+	/* Check that once the group empties, the main process that is no
+	 * longer there is handled as having exited, the watch is dropped
+	 * and the job goes on to be stopped, reaching the waiting state
+	 * where the instance is freed.
+	 */
+	TEST_FEATURE ("with emptied control group");
+	TEST_FREE_TAG (job);
+
+	output = fopen (events_name, "w");
+	fprintf (output, "populated 0\n");
+	fclose (output);
+
+	nfds = 0;
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+
+	nih_io_select_fds (&nfds, &readfds, &writefds, &exceptfds);
+	assert (select (nfds, &readfds, &writefds, &exceptfds, NULL) > 0);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_FREE (io);
+	TEST_NOT_FREE (job);
+	TEST_EQ_P (job->cgroup_watch, NULL);
+	TEST_EQ (job->goal, JOB_STOP);
+	TEST_EQ (job->state, JOB_STOPPING);
+	TEST_EQ (job->pid[PROCESS_MAIN], 0);
+
+	event_poll ();
+
+	TEST_FREE (job);
+	TEST_HASH_EMPTY (class->instances);
+
+	unlink (events_name);
+	rmdir (dirname);
+
+	nih_free (class);
+}
+
+
 void
 test_find (void)
 {
-	JobClass    *class1, *class2, *class3;
-	Job         *job1, *job2, *job3, *job4, *job5, *ptr;
+	JobClass    *class1, *class2, *class3, *class4;
+	Job         *job1, *job2, *job3, *job4, *job5, *job6, *ptr;
 	ProcessType  process;
 
 	TEST_FUNCTION ("job_process_find");
@@ -4545,6 +5264,37 @@ test_find (void)
 	TEST_EQ_P (ptr, NULL);
 
 
+	/* Check that a process recorded with job_process_track() is found
+	 * directly, without searching the classes; the class of this job
+	 * isn't even in the hash.
+	 */
+	TEST_FEATURE ("with tracked pid");
+	class4 = job_class_new (NULL, "frodo");
+	class4->process[PROCESS_MAIN] = process_new (class4);
+
+	job6 = job_new (class4, "");
+	job6->pid[PROCESS_MAIN] = 40;
+	job_process_track (job6, PROCESS_MAIN);
+
+	ptr = job_process_find (40, &process);
+
+	TEST_EQ_P (ptr, job6);
+	TEST_EQ (process, PROCESS_MAIN);
+
+
+	/* Check that a recorded process is no longer found once the job
+	 * has moved on to another.
+	 */
+	TEST_FEATURE ("with tracked pid since replaced");
+	job6->pid[PROCESS_MAIN] = 45;
+
+	ptr = job_process_find (40, NULL);
+
+	TEST_EQ_P (ptr, NULL);
+
+	nih_free (class4);
+
+
 	/* Check that we get NULL if there are jobs in the hash, but none
 	 * have pids.
 	 */
@@ -4845,6 +5595,7 @@ main (int   argc,
 	test_kill ();
 	test_handler ();
 	test_utmp ();
+	test_cgroup_watch ();
 
 	test_find ();
 
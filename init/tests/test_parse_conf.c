@@ -29,6 +29,7 @@
 
 #include "parse_conf.h"
 #include "conf.h"
+#include "event.h"
 #include "errors.h"
 
 
@@ -73,11 +74,183 @@ test_parse_conf (void)
 }
 
 
+void
+test_stanza_event (void)
+{
+	ConfSource        *source;
+	ConfFile          *file;
+	EventPriorityRule *rule;
+	NihError          *err;
+	size_t             pos, lineno;
+	char               buf[1024];
+	int                ret;
+
+	TEST_FUNCTION ("stanza_event");
+	event_init ();
+
+	source = conf_source_new (NULL, "/path", CONF_FILE);
+	file = conf_file_new (source, "/path");
+
+	/* Check that an event priority stanza results in a rule being
+	 * created for each pattern, attached to the file.
+	 */
+	TEST_FEATURE ("with priority and patterns");
+	strcpy (buf, "event priority low net-device-* block-device-*\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		ret = parse_conf (file, buf, strlen (buf), &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			NIH_LIST_FOREACH_SAFE (event_priority_rules, iter)
+				nih_free (iter);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		rule = (EventPriorityRule *)event_priority_rules->next;
+		TEST_ALLOC_PARENT (rule, file);
+		TEST_EQ_STR (rule->pattern, "net-device-*");
+		TEST_EQ (rule->priority, EVENT_PRIORITY_LOW);
+
+		rule = (EventPriorityRule *)rule->entry.next;
+		TEST_ALLOC_PARENT (rule, file);
+		TEST_EQ_STR (rule->pattern, "block-device-*");
+		TEST_EQ (rule->priority, EVENT_PRIORITY_LOW);
+
+		TEST_EQ_P (rule->entry.next, event_priority_rules);
+
+		NIH_LIST_FOREACH_SAFE (event_priority_rules, iter)
+			nih_free (iter);
+	}
+
+
+	/* Check that an event coalesce stanza results in a rule being
+	 * created for each pattern, attached to the file.
+	 */
+	TEST_FEATURE ("with coalesce and patterns");
+	strcpy (buf, "event coalesce net-device-changed health-*\n");
+
+	TEST_ALLOC_FAIL {
+		EventCoalesceRule *crule;
+
+		pos = 0;
+		lineno = 1;
+		ret = parse_conf (file, buf, strlen (buf), &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			NIH_LIST_FOREACH_SAFE (event_coalesce_rules, iter)
+				nih_free (iter);
+
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		crule = (EventCoalesceRule *)event_coalesce_rules->next;
+		TEST_ALLOC_PARENT (crule, file);
+		TEST_EQ_STR (crule->pattern, "net-device-changed");
+
+		crule = (EventCoalesceRule *)crule->entry.next;
+		TEST_ALLOC_PARENT (crule, file);
+		TEST_EQ_STR (crule->pattern, "health-*");
+
+		TEST_EQ_P (crule->entry.next, event_coalesce_rules);
+
+		NIH_LIST_FOREACH_SAFE (event_coalesce_rules, iter)
+			nih_free (iter);
+	}
+
+	TEST_LIST_EMPTY (event_priority_rules);
+
+
+	/* Check that an unknown priority results in a syntax error.
+	 */
+	TEST_FEATURE ("with unknown priority");
+	strcpy (buf, "event priority urgent net-device-*\n");
+
+	pos = 0;
+	lineno = 1;
+	ret = parse_conf (file, buf, strlen (buf), &pos, &lineno);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_PRIORITY);
+	TEST_EQ (pos, 15);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+	TEST_LIST_EMPTY (event_priority_rules);
+
+
+	/* Check that a priority without patterns results in a syntax
+	 * error.
+	 */
+	TEST_FEATURE ("with missing patterns");
+	strcpy (buf, "event priority low\n");
+
+	pos = 0;
+	lineno = 1;
+	ret = parse_conf (file, buf, strlen (buf), &pos, &lineno);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+	TEST_LIST_EMPTY (event_priority_rules);
+
+
+	/* Check that an unknown second-level token results in an error.
+	 */
+	TEST_FEATURE ("with unknown argument");
+	strcpy (buf, "event wibble low net-device-*\n");
+
+	pos = 0;
+	lineno = 1;
+	ret = parse_conf (file, buf, strlen (buf), &pos, &lineno);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 6);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+	nih_free (source);
+}
+
+
 int
 main (int   argc,
       char *argv[])
 {
 	test_parse_conf ();
+	test_stanza_event ();
 
 	return 0;
 }
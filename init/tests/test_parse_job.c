@@ -172,6 +172,297 @@ test_parse_job (void)
 	}
 }
 
+void
+test_parse_job_header (void)
+{
+	JobClass *job = NULL;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("parse_job_header");
+
+	/* Check that only the start on, stop on, instance and manual
+	 * stanzas are parsed, with the remaining stanzas including script
+	 * blocks skipped and the whole definition kept to be parsed later.
+	 */
+	TEST_FEATURE ("with job file");
+	strcpy (buf, "description \"a daemon\"\n");
+	strcat (buf, "instance $TTY\n");
+	strcat (buf, "env FOO=\"bar baz\"\n");
+	strcat (buf, "start on (wibble\n");
+	strcat (buf, "          or wobble)\n");
+	strcat (buf, "pre-start script\n");
+	strcat (buf, "    rm /var/lock/daemon\n");
+	strcat (buf, "end script\n");
+	strcat (buf, "stop on wobble # comment\n");
+	strcat (buf, "exec /sbin/daemon -d\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job_header (NULL, NULL, "test", buf, strlen (buf),
+					&pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 11);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+		TEST_EQ_STR (job->instance, "$TTY");
+
+		TEST_NE_P (job->start_on, NULL);
+		TEST_EQ (job->start_on->type, EVENT_OR);
+		TEST_NE_P (job->stop_on, NULL);
+		TEST_EQ (job->stop_on->type, EVENT_MATCH);
+		TEST_EQ_STR (job->stop_on->name, "wobble");
+
+		TEST_EQ_P (job->description, NULL);
+		TEST_EQ_P (job->env, NULL);
+		TEST_EQ_P (job->process[PROCESS_MAIN], NULL);
+		TEST_EQ_P (job->process[PROCESS_PRE_START], NULL);
+
+		TEST_ALLOC_PARENT (job->deferred, job);
+		TEST_EQ_STR (job->deferred[0], buf);
+		TEST_EQ_P (job->deferred[1], NULL);
+
+		nih_free (job);
+	}
+
+
+	/* Check that an override file for a job parsed in part is parsed
+	 * in part too, with its definition kept after the first.
+	 */
+	TEST_FEATURE ("with override of job parsed in part");
+	strcpy (buf, "start on wibble\n");
+	strcat (buf, "exec /sbin/daemon\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job_header (NULL, NULL, "test", buf, strlen (buf),
+				&pos, &lineno);
+
+	TEST_NE_P (job, NULL);
+
+	strcpy (buf, "manual\n");
+	strcat (buf, "exec /sbin/daemon -d\n");
+
+	pos = 0;
+	lineno = 1;
+	TEST_EQ_P (parse_job_header (NULL, job, "test", buf, strlen (buf),
+				     &pos, &lineno), job);
+
+	TEST_EQ_P (job->start_on, NULL);
+	TEST_EQ_P (job->process[PROCESS_MAIN], NULL);
+
+	TEST_EQ_STR (job->deferred[0], "start on wibble\nexec /sbin/daemon\n");
+	TEST_EQ_STR (job->deferred[1], buf);
+	TEST_EQ_P (job->deferred[2], NULL);
+
+	nih_free (job);
+
+
+	/* Check that an override file for a job already parsed in full is
+	 * parsed in full.
+	 */
+	TEST_FEATURE ("with override of job parsed in full");
+	strcpy (buf, "start on wibble\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+			 &pos, &lineno);
+
+	TEST_NE_P (job, NULL);
+
+	strcpy (buf, "exec /sbin/daemon -d\n");
+
+	pos = 0;
+	lineno = 1;
+	TEST_EQ_P (parse_job_header (NULL, job, "test", buf, strlen (buf),
+				     &pos, &lineno), job);
+
+	TEST_NE_P (job->process[PROCESS_MAIN], NULL);
+	TEST_EQ_STR (job->process[PROCESS_MAIN]->command, "/sbin/daemon -d");
+	TEST_EQ_P (job->deferred, NULL);
+
+	nih_free (job);
+
+
+	/* Check that an error in the start on stanza is still found.
+	 */
+	TEST_FEATURE ("with error in start on stanza");
+	strcpy (buf, "exec /sbin/daemon\n");
+	strcat (buf, "start on (wibble\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job_header (NULL, NULL, "test", buf, strlen (buf),
+				&pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_MISMATCHED_PARENS);
+	TEST_EQ (lineno, 3);
+	nih_free (err);
+}
+
+void
+test_parse_job_deferred (void)
+{
+	JobClass *job = NULL;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+	int       ret;
+
+	TEST_FUNCTION ("parse_job_deferred");
+
+	/* Check that the stanzas skipped by parse_job_header() are parsed,
+	 * leaving the start and stop conditions alone so that events they
+	 * have already matched are kept.
+	 */
+	TEST_FEATURE ("with job parsed in part");
+	strcpy (buf, "description \"a daemon\"\n");
+	strcat (buf, "start on wibble and wobble\n");
+	strcat (buf, "pre-start script\n");
+	strcat (buf, "    rm /var/lock/daemon\n");
+	strcat (buf, "end script\n");
+	strcat (buf, "exec /sbin/daemon -d\n");
+
+	TEST_ALLOC_FAIL {
+		EventOperator *start_on;
+
+		TEST_ALLOC_SAFE {
+			pos = 0;
+			lineno = 1;
+			job = parse_job_header (NULL, NULL, "test", buf,
+						strlen (buf), &pos, &lineno);
+
+			start_on = job->start_on;
+			((EventOperator *)start_on->node.left)->value = TRUE;
+		}
+
+		ret = parse_job_deferred (job, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			TEST_NE_P (job->deferred, NULL);
+
+			nih_free (job);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_EQ_P (job->deferred, NULL);
+		TEST_EQ_P (job->start_on, start_on);
+		TEST_EQ (((EventOperator *)start_on->node.left)->value, TRUE);
+
+		TEST_EQ_STR (job->description, "a daemon");
+
+		TEST_NE_P (job->process[PROCESS_MAIN], NULL);
+		TEST_EQ_STR (job->process[PROCESS_MAIN]->command,
+			     "/sbin/daemon -d");
+
+		TEST_NE_P (job->process[PROCESS_PRE_START], NULL);
+		TEST_EQ (job->process[PROCESS_PRE_START]->script, TRUE);
+		TEST_EQ_STR (job->process[PROCESS_PRE_START]->command,
+			     "rm /var/lock/daemon\n");
+
+		nih_free (job);
+	}
+
+
+	/* Check that an override is applied after the definition it
+	 * overrides.
+	 */
+	TEST_FEATURE ("with override");
+	strcpy (buf, "start on wibble\n");
+	strcat (buf, "exec /sbin/daemon\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job_header (NULL, NULL, "test", buf, strlen (buf),
+				&pos, &lineno);
+
+	TEST_NE_P (job, NULL);
+
+	strcpy (buf, "exec /sbin/daemon -d\n");
+
+	pos = 0;
+	lineno = 1;
+	TEST_EQ_P (parse_job_header (NULL, job, "test", buf, strlen (buf),
+				     &pos, &lineno), job);
+
+	ret = parse_job_deferred (job, &lineno);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ_P (job->deferred, NULL);
+	TEST_NE_P (job->start_on, NULL);
+	TEST_EQ_STR (job->process[PROCESS_MAIN]->command, "/sbin/daemon -d");
+
+	nih_free (job);
+
+
+	/* Check that an error in the skipped stanzas is returned along with
+	 * its line number, leaving the job untouched so that the error is
+	 * found again next time.
+	 */
+	TEST_FEATURE ("with error in skipped stanza");
+	strcpy (buf, "start on wibble\n");
+	strcat (buf, "description \"a daemon\"\n");
+	strcat (buf, "nice wibble\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job_header (NULL, NULL, "test", buf, strlen (buf),
+				&pos, &lineno);
+
+	TEST_NE_P (job, NULL);
+
+	lineno = 0;
+	ret = parse_job_deferred (job, &lineno);
+
+	TEST_LT (ret, 0);
+	TEST_EQ (lineno, 3);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_NICE);
+	nih_free (err);
+
+	TEST_NE_P (job->deferred, NULL);
+	TEST_EQ_P (job->description, NULL);
+
+	lineno = 0;
+	ret = parse_job_deferred (job, &lineno);
+
+	TEST_LT (ret, 0);
+	TEST_EQ (lineno, 3);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_NICE);
+	nih_free (err);
+
+	nih_free (job);
+}
+
+
 void
 test_stanza_exec (void)
 {
@@ -4357,6 +4648,43 @@ test_stanza_respawn (void)
 	}
 
 
+	/* Check that a respawn stanza with the backoff argument and four
+	 * arguments sets the delays between respawns.
+	 */
+	TEST_FEATURE ("with backoff and four arguments");
+	strcpy (buf, "respawn backoff 1 2 60 300\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_FALSE (job->respawn);
+		TEST_EQ (job->respawn_backoff_delay, 1);
+		TEST_EQ (job->respawn_backoff_multiplier, 2);
+		TEST_EQ (job->respawn_backoff_max, 60);
+		TEST_EQ (job->respawn_backoff_reset, 300);
+
+		nih_free (job);
+	}
+
+
 	/* Check that a respawn stanza with the limit argument but no
 	 * interval results in a syntax error.
 	 */
@@ -4566,11 +4894,11 @@ test_stanza_respawn (void)
 	nih_free (err);
 
 
-	/* Check that a respawn stanza with an unknown second argument
+	/* Check that a respawn backoff stanza without all four arguments
 	 * results in a syntax error.
 	 */
-	TEST_FEATURE ("with unknown argument to limit");
-	strcpy (buf, "respawn foo\n");
+	TEST_FEATURE ("with backoff and missing arguments");
+	strcpy (buf, "respawn backoff 1 2\n");
 
 	pos = 0;
 	lineno = 1;
@@ -4579,53 +4907,167 @@ test_stanza_respawn (void)
 	TEST_EQ_P (job, NULL);
 
 	err = nih_error_get ();
-	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
-	TEST_EQ (pos, 8);
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 19);
 	TEST_EQ (lineno, 1);
 	nih_free (err);
-}
 
-void
-test_stanza_task (void)
-{
-	JobClass*job;
-	NihError *err;
-	size_t    pos, lineno;
-	char      buf[1024];
-
-	TEST_FUNCTION ("stanza_task");
 
-	/* Check that a task stanza without any arguments sets the job's
-	 * task flag.
+	/* Check that a respawn backoff stanza with a zero initial delay
+	 * results in a syntax error.
 	 */
-	TEST_FEATURE ("with no arguments");
-	strcpy (buf, "task\n");
-
-	TEST_ALLOC_FAIL {
-		pos = 0;
-		lineno = 1;
-		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
-				 &pos, &lineno);
+	TEST_FEATURE ("with backoff and zero delay argument");
+	strcpy (buf, "respawn backoff 0 2 60 300\n");
 
-		if (test_alloc_failed) {
-			TEST_EQ_P (job, NULL);
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
 
-			err = nih_error_get ();
-			TEST_EQ (err->number, ENOMEM);
-			nih_free (err);
+	TEST_EQ_P (job, NULL);
 
-			continue;
-		}
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 16);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
 
-		TEST_EQ (pos, strlen (buf));
-		TEST_EQ (lineno, 2);
 
-		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+	/* Check that a respawn backoff stanza with a zero multiplier results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with backoff and zero multiplier argument");
+	strcpy (buf, "respawn backoff 1 0 60 300\n");
 
-		TEST_TRUE (job->task);
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
 
-		nih_free (job);
-	}
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_MULTIPLIER);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn backoff stanza with a maximum delay less than
+	 * the initial delay results in a syntax error.
+	 */
+	TEST_FEATURE ("with backoff and maximum below delay");
+	strcpy (buf, "respawn backoff 10 2 5 300\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 21);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn backoff stanza with a negative reset interval
+	 * results in a syntax error.
+	 */
+	TEST_FEATURE ("with backoff and negative reset argument");
+	strcpy (buf, "respawn backoff 1 2 60 -1\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_INTERVAL);
+	TEST_EQ (pos, 23);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn backoff stanza with an extra argument results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with extra argument to backoff");
+	strcpy (buf, "respawn backoff 1 2 60 300 foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNEXPECTED_TOKEN);
+	TEST_EQ (pos, 27);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a respawn stanza with an unknown second argument
+	 * results in a syntax error.
+	 */
+	TEST_FEATURE ("with unknown argument to limit");
+	strcpy (buf, "respawn foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 8);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+}
+
+void
+test_stanza_task (void)
+{
+	JobClass*job;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("stanza_task");
+
+	/* Check that a task stanza without any arguments sets the job's
+	 * task flag.
+	 */
+	TEST_FEATURE ("with no arguments");
+	strcpy (buf, "task\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_TRUE (job->task);
+
+		nih_free (job);
+	}
 
 
 	/* Check that multiple task stanzas are permitted. */
@@ -4719,6 +5161,9 @@ test_stanza_instance (void)
 		TEST_ALLOC_PARENT (job->instance, job);
 		TEST_EQ_STR (job->instance, "$FOO");
 
+		TEST_ALLOC_PARENT (job->instance_template, job);
+		TEST_EQ_STR (job->instance_template->string, "$FOO");
+
 		nih_free (job);
 	}
 
@@ -4757,6 +5202,23 @@ test_stanza_instance (void)
 	}
 
 
+	/* Check that a malformed instance pattern is still accepted, and
+	 * left to be reported when it's expanded, without being compiled.
+	 */
+	TEST_FEATURE ("with malformed pattern");
+	strcpy (buf, "instance ${FOO\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_NE_P (job, NULL);
+	TEST_EQ_STR (job->instance, "${FOO");
+	TEST_EQ_P (job->instance_template, NULL);
+
+	nih_free (job);
+
+
 	/* Check that extra arguments to the instance stanza results in
 	 * a syntax error.
 	 */
@@ -4935,6 +5397,147 @@ test_stanza_kill (void)
 	}
 
 
+	/* Check that a kill stanza with the escalate argument and signals
+	 * results in the ladder of signals being stored in the job.
+	 */
+	TEST_FEATURE ("with escalate and multiple arguments");
+	strcpy (buf, "kill escalate INT HUP\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->kill_escalate_len, 2);
+		TEST_ALLOC_PARENT (job->kill_escalate, job);
+		TEST_ALLOC_SIZE (job->kill_escalate, sizeof (int) * 2);
+		TEST_EQ (job->kill_escalate[0], SIGINT);
+		TEST_EQ (job->kill_escalate[1], SIGHUP);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a later kill escalate stanza replaces the ladder given
+	 * by an earlier one rather than adding to it.
+	 */
+	TEST_FEATURE ("with multiple escalate stanzas");
+	strcpy (buf, "kill escalate INT\n");
+	strcat (buf, "kill escalate HUP QUIT\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 3);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->kill_escalate_len, 2);
+		TEST_ALLOC_PARENT (job->kill_escalate, job);
+		TEST_ALLOC_SIZE (job->kill_escalate, sizeof (int) * 2);
+		TEST_EQ (job->kill_escalate[0], SIGHUP);
+		TEST_EQ (job->kill_escalate[1], SIGQUIT);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a kill stanza with the mode argument and tree sets the
+	 * kill mode of the job.
+	 */
+	TEST_FEATURE ("with tree mode");
+	strcpy (buf, "kill mode tree\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->kill_mode, KILL_TREE);
+
+		nih_free (job);
+	}
+
+
+	/* Check that the last of multiple kill mode stanzas is used.
+	 */
+	TEST_FEATURE ("with multiple mode stanzas");
+	strcpy (buf, "kill mode tree\n");
+	strcat (buf, "kill mode group\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 3);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ (job->kill_mode, KILL_GROUP);
+
+		nih_free (job);
+	}
+
+
 	/* Check that a kill stanza without an argument results in a syntax
 	 * error.
 	 */
@@ -5144,27 +5747,141 @@ test_stanza_kill (void)
 	TEST_EQ (pos, 16);
 	TEST_EQ (lineno, 1);
 	nih_free (err);
-}
-
-void
-test_stanza_normal (void)
-{
-	JobClass*job;
-	NihError *err;
-	size_t    pos, lineno;
-	char      buf[1024];
 
-	TEST_FUNCTION ("stanza_normal");
 
-	/* Check that a normal exit stanza with a single argument results in
-	 * the exit code given being added to the normalexit array, which
-	 * should be allocated.
+	/* Check that a kill escalate stanza without any signals results in
+	 * a syntax error.
 	 */
-	TEST_FEATURE ("with single argument");
-	strcpy (buf, "normal exit 99\n");
+	TEST_FEATURE ("with escalate and missing argument");
+	strcpy (buf, "kill escalate\n");
 
-	TEST_ALLOC_FAIL {
-		pos = 0;
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 13);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a kill escalate stanza with an unknown signal among its
+	 * arguments results in a syntax error.
+	 */
+	TEST_FEATURE ("with escalate and unknown signal argument");
+	strcpy (buf, "kill escalate INT foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_SIGNAL);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a kill escalate stanza with a zero signal results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with escalate and zero signal argument");
+	strcpy (buf, "kill escalate 0\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_SIGNAL);
+	TEST_EQ (pos, 14);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a kill mode stanza without a mode results in a syntax
+	 * error.
+	 */
+	TEST_FEATURE ("with mode and missing argument");
+	strcpy (buf, "kill mode\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 9);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a kill mode stanza with an unknown mode results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with mode and unknown argument");
+	strcpy (buf, "kill mode foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 10);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a kill mode stanza with an extra argument afterwards
+	 * results in a syntax error.
+	 */
+	TEST_FEATURE ("with mode and extra argument");
+	strcpy (buf, "kill mode tree foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNEXPECTED_TOKEN);
+	TEST_EQ (pos, 15);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+}
+
+void
+test_stanza_normal (void)
+{
+	JobClass*job;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("stanza_normal");
+
+	/* Check that a normal exit stanza with a single argument results in
+	 * the exit code given being added to the normalexit array, which
+	 * should be allocated.
+	 */
+	TEST_FEATURE ("with single argument");
+	strcpy (buf, "normal exit 99\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
 		lineno = 1;
 		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
 				 &pos, &lineno);
@@ -7701,6 +8418,562 @@ test_stanza_limit (void)
 	nih_free (err);
 }
 
+void
+test_stanza_cgroup (void)
+{
+	JobClass *job;
+	NihError *err;
+	size_t    pos, lineno;
+	char      buf[1024];
+
+	TEST_FUNCTION ("stanza_cgroup");
+
+	/* Check that the cgroup cpu weight stanza sets the weight written to
+	 * cpu.weight.
+	 */
+	TEST_FEATURE ("with cpu weight");
+	strcpy (buf, "cgroup cpu weight 500\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_CPU_WEIGHT], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_CPU_WEIGHT], "500");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the cgroup cpu quota stanza converts the percentage into
+	 * the microseconds of each period written to cpu.max.
+	 */
+	TEST_FEATURE ("with cpu quota");
+	strcpy (buf, "cgroup cpu quota 150\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_CPU_MAX], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_CPU_MAX], "150000 100000");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the cpu quota may be unlimited, keeping the period.
+	 */
+	TEST_FEATURE ("with unlimited cpu quota");
+	strcpy (buf, "cgroup cpu quota unlimited\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_CPU_MAX], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_CPU_MAX], "max 100000");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the cgroup memory max stanza sets the limit in bytes.
+	 */
+	TEST_FEATURE ("with memory max");
+	strcpy (buf, "cgroup memory max 1048576\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_MEMORY_MAX], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_MEMORY_MAX], "1048576");
+
+		nih_free (job);
+	}
+
+
+	/* Check that memory limits may be given with a binary suffix.
+	 */
+	TEST_FEATURE ("with memory size suffix");
+	strcpy (buf, "cgroup memory high 512M\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_MEMORY_HIGH], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_MEMORY_HIGH], "536870912");
+
+		nih_free (job);
+	}
+
+
+	/* Check that memory limits may be unlimited.
+	 */
+	TEST_FEATURE ("with unlimited memory");
+	strcpy (buf, "cgroup memory max unlimited\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_MEMORY_MAX], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_MEMORY_MAX], "max");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the cgroup io weight stanza sets the weight written to
+	 * io.weight.
+	 */
+	TEST_FEATURE ("with io weight");
+	strcpy (buf, "cgroup io weight 10\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_IO_WEIGHT], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_IO_WEIGHT], "10");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the cgroup pids max stanza sets the process limit.
+	 */
+	TEST_FEATURE ("with pids max");
+	strcpy (buf, "cgroup pids max 64\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 2);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_ALLOC_PARENT (job->cgroup_settings[CGROUP_PIDS_MAX], job);
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_PIDS_MAX], "64");
+
+		nih_free (job);
+	}
+
+
+	/* Check that the last of multiple stanzas for the same setting is
+	 * used, while other settings are left alone.
+	 */
+	TEST_FEATURE ("with multiple stanzas");
+	strcpy (buf, "cgroup pids max 64\n");
+	strcat (buf, "cgroup pids max unlimited\n");
+	strcat (buf, "cgroup cpu weight 200\n");
+
+	TEST_ALLOC_FAIL {
+		pos = 0;
+		lineno = 1;
+		job = parse_job (NULL, NULL, "test", buf, strlen (buf),
+				 &pos, &lineno);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (job, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			continue;
+		}
+
+		TEST_EQ (pos, strlen (buf));
+		TEST_EQ (lineno, 4);
+
+		TEST_ALLOC_SIZE (job, sizeof (JobClass));
+
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_PIDS_MAX], "max");
+		TEST_EQ_STR (job->cgroup_settings[CGROUP_CPU_WEIGHT], "200");
+		TEST_EQ_P (job->cgroup_settings[CGROUP_MEMORY_MAX], NULL);
+
+		nih_free (job);
+	}
+
+
+	/* Check that a weight outside the range the kernel accepts results
+	 * in a syntax error.
+	 */
+	TEST_FEATURE ("with out of range weight");
+	strcpy (buf, "cgroup cpu weight 10001\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a weight may not be unlimited.
+	 */
+	TEST_FEATURE ("with unlimited weight");
+	strcpy (buf, "cgroup io weight unlimited\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a cpu quota of zero results in a syntax error.
+	 */
+	TEST_FEATURE ("with zero cpu quota");
+	strcpy (buf, "cgroup cpu quota 0\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a negative value results in a syntax error.
+	 */
+	TEST_FEATURE ("with negative value");
+	strcpy (buf, "cgroup pids max -1\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 16);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a memory size with an unknown suffix results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with unknown size suffix");
+	strcpy (buf, "cgroup memory max 10X\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a memory size which overflows once scaled results in
+	 * a syntax error.
+	 */
+	TEST_FEATURE ("with too-large memory size");
+	strcpy (buf, "cgroup memory max 20000000000000000T\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 18);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that only memory sizes may be given with a suffix.
+	 */
+	TEST_FEATURE ("with suffix on other value");
+	strcpy (buf, "cgroup pids max 1K\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, PARSE_ILLEGAL_CGROUP);
+	TEST_EQ (pos, 16);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that an unknown setting of a known controller results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with unknown setting");
+	strcpy (buf, "cgroup cpu foo 1\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 7);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that an unknown controller results in a syntax error.
+	 */
+	TEST_FEATURE ("with unknown controller");
+	strcpy (buf, "cgroup foo max 1\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	TEST_EQ (pos, 7);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a cgroup stanza without a value results in a syntax
+	 * error.
+	 */
+	TEST_FEATURE ("with missing value");
+	strcpy (buf, "cgroup cpu weight\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 17);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a cgroup stanza with only a controller results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with missing setting");
+	strcpy (buf, "cgroup cpu\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 10);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a cgroup stanza without arguments results in a syntax
+	 * error.
+	 */
+	TEST_FEATURE ("with missing controller");
+	strcpy (buf, "cgroup\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_EXPECTED_TOKEN);
+	TEST_EQ (pos, 6);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+
+
+	/* Check that a cgroup stanza with an extra argument results in a
+	 * syntax error.
+	 */
+	TEST_FEATURE ("with extra argument");
+	strcpy (buf, "cgroup cpu weight 100 foo\n");
+
+	pos = 0;
+	lineno = 1;
+	job = parse_job (NULL, NULL, "test", buf, strlen (buf), &pos, &lineno);
+
+	TEST_EQ_P (job, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNEXPECTED_TOKEN);
+	TEST_EQ (pos, 22);
+	TEST_EQ (lineno, 1);
+	nih_free (err);
+}
+
 void
 test_stanza_chroot (void)
 {
@@ -7938,6 +9211,8 @@ main (int   argc,
       char *argv[])
 {
 	test_parse_job ();
+	test_parse_job_header ();
+	test_parse_job_deferred ();
 
 	test_stanza_instance ();
 
@@ -7974,6 +9249,7 @@ main (int   argc,
 	test_stanza_nice ();
 	test_stanza_oom ();
 	test_stanza_limit ();
+	test_stanza_cgroup ();
 	test_stanza_chroot ();
 	test_stanza_chdir ();
 
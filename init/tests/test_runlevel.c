@@ -0,0 +1,339 @@
+/* upstart
+ *
+ * test_runlevel.c - test suite for init/runlevel.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/main.h>
+#include <nih/error.h>
+
+#include "event.h"
+#include "runlevel.h"
+
+
+void
+test_event (void)
+{
+	char   filename[PATH_MAX];
+	Event *event;
+	FILE  *state;
+	FILE  *output;
+
+	TEST_FUNCTION ("runlevel_event");
+	program_name = "test";
+	output = tmpfile ();
+
+	/* Check that a runlevel event records both the runlevel and the
+	 * previous runlevel from its environment.
+	 */
+	TEST_FEATURE ("with runlevel and previous runlevel");
+	runlevel_current = 'N';
+	runlevel_previous = 'N';
+
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=2"));
+	assert (nih_str_array_add (&event->env, event, NULL, "PREVLEVEL=S"));
+
+	TEST_TRUE (runlevel_event (event));
+
+	TEST_EQ (runlevel_current, '2');
+	TEST_EQ (runlevel_previous, 'S');
+
+	nih_free (event);
+
+
+	/* Check that when the event has no previous runlevel, the runlevel
+	 * we had before becomes the previous one.
+	 */
+	TEST_FEATURE ("without previous runlevel");
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=3"));
+
+	TEST_TRUE (runlevel_event (event));
+
+	TEST_EQ (runlevel_current, '3');
+	TEST_EQ (runlevel_previous, '2');
+
+	nih_free (event);
+
+
+	/* Check that a runlevel event without a runlevel is ignored.
+	 */
+	TEST_FEATURE ("with no runlevel");
+	event = event_new (NULL, "runlevel", NULL);
+
+	TEST_FALSE (runlevel_event (event));
+
+	TEST_EQ (runlevel_current, '3');
+	TEST_EQ (runlevel_previous, '2');
+
+	nih_free (event);
+
+
+	/* Check that other events are ignored, even with the same
+	 * environment.
+	 */
+	TEST_FEATURE ("with other event");
+	event = event_new (NULL, "wibble", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=5"));
+
+	TEST_FALSE (runlevel_event (event));
+
+	TEST_EQ (runlevel_current, '3');
+	TEST_EQ (runlevel_previous, '2');
+
+	nih_free (event);
+
+
+	/* Check that the runlevels are written to the state file when
+	 * one is set.
+	 */
+	TEST_FEATURE ("with state file");
+	TEST_FILENAME (filename);
+	runlevel_state = filename;
+
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=0"));
+	assert (nih_str_array_add (&event->env, event, NULL, "PREVLEVEL=3"));
+
+	TEST_TRUE (runlevel_event (event));
+
+	state = fopen (filename, "r");
+	TEST_NE_P (state, NULL);
+	TEST_FILE_EQ (state, "3 0\n");
+	TEST_FILE_END (state);
+	fclose (state);
+
+	nih_free (event);
+
+	unlink (filename);
+	runlevel_state = NULL;
+
+
+	/* Check that failing to write the state file doesn't stop the
+	 * runlevel being recorded, and that a warning is logged.
+	 */
+	TEST_FEATURE ("with unwritable state file");
+	runlevel_state = "/nonexistent/runlevel";
+
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=6"));
+	assert (nih_str_array_add (&event->env, event, NULL, "PREVLEVEL=0"));
+
+	TEST_DIVERT_STDERR (output) {
+		TEST_TRUE (runlevel_event (event));
+	}
+	rewind (output);
+
+	TEST_FILE_EQ (output, ("test: /nonexistent/runlevel: "
+			       "Unable to write runlevel state: "
+			       "No such file or directory\n"));
+	TEST_FILE_END (output);
+	TEST_FILE_RESET (output);
+
+	TEST_EQ (runlevel_current, '6');
+	TEST_EQ (runlevel_previous, '0');
+
+	nih_free (event);
+
+	runlevel_state = NULL;
+	runlevel_current = 'N';
+	runlevel_previous = 'N';
+
+	fclose (output);
+}
+
+
+void
+test_write (void)
+{
+	char         filename[PATH_MAX];
+	char         tmpname[PATH_MAX + 4];
+	struct stat  statbuf;
+	FILE        *state;
+	NihError    *error;
+	int          ret;
+
+	TEST_FUNCTION ("runlevel_write");
+	TEST_FILENAME (filename);
+	sprintf (tmpname, "%s.new", filename);
+
+	/* Check that the runlevels are written to the file in the format
+	 * of the runlevel command, and that the temporary file is gone.
+	 */
+	TEST_FEATURE ("with new file");
+	TEST_ALLOC_FAIL {
+		runlevel_current = '2';
+		runlevel_previous = 'S';
+
+		ret = runlevel_write (filename);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+
+			error = nih_error_get ();
+			TEST_EQ (error->number, ENOMEM);
+			nih_free (error);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		state = fopen (filename, "r");
+		TEST_NE_P (state, NULL);
+		TEST_FILE_EQ (state, "S 2\n");
+		TEST_FILE_END (state);
+		fclose (state);
+
+		TEST_LT (stat (tmpname, &statbuf), 0);
+		TEST_EQ (errno, ENOENT);
+
+		unlink (filename);
+	}
+
+
+	/* Check that an existing file is replaced.
+	 */
+	TEST_FEATURE ("with existing file");
+	state = fopen (filename, "w");
+	fprintf (state, "wibble wobble\n");
+	fclose (state);
+
+	runlevel_current = '5';
+	runlevel_previous = '2';
+
+	ret = runlevel_write (filename);
+
+	TEST_EQ (ret, 0);
+
+	state = fopen (filename, "r");
+	TEST_NE_P (state, NULL);
+	TEST_FILE_EQ (state, "2 5\n");
+	TEST_FILE_END (state);
+	fclose (state);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the file can't be written.
+	 */
+	TEST_FEATURE ("with missing directory");
+	ret = runlevel_write ("/nonexistent/runlevel");
+
+	TEST_LT (ret, 0);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENOENT);
+	nih_free (error);
+
+	runlevel_current = 'N';
+	runlevel_previous = 'N';
+}
+
+
+void
+test_restore (void)
+{
+	char      filename[PATH_MAX];
+	FILE     *state;
+	NihError *error;
+	int       ret;
+
+	TEST_FUNCTION ("runlevel_restore");
+	TEST_FILENAME (filename);
+
+	/* Check that the runlevels are read back from a file written by
+	 * runlevel_write().
+	 */
+	TEST_FEATURE ("with state file");
+	runlevel_current = '3';
+	runlevel_previous = '2';
+
+	assert0 (runlevel_write (filename));
+
+	runlevel_current = 'N';
+	runlevel_previous = 'N';
+
+	ret = runlevel_restore (filename);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (runlevel_current, '3');
+	TEST_EQ (runlevel_previous, '2');
+
+	unlink (filename);
+
+
+	/* Check that a malformed file raises an error and leaves the
+	 * runlevels alone.
+	 */
+	TEST_FEATURE ("with malformed file");
+	state = fopen (filename, "w");
+	fprintf (state, "wibble\n");
+	fclose (state);
+
+	ret = runlevel_restore (filename);
+
+	TEST_LT (ret, 0);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, EINVAL);
+	nih_free (error);
+
+	TEST_EQ (runlevel_current, '3');
+	TEST_EQ (runlevel_previous, '2');
+
+	unlink (filename);
+
+
+	/* Check that a missing file raises an error.
+	 */
+	TEST_FEATURE ("with missing file");
+	ret = runlevel_restore (filename);
+
+	TEST_LT (ret, 0);
+
+	error = nih_error_get ();
+	TEST_EQ (error->number, ENOENT);
+	nih_free (error);
+
+	runlevel_current = 'N';
+	runlevel_previous = 'N';
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_event ();
+	test_write ();
+	test_restore ();
+
+	return 0;
+}
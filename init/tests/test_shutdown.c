@@ -0,0 +1,355 @@
+/* upstart
+ *
+ * test_shutdown.c - test suite for init/shutdown.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/tree.h>
+#include <nih/timer.h>
+#include <nih/error.h>
+
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "shutdown.h"
+
+
+/**
+ * stop_on_job:
+ * @class: class to set stop events of,
+ * @name: event name,
+ * @arg: first argument to match or NULL.
+ *
+ * Sets the stop events of @class to a single @name event, with @arg as
+ * its first argument.
+ **/
+static void
+stop_on_job (JobClass   *class,
+	     const char *name,
+	     const char *arg)
+{
+	char **env = NULL;
+
+	if (arg) {
+		env = nih_str_array_new (NULL);
+		assert (nih_str_array_add (&env, NULL, NULL, arg));
+	}
+
+	class->stop_on = event_operator_new (class, EVENT_MATCH, name, env);
+	assert (class->stop_on);
+
+	if (env)
+		nih_unref (env, NULL);
+}
+
+
+void
+test_event (void)
+{
+	Event *event;
+
+	TEST_FUNCTION ("shutdown_event");
+
+	/* Check that the runlevel event for runlevel 0 begins a shutdown.
+	 */
+	TEST_FEATURE ("with runlevel 0");
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=0"));
+	assert (nih_str_array_add (&event->env, event, NULL, "PREVLEVEL=2"));
+
+	TEST_TRUE (shutdown_event (event));
+
+	nih_free (event);
+
+
+	/* Check that the runlevel event for runlevel 6 begins a shutdown.
+	 */
+	TEST_FEATURE ("with runlevel 6");
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=6"));
+
+	TEST_TRUE (shutdown_event (event));
+
+	nih_free (event);
+
+
+	/* Check that the runlevel event for other runlevels does not begin
+	 * a shutdown.
+	 */
+	TEST_FEATURE ("with runlevel 2");
+	event = event_new (NULL, "runlevel", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=2"));
+
+	TEST_FALSE (shutdown_event (event));
+
+	nih_free (event);
+
+
+	/* Check that a runlevel event without a runlevel does not begin
+	 * a shutdown.
+	 */
+	TEST_FEATURE ("with no runlevel");
+	event = event_new (NULL, "runlevel", NULL);
+
+	TEST_FALSE (shutdown_event (event));
+
+	nih_free (event);
+
+
+	/* Check that other events do not begin a shutdown, even with the
+	 * same environment.
+	 */
+	TEST_FEATURE ("with other event");
+	event = event_new (NULL, "wibble", NULL);
+	assert (nih_str_array_add (&event->env, event, NULL, "RUNLEVEL=0"));
+
+	TEST_FALSE (shutdown_event (event));
+
+	nih_free (event);
+}
+
+
+void
+test_operator_references (void)
+{
+	JobClass *class;
+
+	TEST_FUNCTION ("shutdown_operator_references");
+	class = job_class_new (NULL, "test");
+
+	/* Check that a job event naming the job by its first argument
+	 * refers to it, and not to other jobs.
+	 */
+	TEST_FEATURE ("with positional job name");
+	stop_on_job (class, "stopping", "foo");
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "foo"));
+	TEST_FALSE (shutdown_operator_references (class->stop_on, "bar"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that a job event naming the job by the JOB variable
+	 * refers to it.
+	 */
+	TEST_FEATURE ("with named job variable");
+	stop_on_job (class, "stopped", "JOB=foo");
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "foo"));
+	TEST_FALSE (shutdown_operator_references (class->stop_on, "bar"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that a job name pattern refers to any job it matches.
+	 */
+	TEST_FEATURE ("with job name pattern");
+	stop_on_job (class, "stopping", "f*");
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "foo"));
+	TEST_FALSE (shutdown_operator_references (class->stop_on, "bar"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that a job event without arguments refers to every job.
+	 */
+	TEST_FEATURE ("with no job name");
+	stop_on_job (class, "stopping", NULL);
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "foo"));
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "bar"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that a negated job name refers to every job.
+	 */
+	TEST_FEATURE ("with negated job name");
+	stop_on_job (class, "stopping", "JOB!=foo");
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, "bar"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that other events don't refer to any job.
+	 */
+	TEST_FEATURE ("with other event");
+	stop_on_job (class, "wibble", "foo");
+
+	TEST_FALSE (shutdown_operator_references (class->stop_on, "foo"));
+
+	nih_free (class->stop_on);
+
+
+	/* Check that a NULL name looks for the runlevel event.
+	 */
+	TEST_FEATURE ("with runlevel event");
+	stop_on_job (class, "runlevel", "[06]");
+
+	TEST_TRUE (shutdown_operator_references (class->stop_on, NULL));
+	TEST_FALSE (shutdown_operator_references (class->stop_on, "foo"));
+
+	nih_free (class->stop_on);
+
+	nih_free (class);
+}
+
+
+void
+test_begin (void)
+{
+	JobClass *class1, *class2, *class3, *class4;
+	Job      *job1, *job2, *job3, *job4;
+	pid_t     pid;
+	int       status;
+
+	TEST_FUNCTION ("shutdown_begin");
+	job_class_init ();
+
+	class1 = job_class_new (NULL, "foo");
+	nih_hash_add (job_classes, &class1->entry);
+
+	class2 = job_class_new (NULL, "bar");
+	stop_on_job (class2, "stopping", "baz");
+	nih_hash_add (job_classes, &class2->entry);
+
+	class3 = job_class_new (NULL, "baz");
+	nih_hash_add (job_classes, &class3->entry);
+
+	class4 = job_class_new (NULL, "rc");
+	class4->task = TRUE;
+	nih_hash_add (job_classes, &class4->entry);
+
+	job1 = job_new (class1, "");
+	job1->goal = JOB_START;
+	job1->state = JOB_RUNNING;
+
+	job2 = job_new (class2, "");
+	job2->goal = JOB_START;
+	job2->state = JOB_RUNNING;
+
+	job3 = job_new (class3, "");
+	job3->goal = JOB_START;
+	job3->state = JOB_RUNNING;
+
+	job4 = job_new (class4, "");
+	job4->goal = JOB_START;
+	job4->state = JOB_RUNNING;
+
+
+	/* Check that nothing is stopped when no shutdown deadline is set.
+	 */
+	TEST_FEATURE ("without deadline");
+	shutdown_deadline = 0;
+
+	shutdown_begin ();
+
+	TEST_EQ (job1->goal, JOB_START);
+	TEST_EQ (job2->goal, JOB_START);
+	TEST_EQ (job3->goal, JOB_START);
+	TEST_EQ (job4->goal, JOB_START);
+
+	TEST_EQ_P (shutdown_timer, NULL);
+
+
+	/* Check that a service with no stop ordering dependency on any
+	 * other job is stopped, while services that refer to each other
+	 * in their stop events and tasks are left alone; the deadline
+	 * timer should be started.
+	 */
+	TEST_FEATURE ("with independent and dependent jobs");
+	shutdown_deadline = 10;
+
+	shutdown_begin ();
+
+	TEST_EQ (job1->goal, JOB_STOP);
+	TEST_EQ (job1->state, JOB_STOPPING);
+	TEST_EQ (job2->goal, JOB_START);
+	TEST_EQ (job3->goal, JOB_START);
+	TEST_EQ (job4->goal, JOB_START);
+
+	TEST_NE_P (shutdown_timer, NULL);
+	TEST_EQ (shutdown_timer->timeout, 10);
+
+
+	/* Check that the deadline timer kills any process of a job that
+	 * is still stopping, but leaves those of other jobs alone.
+	 */
+	TEST_FEATURE ("with deadline reached");
+	TEST_CHILD (job1->pid[PROCESS_MAIN]) {
+		pause ();
+	}
+
+	TEST_CHILD (job4->pid[PROCESS_MAIN]) {
+		pause ();
+	}
+
+	shutdown_timer->callback (shutdown_timer->data, shutdown_timer);
+
+	TEST_EQ_P (shutdown_timer, NULL);
+
+	waitpid (job1->pid[PROCESS_MAIN], &status, 0);
+	TEST_TRUE (WIFSIGNALED (status));
+	TEST_EQ (WTERMSIG (status), SIGKILL);
+
+	pid = waitpid (job4->pid[PROCESS_MAIN], &status, WNOHANG);
+	TEST_EQ (pid, 0);
+
+	kill (job4->pid[PROCESS_MAIN], SIGTERM);
+	waitpid (job4->pid[PROCESS_MAIN], &status, 0);
+
+	job1->pid[PROCESS_MAIN] = 0;
+	job4->pid[PROCESS_MAIN] = 0;
+
+	NIH_LIST_FOREACH_SAFE (events, iter)
+		nih_free (iter);
+
+	nih_free (class1);
+	nih_free (class2);
+	nih_free (class3);
+	nih_free (class4);
+
+	shutdown_deadline = 0;
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_event ();
+	test_operator_references ();
+	test_begin ();
+
+	return 0;
+}
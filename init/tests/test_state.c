@@ -0,0 +1,395 @@
+/* upstart
+ *
+ * test_state.c - test suite for init/state.c
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/main.h>
+#include <nih/error.h>
+
+#include "process.h"
+#include "job_class.h"
+#include "job.h"
+#include "event.h"
+#include "event_operator.h"
+#include "blocked.h"
+#include "conf.h"
+#include "state.h"
+#include "errors.h"
+
+
+/**
+ * new_class:
+ *
+ * Creates and registers a job class named foo that starts on the wibble
+ * event, as its configuration would be parsed.
+ *
+ * Returns: new class.
+ **/
+static JobClass *
+new_class (void)
+{
+	JobClass *class;
+
+	class = job_class_new (NULL, "foo");
+	assert (class);
+
+	class->start_on = event_operator_new (class, EVENT_MATCH,
+					      "wibble", NULL);
+	assert (class->start_on);
+
+	nih_hash_add (job_classes, &class->entry);
+
+	return class;
+}
+
+/**
+ * reset_state:
+ *
+ * Frees every configuration source, job class and event.
+ **/
+static void
+reset_state (void)
+{
+	NIH_LIST_FOREACH_SAFE (conf_sources, iter)
+		nih_free (iter);
+
+	NIH_HASH_FOREACH_SAFE (job_classes, iter)
+		nih_free (iter);
+
+	NIH_LIST_FOREACH_SAFE (events, iter)
+		nih_free (iter);
+}
+
+
+void
+test_write_read (void)
+{
+	char        filename[PATH_MAX];
+	char        dirname[PATH_MAX];
+	ConfSource *source;
+	JobClass   *class;
+	Job        *job;
+	Event      *event1, *event2;
+	Blocked    *blocked;
+	NihError   *err;
+	FILE       *output;
+	FILE       *state;
+	int         fd;
+	int         ret;
+
+	TEST_FUNCTION ("state_read");
+	program_name = "test";
+	output = tmpfile ();
+
+	conf_init ();
+	event_init ();
+	job_class_init ();
+
+	TEST_FILENAME (filename);
+	TEST_FILENAME (dirname);
+
+
+	/* Check that the state written can be read back again, with the
+	 * configuration sources, the events, the start events matched by
+	 * each class and each job restored along with the references
+	 * between them.
+	 */
+	TEST_FEATURE ("with events and jobs");
+	source = conf_source_new (NULL, dirname, CONF_JOB_DIR);
+	assert (source);
+
+	class = new_class ();
+
+	event1 = event_new (NULL, "wibble", NULL);
+	assert (nih_str_array_add (&event1->env, event1, NULL, "FOO=BAR"));
+	event1->progress = EVENT_HANDLING;
+
+	class->start_on->value = TRUE;
+	class->start_on->event = event1;
+	event_block (event1);
+
+	job = job_new (class, "");
+	job->goal = JOB_START;
+	job->state = JOB_STARTING;
+	job->pid[PROCESS_MAIN] = 1234;
+
+	job->env = nih_str_array_new (job);
+	assert (nih_str_array_add (&job->env, job, NULL, "FOO=BAR"));
+	assert (nih_str_array_add (&job->env, job, NULL, "BAZ=a b\nc"));
+
+	blocked = blocked_new (job, BLOCKED_EVENT, event1);
+	nih_list_add (&job->blocking, &blocked->entry);
+	event_block (event1);
+
+	event2 = event_new (NULL, "starting", NULL);
+	job->blocker = event2;
+
+	blocked = blocked_new (event2, BLOCKED_JOB, job);
+	nih_list_add (&event2->blocking, &blocked->entry);
+
+	fd = open (filename, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	assert (fd >= 0);
+
+	ret = state_write (fd);
+
+	TEST_EQ (ret, 0);
+
+	reset_state ();
+	class = new_class ();
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	ret = state_read (fd);
+
+	TEST_EQ (ret, 0);
+
+	TEST_LIST_NOT_EMPTY (conf_sources);
+	source = (ConfSource *)conf_sources->next;
+	TEST_EQ_STR (source->path, dirname);
+	TEST_EQ (source->type, CONF_JOB_DIR);
+	TEST_EQ_P (source->entry.next, conf_sources);
+
+	TEST_LIST_NOT_EMPTY (events);
+
+	event1 = (Event *)events->next;
+	TEST_EQ_STR (event1->name, "wibble");
+	TEST_EQ_STR (event1->env[0], "FOO=BAR");
+	TEST_EQ_P (event1->env[1], NULL);
+	TEST_EQ (event1->progress, EVENT_HANDLING);
+	TEST_EQ (event1->blockers, 2);
+
+	event2 = (Event *)event1->entry.next;
+	TEST_EQ_STR (event2->name, "starting");
+	TEST_EQ (event2->progress, EVENT_PENDING);
+	TEST_EQ (event2->blockers, 0);
+	TEST_EQ_P (event2->entry.next, events);
+
+	TEST_EQ (class->start_on->value, TRUE);
+	TEST_EQ_P (class->start_on->event, event1);
+
+	job = (Job *)nih_hash_lookup (class->instances, "");
+	TEST_NE_P (job, NULL);
+	TEST_EQ (job->goal, JOB_START);
+	TEST_EQ (job->state, JOB_STARTING);
+	TEST_EQ (job->pid[PROCESS_MAIN], 1234);
+	TEST_EQ (job->pid[PROCESS_PRE_START], 0);
+
+	TEST_ALLOC_PARENT (job->env, job);
+	TEST_EQ_STR (job->env[0], "FOO=BAR");
+	TEST_EQ_STR (job->env[1], "BAZ=a b\nc");
+	TEST_EQ_P (job->env[2], NULL);
+	TEST_EQ_P (job->start_env, NULL);
+
+	TEST_EQ_P (job->blocker, event2);
+
+	TEST_LIST_NOT_EMPTY (&job->blocking);
+	blocked = (Blocked *)job->blocking.next;
+	TEST_EQ (blocked->type, BLOCKED_EVENT);
+	TEST_EQ_P (blocked->event, event1);
+	TEST_EQ_P (blocked->entry.next, &job->blocking);
+
+	TEST_LIST_NOT_EMPTY (&event2->blocking);
+	blocked = (Blocked *)event2->blocking.next;
+	TEST_EQ (blocked->type, BLOCKED_JOB);
+	TEST_EQ_P (blocked->job, job);
+
+	TEST_EQ_P (job->kill_timer, NULL);
+	TEST_EQ_P (job->respawn_timer, NULL);
+
+	reset_state ();
+
+
+	/* Check that a job whose class no longer exists is dropped with a
+	 * warning, along with the references it held to events.
+	 */
+	TEST_FEATURE ("with unknown job class");
+	class = new_class ();
+
+	event1 = event_new (NULL, "wibble", NULL);
+
+	job = job_new (class, "");
+	job->goal = JOB_START;
+	job->state = JOB_RUNNING;
+
+	blocked = blocked_new (job, BLOCKED_EVENT, event1);
+	nih_list_add (&job->blocking, &blocked->entry);
+	event_block (event1);
+
+	fd = open (filename, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	assert (fd >= 0);
+
+	ret = state_write (fd);
+
+	TEST_EQ (ret, 0);
+
+	reset_state ();
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	TEST_DIVERT_STDERR (output) {
+		ret = state_read (fd);
+	}
+	rewind (output);
+
+	TEST_EQ (ret, 0);
+
+	TEST_FILE_EQ (output, "test: Unable to restore foo job instance \"\"\n");
+	TEST_FILE_END (output);
+	TEST_FILE_RESET (output);
+
+	TEST_LIST_NOT_EMPTY (events);
+	event1 = (Event *)events->next;
+	TEST_EQ_STR (event1->name, "wibble");
+	TEST_EQ (event1->blockers, 0);
+
+	TEST_HASH_EMPTY (job_classes);
+
+	reset_state ();
+
+
+	/* Check that state written by a different version is refused.
+	 */
+	TEST_FEATURE ("with different version");
+	state = fopen (filename, "w");
+	fprintf (state, "upstart-state %d\nend\n", STATE_VERSION + 1);
+	fclose (state);
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	ret = state_read (fd);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, STATE_INVALID);
+	nih_free (err);
+
+	TEST_LIST_EMPTY (events);
+
+
+	/* Check that state cut short before its end is refused, though
+	 * whatever was read before is kept.
+	 */
+	TEST_FEATURE ("with truncated state");
+	state = fopen (filename, "w");
+	fprintf (state, "upstart-state %d\n", STATE_VERSION);
+	fprintf (state, "event 6:wibble - 0 0 0\n");
+	fprintf (state, "job 3:foo");
+	fclose (state);
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	ret = state_read (fd);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, STATE_INVALID);
+	nih_free (err);
+
+	TEST_LIST_NOT_EMPTY (events);
+	event1 = (Event *)events->next;
+	TEST_EQ_STR (event1->name, "wibble");
+	TEST_EQ_P (event1->env, NULL);
+
+	reset_state ();
+
+
+	/* Check that state cut short after the configuration sources, but
+	 * before they were parsed, doesn't leave those sources behind so
+	 * that the usual ones may be created instead.
+	 */
+	TEST_FEATURE ("with state truncated after sources");
+	state = fopen (filename, "w");
+	fprintf (state, "upstart-state %d\n", STATE_VERSION);
+	fprintf (state, "source %zu:%s %d\n", strlen (dirname), dirname,
+		 CONF_JOB_DIR);
+	fclose (state);
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	ret = state_read (fd);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, STATE_INVALID);
+	nih_free (err);
+
+	TEST_LIST_EMPTY (conf_sources);
+
+	reset_state ();
+
+
+	/* Check that a string with an impossible length is refused rather
+	 * than allocated.
+	 */
+	TEST_FEATURE ("with overlong string");
+	state = fopen (filename, "w");
+	fprintf (state, "upstart-state %d\n", STATE_VERSION);
+	fprintf (state, "event %zu:wibble - 0 0 0\n", (size_t)-1);
+	fprintf (state, "end\n");
+	fclose (state);
+
+	fd = open (filename, O_RDONLY);
+	assert (fd >= 0);
+
+	ret = state_read (fd);
+
+	TEST_LT (ret, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, STATE_INVALID);
+	nih_free (err);
+
+	TEST_LIST_EMPTY (events);
+
+	reset_state ();
+
+	fclose (output);
+	unlink (filename);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_write_read ();
+
+	return 0;
+}
@@ -24,8 +24,12 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <signal.h>
 #include <unistd.h>
 
+#include <nih/macros.h>
+#include <nih/alloc.h>
+
 #include "system.h"
 
 
@@ -129,11 +133,91 @@ test_kill (void)
 }
 
 
+void
+test_descendants (void)
+{
+	pid_t  pid1, pid2, pid3, *pids;
+	size_t len;
+	int    fds[2], status;
+
+	TEST_FUNCTION ("system_descendants");
+
+	/* Check that a process without children has no descendants.
+	 */
+	TEST_FEATURE ("with no children");
+	TEST_CHILD (pid1) {
+		pause ();
+	}
+
+	len = 1;
+	pids = system_descendants (NULL, pid1, &len);
+
+	TEST_NE_P (pids, NULL);
+	TEST_ALLOC_SIZE (pids, sizeof (pid_t));
+	TEST_EQ (len, 0);
+
+	nih_free (pids);
+
+	kill (pid1, SIGTERM);
+	waitpid (pid1, &status, 0);
+
+
+	/* Check that the children of a process are found along with their
+	 * own children, even where those have left the process group and
+	 * session of their parent.
+	 */
+	TEST_FEATURE ("with children and grandchildren");
+	assert0 (pipe (fds));
+	TEST_CHILD (pid1) {
+		close (fds[0]);
+
+		pid2 = fork ();
+		if (pid2 == 0) {
+			pid3 = fork ();
+			if (pid3 == 0) {
+				setsid ();
+				for (;;)
+					pause ();
+			}
+
+			assert (write (fds[1], &pid3, sizeof pid3)
+				== sizeof pid3);
+			for (;;)
+				pause ();
+		}
+
+		assert (write (fds[1], &pid2, sizeof pid2) == sizeof pid2);
+		for (;;)
+			pause ();
+	}
+
+	close (fds[1]);
+	assert (read (fds[0], &pid2, sizeof pid2) == sizeof pid2);
+	assert (read (fds[0], &pid3, sizeof pid3) == sizeof pid3);
+	close (fds[0]);
+
+	pids = system_descendants (NULL, pid1, &len);
+
+	TEST_NE_P (pids, NULL);
+	TEST_EQ (len, 2);
+	TEST_TRUE (((pids[0] == pid2) && (pids[1] == pid3))
+		   || ((pids[0] == pid3) && (pids[1] == pid2)));
+
+	nih_free (pids);
+
+	kill (pid3, SIGKILL);
+	kill (pid2, SIGKILL);
+	kill (pid1, SIGKILL);
+	waitpid (pid1, &status, 0);
+}
+
+
 int
 main (int   argc,
       char *argv[])
 {
 	test_kill ();
+	test_descendants ();
 
 	return 0;
 }
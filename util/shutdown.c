@@ -29,6 +29,7 @@
 #include <sys/param.h>
 
 #include <pwd.h>
+#include <poll.h>
 #include <time.h>
 #include <utmpx.h>
 #include <fcntl.h>
@@ -71,6 +72,14 @@
  **/
 #define DEV "/dev"
 
+/**
+ * WALL_TIMEOUT:
+ *
+ * Number of seconds we spend writing a message to all logged in users
+ * before giving up on any terminals that haven't taken it.
+ **/
+#define WALL_TIMEOUT 2
+
 /**
  * DEV_INITCTL:
  *
@@ -93,6 +102,8 @@ static void  timer_callback    (const char *message);
 static char *warning_message   (const char *message)
 	__attribute__ ((warn_unused_result));
 static void  wall              (const char *message);
+static size_t wall_write       (struct pollfd *fds, size_t nfds,
+				const char *text);
 static void  sysvinit_shutdown (void);
 
 
@@ -664,13 +675,17 @@ alarm_handler (int signum)
  * @message: message to send.
  *
  * Send a message to all logged in users; based largely on the code from
- * bsdutils.  This is done in a child process to stop anything blocking.
+ * bsdutils.  This is done in a child process to stop anything blocking,
+ * and the terminals are written to together so that a slow or hung
+ * terminal only delays its own user, never longer than WALL_TIMEOUT.
  **/
 static void
 wall (const char *message)
 {
-	struct sigaction act;
 	struct utmpx *   ent;
+	struct pollfd *  fds = NULL;
+	size_t           nfds = 0;
+	size_t           reached;
 	pid_t            pid;
 	time_t           now;
 	struct tm *      tm;
@@ -679,6 +694,7 @@ wall (const char *message)
 	char             hostname[MAXHOSTNAMELEN];
 	char *           banner1;
 	char *           banner2;
+	char *           text;
 
 	pid = fork ();
 	if (pid < 0) {
@@ -689,12 +705,6 @@ wall (const char *message)
 		return;
 	}
 
-	/* Break syscalls with SIGALRM */
-	act.sa_handler = alarm_handler;
-	act.sa_flags = 0;
-	sigemptyset (&act.sa_mask);
-	sigaction (SIGALRM, &act, NULL);
-
 
 	/* Get username for banner */
 	user = getlogin ();
@@ -733,7 +743,13 @@ wall (const char *message)
 			       tty, tm->tm_hour, tm->tm_min);
 
 
-	/* Iterate entries in the utmp file */
+	/* Construct the text once for every terminal */
+	text = NIH_MUST (nih_sprintf (NULL, "\007\r\n%s\r\n\t%s\r\n\r\n%s",
+				      banner1, banner2, message));
+
+	/* Open the terminal of every logged in user without blocking, so
+	 * that one hung terminal can't hold up the others.
+	 */
 	setutxent ();
 	while ((ent = getutxent ()) != NULL) {
 		char dev[PATH_MAX + 1];
@@ -752,24 +768,31 @@ wall (const char *message)
 			snprintf (dev, sizeof (dev), "%s", ent->ut_line);
 		}
 
-		alarm (2);
-		fd = open (dev, O_WRONLY | O_NDELAY | O_NOCTTY);
-		if ((fd >= 0) && isatty (fd)) {
-			FILE *term;
-
-			term = fdopen (fd, "w");
-			if (term) {
-				fprintf (term, "\007\r\n%s\r\n\t%s\r\n\r\n",
-					 banner1, banner2);
-				fputs (message, term);
-				fflush (term);
-				fclose (term);
-			}
+		fd = open (dev, O_WRONLY | O_NONBLOCK | O_NOCTTY);
+		if (fd < 0)
+			continue;
+
+		if (! isatty (fd)) {
+			close (fd);
+			continue;
 		}
-		alarm (0);
+
+		fds = NIH_MUST (nih_realloc (fds, NULL,
+					     sizeof (struct pollfd) * (nfds + 1)));
+		fds[nfds].fd = fd;
+		fds[nfds].events = POLLOUT;
+		fds[nfds].revents = 0;
+		nfds++;
 	}
 	endutxent ();
 
+	reached = wall_write (fds, nfds, text);
+	nih_info (_("Message sent to %zu of %zu terminals"), reached, nfds);
+
+	if (fds)
+		nih_free (fds);
+	nih_free (text);
+
 	nih_free (banner1);
 	nih_free (banner2);
 
@@ -777,6 +800,114 @@ wall (const char *message)
 }
 
 
+/**
+ * wall_write:
+ * @fds: open terminals,
+ * @nfds: number of entries in @fds,
+ * @text: text to write.
+ *
+ * Write @text to each of the non-blocking terminals in @fds together,
+ * polling for those that can't take it all at once, until every terminal
+ * has been written to or WALL_TIMEOUT has passed.  Each terminal is
+ * closed once it is finished with.
+ *
+ * Returns: number of terminals that received the whole of @text.
+ **/
+static size_t
+wall_write (struct pollfd *fds,
+	    size_t         nfds,
+	    const char *   text)
+{
+	struct timespec now;
+	size_t          len;
+	size_t *        offset;
+	size_t          pending;
+	size_t          reached = 0;
+	long            deadline;
+
+	nih_assert (text != NULL);
+
+	if (! nfds)
+		return 0;
+
+	nih_assert (fds != NULL);
+
+	len = strlen (text);
+	offset = NIH_MUST (nih_alloc (NULL, sizeof (size_t) * nfds));
+	memset (offset, 0, sizeof (size_t) * nfds);
+
+	nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+	deadline = (now.tv_sec + WALL_TIMEOUT) * 1000 + now.tv_nsec / 1000000;
+
+	pending = nfds;
+	while (pending) {
+		long remaining;
+
+		/* Write as much as each ready terminal will take; on the
+		 * first pass every terminal is assumed ready.
+		 */
+		for (size_t i = 0; i < nfds; i++) {
+			ssize_t ret;
+
+			if (fds[i].fd < 0)
+				continue;
+
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				close (fds[i].fd);
+				fds[i].fd = -1;
+				pending--;
+				continue;
+			}
+
+			while (offset[i] < len) {
+				ret = write (fds[i].fd, text + offset[i],
+					     len - offset[i]);
+				if (ret > 0) {
+					offset[i] += ret;
+				} else if ((ret < 0) && (errno == EINTR)) {
+					continue;
+				} else {
+					break;
+				}
+			}
+
+			if (offset[i] == len) {
+				reached++;
+			} else if ((errno == EAGAIN)
+				   || (errno == EWOULDBLOCK)) {
+				continue;
+			}
+
+			close (fds[i].fd);
+			fds[i].fd = -1;
+			pending--;
+		}
+
+		if (! pending)
+			break;
+
+		nih_assert (clock_gettime (CLOCK_MONOTONIC, &now) == 0);
+		remaining = deadline - (now.tv_sec * 1000
+					+ now.tv_nsec / 1000000);
+		if (remaining <= 0)
+			break;
+
+		/* Entries with a negative descriptor are ignored by poll */
+		if ((poll (fds, nfds, remaining) < 0) && (errno != EINTR))
+			break;
+	}
+
+	/* Give up on anything left */
+	for (size_t i = 0; i < nfds; i++)
+		if (fds[i].fd >= 0)
+			close (fds[i].fd);
+
+	nih_free (offset);
+
+	return reached;
+}
+
+
 /**
  * struct request:
  *
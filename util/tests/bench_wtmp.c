@@ -0,0 +1,184 @@
+/* upstart
+ *
+ * bench_wtmp.c - benchmark of util/utmp.c wtmp runlevel lookup
+ *
+ * Copyright © 2011 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <utmpx.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/error.h>
+
+#include "utmp.h"
+
+
+/**
+ * RECORDS:
+ *
+ * Default number of records in the synthetic wtmp file, a little under
+ * 400MB of them.
+ **/
+#define RECORDS 1000000
+
+/**
+ * BOOT_RECORDS:
+ *
+ * Number of login records between each runlevel record in the synthetic
+ * wtmp file, as though each boot was followed by that many logins.
+ **/
+#define BOOT_RECORDS 5000
+
+/**
+ * ITERATIONS:
+ *
+ * Number of times the runlevel is looked up backwards.
+ **/
+#define ITERATIONS 1000
+
+
+/**
+ * now:
+ *
+ * Returns: current value of the monotonic clock in nanoseconds.
+ **/
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+/**
+ * forward_read_runlevel:
+ * @wtmp_file: wtmp file to read from.
+ *
+ * Finds the most recent runlevel record in @wtmp_file by walking every
+ * record from the start of the file, as the utmpx functions must.
+ *
+ * Returns: runlevel or 'N' if none was found.
+ **/
+static int
+forward_read_runlevel (const char *wtmp_file)
+{
+	struct utmpx  utmp;
+	struct utmpx *lvl;
+	int           runlevel = 'N';
+
+	memset (&utmp, 0, sizeof utmp);
+	utmp.ut_type = RUN_LVL;
+
+	utmpxname (wtmp_file);
+	setutxent ();
+
+	while ((lvl = getutxid (&utmp)) != NULL) {
+		runlevel = lvl->ut_pid % 256 ?: 'N';
+
+		/* Move past the match, otherwise we'd find it again */
+		if (! getutxent ())
+			break;
+	}
+
+	endutxent ();
+
+	return runlevel;
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char          filename[] = "/tmp/bench_wtmp.XXXXXX";
+	struct utmpx  login, runlevel;
+	FILE         *file;
+	long          records = RECORDS;
+	double        start, forward_ns, backward_ns;
+	int           fd, forward_lvl, backward_lvl = 0;
+
+	if (argc > 1)
+		records = atol (argv[1]);
+
+	fd = mkstemp (filename);
+	if (fd < 0)
+		abort ();
+
+	file = fdopen (fd, "w");
+	if (! file)
+		abort ();
+
+	memset (&runlevel, 0, sizeof runlevel);
+	runlevel.ut_type = RUN_LVL;
+	strcpy (runlevel.ut_line, "~");
+	strcpy (runlevel.ut_id, "~~");
+	strncpy (runlevel.ut_user, "runlevel", sizeof runlevel.ut_user);
+
+	memset (&login, 0, sizeof login);
+	login.ut_type = USER_PROCESS;
+	login.ut_pid = 1000;
+	strcpy (login.ut_line, "pts/0");
+	strcpy (login.ut_id, "ts/0");
+	strncpy (login.ut_user, "user", sizeof login.ut_user);
+
+	/* Each boot changes runlevel from S to 2, the last leaves it in 3
+	 * so we can tell it was the most recent that was found.
+	 */
+	for (long i = 0; i < records; i++) {
+		if (i % BOOT_RECORDS) {
+			fwrite (&login, sizeof login, 1, file);
+		} else {
+			runlevel.ut_pid = ((i + BOOT_RECORDS < records)
+					   ? '2' : '3') + 'S' * 256;
+			fwrite (&runlevel, sizeof runlevel, 1, file);
+		}
+	}
+
+	fclose (file);
+
+	printf ("%ld records, %ld bytes\n", records,
+		records * (long)sizeof (struct utmpx));
+
+	start = now ();
+	forward_lvl = forward_read_runlevel (filename);
+	forward_ns = now () - start;
+
+	start = now ();
+	for (int i = 0; i < ITERATIONS; i++) {
+		backward_lvl = wtmp_read_runlevel (filename, NULL);
+		if (backward_lvl < 0)
+			abort ();
+	}
+	backward_ns = (now () - start) / ITERATIONS;
+
+	if (forward_lvl != backward_lvl)
+		abort ();
+
+	printf ("%-10s %12.0fns\n", "forward", forward_ns);
+	printf ("%-10s %12.0fns\n", "backward", backward_ns);
+
+	unlink (filename);
+
+	return 0;
+}
@@ -324,6 +324,307 @@ test_read_runlevel (void)
 	unlink (filename);
 }
 
+void
+test_wtmp_read_runlevel (void)
+{
+	char           filename[PATH_MAX];
+	FILE *         file;
+	struct utmpx   utmp;
+	int            runlevel;
+	int            prevlevel;
+	NihError *     err;
+
+	TEST_FUNCTION ("wtmp_read_runlevel");
+	TEST_FILENAME (filename);
+
+
+	/* Check that we can obtain both the current and previous runlevel
+	 * from the wtmp file.
+	 */
+	TEST_FEATURE ("with runlevel and previous");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		file = fopen (filename, "w");
+		fclose (file);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = RUN_LVL;
+		utmp.ut_pid = '2' + 'S' * 256;
+
+		strcpy (utmp.ut_line, "~");
+		strcpy (utmp.ut_id, "~~");
+		strncpy (utmp.ut_user, "runlevel", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_EQ (runlevel, '2');
+		TEST_EQ (prevlevel, 'S');
+	}
+
+
+	/* Check that it's the most recent runlevel record that's used,
+	 * even when it's followed by many other records; more than are
+	 * read at once.
+	 */
+	TEST_FEATURE ("with many records");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		file = fopen (filename, "w");
+		fclose (file);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = RUN_LVL;
+		utmp.ut_pid = '2' + 'S' * 256;
+
+		strcpy (utmp.ut_line, "~");
+		strcpy (utmp.ut_id, "~~");
+		strncpy (utmp.ut_user, "runlevel", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		utmp.ut_pid = '3' + '2' * 256;
+
+		updwtmpx (filename, &utmp);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = USER_PROCESS;
+		utmp.ut_pid = 1000;
+
+		strcpy (utmp.ut_line, "pts/0");
+		strcpy (utmp.ut_id, "ts/0");
+		strncpy (utmp.ut_user, "user", sizeof utmp.ut_user);
+
+		for (int i = 0; i < 100; i++)
+			updwtmpx (filename, &utmp);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_EQ (runlevel, '3');
+		TEST_EQ (prevlevel, '2');
+	}
+
+
+	/* Check that a partial record at the end of the file, perhaps
+	 * one still being written, is ignored.
+	 */
+	TEST_FEATURE ("with partial record");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		file = fopen (filename, "w");
+		fclose (file);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = RUN_LVL;
+		utmp.ut_pid = '2' + 'S' * 256;
+
+		strcpy (utmp.ut_line, "~");
+		strcpy (utmp.ut_id, "~~");
+		strncpy (utmp.ut_user, "runlevel", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		utmp.ut_pid = '3' + '2' * 256;
+
+		file = fopen (filename, "a");
+		fwrite (&utmp, sizeof utmp / 2, 1, file);
+		fclose (file);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_EQ (runlevel, '2');
+		TEST_EQ (prevlevel, 'S');
+	}
+
+
+	/* Check that a shutdown record results in the 'N' runlevel being
+	 * returned.
+	 */
+	TEST_FEATURE ("with shutdown record");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		file = fopen (filename, "w");
+		fclose (file);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = RUN_LVL;
+		utmp.ut_pid = '2' + 'S' * 256;
+
+		strcpy (utmp.ut_line, "~");
+		strcpy (utmp.ut_id, "~~");
+		strncpy (utmp.ut_user, "runlevel", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		utmp.ut_pid = 0;
+		strncpy (utmp.ut_user, "shutdown", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_EQ (runlevel, 'N');
+		TEST_EQ (prevlevel, 'N');
+	}
+
+
+	/* Check that a raised ESRCH error is returned along with a
+	 * negative value if we couldn't find a runlevel marker.
+	 */
+	TEST_FEATURE ("with no record");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		file = fopen (filename, "w");
+		fclose (file);
+
+		memset (&utmp, 0, sizeof utmp);
+
+		utmp.ut_type = BOOT_TIME;
+
+		strcpy (utmp.ut_line, "~");
+		strcpy (utmp.ut_id, "~~");
+		strncpy (utmp.ut_user, "reboot", sizeof utmp.ut_user);
+
+		updwtmpx (filename, &utmp);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_LT (runlevel, 0);
+		TEST_EQ (prevlevel, 0);
+
+		err = nih_error_get ();
+		TEST_EQ (err->number, ESRCH);
+		nih_free (err);
+	}
+
+
+	/* Check that a raised ENOENT error is returned along with a
+	 * negative value if the file doesn't exist.
+	 */
+	TEST_FEATURE ("with missing file");
+	TEST_ALLOC_FAIL {
+		unlink (filename);
+
+		prevlevel = 0;
+
+		runlevel = wtmp_read_runlevel (filename, &prevlevel);
+
+		TEST_LT (runlevel, 0);
+		TEST_EQ (prevlevel, 0);
+
+		err = nih_error_get ();
+		TEST_EQ (err->number, ENOENT);
+		nih_free (err);
+	}
+
+
+	unlink (filename);
+}
+
+void
+test_state_read_runlevel (void)
+{
+	char      filename[PATH_MAX];
+	FILE *    file;
+	int       runlevel;
+	int       prevlevel;
+	NihError *err;
+
+	TEST_FUNCTION ("state_read_runlevel");
+	TEST_FILENAME (filename);
+
+
+	/* Check that we can obtain both the current and previous runlevel
+	 * from the state file written by init.
+	 */
+	TEST_FEATURE ("with runlevel and previous");
+	file = fopen (filename, "w");
+	fprintf (file, "S 2\n");
+	fclose (file);
+
+	TEST_ALLOC_FAIL {
+		prevlevel = 0;
+
+		runlevel = state_read_runlevel (filename, &prevlevel);
+
+		TEST_EQ (runlevel, '2');
+		TEST_EQ (prevlevel, 'S');
+	}
+
+
+	/* Check that the previous runlevel argument is optional.
+	 */
+	TEST_FEATURE ("with no previous runlevel argument");
+	TEST_ALLOC_FAIL {
+		runlevel = state_read_runlevel (filename, NULL);
+
+		TEST_EQ (runlevel, '2');
+	}
+
+
+	/* Check that a raised EINVAL error is returned along with a
+	 * negative value if the file isn't in the expected format.
+	 */
+	TEST_FEATURE ("with malformed file");
+	file = fopen (filename, "w");
+	fprintf (file, "N 2 wibble\n");
+	fclose (file);
+
+	TEST_ALLOC_FAIL {
+		prevlevel = 0;
+
+		runlevel = state_read_runlevel (filename, &prevlevel);
+
+		TEST_LT (runlevel, 0);
+		TEST_EQ (prevlevel, 0);
+
+		err = nih_error_get ();
+		TEST_EQ (err->number, EINVAL);
+		nih_free (err);
+	}
+
+
+	/* Check that a raised ENOENT error is returned along with a
+	 * negative value if init hasn't written the file.
+	 */
+	TEST_FEATURE ("with missing file");
+	unlink (filename);
+
+	TEST_ALLOC_FAIL {
+		prevlevel = 0;
+
+		runlevel = state_read_runlevel (filename, &prevlevel);
+
+		TEST_LT (runlevel, 0);
+		TEST_EQ (prevlevel, 0);
+
+		err = nih_error_get ();
+		TEST_EQ (err->number, ENOENT);
+		nih_free (err);
+	}
+}
+
 void
 test_get_runlevel (void)
 {
@@ -1487,6 +1788,8 @@ main (int   argc,
 	nih_error_init ();
 
 	test_read_runlevel ();
+	test_wtmp_read_runlevel ();
+	test_state_read_runlevel ();
 	test_get_runlevel ();
 
 	test_write_runlevel ();
@@ -24,12 +24,16 @@
 #endif /* HAVE_CONFIG_H */
 
 
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/utsname.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <utmpx.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
@@ -40,6 +44,7 @@
 
 
 /* Prototypes for static functions */
+static int  utmp_runlevel   (const struct utmpx *lvl, int *prevlevel);
 static void utmp_entry      (struct utmpx *utmp, short type, pid_t pid,
 			     const char *line, const char *id,
 			     const char *user);
@@ -56,6 +61,14 @@ static void wtmp_write      (const char *wtmp_file, const struct utmpx *utmp);
  **/
 #define SHUTDOWN_TIME 254
 
+/**
+ * WTMP_CHUNK:
+ *
+ * Number of records read from the wtmp file at once while searching it
+ * backwards for the most recent runlevel record.
+ **/
+#define WTMP_CHUNK 32
+
 
 /**
  * utmp_read_runlevel:
@@ -93,20 +106,144 @@ utmp_read_runlevel (const char *utmp_file,
 		return -1;
 	}
 
-	runlevel = lvl->ut_pid % 256 ?: 'N';
-	if (runlevel < 0)
-		runlevel = 'N';
-	if (prevlevel) {
-		*prevlevel = lvl->ut_pid / 256 ?: 'N';
-		if (*prevlevel < 0)
-			*prevlevel = 'N';
-	}
+	runlevel = utmp_runlevel (lvl, prevlevel);
 
 	endutxent ();
 
 	return runlevel;
 }
 
+/**
+ * wtmp_read_runlevel:
+ * @wtmp_file: wtmp file to read from,
+ * @prevlevel: pointer to store previous runlevel in.
+ *
+ * Reads the the most recent runlevel entry from @wtmp_file, returning
+ * the runlevel from it.  If @prevlevel is not NULL, the previous runlevel
+ * will be stored in that variable.
+ *
+ * Since wtmp is only ever appended to, and may be very large, the file is
+ * read backwards from its end a chunk of records at a time, stopping at
+ * the first runlevel record found; utmp_read_runlevel() would read every
+ * record before it.
+ *
+ * @wtmp_file may be NULL, in which case the default /var/log/wtmp is used.
+ *
+ * Returns: runlevel on success, negative value on raised error.
+ **/
+int
+wtmp_read_runlevel (const char *wtmp_file,
+		    int *       prevlevel)
+{
+	struct utmpx records[WTMP_CHUNK];
+	struct stat  statbuf;
+	off_t        end;
+	int          fd;
+
+	fd = open (wtmp_file ?: _PATH_WTMPX, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	if (fstat (fd, &statbuf) < 0) {
+		nih_error_raise_system ();
+		close (fd);
+		return -1;
+	}
+
+	/* Ignore any partial record at the end of the file, it may be
+	 * in the middle of being written.
+	 */
+	end = statbuf.st_size - statbuf.st_size % sizeof (struct utmpx);
+
+	while (end > 0) {
+		size_t  count;
+		ssize_t len;
+
+		count = end / sizeof (struct utmpx);
+		if (count > WTMP_CHUNK)
+			count = WTMP_CHUNK;
+
+		end -= count * sizeof (struct utmpx);
+
+		len = pread (fd, records, count * sizeof (struct utmpx), end);
+		if (len < 0) {
+			nih_error_raise_system ();
+			close (fd);
+			return -1;
+		} else if ((size_t)len < count * sizeof (struct utmpx)) {
+			/* Truncated underneath us, whatever we'd find now
+			 * may no longer be the most recent.
+			 */
+			break;
+		}
+
+		for (size_t i = count; i > 0; i--) {
+			if (records[i - 1].ut_type != RUN_LVL)
+				continue;
+
+			close (fd);
+
+			return utmp_runlevel (&records[i - 1], prevlevel);
+		}
+	}
+
+	close (fd);
+
+	errno = ESRCH;
+	nih_return_system_error (-1);
+}
+
+/**
+ * state_read_runlevel:
+ * @state_file: runlevel state file to read from,
+ * @prevlevel: pointer to store previous runlevel in.
+ *
+ * Reads the runlevel that init keeps in @state_file, written as the
+ * previous and current runlevel separated by a space each time it
+ * handles a runlevel event, returning the runlevel from it.  If
+ * @prevlevel is not NULL, the previous runlevel will be stored in that
+ * variable.
+ *
+ * Unlike utmp and wtmp this is always a single small file, so reading
+ * it costs the same however many records those have accumulated.
+ *
+ * @state_file may be NULL, in which case the default RUNLEVEL_STATE is
+ * used.
+ *
+ * Returns: runlevel on success, negative value on raised error.
+ **/
+int
+state_read_runlevel (const char *state_file,
+		     int *       prevlevel)
+{
+	char    buf[5];
+	ssize_t len;
+	int     fd;
+
+	fd = open (state_file ?: RUNLEVEL_STATE, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		nih_return_system_error (-1);
+
+	len = read (fd, buf, sizeof buf);
+	if (len < 0) {
+		nih_error_raise_system ();
+		close (fd);
+		return -1;
+	}
+
+	close (fd);
+
+	if ((len != 4) || (buf[1] != ' ') || (buf[3] != '\n')) {
+		errno = EINVAL;
+		nih_return_system_error (-1);
+	}
+
+	if (prevlevel)
+		*prevlevel = buf[0];
+
+	return buf[2];
+}
+
 /**
  * utmp_get_runlevel:
  * @utmp_file: utmp or wtmp file to read from,
@@ -117,6 +254,9 @@ utmp_read_runlevel (const char *utmp_file,
  * utmp_read_runlevel() to read the most recent runlevel entry from
  * @utmp_file.
  *
+ * When @utmp_file is NULL the state file kept by init is tried before
+ * the system utmp file, falling back to utmp if init hasn't written one.
+ *
  * Returns: runlevel on success, negative value on raised error.
  **/
 int
@@ -136,6 +276,16 @@ utmp_get_runlevel (const char *utmp_file,
 		return renv[0] ?: 'N';
 	}
 
+	if (! utmp_file) {
+		int runlevel;
+
+		runlevel = state_read_runlevel (NULL, prevlevel);
+		if (runlevel > 0)
+			return runlevel;
+
+		nih_free (nih_error_get ());
+	}
+
 	return utmp_read_runlevel (utmp_file, prevlevel);
 }
 
@@ -191,7 +341,7 @@ utmp_write_runlevel (const char *utmp_file,
 	 * match then we assume a missed reboot so write the boot time
 	 * record out first.
 	 */
-	savedlevel = utmp_read_runlevel (wtmp_file, NULL);
+	savedlevel = wtmp_read_runlevel (wtmp_file, NULL);
 	if (savedlevel != prevlevel) {
 		if (savedlevel < 0)
 			nih_free (nih_error_get ());
@@ -239,6 +389,38 @@ utmp_write_shutdown (const char *utmp_file,
 }
 
 
+/**
+ * utmp_runlevel:
+ * @lvl: runlevel record,
+ * @prevlevel: pointer to store previous runlevel in.
+ *
+ * Returns the runlevel from the runlevel record @lvl, also storing the
+ * previous runlevel from it in @prevlevel if that is not NULL.  A record
+ * without a runlevel, such as that written on shutdown, or one that is
+ * corrupt gives the 'N' runlevel.
+ *
+ * Returns: runlevel.
+ **/
+static int
+utmp_runlevel (const struct utmpx *lvl,
+	       int *               prevlevel)
+{
+	int runlevel;
+
+	nih_assert (lvl != NULL);
+
+	runlevel = lvl->ut_pid % 256 ?: 'N';
+	if (runlevel < 0)
+		runlevel = 'N';
+	if (prevlevel) {
+		*prevlevel = lvl->ut_pid / 256 ?: 'N';
+		if (*prevlevel < 0)
+			*prevlevel = 'N';
+	}
+
+	return runlevel;
+}
+
 /**
  * utmp_entry:
  * @utmp: utmp entry to fill,
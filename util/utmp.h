@@ -23,12 +23,29 @@
 #include <nih/macros.h>
 
 
+/**
+ * RUNLEVEL_STATE:
+ *
+ * File that init writes the previous and current runlevel to, read by
+ * runlevel, shutdown and telinit in preference to utmp.  init reads it
+ * back after a re-exec with state_read_runlevel(), and so shares this
+ * definition.
+ **/
+#ifndef RUNLEVEL_STATE
+#define RUNLEVEL_STATE "/run/runlevel"
+#endif
+
+
 NIH_BEGIN_EXTERN
 
 int utmp_read_runlevel  (const char *utmp_file, int *prevlevel)
 	__attribute__ ((warn_unused_result));
 int utmp_get_runlevel   (const char *utmp_file, int *prevlevel)
 	__attribute__ ((warn_unused_result));
+int wtmp_read_runlevel  (const char *wtmp_file, int *prevlevel)
+	__attribute__ ((warn_unused_result));
+int state_read_runlevel (const char *state_file, int *prevlevel)
+	__attribute__ ((warn_unused_result));
 
 int utmp_write_runlevel (const char *utmp_file, const char *wtmp_file,
 			 int runlevel, int prevlevel)